@@ -38,6 +38,8 @@ conan_cmake_configure(
         # it was removed from faabric. Eventually consolidate to just using one
         # JSON (de-)serialising library
         "rapidjson/cci.20211112@#65b4e5feb6f1edfc8cbac0f669acaf17"
+        # Used to compress artifacts (wasm, object files) in storage
+        "zstd/1.5.5"
     GENERATORS
         cmake_find_package
         cmake_paths
@@ -60,6 +62,7 @@ find_package(Catch2 REQUIRED)
 find_package(jwt-cpp REQUIRED)
 find_package(picojson REQUIRED)
 find_package(RapidJSON REQUIRED)
+find_package(zstd REQUIRED)
 
 # 22/12/2021 - WARNING: we don't install AWS through Conan as the recipe proved
 # very unstable and failed frequently.
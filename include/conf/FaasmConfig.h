@@ -13,9 +13,19 @@ class FaasmConfig
     int maxNetNs;
 
     std::string pythonPreload;
+    std::string pythonPrecompile;
     std::string captureStdout;
+    int captureStdoutMaxBytes;
 
     int chainedCallTimeout;
+    int chainPayloadThreshold;
+    int streamMaxChunks;
+
+    std::string pthreadDispatch;
+    int pthreadEagerGroupSize;
+
+    int stateIoThreads;
+    std::string stateWriteCombine;
 
     std::string wasmVm;
 
@@ -23,12 +33,21 @@ class FaasmConfig
     std::string objectFileDir;
     std::string runtimeFilesDir;
     std::string sharedFilesDir;
+    std::string runtimeImagePath;
+    std::string artifactCompression;
+    int artifactCompressionLevel;
+    std::string artifactPeerFetch;
+    int artifactServerPort;
+    std::string artifactTrustedHosts;
 
     std::string s3Bucket;
     std::string s3Host;
     std::string s3Port;
     std::string s3User;
     std::string s3Password;
+    int s3MaxConnections;
+    int s3MaxRetries;
+    int s3HedgeDelayMs;
 
     std::string attestationProviderUrl;
 
@@ -55,4 +55,16 @@ class FaasletFactory final : public faabric::scheduler::ExecutorFactory
 };
 
 void preloadPythonRuntime();
+
+/**
+ * Evicts everything cached on this host for the given function, i.e. its local
+ * files, IR modules, zygote and reset snapshot, leaving other functions warm.
+ */
+void invalidateFunction(const std::string& user, const std::string& function);
+
+/**
+ * Evicts this host's copy of the given shared file (relative to the shared
+ * files root).
+ */
+void invalidateSharedFile(const std::string& path);
 }
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define COMPRESSED_ARTIFACT_MAGIC "FAASMZST"
+#define COMPRESSED_ARTIFACT_VERSION 1
+
+#define ARTIFACT_DICT_KEY_PREFIX "zstd_dicts/"
+#define ARTIFACT_DICT_DEFAULT_SIZE (112 * 1024)
+
+// Bounds the size claimed by a compressed artifact's frame header, which we
+// allocate before decompressing
+#define ARTIFACT_MAX_RAW_SIZE (2ULL * 1024 * 1024 * 1024)
+
+namespace storage {
+
+enum ArtifactType : uint32_t
+{
+    GENERIC_ARTIFACT,
+    WASM_ARTIFACT,
+    OBJECT_ARTIFACT,
+    AOT_ARTIFACT,
+};
+
+/**
+ * Compressed artifacts are stored as this header followed by a single zstd
+ * frame. The magic lets loaders tell compressed artifacts from raw ones, so
+ * both can live side by side in storage.
+ */
+struct CompressedArtifactHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t type;
+};
+
+std::string getArtifactTypeName(ArtifactType type);
+
+bool isCompressedArtifact(const std::vector<uint8_t>& bytes);
+
+/**
+ * Compresses the given bytes if artifact compression is enabled, using the
+ * dictionary trained for the artifact type if there is one. Returns the bytes
+ * unchanged otherwise.
+ */
+std::vector<uint8_t> compressArtifact(const std::vector<uint8_t>& bytes,
+                                      ArtifactType type);
+
+/**
+ * Decompresses the given bytes if they are a compressed artifact, otherwise
+ * returns them unchanged.
+ */
+std::vector<uint8_t> decompressArtifact(const std::vector<uint8_t>& bytes);
+
+/**
+ * Dictionaries are stored in S3 twice, once under their zstd dictionary ID so
+ * that artifacts can always be decompressed with the dictionary they were
+ * compressed with, and once under the artifact type as the dictionary to use
+ * for new uploads.
+ */
+std::vector<uint8_t> trainArtifactDictionary(
+  const std::vector<std::vector<uint8_t>>& samples,
+  size_t dictSize = ARTIFACT_DICT_DEFAULT_SIZE);
+
+void uploadArtifactDictionary(ArtifactType type,
+                              const std::vector<uint8_t>& dict);
+
+void clearArtifactDictionaries();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cpprest/http_listener.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define ARTIFACT_URL_PART "artifact"
+#define INVALIDATE_URL_PART "invalidate"
+#define INVALIDATE_FUNCTION_URL_PART "function"
+#define INVALIDATE_FILE_URL_PART "file"
+#define ARTIFACT_PEERS_REFRESH_MS 5000
+#define ARTIFACT_PEER_TIMEOUT_MS 2000
+
+namespace storage {
+
+typedef std::function<void(const std::string& user, const std::string& func)>
+  FunctionInvalidationHandler;
+
+typedef std::function<void(const std::string& path)>
+  SharedFileInvalidationHandler;
+
+/**
+ * Serves artifacts held in this host's local file cache to other workers, so
+ * that when a function scales out, hosts can pull artifacts from each other
+ * rather than all going to S3.
+ *
+ * Peers ask for files by their local cache path, which is the same on all
+ * hosts. Only paths inside the function, object file and shared file
+ * directories are served, and only when ARTIFACT_PEER_FETCH is on.
+ *
+ * The server also receives requests to invalidate anything cached on this host
+ * for a given function or shared file, which are passed on to the registered
+ * handlers. These are only accepted from this host, other artifact hosts and
+ * the hosts in ARTIFACT_TRUSTED_HOSTS, and only for valid function names and
+ * shared file paths inside the shared files directory.
+ */
+class ArtifactServer
+{
+  public:
+    explicit ArtifactServer(int portIn);
+
+    ~ArtifactServer();
+
+    void start();
+
+    void stop();
+
+    static void handleGet(const web::http::http_request& request);
+
+    static void handlePut(const web::http::http_request& request);
+
+  private:
+    int port;
+
+    std::unique_ptr<web::http::experimental::listener::http_listener>
+      listener;
+};
+
+void setInvalidationHandlers(FunctionInvalidationHandler functionHandler,
+                             SharedFileInvalidationHandler sharedFileHandler);
+
+/**
+ * Tells all hosts to invalidate anything cached for the given function or
+ * shared file. Hosts that can't be reached are skipped. This doesn't depend on
+ * peer fetching, as workers always run an artifact server to receive these.
+ */
+void broadcastFunctionInvalidation(const std::string& user,
+                                   const std::string& func);
+
+void broadcastSharedFileInvalidation(const std::string& path);
+
+/**
+ * Returns the peers to try when fetching artifacts as host:port strings. By
+ * default these are all other hosts known to the planner.
+ */
+std::vector<std::string> getArtifactPeers();
+
+/**
+ * Overrides the peers returned by getArtifactPeers, e.g. to run several
+ * workers in one process. Passing an empty list removes the override.
+ */
+void setArtifactPeers(const std::vector<std::string>& peers);
+
+/**
+ * Returns the MD5 digest of an artifact's raw bytes.
+ */
+std::vector<uint8_t> getArtifactDigest(const std::vector<uint8_t>& bytes);
+
+/**
+ * Tries to fetch the artifact at the given local cache path from a peer. A
+ * peer is only asked for the artifact if the hash file it holds alongside it
+ * matches the expected hash, and the bytes it sends are only accepted if they
+ * match the expected digest. Returns empty if no peer has it.
+ */
+std::vector<uint8_t> fetchArtifactFromPeers(
+  const std::string& localCachePath,
+  const std::vector<uint8_t>& expectedHash,
+  const std::vector<uint8_t>& expectedDigest);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <storage/FileDescriptor.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Size of the native buffer passed to each getdents64 syscall. This is large
+// enough to hold several hundred entries, so most directories can be listed in
+// one or two syscalls.
+#define DIRENT_BATCH_BUFFER_SIZE 32768
+
+namespace storage {
+
+typedef std::shared_ptr<const std::vector<DirEnt>> DirListing;
+
+/**
+ * Process-wide cache of directory listings under the runtime root. Listings
+ * are immutable once loaded, and are shared between all the file descriptors
+ * (and hence all the Faaslets) that iterate through the same directory.
+ *
+ * Any operation that modifies the runtime root through Faasm must invalidate
+ * the affected directories.
+ */
+class DirectoryCache
+{
+  public:
+    static DirListing getListing(const std::string& realPath);
+
+    static std::vector<DirEnt> readDirectory(const std::string& realPath);
+
+    static void invalidate(const std::string& realPath);
+
+    static void invalidateParent(const std::string& realPath);
+
+    static size_t getCachedListingCount();
+
+    static void clear();
+};
+}
@@ -2,6 +2,8 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <memory>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -22,6 +24,9 @@
 #define DEFAULT_ROOT_FD 4
 
 namespace storage {
+class RuntimeImage;
+struct RuntimeImageEntry;
+
 std::string prependRuntimeRoot(const std::string& originalPath);
 
 enum OpenMode
@@ -117,11 +122,13 @@ class FileDescriptor
 
     ssize_t write(std::vector<::iovec>& nativeIovecs, int iovecCount);
 
+    ssize_t read(std::vector<::iovec>& nativeIovecs, int iovecCount);
+
     void close() const;
 
     bool mkdir(const std::string& dirPath);
 
-    uint16_t seek(int64_t offset, int wasiWhence, uint64_t* newOffset) const;
+    uint16_t seek(int64_t offset, int wasiWhence, uint64_t* newOffset);
 
     uint64_t tell() const;
 
@@ -145,10 +152,14 @@ class FileDescriptor
 
     void setPath(const std::string& newPath);
 
-    std::string getPath();
+    std::string getPath() const;
 
     int duplicate(const FileDescriptor& other);
 
+    bool isImageBacked() const;
+
+    std::span<const uint8_t> getImageData() const;
+
   private:
     static FileDescriptor stdFdFactory(int stdFd, const std::string& devPath);
 
@@ -167,8 +178,14 @@ class FileDescriptor
 
     uint16_t wasiErrno = 0;
 
+    // Set when the file is served from the runtime image rather than a
+    // Linux file descriptor. We hold the image so the entry stays valid.
+    std::shared_ptr<RuntimeImage> runtimeImage;
+    const RuntimeImageEntry* imageEntry = nullptr;
+    uint64_t imageOffset = 0;
+
     bool dirContentsLoaded = false;
-    std::vector<DirEnt> dirContents;
+    std::shared_ptr<const std::vector<DirEnt>> dirContents;
     int dirContentsIdx = 0;
 };
 }
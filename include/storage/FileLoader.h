@@ -1,6 +1,7 @@
 #pragma once
 
 #include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
 #include <storage/S3Wrapper.h>
 
 #include <faabric/util/config.h>
@@ -16,6 +17,7 @@
 #define SHARED_OBJ_EXT ".o"
 
 #define HASH_EXT ".md5"
+#define DIGEST_EXT ".digest"
 
 #define PYTHON_USER "python"
 #define PYTHON_FUNC "py_func"
@@ -32,6 +34,10 @@ class FileLoader
 
     void clearLocalCache();
 
+    void clearLocalCacheForFunction(const faabric::Message& msg);
+
+    void clearLocalCacheForSharedFile(const std::string& path);
+
     std::string getHashFilePath(const std::string& path);
 
     // ----- Function wasm -----
@@ -94,6 +100,14 @@ class FileLoader
 
     std::vector<uint8_t> loadSharedFile(const std::string& path);
 
+    // Returns the stored MD5 of the shared file, or empty if it doesn't exist
+    std::string getSharedFileETag(const std::string& path);
+
+    // Fetches the given shared files in parallel. Missing files are returned
+    // as empty, rather than throwing
+    std::vector<std::vector<uint8_t>> loadSharedFiles(
+      const std::vector<std::string>& paths);
+
     void deleteSharedFile(const std::string& path);
 
     void uploadSharedFile(const std::string& path,
@@ -106,6 +120,14 @@ class FileLoader
 
     std::string getPythonFunctionFile(const faabric::Message& msg);
 
+    // Lists the bytecode compiled for the function at upload time
+    std::string getPythonBytecodeIndexRelativePath(const faabric::Message& msg);
+
+    // Checks the path is a .pyc in the __pycache__ next to the function, as
+    // the bytecode index can be overwritten like any other shared file
+    bool isPythonBytecodeRelativePath(const faabric::Message& msg,
+                                      const std::string& pycPath);
+
     void uploadPythonFunction(faabric::Message& msg);
 
   private:
@@ -118,16 +140,29 @@ class FileLoader
                                    const std::string& fileName,
                                    bool isSgx = false);
 
+    // Only artifacts (wasm, object and AoT files) are decompressed, as other
+    // files are returned exactly as they were uploaded
     std::vector<uint8_t> loadFileBytes(const std::string& path,
                                        const std::string& localCachePath,
-                                       bool tolerateMissing = false);
+                                       bool tolerateMissing = false,
+                                       bool isArtifact = false);
+
+    // Loads an artifact that has a hash file, trying peers before S3
+    std::vector<uint8_t> loadArtifactBytes(const std::string& path,
+                                           const std::string& localCachePath);
+
+    std::vector<std::vector<uint8_t>> loadFilesBytes(
+      const std::vector<std::string>& paths,
+      const std::vector<std::string>& localCachePaths,
+      bool tolerateMissing = false);
 
     std::vector<uint8_t> loadHashFileBytes(const std::string& path,
                                            const std::string& localCachePath);
 
     void uploadFileBytes(const std::string& path,
                          const std::string& localCachePath,
-                         const std::vector<uint8_t>& bytes);
+                         const std::vector<uint8_t>& bytes,
+                         ArtifactType type = GENERIC_ARTIFACT);
 
     void uploadHashFileBytes(const std::string& path,
                              const std::string& localCachePath,
@@ -140,6 +175,23 @@ class FileLoader
 
 FileLoader& getFileLoader();
 
+/**
+ * Resolves a path relative to the given root, following any symlinks. Returns
+ * empty if the result would be outside the root, or the root itself.
+ */
+std::string resolvePathUnder(const std::string& root, const std::string& path);
+
+/**
+ * Checks the absolute path is strictly inside the given root once both have
+ * been resolved, following any symlinks.
+ */
+bool isPathInside(const std::string& root, const std::string& path);
+
+/**
+ * Checks a user or function name is safe to use as a single path component.
+ */
+bool isValidPathComponent(const std::string& name);
+
 FileLoader& getFileLoaderWithoutLocalCache();
 
 class SharedFileNotExistsException : public faabric::util::FaabricException
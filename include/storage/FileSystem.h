@@ -4,9 +4,19 @@
 
 #include <faabric/proto/faabric.pb.h>
 
-#include <unordered_map>
+#include <memory>
+#include <vector>
 
 namespace storage {
+
+/**
+ * Table of a module's file descriptors, indexed directly by fd.
+ *
+ * Entries are shared copy-on-write, so copying the table (e.g. when cloning a
+ * module) is shallow, and an entry is only copied when one of the owners
+ * accesses it for modification. The stdio and preopened root descriptors are
+ * shared process-wide, so preparing a filesystem does no syscalls.
+ */
 class FileSystem
 {
   public:
@@ -24,8 +34,6 @@ class FileSystem
                            uint32_t openFlags,
                            int32_t fdFlags);
 
-    void createPreopenedFileDescriptor(int fd, const std::string& path);
-
     int dup(int fd);
 
     void tearDown();
@@ -34,11 +42,18 @@ class FileSystem
 
     void printDebugInfo();
 
+    static std::shared_ptr<FileDescriptor> createPreopenedFileDescriptor(
+      const std::string& path);
+
+    static void clearSharedFileDescriptors();
+
   private:
     int nextFd;
 
-    std::unordered_map<int, storage::FileDescriptor> fileDescriptors;
+    std::vector<std::shared_ptr<storage::FileDescriptor>> fileDescriptors;
 
     int getNewFd();
+
+    const storage::FileDescriptor* peekFileDescriptor(int fd) const;
 };
 }
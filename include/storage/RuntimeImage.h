@@ -0,0 +1,121 @@
+#pragma once
+
+#include <storage/DirectoryCache.h>
+#include <storage/FileDescriptor.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+#define RUNTIME_IMAGE_MAGIC "FAASMIMG"
+#define RUNTIME_IMAGE_VERSION 1
+
+namespace storage {
+
+/**
+ * A runtime image packs a read-only copy of the runtime root into a single
+ * file, laid out as:
+ *
+ * - a header
+ * - an index of entries, one per file or directory. The children of each
+ *   directory are contiguous and sorted by name, so lookups are a binary
+ *   search per path component. Entry zero is the root itself.
+ * - a table holding all entry names
+ * - the contents of all the regular files
+ *
+ * The image is mapped read-only into memory, so opens, stats, reads and
+ * directory listings are served without syscalls, and the pages are shared
+ * by all Faaslets (and processes) on the host. All offsets and sizes in the
+ * image are checked against its length when it's mapped.
+ */
+struct RuntimeImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nEntries;
+    uint64_t indexOffset;
+    uint64_t namesOffset;
+    uint64_t dataOffset;
+    uint64_t buildTimeNanos;
+};
+
+struct RuntimeImageEntry
+{
+    uint32_t parentIdx;
+    uint32_t nameOffset;
+    uint32_t nameLen;
+    uint32_t mode;
+    uint64_t dataOffset;
+    uint64_t size;
+    uint32_t firstChild;
+    uint32_t nChildren;
+};
+
+class RuntimeImage
+{
+  public:
+    explicit RuntimeImage(const std::string& imagePathIn);
+
+    ~RuntimeImage();
+
+    RuntimeImage(const RuntimeImage&) = delete;
+
+    RuntimeImage& operator=(const RuntimeImage&) = delete;
+
+    static void build(const std::string& sourceDir,
+                      const std::string& imagePath);
+
+    const RuntimeImageEntry* lookup(const std::string& path) const;
+
+    bool isDirectory(const RuntimeImageEntry* entry) const;
+
+    std::span<const uint8_t> getFileData(const RuntimeImageEntry* entry) const;
+
+    Stat stat(const RuntimeImageEntry* entry) const;
+
+    DirListing getListing(const RuntimeImageEntry* entry);
+
+    std::string_view getName(const RuntimeImageEntry* entry) const;
+
+    size_t getEntryCount() const;
+
+    std::string getImagePath() const;
+
+  private:
+    std::string imagePath;
+
+    uint8_t* mappedPtr = nullptr;
+    size_t mappedSize = 0;
+
+    const RuntimeImageHeader* header = nullptr;
+    const RuntimeImageEntry* entries = nullptr;
+    const char* names = nullptr;
+
+    std::mutex listingsMx;
+    std::unordered_map<uint32_t, DirListing> listings;
+
+    bool hasValidEntries() const;
+
+    uint32_t getIndex(const RuntimeImageEntry* entry) const;
+
+    const RuntimeImageEntry* findChild(const RuntimeImageEntry* dir,
+                                       std::string_view name) const;
+};
+
+/**
+ * Returns the process-wide runtime image, or nullptr if not enabled. The image
+ * is loaded on first use and kept from then on, and callers can hold on to it
+ * (and the entries they've looked up in it) for as long as they need.
+ */
+std::shared_ptr<RuntimeImage> getRuntimeImage();
+
+/**
+ * Drops the process-wide image, so that the next call to getRuntimeImage loads
+ * it again from the configured path. Anything still holding the old image
+ * keeps it mapped.
+ */
+void resetRuntimeImage();
+}
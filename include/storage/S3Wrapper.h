@@ -1,5 +1,6 @@
 #pragma once
 
+#include <future>
 #include <memory>
 #include <string>
 #include <vector>
@@ -14,6 +15,7 @@
 
 #define S3_REQUEST_TIMEOUT_MS 10000
 #define S3_CONNECT_TIMEOUT_MS 500
+#define S3_RETRY_SCALE_FACTOR_MS 25
 
 namespace storage {
 
@@ -21,6 +23,17 @@ void initFaasmS3();
 
 void shutdownFaasmS3();
 
+/**
+ * All S3Wrappers in the process share a single client, and hence a single
+ * connection pool and executor for async requests. The client is created on
+ * first use, and destroyed in shutdownFaasmS3.
+ */
+std::shared_ptr<Aws::S3::S3Client> getSharedS3Client();
+
+void resetSharedS3Client();
+
+struct PendingS3Get;
+
 class S3Wrapper
 {
   public:
@@ -48,12 +61,44 @@ class S3Wrapper
                                      const std::string& keyName,
                                      bool tolerateMissing = false);
 
+    /**
+     * Fetches a key without blocking the caller. The request is run on the
+     * shared client's executor.
+     */
+    std::shared_future<std::vector<uint8_t>> getKeyBytesAsync(
+      const std::string& bucketName,
+      const std::string& keyName,
+      bool tolerateMissing = false);
+
+    /**
+     * Fetches many keys in parallel, returning their contents in the same
+     * order as the keys. Slow requests are hedged.
+     */
+    std::vector<std::vector<uint8_t>> getKeysBytes(
+      const std::string& bucketName,
+      const std::vector<std::string>& keyNames,
+      bool tolerateMissing = false);
+
     std::string getKeyStr(const std::string& bucketName,
                           const std::string& keyName);
 
+    /**
+     * Returns the key's ETag (the MD5 of its contents for keys uploaded in a
+     * single part) without fetching it, or empty if the key doesn't exist.
+     */
+    std::string getKeyETag(const std::string& bucketName,
+                           const std::string& keyName);
+
   private:
     const conf::FaasmConfig& faasmConf;
-    Aws::Client::ClientConfiguration clientConf;
-    Aws::S3::S3Client client;
+    std::shared_ptr<Aws::S3::S3Client> client;
+
+    std::shared_ptr<PendingS3Get> startGet(const std::string& bucketName,
+                                           const std::string& keyName,
+                                           bool tolerateMissing);
+
+    void issueGet(std::shared_ptr<PendingS3Get> pending);
+
+    std::vector<uint8_t> awaitGet(std::shared_ptr<PendingS3Get> pending);
 };
 }
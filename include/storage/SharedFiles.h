@@ -3,6 +3,7 @@
 #include <faabric/proto/faabric.pb.h>
 
 #include <string>
+#include <vector>
 
 namespace storage {
 class SharedFiles
@@ -11,6 +12,13 @@ class SharedFiles
     static int syncSharedFile(const std::string& sharedPath,
                               const std::string& localPath = "");
 
+    // Syncs many shared files at once, fetching those not held locally in
+    // parallel. Returns the same values as syncSharedFile for each path. If
+    // given, localPaths holds where to write each file, as in syncSharedFile
+    static std::vector<int> syncSharedFiles(
+      const std::vector<std::string>& sharedPaths,
+      const std::vector<std::string>& localPaths = {});
+
     static void clearCacheForSharedFile(const std::string& sharedPath);
 
     static std::string realPathForSharedFile(const std::string& sharedPath);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Number of times to retry taking a contended mutex before sleeping
+#define FUTEX_MUTEX_SPINS 100
+
+#define FUTEX_MUTEX_UNLOCKED 0
+#define FUTEX_MUTEX_LOCKED 1
+#define FUTEX_MUTEX_CONTENDED 2
+
+namespace threads {
+
+/**
+ * Sleeps while the word holds the expected value, until woken or the timeout
+ * passes. A negative timeout waits forever. Returns false on timeout.
+ *
+ * The word can be anywhere in this process' memory, including in wasm memory,
+ * so threads on this host can wait on guest addresses directly.
+ */
+bool futexWait(int32_t* word, int32_t expected, int timeoutMs = -1);
+
+/**
+ * Wakes up to the given number of threads waiting on the word, returning how
+ * many were woken.
+ */
+int futexWake(int32_t* word, int nWaiters);
+
+/**
+ * A mutex held in a single word, which is unlocked, locked, or locked with
+ * threads waiting on it. Lockers spin for a while before sleeping, and
+ * unlocking only makes a syscall if someone may be waiting. A zeroed word is
+ * an unlocked mutex.
+ */
+void lockFutexMutex(int32_t* word);
+
+bool tryLockFutexMutex(int32_t* word);
+
+void unlockFutexMutex(int32_t* word);
+
+/**
+ * A condition variable, used with any mutex. Waiters note the sequence number
+ * while holding the mutex, then sleep on it after unlocking. Each notify bumps
+ * the sequence number, so a notify between the two means the waiter doesn't
+ * sleep at all. As with pthreads, waiters may wake spuriously.
+ */
+class FutexCondition
+{
+  public:
+    // Must be called with the mutex held, returning the number to wait on
+    int32_t prepareWait();
+
+    // Must be called after prepareWait with the mutex unlocked. A negative
+    // timeout waits forever. Returns false on timeout.
+    bool wait(int32_t waitSeq, int timeoutMs = -1);
+
+    void notifyOne();
+
+    void notifyAll();
+
+  private:
+    int32_t seq = 0;
+
+    // Lets notifiers skip the syscall when no one is waiting
+    std::atomic<int> nWaiters = 0;
+};
+}
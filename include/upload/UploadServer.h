@@ -1,5 +1,6 @@
 #pragma once
 
+#include <faabric/state/StateKeyValue.h>
 #include <faabric/util/func.h>
 
 #include <cpprest/http_listener.h>
@@ -13,6 +14,11 @@ using namespace web::http;
 #define PYTHON_URL_PART "p"
 #define STATE_URL_PART "s"
 #define SHARED_FILE_URL_PART "file"
+#define WORKFLOW_URL_PART "wf"
+
+// Python function run on the workers to compile uploaded Python to bytecode
+#define PYTHON_COMPILER_USER "python"
+#define PYTHON_COMPILER_FUNC "faasm_compile"
 
 namespace edge {
 class UploadServer
@@ -31,8 +37,9 @@ class UploadServer
   private:
     bool stopped = false;
 
-    static std::vector<uint8_t> getState(const std::string& user,
-                                         const std::string& key);
+    static std::shared_ptr<faabric::state::StateKeyValue> getState(
+      const std::string& user,
+      const std::string& key);
 
     static void handlePythonFunctionUpload(const http_request& request,
                                            const std::string& user,
@@ -49,6 +56,9 @@ class UploadServer
     static void handleSharedFileUpload(const http_request& request,
                                        const std::string& path);
 
+    static void handleWorkflowSubmission(const http_request& request,
+                                         const std::string& user);
+
     static void extractRequestBody(const http_request& req,
                                    faabric::Message& msg);
 };
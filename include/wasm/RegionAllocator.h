@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+namespace wasm {
+
+/**
+ * Keeps track of free ranges in a module's linear memory so they can be reused
+ * rather than growing memory again. Freed ranges are merged with any free
+ * neighbours, and allocations take the first free range that is big enough.
+ *
+ * The allocator only does the bookkeeping, callers are responsible for
+ * locking and for the memory itself.
+ */
+class RegionAllocator
+{
+  public:
+    // Returns the start of a free range of the given size, or nothing if no
+    // free range is big enough
+    std::optional<uint32_t> allocate(uint32_t size);
+
+    void free(uint32_t start, uint32_t size);
+
+    void clear();
+
+    size_t getFreeBytes() const;
+
+    size_t getNumFreeRanges() const;
+
+  private:
+    // Start -> size
+    std::map<uint32_t, uint32_t> freeRanges;
+};
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <faabric/state/StateKeyValue.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Pending writes to a single key are flushed once they get this big
+#define STATE_WRITE_COMBINE_MAX_BYTES (1024 * 1024)
+
+namespace wasm {
+
+struct StateWriteCombinerMetrics
+{
+    // Writes and dirty flags passed in
+    uint64_t fragmentsIn = 0;
+
+    // Merged ranges passed on to the state values
+    uint64_t fragmentsOut = 0;
+
+    uint64_t bytesIn = 0;
+
+    uint64_t flushes = 0;
+};
+
+/**
+ * Buffers small offset writes and dirty flags on state values, merging any
+ * that overlap or touch, so that the state value only sees one range for each
+ * contiguous run. Later writes win where writes overlap.
+ *
+ * Nothing reaches the state value until it's flushed, so callers must flush a
+ * key before anything else reads, pushes or pulls it. This includes guests
+ * reading through pointers into the value's memory, which is why combining is
+ * opt-in (STATE_WRITE_COMBINE).
+ */
+class StateWriteCombiner
+{
+  public:
+    void write(const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+               long offset,
+               const uint8_t* data,
+               size_t length);
+
+    void flagDirty(const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+                   long offset,
+                   size_t length);
+
+    void flush(const std::shared_ptr<faabric::state::StateKeyValue>& kv);
+
+    void flushAll();
+
+    // Drops anything pending without applying it
+    void clear();
+
+    StateWriteCombinerMetrics getMetrics();
+
+  private:
+    struct PendingKey
+    {
+        std::shared_ptr<faabric::state::StateKeyValue> kv;
+
+        // Start -> bytes
+        std::map<long, std::vector<uint8_t>> writes;
+        size_t writeBytes = 0;
+
+        // Start -> end
+        std::map<long, long> dirty;
+    };
+
+    std::mutex mx;
+    std::unordered_map<faabric::state::StateKeyValue*, PendingKey> pending;
+    StateWriteCombinerMetrics metrics;
+
+    void doFlush(PendingKey& p);
+};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+#define STDOUT_TRUNCATED_MARKER "[Faasm: {} bytes of stdout truncated]\n"
+
+// How much stdout to gather before sending it down a call's stream
+#define STDOUT_STREAM_CHUNK_BYTES 4096
+
+namespace wasm {
+
+/**
+ * Bounded ring buffer holding captured guest stdout. Once the buffer is full,
+ * the oldest output is dropped, and the output is prefixed with a marker
+ * saying how much was truncated.
+ *
+ * The buffer grows as output is appended, so modules that write little output
+ * don't pay for the full capacity up front.
+ */
+class StdoutCapture
+{
+  public:
+    StdoutCapture();
+
+    size_t append(const struct ::iovec* iovecs, int iovecCount);
+
+    size_t append(std::string_view data);
+
+    std::string read();
+
+    // Reads and clears the buffer in one go
+    std::string take();
+
+    size_t size();
+
+    size_t getTruncatedBytes();
+
+    size_t getCapacity();
+
+    void clear();
+
+  private:
+    std::mutex mx;
+
+    size_t capacity = 0;
+
+    std::vector<char> buffer;
+    size_t head = 0;
+    size_t used = 0;
+    size_t truncated = 0;
+
+    void doAppend(const char* data, size_t len);
+
+    std::string doRead();
+};
+}
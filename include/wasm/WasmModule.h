@@ -7,18 +7,31 @@
 #include <faabric/util/queue.h>
 #include <faabric/util/snapshot.h>
 #include <storage/FileSystem.h>
+#include <threads/Futex.h>
 #include <threads/ThreadState.h>
+#include <wasm/RegionAllocator.h>
+#include <wasm/StateWriteCombiner.h>
+#include <wasm/StdoutCapture.h>
 #include <wasm/WasmCommon.h>
 #include <wasm/WasmEnvironment.h>
 
+#include <array>
 #include <atomic>
 #include <exception>
+#include <functional>
+#include <future>
 #include <mutex>
 #include <string>
 #include <sys/uio.h>
 #include <thread>
 #include <tuple>
 
+#define MAX_STATE_HANDLES 4096
+
+// Longest a condition wait sleeps once threads are spread across hosts, as
+// signals from other hosts never reach it
+#define DISTRIBUTED_PTHREAD_COND_WAIT_MS 10
+
 namespace wasm {
 
 // Note - avoid a zero default on the thread request type otherwise it can
@@ -32,6 +45,14 @@ enum ThreadRequestType
 
 bool isWasmPageAligned(int32_t offset);
 
+// A state segment mapped into linear memory, keyed by the pointer handed out
+struct SharedMemSegment
+{
+    std::string segmentKey;
+    uint32_t wasmBasePtr = 0;
+    uint32_t allocSize = 0;
+};
+
 class WasmModule
 {
   public:
@@ -114,8 +135,62 @@ class WasmModule
       long offset,
       uint32_t length);
 
+    // Takes the pointer returned when mapping. The range is replaced with
+    // private memory, and reused by later mappings.
+    void unmapSharedStateMemory(uint32_t wasmPtr);
+
     virtual uint8_t* wasmPointerToNative(uint32_t wasmPtr);
 
+    // ----- State handles -----
+    // Opening the same key twice returns the same handle. Handles index into
+    // a fixed table, so looking one up needs no lock or key building.
+    int32_t openStateHandle(const std::string& user,
+                            const std::string& key,
+                            size_t size);
+
+    // Returns a reference into the handle table, so the hot path doesn't touch
+    // the reference count
+    const std::shared_ptr<faabric::state::StateKeyValue>& getStateHandle(
+      int32_t handle);
+
+    // Handles only last for one call, so are dropped whenever the module is
+    // reset
+    void clearStateHandles();
+
+    // ----- Async state transfers -----
+    // Request ids are only meaningful within this module, and each one is
+    // released once it has been awaited. Testing returns 1 if the transfer
+    // has finished, 0 if it's still in flight and -1 for unknown ids.
+    int32_t startStateTransfer(std::function<void()> op);
+
+    int testStateTransfer(int32_t requestId);
+
+    void awaitStateTransfer(int32_t requestId);
+
+    void awaitAllStateTransfers();
+
+    // ----- State write combining -----
+    // Small offset writes and dirty flags are buffered and merged per key
+    // (unless STATE_WRITE_COMBINE is off). They must be flushed before the
+    // key is read, pushed, pulled or unlocked.
+    void writeStateOffset(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      long offset,
+      const uint8_t* data,
+      size_t length);
+
+    void flagStateOffsetDirty(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      long offset,
+      size_t length);
+
+    void flushStateWrites(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv);
+
+    void flushAllStateWrites();
+
+    StateWriteCombinerMetrics getStateWriteMetrics();
+
     virtual size_t getMemorySizeBytes();
 
     virtual size_t getMaxMemoryPages();
@@ -133,13 +208,17 @@ class WasmModule
 
     // ----- Threading -----
     // Queues a pthread call that will be executed along with all other queued
-    // calls on the first call to await
+    // calls on the first call to await. In eager mode, calls are instead
+    // started on this host as soon as a group of them has been queued.
     void queuePthreadCall(threads::PthreadCall call);
 
     // Executes all queued pthread calls and awaits the call relating to the
     // given pointer
     int awaitPthreadCall(faabric::Message* msg, int pthreadPtr);
 
+    // Waits for all eager pthreads to finish, including any never joined
+    void awaitEagerPthreadCalls();
+
     std::vector<uint32_t> getThreadStacks();
 
     // Returns the given pthread mutex and errors if it doesn't exist
@@ -148,6 +227,33 @@ class WasmModule
     // Returns the given pthread mutex, creating it if it doesn't exist
     std::shared_ptr<std::mutex> getOrCreatePthreadMutex(uint32_t id);
 
+    // Guest pthread mutexes live in the pthread_mutex_t in wasm memory, apart
+    // from once the module's threads have been spread across hosts, after
+    // which all of its threads use the mutexes above
+    void initPthreadMutex(uint32_t mx);
+
+    void lockPthreadMutex(uint32_t mx);
+
+    bool tryLockPthreadMutex(uint32_t mx);
+
+    void unlockPthreadMutex(uint32_t mx);
+
+    // Guest pthread condition variables are held on the host, keyed by their
+    // address in wasm memory
+    std::shared_ptr<threads::FutexCondition> getOrCreatePthreadCond(
+      uint32_t cond);
+
+    void destroyPthreadCond(uint32_t cond);
+
+    // Waits on the condition with the given mutex held, returning zero or
+    // ETIMEDOUT. A negative timeout waits forever. Once the module's threads
+    // are spread across hosts, waits return zero after a short sleep instead.
+    int waitPthreadCond(uint32_t cond, uint32_t mx, int timeoutMs = -1);
+
+    // Switches the module's threads to host-side mutexes if the batch is
+    // spread across hosts
+    void setDistributedPthreads(const faabric::BatchExecuteRequest& req);
+
     // Adds a merge region to be used in the next threaded operation spawned by
     // this module
     void addMergeRegionForNextThreads(
@@ -184,8 +290,16 @@ class WasmModule
 
     WasmEnvironment wasmEnvironment;
 
-    int stdoutMemFd = 0;
-    ssize_t stdoutSize = 0;
+    StdoutCapture stdoutCapture;
+
+    // Stdout written since we last tried sending it down the call's stream
+    std::mutex stdoutStreamMx;
+    size_t stdoutSinceStreamFlush = 0;
+
+    // Sends captured stdout down the call's stream once the caller is reading
+    // it, leaving it captured otherwise. Unless forced, only does so once
+    // there's a chunk's worth.
+    void flushStdoutStream(bool force);
 
     int threadPoolSize = 0;
     std::vector<uint32_t> threadStacks;
@@ -201,14 +315,60 @@ class WasmModule
     std::vector<std::pair<uint32_t, int32_t>> lastPthreadResults;
     std::vector<faabric::util::SnapshotMergeRegion> mergeRegions;
 
+    // Eager pthreads, each with the results of the group it was started in,
+    // and the pool threads they can still use
+    std::mutex eagerPthreadsMx;
+    std::vector<int> freeEagerPthreadIdxs;
+    std::unordered_map<
+      int32_t,
+      std::shared_future<std::vector<std::pair<uint32_t, int32_t>>>>
+      eagerPthreadResults;
+
+    std::shared_ptr<faabric::BatchExecuteRequest> buildPthreadRequest(
+      const faabric::Message& msg,
+      const std::vector<int>& threadIdxs);
+
+    // Returns false if there aren't enough pool threads to start the calls
+    bool startEagerPthreadCalls(const faabric::Message& msg);
+
+    // Sends the queued calls as a single batch, once any eager threads have
+    // finished, and returns their results
+    std::vector<std::pair<uint32_t, int32_t>> executeQueuedPthreadCalls(
+      const faabric::Message& msg);
+
     std::shared_mutex pthreadLocksMx;
     std::unordered_map<uint32_t, std::shared_ptr<std::mutex>> pthreadLocks;
 
+    // Set when a batch of this module's threads is spread across hosts, and
+    // only cleared when the module is reset
+    std::atomic<bool> distributedPthreads = false;
+
+    bool usePthreadMutexMap(uint32_t mx);
+
+    std::shared_mutex pthreadCondsMx;
+    std::unordered_map<uint32_t, std::shared_ptr<threads::FutexCondition>>
+      pthreadConds;
+
     // Shared memory regions
     std::shared_mutex sharedMemWasmPtrsMutex;
     std::unordered_map<std::string, uint32_t> sharedMemWasmPtrs;
-
-    int getStdoutFd();
+    std::unordered_map<uint32_t, SharedMemSegment> sharedMemSegments;
+    RegionAllocator sharedMemAllocator;
+
+    // State handles
+    std::mutex stateHandlesMx;
+    std::unordered_map<std::string, int32_t> stateHandleIdxs;
+    std::array<std::shared_ptr<faabric::state::StateKeyValue>,
+               MAX_STATE_HANDLES>
+      stateHandles;
+    std::atomic<int32_t> nStateHandles = 0;
+
+    // Async state transfers
+    std::mutex stateTransfersMx;
+    std::unordered_map<int32_t, std::future<void>> stateTransfers;
+    int32_t nextStateTransferId = 1;
+
+    StateWriteCombiner stateWrites;
 
     void prepareArgcArgv(const faabric::Message& msg);
 
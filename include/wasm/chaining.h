@@ -1,17 +1,214 @@
 #pragma once
 
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/util/timing.h>
+
 #include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
 #include <vector>
 
+// Bounds on how long to block on one call between checks of all the others
+// when waiting on several
+#define AWAIT_CALLS_MIN_POLL_MS 1
+#define AWAIT_CALLS_MAX_POLL_MS 50
+
+#define CHAIN_PAYLOAD_KEY_PREFIX "chain_payload_"
+
+// Where a message holds references to its input and output
+#define CHAIN_PAYLOAD_INPUT "chain_payload_input"
+#define CHAIN_PAYLOAD_OUTPUT "chain_payload_output"
+
+// Set on an input reference when the caller can also read the output by
+// reference
+#define CHAIN_PAYLOAD_FLAG_OUTPUT_REF 1
+
 namespace wasm {
 
 int awaitChainedCall(unsigned int messageId);
 
 int awaitChainedCallOutput(unsigned int messageId, char* buffer, int bufferLen);
 
+struct ChainedCallResult
+{
+    uint32_t messageId;
+    int returnValue;
+};
+
+/**
+ * Waits on a set of calls in one app that can grow as it's waited on.
+ *
+ * Each call is checked once when it's added, which also registers our interest
+ * in its result with the planner. After that, we block on the oldest pending
+ * call, and only check all the others at an interval that backs off while
+ * none are finishing, so each round doesn't cost a planner request per call.
+ */
+class ChainedCallWaiter
+{
+  public:
+    explicit ChainedCallWaiter(int appIdIn);
+
+    void add(uint32_t messageId);
+
+    size_t getPendingCount() const;
+
+    /**
+     * Returns the results of calls seen to finish, in that order. If waitForAll
+     * is false this returns as soon as any have finished.
+     */
+    std::vector<ChainedCallResult> wait(bool waitForAll, int timeoutMs);
+
+  private:
+    int appId;
+
+    std::vector<uint32_t> added;
+    std::list<uint32_t> pending;
+
+    int sweepMs = AWAIT_CALLS_MIN_POLL_MS;
+    faabric::util::TimePoint lastSweep;
+
+    bool checkCall(uint32_t messageId,
+                   int waitMs,
+                   std::vector<ChainedCallResult>& results);
+};
+
+/**
+ * Waits on a set of calls in the given app, returning the results in the order
+ * the calls were seen to finish. If waitForAll is false this returns as soon as
+ * any have finished. Fewer results than calls means the wait timed out.
+ */
+std::vector<ChainedCallResult> awaitChainedCalls(
+  int appId,
+  const std::vector<uint32_t>& messageIds,
+  bool waitForAll,
+  int timeoutMs);
+
+/**
+ * As above for calls chained by the executing call. A timeout of zero or less
+ * uses the default chained call timeout.
+ */
+std::vector<ChainedCallResult> awaitChainedCalls(
+  const std::vector<uint32_t>& messageIds,
+  bool waitForAll,
+  int timeoutMs);
+
 int makeChainedCall(const std::string& functionName,
                     int wasmFuncPtr,
                     const char* pyFunc,
                     const std::vector<uint8_t>& inputData);
+
+struct ChainedCall
+{
+    std::string functionName;
+    int wasmFuncPtr = 0;
+    std::vector<uint8_t> inputData;
+};
+
+/**
+ * Builds the requests to chain the given calls from the original call. All the
+ * calls to each function go in a single batch so that the planner can schedule
+ * them together, so this returns one request per distinct function.
+ */
+std::vector<std::shared_ptr<faabric::BatchExecuteRequest>>
+buildChainedCallBatches(const faabric::Message& originalCall,
+                        const std::vector<ChainedCall>& calls);
+
+/**
+ * Chains all the given calls from the executing call, returning their ids in
+ * the same order as the calls.
+ */
+std::vector<int> makeChainedCallBatch(const std::vector<ChainedCall>& calls);
+
+/**
+ * Chained call inputs and outputs over the configured threshold aren't sent in
+ * the message. Instead they're written to a state value owned by the message's
+ * user, and the message's exec graph details hold this header followed by the
+ * value's key, under CHAIN_PAYLOAD_INPUT or CHAIN_PAYLOAD_OUTPUT. Only the host
+ * sets these, so no input or output a guest writes can pass for a reference.
+ * Whoever reads the payload copies it straight from the state value into wasm
+ * memory.
+ *
+ * The functions below take one of those two names as the field, and fall back
+ * to the message's input or output data when the field isn't a reference.
+ */
+struct ChainPayloadRef
+{
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+bool isChainPayloadRef(const faabric::Message& msg, const std::string& field);
+
+/**
+ * Returns the size of the data a message field holds, whether that's inline or
+ * by reference.
+ */
+size_t getChainPayloadSize(const faabric::Message& msg,
+                           const std::string& field);
+
+/**
+ * Copies up to bufferLen bytes of a message field's data into the buffer,
+ * returning the number copied.
+ */
+size_t readChainPayload(const faabric::Message& msg,
+                        const std::string& field,
+                        uint8_t* buffer,
+                        size_t bufferLen);
+
+/**
+ * Removes the state value behind a reference, and the reference itself. Does
+ * nothing for inline data.
+ */
+void deleteChainPayload(faabric::Message& msg, const std::string& field);
+
+/**
+ * Deletes the outputs passed back by reference to the given call by the calls
+ * it chained, for when it's finished without reading them all.
+ */
+void deleteChainedCallOutputs(const faabric::Message& msg);
+
+/**
+ * Passes a reference to one call's output straight on as another's input,
+ * without copying it out of state. Both calls must belong to the same user.
+ */
+void forwardChainPayload(const faabric::Message& from,
+                         faabric::Message& to,
+                         bool outputByRef);
+
+/**
+ * Sets the input of a chained call, passing it by reference if it's over the
+ * threshold. If outputByRef is set, the call's output can be passed back by
+ * reference too.
+ */
+void setChainedCallInput(faabric::Message& msg,
+                         const std::vector<uint8_t>& inputData,
+                         bool outputByRef = true);
+
+/**
+ * Sets the output of a call, passing it by reference if it's over the
+ * threshold and the caller can read it that way. Replaces any output
+ * previously set by reference.
+ */
+void setCallOutput(faabric::Message& msg, const uint8_t* data, size_t len);
+
+/**
+ * Sets whether calls chained from now on by the executing call stream to it
+ */
+void streamChainedCalls(bool enabled);
+
+/**
+ * Emits a chunk of partial output from the executing call, see streams.h
+ */
+void emitCallStreamChunk(const uint8_t* data, size_t len);
+
+/**
+ * Reads the next chunk of partial output from a call chained by the executing
+ * call. A timeout of zero or less uses the default chained call timeout.
+ */
+int readChainedCallStreamChunk(unsigned int messageId,
+                               uint8_t* buffer,
+                               size_t bufferLen,
+                               int timeoutMs);
 }
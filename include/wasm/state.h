@@ -0,0 +1,47 @@
+#pragma once
+
+#include <faabric/state/StateKeyValue.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+// How many keys mastered by one host are transferred at once
+#define STATE_MULTI_KEYS_IN_FLIGHT 8
+
+namespace wasm {
+
+typedef std::vector<std::shared_ptr<faabric::state::StateKeyValue>> StateKVs;
+
+/**
+ * Multi-key state operations. Keys are grouped by the host that masters them.
+ * Groups are transferred in parallel, and within each group up to
+ * STATE_MULTI_KEYS_IN_FLIGHT keys are in flight at once. Each key is still its
+ * own request, but touching many keys costs roughly one round trip per that
+ * many keys on each host, rather than one per key.
+ */
+void pullStateMulti(const StateKVs& kvs);
+
+void pullStateChunksMulti(const StateKVs& kvs,
+                          const std::vector<long>& offsets,
+                          const std::vector<long>& lengths);
+
+void pushStateMulti(const StateKVs& kvs, bool partial);
+
+/**
+ * Whole-value reads and writes copy the value's full size, so this throws if
+ * the guest buffer given for one is smaller than the value.
+ */
+void checkStateBufferSize(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  int32_t bufferLen);
+
+/**
+ * Runs a state transfer on this host's pool of state I/O threads, so that the
+ * caller can carry on computing while it is in flight. The pool is sized with
+ * STATE_IO_THREADS and started on first use. Errors are rethrown from the
+ * returned future.
+ */
+std::future<void> submitStateTransfer(std::function<void()> op);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <cstdint>
+#include <string>
+
+#define STREAM_KEY_PREFIX "stream_"
+
+// Where a chained call's message names the call that may read its stream
+#define STREAM_READER "stream_reader"
+
+// Set on a call's message when the calls it chains should stream to it
+#define STREAM_CHAINED_CALLS "stream_chained_calls"
+
+// Bounds on how long to wait between checks of a stream held on another host
+#define STREAM_MIN_POLL_MS 1
+#define STREAM_MAX_POLL_MS 50
+
+namespace wasm {
+
+/**
+ * Calls can stream partial results to whoever is waiting on them as a sequence
+ * of chunks, before they finish. Each stream is held in state values under the
+ * producing call's id: a header with the number of chunks emitted, a count of
+ * those consumed, the reader's state, and one value per chunk. When both ends
+ * are on the same host these are just in-memory values, otherwise they go over
+ * the state transport.
+ *
+ * Only calls given a reader with addStreamReader keep what they emit, anything
+ * else is dropped as nobody could read it. Callers only become readers of the
+ * calls they chain once they've asked for streaming, so calls nobody streams
+ * from never touch these values. Once the reader has read from a
+ * stream, the stream holds at most the configured number of unread chunks and
+ * emitting blocks until the reader makes room. Until then chunks are kept
+ * without blocking, so a reader that comes late still sees them all. Each
+ * stream must only have one reader.
+ *
+ * Whichever of the reader and producer finishes last removes the stream, so
+ * the reader must call detachStreams once it's done.
+ */
+void emitStreamChunk(const faabric::Message& msg,
+                     const uint8_t* data,
+                     size_t len,
+                     int timeoutMs);
+
+/**
+ * Reads the next chunk from the given call's stream into the buffer. Returns
+ * the chunk's size, zero once the stream is finished, or -1 on timeout. If the
+ * chunk is bigger than the buffer nothing is read, and the caller can retry
+ * with a buffer of the returned size.
+ */
+int readStreamChunk(int appId,
+                    const std::string& user,
+                    int callId,
+                    uint8_t* buffer,
+                    size_t bufferLen,
+                    int timeoutMs);
+
+/**
+ * Marks the end of the call's stream.
+ */
+void closeStream(const faabric::Message& msg);
+
+/**
+ * Makes the reader the only call that can read the given call's stream. Must
+ * be called on the reader's host before the call is dispatched.
+ */
+void addStreamReader(const faabric::Message& reader, faabric::Message& msg);
+
+bool hasStreamReader(const faabric::Message& msg);
+
+/**
+ * Checks whether the call's reader has started reading its stream, so what the
+ * call emits is held back by how fast the reader reads.
+ */
+bool isStreamReaderAttached(const faabric::Message& msg);
+
+/**
+ * Sets whether the calls chained from now on by the given call can stream to
+ * it.
+ */
+void setStreamChainedCalls(faabric::Message& msg, bool enabled);
+
+bool streamsChainedCalls(const faabric::Message& msg);
+
+/**
+ * Gives up on the streams of all the calls the reader was added to, removing
+ * those that have already closed. Those still running stop keeping what they
+ * emit, and remove their stream when they close.
+ */
+void detachStreams(const faabric::Message& reader);
+}
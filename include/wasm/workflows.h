@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How often workflows waiting on their nodes check if they've been cancelled
+#define WORKFLOW_CANCEL_POLL_MS 500
+
+namespace wasm {
+
+struct WorkflowNode
+{
+    std::string function;
+
+    std::vector<uint8_t> inputData;
+
+    // Indexes of the nodes whose outputs are appended to this node's input, in
+    // order. Nodes can only depend on nodes before them, so every workflow is
+    // a DAG.
+    std::vector<int> dependsOn;
+};
+
+struct Workflow
+{
+    std::string user;
+
+    std::vector<WorkflowNode> nodes;
+};
+
+/**
+ * Parses a workflow from its JSON spec, e.g.
+ *
+ * {"user": "demo", "nodes": [
+ *   {"function": "split", "input": "abc"},
+ *   {"function": "count", "deps": [0]},
+ *   {"function": "count", "deps": [0]},
+ *   {"function": "merge", "deps": [1, 2]}
+ * ]}
+ *
+ * The user can be left out if the caller provides it. Throws if the spec
+ * isn't a valid workflow.
+ */
+Workflow parseWorkflow(const std::string& json,
+                       const std::string& defaultUser = "");
+
+/**
+ * Throws if the workflow is empty, has nodes with no function, or has
+ * dependencies that aren't on earlier nodes.
+ */
+void validateWorkflow(const Workflow& workflow);
+
+/**
+ * Submits a workflow as part of the given app, returning the message id of
+ * each node in order. The results of all nodes can be awaited like any other
+ * call in the app.
+ *
+ * Nodes are scheduled from a background thread on this host as soon as all
+ * the nodes they depend on have finished, with their input made up of those
+ * nodes' outputs. If a node fails, all the nodes that depend on it are given a
+ * failed result without running.
+ */
+std::vector<int> submitWorkflow(const Workflow& workflow, int appId);
+
+/**
+ * Submits a workflow from the executing call, making each node a chained call
+ * of it.
+ */
+std::vector<int> submitChainedWorkflow(const std::string& json);
+
+size_t getActiveWorkflowCount();
+
+/**
+ * Waits for all workflows on this host to finish, joining their threads.
+ * Returns false on timeout.
+ */
+bool waitForWorkflows(int timeoutMs);
+
+/**
+ * Cancels all workflows on this host and joins their threads. Nodes that are
+ * already running carry on, but no more are started, and those that haven't
+ * run are given a failed result. Workflows submitted while this runs are
+ * rejected.
+ */
+void shutdownWorkflows();
+}
@@ -40,6 +40,10 @@ class IRModuleCache
 
     void clear();
 
+    // Removes the main module for the function and any shared modules it
+    // has loaded
+    void invalidateFunction(const std::string& user, const std::string& func);
+
   private:
     std::shared_mutex mx;
     std::unordered_map<std::string, IR::Module> moduleMap;
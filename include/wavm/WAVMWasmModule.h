@@ -38,6 +38,25 @@ void unalignedWavmWrite(const T& value,
     faabric::util::unalignedWrite<T>(value, bytes);
 }
 
+/**
+ * To double check this, work out which header from the sysroot is resolved
+ * Currently this is:
+ *  - include/__struct_dirent.h
+ *  - include/__typedef_ino_t.h
+ *
+ * struct dirent {
+ *     ino_t d_ino;  # unsigned long long
+ *     unsigned char d_type;
+ *     char d_name[];
+ * };
+ */
+struct wasm_dirent64
+{
+    uint64_t d_ino;
+    uint8_t d_type;
+    uint8_t d_name[];
+};
+
 class WAVMWasmModule final
   : public WasmModule
   , WAVM::Runtime::Resolver
@@ -55,6 +74,8 @@ class WAVMWasmModule final
 
     static void clearCaches();
 
+    static void clearCachesForFunction(const faabric::Message& msg);
+
     // ----- Module lifecycle -----
     void doBindToFunction(faabric::Message& msg, bool cache) override;
 
@@ -76,6 +97,13 @@ class WAVMWasmModule final
 
     uint8_t* getMemoryBase() override;
 
+    // ----- Filesystem -----
+    // Fills the wasm buffer with wasm_dirent64s read from the given native
+    // directory fd, returning the bytes written or -errno (see getdents64)
+    int32_t readDirents64(int32_t fd,
+                          int32_t wasmDirentBuf,
+                          int32_t wasmDirentBufLen);
+
     // ----- Environment variables -----
     void writeWasmEnvToMemory(uint32_t envPointers,
                               uint32_t envBuffer) override;
@@ -231,17 +259,27 @@ class WAVMModuleCache
     std::pair<wasm::WAVMWasmModule&, faabric::util::SharedLock> getCachedModule(
       faabric::Message& msg);
 
-    std::string registerResetSnapshot(wasm::WasmModule& module,
-                                      faabric::Message& msg);
+    // Registers the function's reset snapshot from its cached zygote if it
+    // doesn't already exist, returning its key
+    std::string registerResetSnapshot(faabric::Message& msg);
+
+    // As above, for callers already holding the lock from getCachedModule
+    void ensureResetSnapshot(wasm::WAVMWasmModule& cachedModule,
+                             const std::string& snapKey);
 
     void clear();
 
+    // Removes the cached zygote and reset snapshot for the function
+    void invalidate(const faabric::Message& msg);
+
     size_t getTotalCachedModuleCount();
 
   private:
     std::shared_mutex mx;
     std::unordered_map<std::string, wasm::WAVMWasmModule> cachedModuleMap;
 
+    std::mutex snapshotMx;
+
     int getCachedModuleCount(const std::string& key);
 };
 
@@ -25,10 +25,20 @@ void FaasmConfig::initialise()
     maxNetNs = this->getIntParam("MAX_NET_NAMESPACES", "100");
 
     pythonPreload = getEnvVar("PYTHON_PRELOAD", "off");
+    pythonPrecompile = getEnvVar("PYTHON_PRECOMPILE", "off");
     captureStdout = getEnvVar("CAPTURE_STDOUT", "off");
+    captureStdoutMaxBytes =
+      this->getIntParam("CAPTURE_STDOUT_MAX_BYTES", "1048576");
 
     wasmVm = getEnvVar("WASM_VM", "wavm");
     chainedCallTimeout = this->getIntParam("CHAINED_CALL_TIMEOUT", "300000");
+    chainPayloadThreshold =
+      this->getIntParam("CHAIN_PAYLOAD_THRESHOLD", "1048576");
+    streamMaxChunks = this->getIntParam("STREAM_MAX_CHUNKS", "16");
+    pthreadDispatch = getEnvVar("PTHREAD_DISPATCH", "batch");
+    pthreadEagerGroupSize = this->getIntParam("PTHREAD_EAGER_GROUP_SIZE", "1");
+    stateIoThreads = this->getIntParam("STATE_IO_THREADS", "4");
+    stateWriteCombine = getEnvVar("STATE_WRITE_COMBINE", "off");
 
     std::string faasmLocalDir =
       getEnvVar("FAASM_LOCAL_DIR", "/usr/local/faasm");
@@ -36,12 +46,22 @@ void FaasmConfig::initialise()
     objectFileDir = fmt::format("{}/{}", faasmLocalDir, "object");
     runtimeFilesDir = fmt::format("{}/{}", faasmLocalDir, "runtime_root");
     sharedFilesDir = fmt::format("{}/{}", faasmLocalDir, "shared");
+    runtimeImagePath = getEnvVar("RUNTIME_IMAGE", "");
+    artifactCompression = getEnvVar("ARTIFACT_COMPRESSION", "off");
+    artifactCompressionLevel =
+      this->getIntParam("ARTIFACT_COMPRESSION_LEVEL", "3");
+    artifactPeerFetch = getEnvVar("ARTIFACT_PEER_FETCH", "off");
+    artifactServerPort = this->getIntParam("ARTIFACT_SERVER_PORT", "8006");
+    artifactTrustedHosts = getEnvVar("ARTIFACT_TRUSTED_HOSTS", "");
 
     s3Bucket = getEnvVar("S3_BUCKET", "faasm");
     s3Host = getEnvVar("S3_HOST", "minio");
     s3Port = getEnvVar("S3_PORT", "9000");
     s3User = getEnvVar("S3_USER", "minio");
     s3Password = getEnvVar("S3_PASSWORD", "minio123");
+    s3MaxConnections = this->getIntParam("S3_MAX_CONNECTIONS", "32");
+    s3MaxRetries = this->getIntParam("S3_MAX_RETRIES", "3");
+    s3HedgeDelayMs = this->getIntParam("S3_HEDGE_DELAY_MS", "0");
 
     attestationProviderUrl = getEnvVar("AZ_ATTESTATION_PROVIDER_URL", "");
 }
@@ -68,8 +88,17 @@ void FaasmConfig::print()
 
     SPDLOG_INFO("--- MISC ---");
     SPDLOG_INFO("Capture stdout:       {}", captureStdout);
+    SPDLOG_INFO("Capture stdout max:   {}", captureStdoutMaxBytes);
     SPDLOG_INFO("Chained call timeout: {}", chainedCallTimeout);
+    SPDLOG_INFO("Chain payload limit:  {}", chainPayloadThreshold);
+    SPDLOG_INFO("Pthread dispatch:     {} (group {})",
+                pthreadDispatch,
+                pthreadEagerGroupSize);
     SPDLOG_INFO("Python preload:       {}", pythonPreload);
+    SPDLOG_INFO("Python precompile:    {}", pythonPrecompile);
+    SPDLOG_INFO("State I/O threads:    {}", stateIoThreads);
+    SPDLOG_INFO("State write combine:  {}", stateWriteCombine);
+    SPDLOG_INFO("Stream max chunks:    {}", streamMaxChunks);
     SPDLOG_INFO("Wasm VM:              {}", wasmVm);
 
     SPDLOG_INFO("--- STORAGE ---");
@@ -77,5 +106,20 @@ void FaasmConfig::print()
     SPDLOG_INFO("Object file dir:      {}", objectFileDir);
     SPDLOG_INFO("Runtime files dir:    {}", runtimeFilesDir);
     SPDLOG_INFO("Shared files dir:     {}", sharedFilesDir);
+    SPDLOG_INFO("Runtime image:        {}", runtimeImagePath);
+    SPDLOG_INFO("Artifact compression: {} (level {})",
+                artifactCompression,
+                artifactCompressionLevel);
+    SPDLOG_INFO("Artifact peer fetch:  {} (port {})",
+                artifactPeerFetch,
+                artifactServerPort);
+    SPDLOG_INFO("Artifact trusted:     {}", artifactTrustedHosts);
+
+    SPDLOG_INFO("--- S3 ---");
+    SPDLOG_INFO("S3 host:              {}:{}", s3Host, s3Port);
+    SPDLOG_INFO("S3 bucket:            {}", s3Bucket);
+    SPDLOG_INFO("S3 max connections:   {}", s3MaxConnections);
+    SPDLOG_INFO("S3 max retries:       {}", s3MaxRetries);
+    SPDLOG_INFO("S3 hedge delay (ms):  {}", s3HedgeDelayMs);
 }
 }
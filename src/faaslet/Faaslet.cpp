@@ -11,16 +11,21 @@
 #include <faabric/util/gids.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/string_tools.h>
 #include <faabric/util/timing.h>
 #include <faaslet/Faaslet.h>
+#include <storage/DirectoryCache.h>
 #include <storage/FileLoader.h>
 #include <storage/FileSystem.h>
+#include <storage/SharedFiles.h>
 #include <system/CGroup.h>
 #include <system/NetworkNamespace.h>
 #include <threads/ThreadState.h>
 #include <wamr/WAMRWasmModule.h>
+#include <wasm/streams.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <filesystem>
 #include <stdexcept>
 
 static thread_local bool threadIsIsolated = false;
@@ -81,7 +86,7 @@ Faaslet::Faaslet(faabric::Message& msg)
     // (currently only supported in WAVM)
     if (conf.wasmVm == "wavm") {
         localResetSnapshotKey =
-          wasm::getWAVMModuleCache().registerResetSnapshot(*module, msg);
+          wasm::getWAVMModuleCache().registerResetSnapshot(msg);
     }
 }
 
@@ -108,7 +113,22 @@ int32_t Faaslet::executeTask(int threadPoolIdx,
         threadIsIsolated = true;
     }
 
-    int32_t returnValue = module->executeTask(threadPoolIdx, msgIdx, req);
+    // However the call finishes, any stream it emits ends then, and it stops
+    // reading the streams of the calls it chained
+    const faabric::Message& msg = req->messages(msgIdx);
+    auto finishCall = [&msg] {
+        wasm::closeStream(msg);
+        wasm::detachStreams(msg);
+    };
+
+    int32_t returnValue;
+    try {
+        returnValue = module->executeTask(threadPoolIdx, msgIdx, req);
+    } catch (...) {
+        finishCall();
+        throw;
+    }
+    finishCall();
 
     return returnValue;
 }
@@ -163,10 +183,63 @@ void FaasletFactory::flushHost()
     storage::FileLoader& fileLoader = storage::getFileLoader();
     fileLoader.clearLocalCache();
 
+    // Clear cached directory listings
+    storage::DirectoryCache::clear();
+
     // WAVM-specific flushing
     const conf::FaasmConfig& conf = conf::getFaasmConfig();
     if (conf.wasmVm == "wavm") {
         wasm::WAVMWasmModule::clearCaches();
     }
 }
+
+void invalidateFunction(const std::string& user, const std::string& function)
+{
+    if (!storage::isValidPathComponent(user) ||
+        !storage::isValidPathComponent(function)) {
+        SPDLOG_ERROR("Ignoring invalidation of {}/{}", user, function);
+        return;
+    }
+
+    SPDLOG_INFO("Invalidating cached state for {}/{}", user, function);
+    faabric::Message msg = faabric::util::messageFactory(user, function);
+
+    storage::FileLoader& fileLoader = storage::getFileLoader();
+    fileLoader.clearLocalCacheForFunction(msg);
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.wasmVm == "wavm") {
+        wasm::WAVMWasmModule::clearCachesForFunction(msg);
+    }
+}
+
+void invalidateSharedFile(const std::string& path)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (storage::resolvePathUnder(conf.sharedFilesDir, path).empty()) {
+        SPDLOG_ERROR("Ignoring invalidation of shared file {}", path);
+        return;
+    }
+
+    SPDLOG_INFO("Invalidating cached shared file {}", path);
+
+    storage::FileLoader& fileLoader = storage::getFileLoader();
+    fileLoader.clearLocalCacheForSharedFile(path);
+
+    std::filesystem::path sharedPath(SHARED_FILE_PREFIX);
+    sharedPath.append(path);
+    storage::SharedFiles::clearCacheForSharedFile(sharedPath.string());
+
+    // Python functions are also copied into the runtime root
+    if (faabric::util::startsWith(path, PYTHON_FUNC_DIR)) {
+        std::string resolvedPath =
+          storage::resolvePathUnder(conf.runtimeFilesDir, path);
+        if (!resolvedPath.empty()) {
+            std::filesystem::path runtimePath(conf.runtimeFilesDir);
+            runtimePath.append(path);
+            std::filesystem::remove(resolvedPath);
+            storage::DirectoryCache::invalidateParent(runtimePath.string());
+        }
+    }
+}
 }
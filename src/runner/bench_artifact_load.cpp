@@ -0,0 +1,131 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
+#include <storage/FileLoader.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <boost/program_options.hpp>
+
+#include <fstream>
+
+using namespace faabric::util;
+namespace po = boost::program_options;
+
+po::variables_map parseCmdLine(int argc, char* argv[])
+{
+    // Define command line arguments
+    po::options_description desc("Allowed options");
+    desc.add_options()(
+      "user", po::value<std::string>(), "function's user name (required)")(
+      "func", po::value<std::string>(), "function's name (required)")(
+      "runs", po::value<int>()->default_value(10), "number of cold loads")(
+      "out-file",
+      po::value<std::string>()->default_value("artifact_load.csv"),
+      "file to write results to");
+
+    // Mark user and function as positional arguments
+    po::positional_options_description p;
+    p.add("user", 1);
+    p.add("func", 1);
+
+    // Parse command line arguments
+    po::variables_map vm;
+    po::store(
+      po::command_line_parser(argc, argv).options(desc).positional(p).run(),
+      vm);
+    po::notify(vm);
+
+    return vm;
+}
+
+/**
+ * Measures cold loads of a function's artifacts from S3, both stored raw and
+ * compressed, recording the time to fetch (and decompress) and the number of
+ * bytes transferred.
+ */
+int main(int argc, char* argv[])
+{
+    initLogging();
+    storage::initFaasmS3();
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    auto vm = parseCmdLine(argc, argv);
+    if (vm.find("user") == vm.end() || vm.find("func") == vm.end()) {
+        SPDLOG_ERROR("Must provide a user and function");
+        return 1;
+    }
+
+    std::string user = vm["user"].as<std::string>();
+    std::string func = vm["func"].as<std::string>();
+    int nRuns = vm["runs"].as<int>();
+    std::string outFile = vm["out-file"].as<std::string>();
+
+    faabric::Message msg = messageFactory(user, func);
+    storage::FileLoader& loader = storage::getFileLoaderWithoutLocalCache();
+
+    std::vector<std::pair<storage::ArtifactType, std::vector<uint8_t>>>
+      artifacts = {
+          { storage::WASM_ARTIFACT, loader.loadFunctionWasm(msg) },
+          { storage::OBJECT_ARTIFACT, loader.loadFunctionObjectFile(msg) },
+      };
+
+    std::ofstream outFs(outFile);
+    outFs << "Artifact,Mode,Raw bytes,Bytes moved,Load (us)" << std::endl;
+
+    storage::S3Wrapper s3;
+    std::string originalCompression = conf.artifactCompression;
+    for (const auto& [type, rawBytes] : artifacts) {
+        if (rawBytes.empty()) {
+            SPDLOG_WARN("No {} artifact for {}/{}, skipping",
+                        storage::getArtifactTypeName(type),
+                        user,
+                        func);
+            continue;
+        }
+
+        for (const std::string mode : { "off", "on" }) {
+            conf.artifactCompression = mode;
+            std::vector<uint8_t> stored =
+              storage::compressArtifact(rawBytes, type);
+
+            std::string key = fmt::format("artifact_bench/{}/{}/{}",
+                                          user,
+                                          func,
+                                          storage::getArtifactTypeName(type));
+            s3.addKeyBytes(conf.s3Bucket, key, stored);
+
+            for (int r = 0; r < nRuns; r++) {
+                // Use a fresh wrapper each time, the shared client still
+                // reuses connections as it would in a real cold start
+                TimePoint start = startTimer();
+                std::vector<uint8_t> loaded = storage::decompressArtifact(
+                  storage::S3Wrapper().getKeyBytes(conf.s3Bucket, key));
+                long loadNanos = getTimeDiffNanos(start);
+
+                if (loaded != rawBytes) {
+                    SPDLOG_ERROR("Loaded artifact does not match original");
+                    return 1;
+                }
+
+                outFs << storage::getArtifactTypeName(type) << "," << mode
+                      << "," << rawBytes.size() << "," << stored.size() << ","
+                      << float(loadNanos) / 1000 << std::endl;
+            }
+
+            SPDLOG_INFO("{} artifact, compression {}: {} -> {} bytes",
+                        storage::getArtifactTypeName(type),
+                        mode,
+                        rawBytes.size(),
+                        stored.size());
+
+            s3.deleteKey(conf.s3Bucket, key);
+        }
+    }
+
+    conf.artifactCompression = originalCompression;
+    storage::shutdownFaasmS3();
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/state.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <numeric>
+#include <thread>
+
+using namespace faabric::util;
+namespace po = boost::program_options;
+
+po::variables_map parseCmdLine(int argc, char* argv[])
+{
+    // Define command line arguments
+    po::options_description desc("Allowed options");
+    desc.add_options()(
+      "workers", po::value<int>()->default_value(4), "number of workers")(
+      "keys", po::value<int>()->default_value(8), "keys per worker")(
+      "key-bytes",
+      po::value<long>()->default_value(4 * 1024 * 1024),
+      "size of each key")(
+      "compute-passes",
+      po::value<int>()->default_value(4),
+      "passes over each key's data per iteration")(
+      "iterations", po::value<int>()->default_value(10), "iterations")(
+      "out-file",
+      po::value<std::string>()->default_value("state_async.csv"),
+      "file to write results to");
+
+    // Parse command line arguments
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    return vm;
+}
+
+// Stands in for the work a guest does on each chunk of state
+static uint64_t compute(const uint8_t* data, long nBytes, int nPasses)
+{
+    uint64_t total = 0;
+    for (int p = 0; p < nPasses; p++) {
+        total = std::accumulate(data, data + nBytes, total);
+    }
+
+    return total;
+}
+
+// Runs iterations of pulling each of the worker's keys and computing on them.
+// In async mode the next key is prefetched while computing on the current one.
+static void runWorker(
+  const std::vector<std::shared_ptr<faabric::state::StateKeyValue>>& kvs,
+  int nPasses,
+  int nIterations,
+  bool async)
+{
+    uint64_t checksum = 0;
+    for (int i = 0; i < nIterations; i++) {
+        std::future<void> next;
+        if (async) {
+            auto kv = kvs.at(0);
+            next = wasm::submitStateTransfer([kv] { kv->pull(); });
+        }
+
+        for (size_t k = 0; k < kvs.size(); k++) {
+            if (async) {
+                next.get();
+                if (k + 1 < kvs.size()) {
+                    auto kv = kvs.at(k + 1);
+                    next = wasm::submitStateTransfer([kv] { kv->pull(); });
+                }
+            } else {
+                kvs.at(k)->pull();
+            }
+
+            checksum +=
+              compute(kvs.at(k)->get(), (long)kvs.at(k)->size(), nPasses);
+        }
+    }
+
+    SPDLOG_TRACE("Worker checksum {}", checksum);
+}
+
+/**
+ * Measures how much overlapping state pulls with compute helps iterative
+ * workloads. Several workers each loop over their own keys, either pulling
+ * synchronously or prefetching the next key on the state I/O pool.
+ *
+ * Pulls of keys mastered on this host don't move any data, so this needs
+ * STATE_MODE=redis to measure real transfers.
+ */
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    auto vm = parseCmdLine(argc, argv);
+    int nWorkers = vm["workers"].as<int>();
+    int nKeys = vm["keys"].as<int>();
+    long keyBytes = vm["key-bytes"].as<long>();
+    int nPasses = vm["compute-passes"].as<int>();
+    int nIterations = vm["iterations"].as<int>();
+    std::string outFile = vm["out-file"].as<std::string>();
+
+    SPDLOG_INFO("State mode {}, {} I/O threads",
+                getSystemConfig().stateMode,
+                conf::getFaasmConfig().stateIoThreads);
+
+    // Set up each worker's keys
+    faabric::state::State& state = faabric::state::getGlobalState();
+    std::vector<std::vector<std::shared_ptr<faabric::state::StateKeyValue>>>
+      workerKvs(nWorkers);
+    std::vector<uint8_t> value(keyBytes);
+    std::iota(value.begin(), value.end(), 0);
+    for (int w = 0; w < nWorkers; w++) {
+        for (int k = 0; k < nKeys; k++) {
+            auto kv = state.getKV(
+              "bench", fmt::format("state_async_{}_{}", w, k), keyBytes);
+            kv->set(value.data());
+            kv->pushFull();
+            workerKvs.at(w).emplace_back(kv);
+        }
+    }
+
+    std::ofstream outFs(outFile);
+    outFs << "Mode,Workers,Keys,Key bytes,Passes,Time (ms)" << std::endl;
+
+    for (bool async : { false, true }) {
+        std::string mode = async ? "async" : "sync";
+
+        TimePoint start = startTimer();
+        std::vector<std::thread> workers;
+        for (int w = 0; w < nWorkers; w++) {
+            workers.emplace_back(runWorker,
+                                 std::cref(workerKvs.at(w)),
+                                 nPasses,
+                                 nIterations,
+                                 async);
+        }
+
+        for (auto& t : workers) {
+            t.join();
+        }
+        double millis = getTimeDiffMillis(start);
+
+        SPDLOG_INFO("{}: {} workers x {} keys x {} bytes in {:.2f}ms",
+                    mode,
+                    nWorkers,
+                    nKeys,
+                    keyBytes,
+                    millis);
+
+        outFs << mode << "," << nWorkers << "," << nKeys << "," << keyBytes
+              << "," << nPasses << "," << millis << std::endl;
+    }
+
+    for (int w = 0; w < nWorkers; w++) {
+        for (int k = 0; k < nKeys; k++) {
+            state.deleteKV("bench", fmt::format("state_async_{}_{}", w, k));
+        }
+    }
+
+    return 0;
+}
@@ -12,6 +12,7 @@
 #include <runner/runner_utils.h>
 #include <storage/FileLoader.h>
 #include <wasm/WasmModule.h>
+#include <wasm/workflows.h>
 
 namespace po = boost::program_options;
 
@@ -95,6 +96,7 @@ int doRunner(int argc, char* argv[])
 
     PROF_END(FunctionExec)
 
+    wasm::shutdownWorkflows();
     m.shutdown();
 
     return 0;
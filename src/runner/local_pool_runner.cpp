@@ -6,6 +6,7 @@
 #include <faaslet/Faaslet.h>
 #include <runner/runner_utils.h>
 #include <storage/S3Wrapper.h>
+#include <wasm/workflows.h>
 
 int doRunner(int argc, char* argv[])
 {
@@ -66,6 +67,7 @@ int main(int argc, char* argv[])
 
         doRunner(argc, argv);
 
+        wasm::shutdownWorkflows();
         m.shutdown();
     }
 
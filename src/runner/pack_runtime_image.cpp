@@ -0,0 +1,53 @@
+#include <conf/FaasmConfig.h>
+#include <storage/RuntimeImage.h>
+
+#include <faabric/util/logging.h>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+po::variables_map parseCmdLine(int argc, char* argv[])
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    // Define command line arguments
+    po::options_description desc("Allowed options");
+    desc.add_options()("output-path",
+                       po::value<std::string>(),
+                       "path to write the runtime image to (required)")(
+      "input-path",
+      po::value<std::string>()->default_value(conf.runtimeFilesDir),
+      "runtime root directory to pack");
+
+    // Mark output path as positional argument
+    po::positional_options_description p;
+    p.add("output-path", 1);
+
+    // Parse command line arguments
+    po::variables_map vm;
+    po::store(
+      po::command_line_parser(argc, argv).options(desc).positional(p).run(),
+      vm);
+    po::notify(vm);
+
+    return vm;
+}
+
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+
+    auto vm = parseCmdLine(argc, argv);
+    if (vm.find("output-path") == vm.end()) {
+        SPDLOG_ERROR("Must provide an output path for the runtime image");
+        return 1;
+    }
+
+    std::string outputPath = vm["output-path"].as<std::string>();
+    std::string inputPath = vm["input-path"].as<std::string>();
+
+    storage::RuntimeImage::build(inputPath, outputPath);
+
+    return 0;
+}
@@ -1,8 +1,11 @@
 #include <faabric/endpoint/FaabricEndpoint.h>
 #include <faabric/runner/FaabricMain.h>
 #include <faabric/util/logging.h>
+#include <conf/FaasmConfig.h>
 #include <faaslet/Faaslet.h>
+#include <storage/ArtifactServer.h>
 #include <storage/S3Wrapper.h>
+#include <wasm/workflows.h>
 
 int main()
 {
@@ -17,12 +20,22 @@ int main()
         faabric::runner::FaabricMain m(fac);
         m.startBackground();
 
+        // Receive invalidations from the upload server, and serve cached
+        // artifacts to other workers if peer fetching is enabled
+        const conf::FaasmConfig& faasmConf = conf::getFaasmConfig();
+        storage::ArtifactServer artifactServer(faasmConf.artifactServerPort);
+        storage::setInvalidationHandlers(faaslet::invalidateFunction,
+                                         faaslet::invalidateSharedFile);
+        artifactServer.start();
+
         // Start endpoint (will also have multiple threads)
         SPDLOG_INFO("Starting endpoint");
         faabric::endpoint::FaabricEndpoint endpoint;
         endpoint.start(faabric::endpoint::EndpointMode::SIGNAL);
 
         SPDLOG_INFO("Shutting down");
+        artifactServer.stop();
+        wasm::shutdownWorkflows();
         m.shutdown();
     }
 
@@ -0,0 +1,103 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/util/logging.h>
+#include <faabric/util/string_tools.h>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+po::variables_map parseCmdLine(int argc, char* argv[])
+{
+    // Define command line arguments
+    po::options_description desc("Allowed options");
+    desc.add_options()(
+      "type",
+      po::value<std::string>(),
+      "artifact type to train a dictionary for: wasm, object or aot")(
+      "dict-size",
+      po::value<size_t>()->default_value(ARTIFACT_DICT_DEFAULT_SIZE),
+      "maximum dictionary size in bytes")(
+      "max-samples",
+      po::value<size_t>()->default_value(1000),
+      "maximum number of artifacts to sample");
+
+    // Mark type as positional argument
+    po::positional_options_description p;
+    p.add("type", 1);
+
+    // Parse command line arguments
+    po::variables_map vm;
+    po::store(
+      po::command_line_parser(argc, argv).options(desc).positional(p).run(),
+      vm);
+    po::notify(vm);
+
+    return vm;
+}
+
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    storage::initFaasmS3();
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    auto vm = parseCmdLine(argc, argv);
+    if (vm.find("type") == vm.end()) {
+        SPDLOG_ERROR("Must provide an artifact type");
+        return 1;
+    }
+
+    std::string typeName = vm["type"].as<std::string>();
+    size_t dictSize = vm["dict-size"].as<size_t>();
+    size_t maxSamples = vm["max-samples"].as<size_t>();
+
+    storage::ArtifactType type;
+    std::string suffix;
+    if (typeName == "wasm") {
+        type = storage::WASM_ARTIFACT;
+        suffix = ".wasm";
+    } else if (typeName == "object") {
+        type = storage::OBJECT_ARTIFACT;
+        suffix = ".o";
+    } else if (typeName == "aot") {
+        type = storage::AOT_ARTIFACT;
+        suffix = ".aot";
+    } else {
+        SPDLOG_ERROR("Unrecognised artifact type: {}", typeName);
+        return 1;
+    }
+
+    // Sample existing artifacts of this type from storage
+    storage::S3Wrapper s3;
+    std::vector<std::vector<uint8_t>> samples;
+    for (const auto& key : s3.listKeys(conf.s3Bucket)) {
+        if (samples.size() >= maxSamples) {
+            break;
+        }
+
+        if (!faabric::util::endsWith(key, suffix)) {
+            continue;
+        }
+
+        samples.emplace_back(
+          storage::decompressArtifact(s3.getKeyBytes(conf.s3Bucket, key)));
+    }
+
+    if (samples.empty()) {
+        SPDLOG_ERROR("No {} artifacts found to train on", typeName);
+        return 1;
+    }
+
+    SPDLOG_INFO("Training {} artifact dictionary on {} samples",
+                typeName,
+                samples.size());
+    std::vector<uint8_t> dict =
+      storage::trainArtifactDictionary(samples, dictSize);
+    storage::uploadArtifactDictionary(type, dict);
+
+    storage::shutdownFaasmS3();
+    return 0;
+}
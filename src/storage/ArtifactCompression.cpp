@@ -0,0 +1,304 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <zdict.h>
+#include <zstd.h>
+
+namespace storage {
+
+struct ArtifactCDict
+{
+    int level = 0;
+    std::shared_ptr<ZSTD_CDict> cDict = nullptr;
+};
+
+static std::shared_mutex dictsMx;
+static std::unordered_map<uint32_t, ArtifactCDict> cDicts;
+static std::unordered_map<uint32_t, std::shared_ptr<ZSTD_DDict>> dDicts;
+
+static std::string getDictTypeKey(ArtifactType type)
+{
+    return ARTIFACT_DICT_KEY_PREFIX + getArtifactTypeName(type);
+}
+
+static std::string getDictIdKey(uint32_t dictId)
+{
+    return ARTIFACT_DICT_KEY_PREFIX + std::to_string(dictId);
+}
+
+static void checkZstdResult(size_t res, const std::string& context)
+{
+    if (ZSTD_isError(res)) {
+        std::string errorMsg =
+          fmt::format("Failed to {}: {}", context, ZSTD_getErrorName(res));
+        SPDLOG_ERROR(errorMsg);
+        throw std::runtime_error(errorMsg);
+    }
+}
+
+std::string getArtifactTypeName(ArtifactType type)
+{
+    switch (type) {
+        case (WASM_ARTIFACT):
+            return "wasm";
+        case (OBJECT_ARTIFACT):
+            return "object";
+        case (AOT_ARTIFACT):
+            return "aot";
+        default:
+            return "generic";
+    }
+}
+
+bool isCompressedArtifact(const std::vector<uint8_t>& bytes)
+{
+    return bytes.size() >= sizeof(CompressedArtifactHeader) &&
+           std::memcmp(bytes.data(), COMPRESSED_ARTIFACT_MAGIC, 8) == 0;
+}
+
+// Returns the compression dictionary for the given type, or nullptr if none
+// has been trained. Missing dictionaries are cached too, so we only check S3
+// once per type. We don't hold the lock while fetching from S3, so loading one
+// dictionary doesn't hold up (de)compression with others. If two threads race
+// to load the same dictionary, the first one in is kept.
+static std::shared_ptr<ZSTD_CDict> getCDict(ArtifactType type, int level)
+{
+    {
+        faabric::util::SharedLock lock(dictsMx);
+        auto it = cDicts.find(type);
+        if (it != cDicts.end() && it->second.level == level) {
+            return it->second.cDict;
+        }
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    S3Wrapper s3;
+    std::vector<uint8_t> dict =
+      s3.getKeyBytes(conf.s3Bucket, getDictTypeKey(type), true);
+
+    std::shared_ptr<ZSTD_CDict> cDict = nullptr;
+    if (dict.empty()) {
+        SPDLOG_DEBUG("No zstd dictionary for {} artifacts",
+                     getArtifactTypeName(type));
+    } else {
+        SPDLOG_DEBUG("Loaded {} byte zstd dictionary for {} artifacts",
+                     dict.size(),
+                     getArtifactTypeName(type));
+        cDict = std::shared_ptr<ZSTD_CDict>(
+          ZSTD_createCDict(dict.data(), dict.size(), level), ZSTD_freeCDict);
+    }
+
+    faabric::util::FullLock lock(dictsMx);
+    auto it = cDicts.find(type);
+    if (it != cDicts.end() && it->second.level == level) {
+        return it->second.cDict;
+    }
+
+    ArtifactCDict& entry = cDicts[type];
+    entry.level = level;
+    entry.cDict = cDict;
+
+    return entry.cDict;
+}
+
+static std::shared_ptr<ZSTD_DDict> getDDict(uint32_t dictId)
+{
+    {
+        faabric::util::SharedLock lock(dictsMx);
+        auto it = dDicts.find(dictId);
+        if (it != dDicts.end()) {
+            return it->second;
+        }
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    S3Wrapper s3;
+    std::vector<uint8_t> dict =
+      s3.getKeyBytes(conf.s3Bucket, getDictIdKey(dictId), true);
+    if (dict.empty()) {
+        std::string errorMsg =
+          fmt::format("Missing zstd dictionary {} for artifact", dictId);
+        SPDLOG_ERROR(errorMsg);
+        throw std::runtime_error(errorMsg);
+    }
+
+    auto dDict = std::shared_ptr<ZSTD_DDict>(
+      ZSTD_createDDict(dict.data(), dict.size()), ZSTD_freeDDict);
+
+    faabric::util::FullLock lock(dictsMx);
+    auto [it, inserted] = dDicts.try_emplace(dictId, dDict);
+
+    return it->second;
+}
+
+std::vector<uint8_t> compressArtifact(const std::vector<uint8_t>& bytes,
+                                      ArtifactType type)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.artifactCompression != "on") {
+        return bytes;
+    }
+
+    static thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)>
+      cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+
+    size_t headerSize = sizeof(CompressedArtifactHeader);
+    std::vector<uint8_t> result(headerSize + ZSTD_compressBound(bytes.size()));
+
+    CompressedArtifactHeader header;
+    std::memcpy(header.magic, COMPRESSED_ARTIFACT_MAGIC, 8);
+    header.version = COMPRESSED_ARTIFACT_VERSION;
+    header.type = type;
+    std::memcpy(result.data(), &header, headerSize);
+
+    int level = conf.artifactCompressionLevel;
+    std::shared_ptr<ZSTD_CDict> cDict = getCDict(type, level);
+
+    size_t compressedSize;
+    if (cDict != nullptr) {
+        compressedSize = ZSTD_compress_usingCDict(cctx.get(),
+                                                  result.data() + headerSize,
+                                                  result.size() - headerSize,
+                                                  bytes.data(),
+                                                  bytes.size(),
+                                                  cDict.get());
+    } else {
+        compressedSize = ZSTD_compressCCtx(cctx.get(),
+                                           result.data() + headerSize,
+                                           result.size() - headerSize,
+                                           bytes.data(),
+                                           bytes.size(),
+                                           level);
+    }
+    checkZstdResult(compressedSize, "compress artifact");
+
+    result.resize(headerSize + compressedSize);
+
+    SPDLOG_TRACE("Compressed {} artifact from {} to {} bytes",
+                 getArtifactTypeName(type),
+                 bytes.size(),
+                 result.size());
+
+    return result;
+}
+
+std::vector<uint8_t> decompressArtifact(const std::vector<uint8_t>& bytes)
+{
+    if (!isCompressedArtifact(bytes)) {
+        return bytes;
+    }
+
+    static thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)>
+      dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+    size_t headerSize = sizeof(CompressedArtifactHeader);
+    const uint8_t* frame = bytes.data() + headerSize;
+    size_t frameSize = bytes.size() - headerSize;
+
+    unsigned long long rawSize = ZSTD_getFrameContentSize(frame, frameSize);
+    if (rawSize == ZSTD_CONTENTSIZE_ERROR ||
+        rawSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+        SPDLOG_ERROR("Invalid compressed artifact ({} bytes)", bytes.size());
+        throw std::runtime_error("Invalid compressed artifact");
+    }
+
+    if (rawSize > ARTIFACT_MAX_RAW_SIZE) {
+        SPDLOG_ERROR("Compressed artifact too large ({} > {} bytes)",
+                     rawSize,
+                     ARTIFACT_MAX_RAW_SIZE);
+        throw std::runtime_error("Compressed artifact too large");
+    }
+
+    std::vector<uint8_t> result(rawSize);
+
+    size_t actualSize;
+    uint32_t dictId = ZSTD_getDictID_fromFrame(frame, frameSize);
+    if (dictId != 0) {
+        std::shared_ptr<ZSTD_DDict> dDict = getDDict(dictId);
+        actualSize = ZSTD_decompress_usingDDict(dctx.get(),
+                                                result.data(),
+                                                result.size(),
+                                                frame,
+                                                frameSize,
+                                                dDict.get());
+    } else {
+        actualSize = ZSTD_decompressDCtx(
+          dctx.get(), result.data(), result.size(), frame, frameSize);
+    }
+    checkZstdResult(actualSize, "decompress artifact");
+
+    result.resize(actualSize);
+    return result;
+}
+
+std::vector<uint8_t> trainArtifactDictionary(
+  const std::vector<std::vector<uint8_t>>& samples,
+  size_t dictSize)
+{
+    // Training takes all the samples concatenated in one buffer
+    std::vector<uint8_t> samplesBuffer;
+    std::vector<size_t> sampleSizes;
+    for (const auto& s : samples) {
+        samplesBuffer.insert(samplesBuffer.end(), s.begin(), s.end());
+        sampleSizes.emplace_back(s.size());
+    }
+
+    std::vector<uint8_t> dict(dictSize);
+    size_t actualSize = ZDICT_trainFromBuffer(dict.data(),
+                                              dict.size(),
+                                              samplesBuffer.data(),
+                                              sampleSizes.data(),
+                                              sampleSizes.size());
+    if (ZDICT_isError(actualSize)) {
+        std::string errorMsg =
+          fmt::format("Failed to train zstd dictionary from {} samples: {}",
+                      samples.size(),
+                      ZDICT_getErrorName(actualSize));
+        SPDLOG_ERROR(errorMsg);
+        throw std::runtime_error(errorMsg);
+    }
+
+    dict.resize(actualSize);
+    return dict;
+}
+
+void uploadArtifactDictionary(ArtifactType type,
+                              const std::vector<uint8_t>& dict)
+{
+    uint32_t dictId = ZDICT_getDictID(dict.data(), dict.size());
+    if (dictId == 0) {
+        SPDLOG_ERROR("Uploading invalid zstd dictionary for {} artifacts",
+                     getArtifactTypeName(type));
+        throw std::runtime_error("Invalid zstd dictionary");
+    }
+
+    SPDLOG_INFO("Uploading zstd dictionary {} for {} artifacts ({} bytes)",
+                dictId,
+                getArtifactTypeName(type),
+                dict.size());
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    S3Wrapper s3;
+    s3.addKeyBytes(conf.s3Bucket, getDictIdKey(dictId), dict);
+    s3.addKeyBytes(conf.s3Bucket, getDictTypeKey(type), dict);
+
+    faabric::util::FullLock lock(dictsMx);
+    cDicts.erase(type);
+}
+
+void clearArtifactDictionaries()
+{
+    faabric::util::FullLock lock(dictsMx);
+    cDicts.clear();
+    dDicts.clear();
+}
+}
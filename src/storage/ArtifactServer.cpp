@@ -0,0 +1,441 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactServer.h>
+#include <storage/FileLoader.h>
+
+#include <faabric/planner/PlannerClient.h>
+#include <faabric/util/config.h>
+#include <faabric/util/files.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/string_tools.h>
+#include <faabric/util/timing.h>
+
+#include <cpprest/http_client.h>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <filesystem>
+#include <netdb.h>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_set>
+
+using namespace web::http;
+using namespace web::http::client;
+using namespace web::http::experimental::listener;
+
+namespace storage {
+
+static std::shared_mutex peersMx;
+static std::vector<std::string> peersOverride;
+static std::vector<std::string> cachedPeers;
+static faabric::util::TimePoint peersRefreshed;
+static bool peersFetched = false;
+
+static std::shared_mutex handlersMx;
+static FunctionInvalidationHandler functionInvalidationHandler;
+static SharedFileInvalidationHandler sharedFileInvalidationHandler;
+
+// Checks the requested path is a file inside one of the cache directories,
+// after following any symlinks, so the server can't be used to read arbitrary
+// files
+static bool isServablePath(const std::string& path)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    for (const auto& dir :
+         { conf.functionDir, conf.objectFileDir, conf.sharedFilesDir }) {
+        if (isPathInside(dir, path)) {
+            return std::filesystem::is_regular_file(path);
+        }
+    }
+
+    return false;
+}
+
+static bool isTrustedSender(const std::string& address);
+
+ArtifactServer::ArtifactServer(int portIn)
+  : port(portIn)
+{}
+
+ArtifactServer::~ArtifactServer()
+{
+    stop();
+}
+
+void ArtifactServer::start()
+{
+    std::string addr = fmt::format("http://0.0.0.0:{}", port);
+    listener = std::make_unique<http_listener>(addr);
+    listener->support(methods::GET, ArtifactServer::handleGet);
+    listener->support(methods::PUT, ArtifactServer::handlePut);
+    listener->open().wait();
+
+    SPDLOG_INFO("Serving artifacts to peers on port {}", port);
+}
+
+void ArtifactServer::stop()
+{
+    if (listener != nullptr) {
+        SPDLOG_DEBUG("Stopping artifact server on port {}", port);
+        listener->close().wait();
+        listener = nullptr;
+    }
+}
+
+void ArtifactServer::handleGet(const http_request& request)
+{
+    std::string relativeUri = uri::decode(request.relative_uri().path());
+    std::vector<std::string> pathParts = uri::split_path(relativeUri);
+    if (pathParts.size() != 1 || pathParts.at(0) != ARTIFACT_URL_PART) {
+        request.reply(
+          status_codes::BadRequest,
+          fmt::format("Unrecognised GET request to {}", relativeUri));
+        return;
+    }
+
+    http_headers headers = request.headers();
+    if (!headers.has(FILE_PATH_HEADER)) {
+        request.reply(
+          status_codes::BadRequest,
+          fmt::format("Expected file path header {}", FILE_PATH_HEADER));
+        return;
+    }
+
+    // The server always runs to receive invalidations, but only hands out
+    // artifacts when peer fetching is on
+    if (conf::getFaasmConfig().artifactPeerFetch != "on") {
+        request.reply(status_codes::NotFound);
+        return;
+    }
+
+    std::string filePath = headers[FILE_PATH_HEADER];
+    if (!std::filesystem::path(filePath).is_absolute() ||
+        !isServablePath(filePath)) {
+        SPDLOG_TRACE("Peer asked for artifact we don't have: {}", filePath);
+        request.reply(status_codes::NotFound);
+        return;
+    }
+
+    SPDLOG_TRACE("Serving artifact {} to peer", filePath);
+    http_response response(status_codes::OK);
+    response.set_body(faabric::util::readFileToBytes(
+      std::filesystem::weakly_canonical(filePath).string()));
+    request.reply(response);
+}
+
+void ArtifactServer::handlePut(const http_request& request)
+{
+    std::string relativeUri = uri::decode(request.relative_uri().path());
+    std::vector<std::string> pathParts = uri::split_path(relativeUri);
+    if (pathParts.size() < 2 || pathParts.at(0) != INVALIDATE_URL_PART) {
+        request.reply(
+          status_codes::BadRequest,
+          fmt::format("Unrecognised PUT request to {}", relativeUri));
+        return;
+    }
+
+    std::string sender = request.remote_address();
+    if (!isTrustedSender(sender)) {
+        SPDLOG_WARN("Rejecting invalidation {} from unknown host {}",
+                    relativeUri,
+                    sender);
+        request.reply(status_codes::Forbidden);
+        return;
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    faabric::util::SharedLock lock(handlersMx);
+    if (pathParts.at(1) == INVALIDATE_FUNCTION_URL_PART &&
+        pathParts.size() == 4 && isValidPathComponent(pathParts.at(2)) &&
+        isValidPathComponent(pathParts.at(3))) {
+        if (functionInvalidationHandler) {
+            functionInvalidationHandler(pathParts.at(2), pathParts.at(3));
+        }
+    } else if (pathParts.at(1) == INVALIDATE_FILE_URL_PART &&
+               request.headers().has(FILE_PATH_HEADER) &&
+               !resolvePathUnder(conf.sharedFilesDir,
+                                 request.headers()[FILE_PATH_HEADER])
+                  .empty()) {
+        if (sharedFileInvalidationHandler) {
+            sharedFileInvalidationHandler(
+              request.headers()[FILE_PATH_HEADER]);
+        }
+    } else {
+        request.reply(status_codes::BadRequest,
+                      fmt::format("Bad invalidation request {}", relativeUri));
+        return;
+    }
+
+    request.reply(status_codes::OK);
+}
+
+void setInvalidationHandlers(FunctionInvalidationHandler functionHandler,
+                             SharedFileInvalidationHandler sharedFileHandler)
+{
+    faabric::util::FullLock lock(handlersMx);
+    functionInvalidationHandler = std::move(functionHandler);
+    sharedFileInvalidationHandler = std::move(sharedFileHandler);
+}
+
+// Returns all hosts with artifact servers, including this one
+static std::vector<std::string> getArtifactHosts()
+{
+    {
+        faabric::util::SharedLock lock(peersMx);
+        if (!peersOverride.empty()) {
+            return peersOverride;
+        }
+
+        if (peersFetched && faabric::util::getTimeDiffMillis(peersRefreshed) <
+                              ARTIFACT_PEERS_REFRESH_MS) {
+            return cachedPeers;
+        }
+    }
+
+    faabric::util::FullLock lock(peersMx);
+    if (!peersOverride.empty()) {
+        return peersOverride;
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    cachedPeers.clear();
+    for (const auto& host :
+         faabric::planner::getPlannerClient().getAvailableHosts()) {
+        cachedPeers.emplace_back(
+          fmt::format("{}:{}", host.ip(), conf.artifactServerPort));
+    }
+
+    peersRefreshed = faabric::util::startTimer();
+    peersFetched = true;
+
+    return cachedPeers;
+}
+
+// Adds the addresses the host name resolves to, ignoring any port
+static void addHostAddresses(const std::string& hostPort,
+                             std::unordered_set<std::string>& addresses)
+{
+    std::string host = hostPort.substr(0, hostPort.rfind(':'));
+    if (host.empty()) {
+        return;
+    }
+
+    addresses.insert(host);
+
+    struct addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, nullptr, &results) != 0) {
+        return;
+    }
+
+    char buf[INET6_ADDRSTRLEN];
+    for (struct addrinfo* r = results; r != nullptr; r = r->ai_next) {
+        const void* addr = nullptr;
+        if (r->ai_family == AF_INET) {
+            addr = &reinterpret_cast<struct sockaddr_in*>(r->ai_addr)->sin_addr;
+        } else if (r->ai_family == AF_INET6) {
+            addr =
+              &reinterpret_cast<struct sockaddr_in6*>(r->ai_addr)->sin6_addr;
+        }
+
+        if (addr != nullptr &&
+            inet_ntop(r->ai_family, addr, buf, sizeof(buf)) != nullptr) {
+            addresses.insert(buf);
+        }
+    }
+
+    freeaddrinfo(results);
+}
+
+// Invalidations are only accepted from this host, other artifact hosts, and
+// the hosts listed in ARTIFACT_TRUSTED_HOSTS (e.g. the upload server)
+static bool isTrustedSender(const std::string& address)
+{
+    // IPv4 clients of an IPv6 listener show up as mapped addresses
+    std::string sender = address;
+    if (faabric::util::startsWith(sender, "::ffff:")) {
+        sender = sender.substr(7);
+    }
+
+    std::unordered_set<std::string> trusted = { "127.0.0.1", "::1" };
+    addHostAddresses(faabric::util::getSystemConfig().endpointHost + ":",
+                     trusted);
+    for (const auto& host : getArtifactHosts()) {
+        addHostAddresses(host, trusted);
+    }
+
+    std::stringstream ss(conf::getFaasmConfig().artifactTrustedHosts);
+    std::string host;
+    while (std::getline(ss, host, ',')) {
+        if (!host.empty()) {
+            addHostAddresses(host + ":", trusted);
+        }
+    }
+
+    return trusted.contains(sender);
+}
+
+std::vector<std::string> getArtifactPeers()
+{
+    std::vector<std::string> hosts = getArtifactHosts();
+
+    // The override may deliberately include this host when running several
+    // workers in one process
+    {
+        faabric::util::SharedLock lock(peersMx);
+        if (!peersOverride.empty()) {
+            return hosts;
+        }
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    const std::string thisHost =
+      fmt::format("{}:{}",
+                  faabric::util::getSystemConfig().endpointHost,
+                  conf.artifactServerPort);
+    std::erase(hosts, thisHost);
+
+    return hosts;
+}
+
+void setArtifactPeers(const std::vector<std::string>& peers)
+{
+    faabric::util::FullLock lock(peersMx);
+    peersOverride = peers;
+    peersFetched = false;
+}
+
+static void sendInvalidation(const std::string& path,
+                             const std::string& filePath)
+{
+    http_client_config config;
+    config.set_timeout(std::chrono::milliseconds(ARTIFACT_PEER_TIMEOUT_MS));
+
+    for (const auto& host : getArtifactHosts()) {
+        try {
+            http_client client(fmt::format("http://{}", host), config);
+            http_request request(methods::PUT);
+            request.set_request_uri(path);
+            if (!filePath.empty()) {
+                request.headers().add(FILE_PATH_HEADER, filePath);
+            }
+
+            http_response response = client.request(request).get();
+            if (response.status_code() != status_codes::OK) {
+                SPDLOG_WARN("Host {} rejected invalidation {} ({})",
+                            host,
+                            path,
+                            response.status_code());
+            }
+        } catch (std::exception& e) {
+            SPDLOG_WARN(
+              "Failed sending invalidation {} to {}: {}", path, host, e.what());
+        }
+    }
+}
+
+void broadcastFunctionInvalidation(const std::string& user,
+                                   const std::string& func)
+{
+    SPDLOG_INFO("Invalidating {}/{} on all hosts", user, func);
+    sendInvalidation(fmt::format("/{}/{}/{}/{}",
+                                 INVALIDATE_URL_PART,
+                                 INVALIDATE_FUNCTION_URL_PART,
+                                 user,
+                                 func),
+                     "");
+}
+
+void broadcastSharedFileInvalidation(const std::string& path)
+{
+    SPDLOG_INFO("Invalidating shared file {} on all hosts", path);
+    sendInvalidation(
+      fmt::format("/{}/{}", INVALIDATE_URL_PART, INVALIDATE_FILE_URL_PART),
+      path);
+}
+
+static std::vector<uint8_t> getFromPeer(const std::string& peer,
+                                        const std::string& path)
+{
+    http_client_config config;
+    config.set_timeout(std::chrono::milliseconds(ARTIFACT_PEER_TIMEOUT_MS));
+    http_client client(fmt::format("http://{}", peer), config);
+
+    http_request request(methods::GET);
+    request.set_request_uri(fmt::format("/{}", ARTIFACT_URL_PART));
+    request.headers().add(FILE_PATH_HEADER, path);
+
+    http_response response = client.request(request).get();
+    if (response.status_code() != status_codes::OK) {
+        return {};
+    }
+
+    return response.extract_vector().get();
+}
+
+std::vector<uint8_t> getArtifactDigest(const std::vector<uint8_t>& bytes)
+{
+    unsigned int digestLen = EVP_MD_size(EVP_md5());
+    std::vector<uint8_t> digest(digestLen);
+    EVP_Digest(bytes.data(),
+               bytes.size(),
+               digest.data(),
+               &digestLen,
+               EVP_md5(),
+               nullptr);
+
+    return digest;
+}
+
+std::vector<uint8_t> fetchArtifactFromPeers(
+  const std::string& localCachePath,
+  const std::vector<uint8_t>& expectedHash,
+  const std::vector<uint8_t>& expectedDigest)
+{
+    std::vector<std::string> peers = getArtifactPeers();
+
+    // Spread the load across peers
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::shuffle(peers.begin(), peers.end(), gen);
+
+    std::string hashPath = localCachePath + HASH_EXT;
+    for (const auto& peer : peers) {
+        try {
+            // Check the peer's copy is the right version before pulling it
+            if (getFromPeer(peer, hashPath) != expectedHash) {
+                SPDLOG_TRACE("Peer {} has no up-to-date copy of {}",
+                             peer,
+                             localCachePath);
+                continue;
+            }
+
+            std::vector<uint8_t> bytes = getFromPeer(peer, localCachePath);
+            if (getArtifactDigest(bytes) != expectedDigest) {
+                SPDLOG_WARN("Peer {} sent a bad copy of {} ({} bytes)",
+                            peer,
+                            localCachePath,
+                            bytes.size());
+                continue;
+            }
+
+            if (!bytes.empty()) {
+                SPDLOG_DEBUG("Fetched {} from peer {} ({} bytes)",
+                             localCachePath,
+                             peer,
+                             bytes.size());
+                return bytes;
+            }
+        } catch (std::exception& e) {
+            SPDLOG_DEBUG("Failed fetching {} from peer {}: {}",
+                         localCachePath,
+                         peer,
+                         e.what());
+        }
+    }
+
+    return {};
+}
+}
@@ -0,0 +1,144 @@
+#include "DirectoryCache.h"
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <shared_mutex>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace storage {
+
+static std::shared_mutex dirCacheMutex;
+static std::unordered_map<std::string, DirListing> dirCache;
+
+static std::string normalisePath(const std::string& realPath)
+{
+    boost::filesystem::path p =
+      boost::filesystem::path(realPath).lexically_normal();
+
+    // Boost normalises trailing slashes to a trailing "."
+    if (p.filename_is_dot() && p.has_parent_path()) {
+        p = p.parent_path();
+    }
+
+    return p.string();
+}
+
+std::vector<DirEnt> DirectoryCache::readDirectory(const std::string& realPath)
+{
+    int dirFd = ::open(realPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        SPDLOG_ERROR("Failed to open dir {}: {}", realPath, strerror(errno));
+        throw std::runtime_error("Failed to open dir");
+    }
+
+    // Read the native dirents in large batches rather than one at a time
+    std::vector<DirEnt> entries;
+    std::vector<uint8_t> nativeBuf(DIRENT_BATCH_BUFFER_SIZE, 0);
+    while (true) {
+        long nativeBytesRead =
+          ::syscall(SYS_getdents64, dirFd, nativeBuf.data(), nativeBuf.size());
+
+        if (nativeBytesRead < 0) {
+            int readErrno = errno;
+            ::close(dirFd);
+            SPDLOG_ERROR(
+              "Failed to list dir {}: {}", realPath, strerror(readErrno));
+            throw std::runtime_error("Failed to list dir");
+        }
+
+        if (nativeBytesRead == 0) {
+            break;
+        }
+
+        for (long nativeOffset = 0; nativeOffset < nativeBytesRead;) {
+            auto* d =
+              reinterpret_cast<::dirent64*>(nativeBuf.data() + nativeOffset);
+
+            DirEnt nextEnt;
+
+            // We have to set "next" here to specify the offset of this
+            // directory entry. It seems this is only used to be passed
+            // back as the "cookie" value to fd_readdir
+            nextEnt.next = entries.size() + 1;
+
+            nextEnt.type = d->d_type;
+            nextEnt.ino = d->d_ino;
+            nextEnt.path = std::string(d->d_name);
+
+            entries.emplace_back(std::move(nextEnt));
+
+            nativeOffset += d->d_reclen;
+        }
+    }
+
+    ::close(dirFd);
+    SPDLOG_DEBUG("Loaded {} entries for {}", entries.size(), realPath);
+
+    return entries;
+}
+
+DirListing DirectoryCache::getListing(const std::string& realPath)
+{
+    std::string key = normalisePath(realPath);
+
+    {
+        faabric::util::SharedLock lock(dirCacheMutex);
+        auto it = dirCache.find(key);
+        if (it != dirCache.end()) {
+            SPDLOG_TRACE("Using cached listing for {}", key);
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(dirCacheMutex);
+
+    // Check again
+    auto it = dirCache.find(key);
+    if (it != dirCache.end()) {
+        return it->second;
+    }
+
+    auto listing =
+      std::make_shared<const std::vector<DirEnt>>(readDirectory(key));
+    dirCache.emplace(key, listing);
+
+    return listing;
+}
+
+void DirectoryCache::invalidate(const std::string& realPath)
+{
+    std::string key = normalisePath(realPath);
+
+    SPDLOG_TRACE("Invalidating cached listing for {}", key);
+    faabric::util::FullLock lock(dirCacheMutex);
+    dirCache.erase(key);
+}
+
+void DirectoryCache::invalidateParent(const std::string& realPath)
+{
+    boost::filesystem::path p(normalisePath(realPath));
+    if (p.has_parent_path()) {
+        invalidate(p.parent_path().string());
+    }
+}
+
+size_t DirectoryCache::getCachedListingCount()
+{
+    faabric::util::SharedLock lock(dirCacheMutex);
+    return dirCache.size();
+}
+
+void DirectoryCache::clear()
+{
+    faabric::util::FullLock lock(dirCacheMutex);
+    dirCache.clear();
+}
+}
@@ -7,6 +7,8 @@
 #include <faabric/util/timing.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/DirectoryCache.h>
+#include <storage/RuntimeImage.h>
 #include <storage/SharedFiles.h>
 
 #include <WAVM/WASI/WASIABI.h>
@@ -141,7 +143,7 @@ uint16_t errnoToWasi(int errnoIn)
     }
 }
 
-std::string FileDescriptor::getPath()
+std::string FileDescriptor::getPath() const
 {
     return path;
 }
@@ -198,14 +200,13 @@ void FileDescriptor::iterReset()
     // Reset iterator state
     dirContentsLoaded = false;
     dirContentsIdx = 0;
-    dirContents.clear();
+    dirContents = nullptr;
 }
 
 void FileDescriptor::loadDirContents()
 {
-
-    // Work out the local filesystem path
-    std::string realPath;
+    // Shared directories are listed directly, whereas listings in the runtime
+    // root are read-mostly, so we share them through the directory cache
     if (SharedFiles::isPathShared(path)) {
         int pullErr = SharedFiles::syncSharedFile(path);
 
@@ -213,42 +214,19 @@ void FileDescriptor::loadDirContents()
             throw std::runtime_error("Failed to open shared dir");
         }
 
-        realPath = SharedFiles::realPathForSharedFile(path);
+        std::string realPath = SharedFiles::realPathForSharedFile(path);
+        SPDLOG_DEBUG("Loading shared dir contents: {}", realPath);
+        dirContents = std::make_shared<const std::vector<DirEnt>>(
+          DirectoryCache::readDirectory(realPath));
+    } else if (imageEntry != nullptr) {
+        SPDLOG_DEBUG("Loading dir contents from runtime image: {}", path);
+        dirContents = runtimeImage->getListing(imageEntry);
     } else {
-        realPath = prependRuntimeRoot(path);
+        std::string realPath = prependRuntimeRoot(path);
+        SPDLOG_DEBUG("Loading dir contents: {}", realPath);
+        dirContents = DirectoryCache::getListing(realPath);
     }
 
-    // Open the directory
-    SPDLOG_DEBUG("Loading dir contents: {}", realPath);
-    DIR* dirPtr = ::opendir(realPath.c_str());
-    if (dirPtr == nullptr) {
-        throw std::runtime_error("Failed to open dir");
-    }
-
-    // Load all directory entries
-    uint64_t nextIdx = 0;
-    struct dirent* direntPtr;
-    while ((direntPtr = ::readdir(dirPtr)) != nullptr) {
-        nextIdx++;
-
-        DirEnt nextEnt;
-
-        // We have to set "next" here to specify the offset of this
-        // directory entry. It seems this is only used to be passed
-        // back as the "cookie" value to fd_readdir
-        nextEnt.next = nextIdx;
-
-        nextEnt.type = direntPtr->d_type;
-        nextEnt.ino = direntPtr->d_ino;
-        nextEnt.path = std::string(direntPtr->d_name);
-
-        dirContents.push_back(nextEnt);
-    }
-
-    // Close iterator
-    closedir(dirPtr);
-    SPDLOG_DEBUG("Loaded {} entries for {}", dirContents.size(), realPath);
-
     // Set flag
     dirContentsLoaded = true;
 }
@@ -273,7 +251,7 @@ bool FileDescriptor::iterStarted() const
 
 bool FileDescriptor::iterFinished()
 {
-    return dirContentsLoaded && (dirContentsIdx >= dirContents.size());
+    return dirContentsLoaded && (dirContentsIdx >= dirContents->size());
 }
 
 DirEnt FileDescriptor::iterNext()
@@ -288,10 +266,10 @@ DirEnt FileDescriptor::iterNext()
         throw std::runtime_error(
           fmt::format("Accessing index {} in directory length {}",
                       dirContentsIdx,
-                      dirContents.size()));
+                      dirContents->size()));
     }
 
-    DirEnt nextEntry = dirContents.at(dirContentsIdx);
+    DirEnt nextEntry = dirContents->at(dirContentsIdx);
 
     // Increment the iterator
     dirContentsIdx++;
@@ -450,6 +428,29 @@ bool FileDescriptor::pathOpen(uint32_t lookupFlags,
         realPath = prependRuntimeRoot(path);
     }
 
+    // Serve read-only opens from the runtime image if it holds the path,
+    // otherwise fall through to the local filesystem
+    std::shared_ptr<RuntimeImage> image = getRuntimeImage();
+    bool isReadOnlyOpen =
+      !isWrite &&
+      (openMode == OpenMode::DIRECTORY || openMode == OpenMode::NONE);
+    if (image != nullptr && !isShared && isReadOnlyOpen) {
+        const RuntimeImageEntry* entry = image->lookup(path);
+        if (entry != nullptr) {
+            if (openMode == OpenMode::DIRECTORY && !image->isDirectory(entry)) {
+                linuxFd = -1;
+                wasiErrno = __WASI_ENOTDIR;
+                return false;
+            }
+
+            runtimeImage = image;
+            imageEntry = entry;
+            imageOffset = 0;
+            linuxFd = -1;
+            return true;
+        }
+    }
+
     // Attempt to open the local file
     if (realPath == "/dev/urandom") {
         // TODO avoid use of system-wide urandom
@@ -467,6 +468,11 @@ bool FileDescriptor::pathOpen(uint32_t lookupFlags,
         return false;
     }
 
+    // Creating a file may change the listing of its parent directory
+    if (!isShared && (linuxFlags & O_CREAT)) {
+        DirectoryCache::invalidateParent(realPath);
+    }
+
     return true;
 }
 
@@ -480,6 +486,8 @@ bool FileDescriptor::mkdir(const std::string& dirPath)
         return false;
     }
 
+    DirectoryCache::invalidateParent(fullPath);
+
     return true;
 }
 
@@ -488,6 +496,11 @@ bool FileDescriptor::updateFlags(int32_t fdFlags)
     // Update underlying file descriptor
     int32_t newFlags = wasiFdFlagsToLinux(fdFlags);
 
+    if (imageEntry != nullptr) {
+        linuxFlags |= newFlags;
+        return true;
+    }
+
     int res = fcntl(linuxFd, F_SETFL, newFlags);
     if (res < 0) {
         wasiErrno = errnoToWasi(errno);
@@ -521,6 +534,29 @@ ssize_t FileDescriptor::write(std::vector<::iovec>& nativeIovecs,
     return bytesWritten;
 }
 
+ssize_t FileDescriptor::read(std::vector<::iovec>& nativeIovecs, int iovecCount)
+{
+    if (imageEntry == nullptr) {
+        return ::readv(getLinuxFd(), nativeIovecs.data(), iovecCount);
+    }
+
+    // Copy straight out of the mapped image
+    std::span<const uint8_t> data = getImageData();
+    ssize_t bytesRead = 0;
+    for (int i = 0; i < iovecCount && imageOffset < data.size(); i++) {
+        size_t nBytes = std::min<size_t>(nativeIovecs.at(i).iov_len,
+                                         data.size() - imageOffset);
+        std::copy(data.begin() + imageOffset,
+                  data.begin() + imageOffset + nBytes,
+                  BYTES(nativeIovecs.at(i).iov_base));
+
+        imageOffset += nBytes;
+        bytesRead += nBytes;
+    }
+
+    return bytesRead;
+}
+
 void FileDescriptor::close() const
 {
     if (linuxFd > 0) {
@@ -541,6 +577,8 @@ bool FileDescriptor::unlink(const std::string& relativePath)
             wasiErrno = errnoToWasi(errno);
             return false;
         }
+
+        DirectoryCache::invalidateParent(maskedPath);
     }
 
     return true;
@@ -557,6 +595,9 @@ bool FileDescriptor::rmdir(const std::string& relativePath)
         return false;
     }
 
+    DirectoryCache::invalidate(maskedPath);
+    DirectoryCache::invalidateParent(maskedPath);
+
     return true;
 }
 
@@ -574,6 +615,10 @@ bool FileDescriptor::rename(const std::string& newPath,
         return false;
     }
 
+    DirectoryCache::invalidate(fullOldPath);
+    DirectoryCache::invalidateParent(fullOldPath);
+    DirectoryCache::invalidateParent(fullNewPath);
+
     return true;
 }
 
@@ -593,6 +638,15 @@ Stat FileDescriptor::stat(const std::string& relativePath)
         // Work out whether we're stat-ing a shared path
         std::string statPath = absPath(relativePath);
         std::string realPath;
+
+        std::shared_ptr<RuntimeImage> image = getRuntimeImage();
+        if (image != nullptr && !SharedFiles::isPathShared(statPath)) {
+            const RuntimeImageEntry* entry = image->lookup(statPath);
+            if (entry != nullptr) {
+                return image->stat(entry);
+            }
+        }
+
         if (SharedFiles::isPathShared(statPath)) {
             statErrno = SharedFiles::syncSharedFile(statPath);
             if (statErrno == 0) {
@@ -669,7 +723,7 @@ ssize_t FileDescriptor::readLink(const std::string& relativePath,
 
 uint16_t FileDescriptor::seek(int64_t offset,
                               int wasiWhence,
-                              uint64_t* newOffset) const
+                              uint64_t* newOffset)
 {
     int linuxWhence;
     if (wasiWhence == __WASI_WHENCE_SET) {
@@ -682,6 +736,23 @@ uint16_t FileDescriptor::seek(int64_t offset,
         throw std::runtime_error("Unsupported whence");
     }
 
+    if (imageEntry != nullptr) {
+        int64_t base = 0;
+        if (linuxWhence == SEEK_CUR) {
+            base = imageOffset;
+        } else if (linuxWhence == SEEK_END) {
+            base = getImageData().size();
+        }
+
+        if (base + offset < 0) {
+            return __WASI_EINVAL;
+        }
+
+        imageOffset = base + offset;
+        *newOffset = imageOffset;
+        return __WASI_ESUCCESS;
+    }
+
     // Do the seek
     off_t result = ::lseek(linuxFd, offset, linuxWhence);
     if (result < 0) {
@@ -695,6 +766,10 @@ uint16_t FileDescriptor::seek(int64_t offset,
 
 uint64_t FileDescriptor::tell() const
 {
+    if (imageEntry != nullptr) {
+        return imageOffset;
+    }
+
     off_t result = ::lseek(linuxFd, 0, SEEK_CUR);
     return result;
 }
@@ -738,8 +813,12 @@ void FileDescriptor::setActualRights(uint64_t rights, uint64_t inheriting)
 
 int FileDescriptor::duplicate(const FileDescriptor& other)
 {
-    // Duplicate the underlying fd
-    linuxFd = ::dup(other.linuxFd);
+    // Duplicate the underlying fd, files served from the runtime image don't
+    // have one
+    linuxFd = other.imageEntry == nullptr ? ::dup(other.linuxFd) : -1;
+    runtimeImage = other.runtimeImage;
+    imageEntry = other.imageEntry;
+    imageOffset = other.imageOffset;
 
     linuxMode = other.linuxMode;
     linuxFlags = other.linuxFlags;
@@ -757,4 +836,18 @@ int FileDescriptor::duplicate(const FileDescriptor& other)
 
     return linuxFd;
 }
+
+bool FileDescriptor::isImageBacked() const
+{
+    return imageEntry != nullptr;
+}
+
+std::span<const uint8_t> FileDescriptor::getImageData() const
+{
+    if (imageEntry == nullptr) {
+        return {};
+    }
+
+    return runtimeImage->getFileData(imageEntry);
+}
 }
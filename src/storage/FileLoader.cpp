@@ -1,4 +1,6 @@
 #include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
+#include <storage/ArtifactServer.h>
 #include <storage/FileLoader.h>
 #include <storage/SharedFiles.h>
 
@@ -6,8 +8,11 @@
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
+#include <faabric/util/gids.h>
 #include <faabric/util/testing.h>
 
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <stdexcept>
 
@@ -22,6 +27,7 @@ namespace storage {
 #define FUNC_FILENAME "function.wasm"
 #define FUNC_OBJECT_FILENAME "function.wasm.o"
 #define PYTHON_FUNCTION_FILENAME "function.py"
+#define PYTHON_BYTECODE_INDEX_FILENAME "bytecode.idx"
 #define FUNC_ENCRYPTED_FILENAME "function.wasm.enc"
 #define FUNCTION_SYMBOLS_FILENAME "function.symbols"
 #define WAMR_AOT_FILENAME "function.aot"
@@ -83,6 +89,17 @@ static std::string trimLeadingSlashes(const std::string& pathIn)
     return pathOut;
 }
 
+// Writes to a temporary file first, so that other threads and peers never see
+// a partly written file in the cache
+static void writeCacheFile(const std::string& path,
+                           const std::vector<uint8_t>& bytes)
+{
+    std::string tmpPath =
+      fmt::format("{}.tmp{}", path, faabric::util::generateGid());
+    writeBytesToFile(tmpPath, bytes);
+    std::filesystem::rename(tmpPath, path);
+}
+
 static std::string getKey(const faabric::Message& msg,
                           const std::string& filename)
 {
@@ -108,6 +125,53 @@ static std::filesystem::path getDir(std::string baseDir,
     return path;
 }
 
+bool isPathInside(const std::string& root, const std::string& path)
+{
+    std::error_code ec;
+    std::filesystem::path rootPath =
+      std::filesystem::weakly_canonical(root, ec);
+    if (ec) {
+        return false;
+    }
+
+    std::filesystem::path fullPath =
+      std::filesystem::weakly_canonical(path, ec);
+    if (ec) {
+        return false;
+    }
+
+    std::filesystem::path rel = fullPath.lexically_relative(rootPath);
+    return !rel.empty() && rel != "." && *rel.begin() != "..";
+}
+
+std::string resolvePathUnder(const std::string& root, const std::string& path)
+{
+    std::string relPath = trimLeadingSlashes(path);
+    if (relPath.empty()) {
+        return "";
+    }
+
+    std::filesystem::path fullPath(root);
+    fullPath.append(relPath);
+    if (!isPathInside(root, fullPath.string())) {
+        return "";
+    }
+
+    return std::filesystem::weakly_canonical(fullPath).string();
+}
+
+bool isValidPathComponent(const std::string& name)
+{
+    if (name.empty() || name == "." || name == "..") {
+        return false;
+    }
+
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+               c == '-' || c == '.';
+    });
+}
+
 // -------------------------------------
 // MISC CLASS METHODS
 // -------------------------------------
@@ -154,6 +218,35 @@ void FileLoader::clearLocalCache()
     SharedFiles::clear();
 }
 
+void FileLoader::clearLocalCacheForFunction(const faabric::Message& msg)
+{
+    if (!isValidPathComponent(msg.user()) ||
+        !isValidPathComponent(msg.function())) {
+        SPDLOG_ERROR("Invalid function to clear: {}/{}",
+                     msg.user(),
+                     msg.function());
+        throw std::runtime_error("Invalid function to clear");
+    }
+
+    // Removes the wasm, object files and their hashes
+    std::string funcStr = funcToString(msg, false);
+    SPDLOG_DEBUG("Clearing local files for {}", funcStr);
+    std::filesystem::remove_all(getDir(conf.functionDir, msg, false));
+    std::filesystem::remove_all(getDir(conf.objectFileDir, msg, false));
+}
+
+void FileLoader::clearLocalCacheForSharedFile(const std::string& path)
+{
+    std::string localPath = resolvePathUnder(conf.sharedFilesDir, path);
+    if (localPath.empty()) {
+        SPDLOG_ERROR("Invalid shared file to clear: {}", path);
+        throw std::runtime_error("Invalid shared file to clear");
+    }
+
+    SPDLOG_DEBUG("Clearing local copy of shared file {}", path);
+    std::filesystem::remove(localPath);
+}
+
 // -------------------------------------
 // SHARED LOAD/ UPLOAD
 // -------------------------------------
@@ -161,7 +254,8 @@ void FileLoader::clearLocalCache()
 std::vector<uint8_t> FileLoader::loadFileBytes(
   const std::string& path,
   const std::string& localCachePath,
-  bool tolerateMissing)
+  bool tolerateMissing,
+  bool isArtifact)
 {
     SPDLOG_TRACE("Loading file {} ({})", path, localCachePath);
 
@@ -177,35 +271,135 @@ std::vector<uint8_t> FileLoader::loadFileBytes(
         return readFileToBytes(localCachePath);
     }
 
-    // Load from S3 if not found
+    // Load from S3 if not found. Artifacts may be stored compressed, but are
+    // always cached locally decompressed. Other files are left as they are,
+    // whatever they start with.
     std::string pathCopy = trimLeadingSlashes(path);
     std::vector<uint8_t> bytes =
       s3.getKeyBytes(conf.s3Bucket, pathCopy, tolerateMissing);
+    if (isArtifact) {
+        bytes = decompressArtifact(bytes);
+    }
 
     if (!bytes.empty() && useLocalFsCache) {
         SPDLOG_TRACE("Caching S3 key {}/{} at {}",
                      conf.s3Bucket,
                      pathCopy,
                      localCachePath);
-        writeBytesToFile(localCachePath, bytes);
+        writeCacheFile(localCachePath, bytes);
+    }
+
+    return bytes;
+}
+
+std::vector<uint8_t> FileLoader::loadArtifactBytes(
+  const std::string& path,
+  const std::string& localCachePath)
+{
+    if (conf.artifactPeerFetch != "on" ||
+        (useLocalFsCache && std::filesystem::exists(localCachePath))) {
+        return loadFileBytes(path, localCachePath, false, true);
+    }
+
+    // Load the hash first. This both tells us which version peers must hold,
+    // and caches the hash locally so that we can serve the artifact to peers
+    // in turn
+    std::vector<uint8_t> expectedHash =
+      loadHashFileBytes(path, localCachePath);
+
+    // The digest of the artifact itself lets us check what peers send us
+    std::vector<uint8_t> expectedDigest = loadFileBytes(
+      path + DIGEST_EXT, localCachePath + DIGEST_EXT, true);
+    if (expectedHash.empty() || expectedDigest.empty()) {
+        return loadFileBytes(path, localCachePath, false, true);
+    }
+
+    std::vector<uint8_t> bytes =
+      fetchArtifactFromPeers(localCachePath, expectedHash, expectedDigest);
+    if (bytes.empty()) {
+        SPDLOG_TRACE("No peer has {}, falling back to S3", path);
+        return loadFileBytes(path, localCachePath, false, true);
+    }
+
+    if (useLocalFsCache) {
+        writeCacheFile(localCachePath, bytes);
     }
 
     return bytes;
 }
 
+std::vector<std::vector<uint8_t>> FileLoader::loadFilesBytes(
+  const std::vector<std::string>& paths,
+  const std::vector<std::string>& localCachePaths,
+  bool tolerateMissing)
+{
+    std::vector<std::vector<uint8_t>> results(paths.size());
+
+    // Serve what we can from the local cache, and fetch the rest from S3 in
+    // one batch
+    std::vector<size_t> s3Idxs;
+    std::vector<std::string> s3Keys;
+    for (size_t i = 0; i < paths.size(); i++) {
+        const std::string& localCachePath = localCachePaths.at(i);
+        if (useLocalFsCache && std::filesystem::exists(localCachePath)) {
+            if (std::filesystem::is_directory(localCachePath)) {
+                SPDLOG_ERROR("Local cache path ({}) exists but is a directory",
+                             localCachePath);
+                throw SharedFileIsDirectoryException(localCachePath);
+            }
+
+            results.at(i) = readFileToBytes(localCachePath);
+            continue;
+        }
+
+        s3Idxs.emplace_back(i);
+        s3Keys.emplace_back(trimLeadingSlashes(paths.at(i)));
+    }
+
+    if (s3Keys.empty()) {
+        return results;
+    }
+
+    SPDLOG_TRACE("Loading {}/{} files from S3", s3Keys.size(), paths.size());
+    std::vector<std::vector<uint8_t>> s3Results =
+      s3.getKeysBytes(conf.s3Bucket, s3Keys, tolerateMissing);
+
+    for (size_t j = 0; j < s3Idxs.size(); j++) {
+        size_t i = s3Idxs.at(j);
+        results.at(i) = std::move(s3Results.at(j));
+
+        if (!results.at(i).empty() && useLocalFsCache) {
+            writeCacheFile(localCachePaths.at(i), results.at(i));
+        }
+    }
+
+    return results;
+}
+
 void FileLoader::uploadFileBytes(const std::string& path,
                                  const std::string& localCachePath,
-                                 const std::vector<uint8_t>& bytes)
+                                 const std::vector<uint8_t>& bytes,
+                                 ArtifactType type)
 {
     std::string pathCopy = trimLeadingSlashes(path);
-    s3.addKeyBytes(conf.s3Bucket, pathCopy, bytes);
+    if (type == GENERIC_ARTIFACT) {
+        s3.addKeyBytes(conf.s3Bucket, pathCopy, bytes);
+    } else {
+        s3.addKeyBytes(conf.s3Bucket, pathCopy, compressArtifact(bytes, type));
+
+        // Peers' copies of the artifact are checked against its digest
+        std::string digestCachePath =
+          localCachePath.empty() ? "" : localCachePath + DIGEST_EXT;
+        uploadFileBytes(
+          path + DIGEST_EXT, digestCachePath, getArtifactDigest(bytes));
+    }
 
     if (useLocalFsCache && !localCachePath.empty()) {
         SPDLOG_TRACE("Caching S3 key {}/{} at {}",
                      conf.s3Bucket,
                      pathCopy,
                      localCachePath);
-        writeBytesToFile(localCachePath, bytes);
+        writeCacheFile(localCachePath, bytes);
     }
 }
 
@@ -223,7 +417,7 @@ void FileLoader::uploadFileString(const std::string& path,
                      conf.s3Bucket,
                      pathCopy,
                      localCachePath);
-        writeBytesToFile(localCachePath, stringToBytes(bytes));
+        writeCacheFile(localCachePath, stringToBytes(bytes));
     }
 }
 
@@ -267,7 +461,7 @@ std::vector<uint8_t> FileLoader::loadFunctionWasm(const faabric::Message& msg)
 {
     const std::string key = getKey(msg, FUNC_FILENAME);
     const std::string localCachePath = getFunctionFile(msg);
-    return loadFileBytes(key, localCachePath);
+    return loadFileBytes(key, localCachePath, false, true);
 }
 
 void FileLoader::uploadFunction(faabric::Message& msg)
@@ -277,7 +471,8 @@ void FileLoader::uploadFunction(faabric::Message& msg)
 
     // Note, when uploading, the input data is the function body
     const std::string& inputBytes = msg.inputdata();
-    uploadFileString(key, localCachePath, inputBytes);
+    uploadFileBytes(
+      key, localCachePath, stringToBytes(inputBytes), WASM_ARTIFACT);
 }
 
 // -------------------------------------
@@ -296,7 +491,7 @@ std::vector<uint8_t> FileLoader::loadFunctionObjectFile(
 {
     const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
     const std::string localCachePath = getFunctionObjectFile(msg);
-    return loadFileBytes(key, localCachePath);
+    return loadArtifactBytes(key, localCachePath);
 }
 
 std::vector<uint8_t> FileLoader::loadFunctionObjectHash(
@@ -312,7 +507,7 @@ void FileLoader::uploadFunctionObjectFile(const faabric::Message& msg,
 {
     const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
     const std::string localCachePath = getFunctionObjectFile(msg);
-    uploadFileBytes(key, localCachePath, objBytes);
+    uploadFileBytes(key, localCachePath, objBytes, OBJECT_ARTIFACT);
 }
 
 void FileLoader::uploadFunctionObjectHash(const faabric::Message& msg,
@@ -353,7 +548,7 @@ std::vector<uint8_t> FileLoader::loadFunctionWamrAotFile(
 {
     const std::string key = getWamrAotKey(msg);
     const std::string localCachePath = getFunctionAotFile(msg);
-    return loadFileBytes(key, localCachePath);
+    return loadArtifactBytes(key, localCachePath);
 }
 
 std::vector<uint8_t> FileLoader::loadFunctionWamrAotHash(
@@ -369,7 +564,7 @@ void FileLoader::uploadFunctionWamrAotFile(const faabric::Message& msg,
 {
     const std::string key = getWamrAotKey(msg);
     const std::string localCachePath = getFunctionAotFile(msg);
-    uploadFileBytes(key, localCachePath, objBytes);
+    uploadFileBytes(key, localCachePath, objBytes, AOT_ARTIFACT);
 }
 
 void FileLoader::uploadFunctionWamrAotHash(const faabric::Message& msg,
@@ -443,7 +638,7 @@ std::vector<uint8_t> FileLoader::loadSharedObjectObjectFile(
   const std::string& path)
 {
     const std::string localCachePath = getSharedObjectObjectFile(path);
-    return loadFileBytes(path, localCachePath);
+    return loadArtifactBytes(path, localCachePath);
 }
 
 std::vector<uint8_t> FileLoader::loadSharedObjectObjectHash(
@@ -458,7 +653,7 @@ void FileLoader::uploadSharedObjectObjectFile(
   const std::vector<uint8_t>& objBytes)
 {
     const std::string localCachePath = getSharedObjectObjectFile(path);
-    uploadFileBytes(path, localCachePath, objBytes);
+    uploadFileBytes(path, localCachePath, objBytes, OBJECT_ARTIFACT);
 }
 
 void FileLoader::uploadSharedObjectObjectHash(const std::string& path,
@@ -496,6 +691,23 @@ std::vector<uint8_t> FileLoader::loadSharedFile(const std::string& path)
     return bytes;
 }
 
+std::string FileLoader::getSharedFileETag(const std::string& path)
+{
+    return s3.getKeyETag(conf.s3Bucket, trimLeadingSlashes(path));
+}
+
+std::vector<std::vector<uint8_t>> FileLoader::loadSharedFiles(
+  const std::vector<std::string>& paths)
+{
+    std::vector<std::string> localCachePaths;
+    localCachePaths.reserve(paths.size());
+    for (const auto& path : paths) {
+        localCachePaths.emplace_back(getSharedFileFile(path));
+    }
+
+    return loadFilesBytes(paths, localCachePaths, true);
+}
+
 void FileLoader::deleteSharedFile(const std::string& path)
 {
     std::string pathCopy = trimLeadingSlashes(path);
@@ -561,6 +773,26 @@ std::string FileLoader::getPythonFunctionFile(const faabric::Message& msg)
     return getSharedFileFile(getPythonFunctionRelativePath(msg));
 }
 
+std::string FileLoader::getPythonBytecodeIndexRelativePath(
+  const faabric::Message& msg)
+{
+    std::filesystem::path path(getPythonFunctionRelativePath(msg));
+    path.replace_filename(PYTHON_BYTECODE_INDEX_FILENAME);
+    return path.string();
+}
+
+bool FileLoader::isPythonBytecodeRelativePath(const faabric::Message& msg,
+                                              const std::string& pycPath)
+{
+    std::filesystem::path path(pycPath);
+    std::filesystem::path cacheDir(getPythonFunctionRelativePath(msg));
+    cacheDir.replace_filename("__pycache__");
+
+    return !path.is_absolute() && path.parent_path() == cacheDir &&
+           path.extension() == ".pyc" &&
+           isValidPathComponent(path.filename().string());
+}
+
 void FileLoader::uploadPythonFunction(faabric::Message& msg)
 {
     // Note that Python functions are handled like shared files
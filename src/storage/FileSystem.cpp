@@ -7,36 +7,87 @@
 #include <boost/filesystem.hpp>
 
 #include <faabric/util/config.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 
 namespace storage {
-void FileSystem::prepareFilesystem()
+
+// Root file descriptors are predefined as those just above the stdxxx's
+#define ROOT_FD 3
+#define DOT_FD 4
+#define FIRST_FREE_FD 5
+
+struct SharedFileDescriptors
 {
-    // Clear existing file descriptors if any
-    fileDescriptors.clear();
+    std::string runtimeFilesDir;
+    std::string runtimeImagePath;
+
+    std::vector<std::shared_ptr<FileDescriptor>> fds;
+};
+
+static std::mutex sharedFdsMx;
+static std::shared_ptr<SharedFileDescriptors> sharedFds;
+
+/**
+ * The stdio and preopened root descriptors are opened once per process and
+ * shared by all modules. Because they are held copy-on-write, modules never
+ * modify the shared copies.
+ */
+static std::shared_ptr<SharedFileDescriptors> getSharedFileDescriptors()
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    faabric::util::UniqueLock lock(sharedFdsMx);
+    if (sharedFds != nullptr &&
+        sharedFds->runtimeFilesDir == conf.runtimeFilesDir &&
+        sharedFds->runtimeImagePath == conf.runtimeImagePath) {
+        return sharedFds;
+    }
+
+    auto newFds = std::make_shared<SharedFileDescriptors>();
+    newFds->runtimeFilesDir = conf.runtimeFilesDir;
+    newFds->runtimeImagePath = conf.runtimeImagePath;
+
+    newFds->fds.emplace_back(std::make_shared<FileDescriptor>(
+      storage::FileDescriptor::stdinFactory()));
+    newFds->fds.emplace_back(std::make_shared<FileDescriptor>(
+      storage::FileDescriptor::stdoutFactory()));
+    newFds->fds.emplace_back(std::make_shared<FileDescriptor>(
+      storage::FileDescriptor::stderrFactory()));
+
+    newFds->fds.emplace_back(FileSystem::createPreopenedFileDescriptor("/"));
+    newFds->fds.emplace_back(FileSystem::createPreopenedFileDescriptor("."));
+
+    // Close the descriptors being replaced. Any modules still holding
+    // them will have been bound to a previous runtime root
+    if (sharedFds != nullptr) {
+        for (int i = ROOT_FD; i < FIRST_FREE_FD; i++) {
+            sharedFds->fds.at(i)->close();
+        }
+    }
 
-    // Predefined stdin, stdout and stderr
-    fileDescriptors.emplace(0, storage::FileDescriptor::stdinFactory());
-    fileDescriptors.emplace(1, storage::FileDescriptor::stdoutFactory());
-    fileDescriptors.emplace(2, storage::FileDescriptor::stderrFactory());
+    sharedFds = newFds;
+    return sharedFds;
+}
 
-    // Add roots, note that they are predefined as the file descriptors
-    // just above the stdxxx's (i.e. > 3)
-    createPreopenedFileDescriptor(3, "/");
-    createPreopenedFileDescriptor(4, ".");
+void FileSystem::prepareFilesystem()
+{
+    // Reset to the shared stdin, stdout, stderr and preopened roots
+    fileDescriptors = getSharedFileDescriptors()->fds;
 
     // Set the starting point for subsequent file descriptors
-    nextFd = 5;
+    nextFd = FIRST_FREE_FD;
 }
 
-void FileSystem::createPreopenedFileDescriptor(int fd, const std::string& path)
+std::shared_ptr<FileDescriptor> FileSystem::createPreopenedFileDescriptor(
+  const std::string& path)
 {
     // Open the descriptor as a directory
-    storage::FileDescriptor fileDesc;
-    fileDesc.setPath(path);
-    fileDesc.setActualRights(DIRECTORY_RIGHTS, INHERITING_DIRECTORY_RIGHTS);
+    auto fileDesc = std::make_shared<storage::FileDescriptor>();
+    fileDesc->setPath(path);
+    fileDesc->setActualRights(DIRECTORY_RIGHTS, INHERITING_DIRECTORY_RIGHTS);
 
-    bool success = fileDesc.pathOpen(0, __WASI_O_DIRECTORY, 0);
+    bool success = fileDesc->pathOpen(0, __WASI_O_DIRECTORY, 0);
 
     if (!success) {
         const std::string realSysPath = prependRuntimeRoot(path);
@@ -44,16 +95,27 @@ void FileSystem::createPreopenedFileDescriptor(int fd, const std::string& path)
           "Failed on preopened fd at {} (system path {}). Error: {} ",
           path,
           realSysPath,
-          strerror(fileDesc.getLinuxErrno()));
+          strerror(fileDesc->getLinuxErrno()));
         throw std::runtime_error("Problem opening preopened fd");
 
     } else {
         SPDLOG_DEBUG("Opened preopened fd at {}", path);
     }
 
-    // Add to this module's fds
-    fileDesc.wasiPreopenType = __WASI_PREOPENTYPE_DIR;
-    fileDescriptors.emplace(fd, fileDesc);
+    fileDesc->wasiPreopenType = __WASI_PREOPENTYPE_DIR;
+    return fileDesc;
+}
+
+void FileSystem::clearSharedFileDescriptors()
+{
+    faabric::util::UniqueLock lock(sharedFdsMx);
+    if (sharedFds != nullptr) {
+        for (int i = ROOT_FD; i < FIRST_FREE_FD; i++) {
+            sharedFds->fds.at(i)->close();
+        }
+    }
+
+    sharedFds = nullptr;
 }
 
 int FileSystem::getNewFd()
@@ -61,16 +123,31 @@ int FileSystem::getNewFd()
     // Assign a new file descriptor
     int thisFd = nextFd;
     nextFd++;
+
+    if (fileDescriptors.size() <= (size_t)thisFd) {
+        fileDescriptors.resize(thisFd + 1);
+    }
+
     return thisFd;
 }
 
+const storage::FileDescriptor* FileSystem::peekFileDescriptor(int fd) const
+{
+    if (fd < 0 || (size_t)fd >= fileDescriptors.size()) {
+        return nullptr;
+    }
+
+    return fileDescriptors[fd].get();
+}
+
 std::string FileSystem::getPathForFd(int fd)
 {
-    if (fileDescriptors.count(fd) == 0) {
+    const FileDescriptor* fileDesc = peekFileDescriptor(fd);
+    if (fileDesc == nullptr) {
         return "";
     }
 
-    return fileDescriptors[fd].getPath();
+    return fileDesc->getPath();
 }
 
 int FileSystem::openFileDescriptor(int rootFd,
@@ -81,23 +158,26 @@ int FileSystem::openFileDescriptor(int rootFd,
                                    uint32_t openFlags,
                                    int32_t fdFlags)
 {
-
-    storage::FileDescriptor& rootFileDesc = getFileDescriptor(rootFd);
+    const FileDescriptor* rootFileDesc = peekFileDescriptor(rootFd);
+    if (rootFileDesc == nullptr) {
+        throw std::runtime_error("File descriptor does not exist");
+    }
 
     std::string fullPath;
     if (SharedFiles::isPathShared(relativePath)) {
         fullPath = relativePath;
-    } else if (rootFileDesc.getPath() == ".") {
+    } else if (rootFileDesc->getPath() == ".") {
         fullPath = relativePath;
     } else {
-        boost::filesystem::path joinedPath(rootFileDesc.getPath());
+        boost::filesystem::path joinedPath(rootFileDesc->getPath());
         joinedPath.append(relativePath);
         fullPath = std::string(joinedPath.string());
     }
 
     // Initialise the new fd
     int thisFd = getNewFd();
-    FileDescriptor& fileDesc = fileDescriptors[thisFd];
+    fileDescriptors[thisFd] = std::make_shared<FileDescriptor>();
+    FileDescriptor& fileDesc = *fileDescriptors[thisFd];
     fileDesc.setPath(fullPath);
 
     // AND requested rights with those of the root file descriptor. Rights for
@@ -105,9 +185,9 @@ int FileSystem::openFileDescriptor(int rootFd,
     // children of this file descriptor can only inherit rights permitted by
     // their ancestors.
     uint64_t effectiveRightsInheriting =
-      rightsInheriting & rootFileDesc.getActualRightsInheriting();
+      rightsInheriting & rootFileDesc->getActualRightsInheriting();
     uint64_t effectiveRights =
-      rightsBase & rootFileDesc.getActualRightsInheriting();
+      rightsBase & rootFileDesc->getActualRightsInheriting();
 
     fileDesc.setActualRights(effectiveRights, effectiveRightsInheriting);
 
@@ -122,25 +202,35 @@ int FileSystem::openFileDescriptor(int rootFd,
 
 bool FileSystem::fileDescriptorExists(int fd)
 {
-    return fileDescriptors.count(fd) > 0;
+    return peekFileDescriptor(fd) != nullptr;
 }
 
 storage::FileDescriptor& FileSystem::getFileDescriptor(int fd)
 {
-    if (fileDescriptors.count(fd) == 0) {
+    if (peekFileDescriptor(fd) == nullptr) {
         throw std::runtime_error("File descriptor does not exist");
     }
 
-    return fileDescriptors.at(fd);
+    // Callers may modify the descriptor, so take a private copy if it's
+    // shared with another module
+    std::shared_ptr<FileDescriptor>& fileDesc = fileDescriptors[fd];
+    if (fileDesc.use_count() > 1) {
+        fileDesc = std::make_shared<FileDescriptor>(*fileDesc);
+    }
+
+    return *fileDesc;
 }
 
 int FileSystem::dup(int fd)
 {
-    int newFd = getNewFd();
+    const FileDescriptor* originalDesc = peekFileDescriptor(fd);
+    if (originalDesc == nullptr) {
+        throw std::runtime_error("File descriptor does not exist");
+    }
 
-    FileDescriptor& originalDesc = getFileDescriptor(fd);
-    FileDescriptor& newDesc = fileDescriptors[newFd];
-    newDesc.duplicate(originalDesc);
+    int newFd = getNewFd();
+    fileDescriptors[newFd] = std::make_shared<FileDescriptor>();
+    fileDescriptors[newFd]->duplicate(*originalDesc);
 
     return newFd;
 }
@@ -148,18 +238,23 @@ int FileSystem::dup(int fd)
 void FileSystem::tearDown()
 {
     for (auto& f : fileDescriptors) {
-        // Only close non-preopened fds
-        if (f.second.wasiPreopenType != __WASI_PREOPENTYPE_DIR) {
-            f.second.close();
+        // Only close non-preopened fds that aren't shared with other modules
+        if (f != nullptr && f.use_count() == 1 &&
+            f->wasiPreopenType != __WASI_PREOPENTYPE_DIR) {
+            f->close();
         }
     }
+
+    fileDescriptors.clear();
 }
 
 void FileSystem::printDebugInfo()
 {
     printf("--- Open file descriptors ---\n");
-    for (auto& p : fileDescriptors) {
-        printf("    %s\n", p.second.getPath().c_str());
+    for (auto& f : fileDescriptors) {
+        if (f != nullptr) {
+            printf("    %s\n", f->getPath().c_str());
+        }
     }
 }
 
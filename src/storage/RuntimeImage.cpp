@@ -0,0 +1,485 @@
+#include "RuntimeImage.h"
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/files.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <WAVM/WASI/WASIABI.h>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <set>
+#include <shared_mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_ALIGN 8
+#define IMAGE_DATA_ALIGN 4096
+
+namespace storage {
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// ------------------------------------------
+// Building
+// ------------------------------------------
+
+void RuntimeImage::build(const std::string& sourceDir,
+                         const std::string& imagePath)
+{
+    SPDLOG_INFO("Building runtime image from {} at {}", sourceDir, imagePath);
+
+    struct ::stat rootStat
+    {};
+    if (::stat(sourceDir.c_str(), &rootStat) != 0 ||
+        !S_ISDIR(rootStat.st_mode)) {
+        SPDLOG_ERROR("Runtime image source {} is not a directory", sourceDir);
+        throw std::runtime_error("Invalid runtime image source");
+    }
+
+    std::vector<RuntimeImageEntry> index;
+    std::vector<std::string> realPaths;
+    std::string names;
+
+    RuntimeImageEntry rootEntry{};
+    rootEntry.mode = rootStat.st_mode;
+    index.push_back(rootEntry);
+    realPaths.push_back(sourceDir);
+
+    // Guard against symlink loops when following linked directories
+    std::set<std::pair<dev_t, ino_t>> visitedDirs;
+    visitedDirs.emplace(rootStat.st_dev, rootStat.st_ino);
+
+    // Walk the tree breadth-first, so that the children of each directory
+    // end up contiguous in the index
+    uint64_t dataSize = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        if (!S_ISDIR(index.at(i).mode)) {
+            continue;
+        }
+
+        std::vector<std::string> childNames;
+        for (const auto& d :
+             boost::filesystem::directory_iterator(realPaths.at(i))) {
+            childNames.push_back(d.path().filename().string());
+        }
+        std::sort(childNames.begin(), childNames.end());
+
+        index.at(i).firstChild = index.size();
+        for (const auto& childName : childNames) {
+            std::string childPath = realPaths.at(i) + "/" + childName;
+
+            struct ::stat childStat
+            {};
+            if (::stat(childPath.c_str(), &childStat) != 0) {
+                SPDLOG_WARN("Skipping {} in runtime image ({})",
+                            childPath,
+                            strerror(errno));
+                continue;
+            }
+
+            bool isDir = S_ISDIR(childStat.st_mode);
+            if (isDir &&
+                !visitedDirs.emplace(childStat.st_dev, childStat.st_ino)
+                   .second) {
+                SPDLOG_WARN("Skipping looped directory {}", childPath);
+                continue;
+            }
+
+            if (!isDir && !S_ISREG(childStat.st_mode)) {
+                SPDLOG_WARN("Skipping non-regular file {}", childPath);
+                continue;
+            }
+
+            RuntimeImageEntry childEntry{};
+            childEntry.parentIdx = i;
+            childEntry.nameOffset = names.size();
+            childEntry.nameLen = childName.size();
+            childEntry.mode = childStat.st_mode;
+
+            if (!isDir) {
+                childEntry.size = childStat.st_size;
+                childEntry.dataOffset = dataSize;
+                dataSize = alignUp(dataSize + childEntry.size, IMAGE_ALIGN);
+            }
+
+            names += childName;
+            index.push_back(childEntry);
+            realPaths.push_back(childPath);
+        }
+        index.at(i).nChildren = index.size() - index.at(i).firstChild;
+    }
+
+    // Work out the layout
+    RuntimeImageHeader header{};
+    std::memcpy(header.magic, RUNTIME_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = RUNTIME_IMAGE_VERSION;
+    header.nEntries = index.size();
+    header.indexOffset = alignUp(sizeof(RuntimeImageHeader), IMAGE_ALIGN);
+    header.namesOffset = header.indexOffset +
+                         (index.size() * sizeof(RuntimeImageEntry));
+    header.dataOffset =
+      alignUp(header.namesOffset + names.size(), IMAGE_DATA_ALIGN);
+    header.buildTimeNanos = faabric::util::timespecToNanos(
+      &rootStat.st_mtim);
+
+    for (auto& e : index) {
+        if (!S_ISDIR(e.mode)) {
+            e.dataOffset += header.dataOffset;
+        }
+    }
+
+    // Write it out alongside the image, then move it into place, so that
+    // anything with the old image mapped keeps a consistent copy
+    std::string tmpPath = imagePath + ".tmp";
+    std::ofstream out(tmpPath, std::ios::out | std::ios::binary |
+                                 std::ios::trunc);
+    if (!out.is_open()) {
+        SPDLOG_ERROR("Could not open {} to write runtime image", imagePath);
+        throw std::runtime_error("Could not write runtime image");
+    }
+
+    auto writePadding = [&out](size_t targetOffset) {
+        size_t currentOffset = out.tellp();
+        std::vector<char> padding(targetOffset - currentOffset, 0);
+        out.write(padding.data(), padding.size());
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(header.indexOffset);
+    out.write(reinterpret_cast<const char*>(index.data()),
+              index.size() * sizeof(RuntimeImageEntry));
+    out.write(names.data(), names.size());
+
+    for (size_t i = 0; i < index.size(); i++) {
+        const RuntimeImageEntry& e = index.at(i);
+        if (S_ISDIR(e.mode)) {
+            continue;
+        }
+
+        writePadding(e.dataOffset);
+        std::vector<uint8_t> bytes =
+          faabric::util::readFileToBytes(realPaths.at(i));
+        if (bytes.size() != e.size) {
+            SPDLOG_ERROR("{} changed size while building runtime image",
+                         realPaths.at(i));
+            throw std::runtime_error("File changed building runtime image");
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    out.close();
+    boost::filesystem::rename(tmpPath, imagePath);
+
+    SPDLOG_INFO("Built runtime image with {} entries and {} data bytes",
+                index.size(),
+                dataSize);
+}
+
+// ------------------------------------------
+// Reading
+// ------------------------------------------
+
+RuntimeImage::RuntimeImage(const std::string& imagePathIn)
+  : imagePath(imagePathIn)
+{
+    int fd = ::open(imagePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR(
+          "Failed to open runtime image {}: {}", imagePath, strerror(errno));
+        throw std::runtime_error("Failed to open runtime image");
+    }
+
+    struct ::stat imageStat
+    {};
+    if (::fstat(fd, &imageStat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat runtime image");
+    }
+    mappedSize = imageStat.st_size;
+
+    if (mappedSize < sizeof(RuntimeImageHeader)) {
+        ::close(fd);
+        SPDLOG_ERROR("Runtime image {} too small", imagePath);
+        throw std::runtime_error("Invalid runtime image");
+    }
+
+    void* ptr = ::mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        SPDLOG_ERROR(
+          "Failed to map runtime image {}: {}", imagePath, strerror(errno));
+        throw std::runtime_error("Failed to map runtime image");
+    }
+    mappedPtr = static_cast<uint8_t*>(ptr);
+
+    header = reinterpret_cast<const RuntimeImageHeader*>(mappedPtr);
+    bool valid =
+      std::memcmp(header->magic, RUNTIME_IMAGE_MAGIC, sizeof(header->magic)) ==
+        0 &&
+      header->version == RUNTIME_IMAGE_VERSION && header->nEntries > 0 &&
+      header->indexOffset % alignof(RuntimeImageEntry) == 0 &&
+      header->indexOffset <= mappedSize &&
+      header->nEntries * sizeof(RuntimeImageEntry) <=
+        mappedSize - header->indexOffset &&
+      header->indexOffset + (header->nEntries * sizeof(RuntimeImageEntry)) <=
+        header->namesOffset &&
+      header->namesOffset <= header->dataOffset &&
+      header->dataOffset <= mappedSize;
+
+    if (!valid) {
+        SPDLOG_ERROR("Runtime image {} has invalid header", imagePath);
+        ::munmap(mappedPtr, mappedSize);
+        throw std::runtime_error("Invalid runtime image");
+    }
+
+    entries = reinterpret_cast<const RuntimeImageEntry*>(mappedPtr +
+                                                         header->indexOffset);
+    names = reinterpret_cast<const char*>(mappedPtr + header->namesOffset);
+
+    if (!hasValidEntries()) {
+        SPDLOG_ERROR("Runtime image {} has invalid entries", imagePath);
+        ::munmap(mappedPtr, mappedSize);
+        throw std::runtime_error("Invalid runtime image");
+    }
+
+    SPDLOG_DEBUG("Mapped runtime image {} ({} entries, {} bytes)",
+                 imagePath,
+                 header->nEntries,
+                 mappedSize);
+}
+
+RuntimeImage::~RuntimeImage()
+{
+    if (mappedPtr != nullptr) {
+        ::munmap(mappedPtr, mappedSize);
+    }
+}
+
+// Checks every entry points inside the image, so that lookups, listings and
+// reads can't run off the end of the mapping
+bool RuntimeImage::hasValidEntries() const
+{
+    if (!S_ISDIR(entries[0].mode)) {
+        return false;
+    }
+
+    uint32_t nEntries = header->nEntries;
+    uint64_t namesSize = header->dataOffset - header->namesOffset;
+    for (uint32_t i = 0; i < nEntries; i++) {
+        const RuntimeImageEntry& e = entries[i];
+        if (e.parentIdx >= nEntries || e.nameOffset > namesSize ||
+            e.nameLen > namesSize - e.nameOffset) {
+            return false;
+        }
+
+        if (S_ISDIR(e.mode)) {
+            if (e.firstChild > nEntries ||
+                e.nChildren > nEntries - e.firstChild) {
+                return false;
+            }
+        } else if (e.dataOffset < header->dataOffset ||
+                   e.dataOffset > mappedSize ||
+                   e.size > mappedSize - e.dataOffset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t RuntimeImage::getIndex(const RuntimeImageEntry* entry) const
+{
+    return entry - entries;
+}
+
+std::string_view RuntimeImage::getName(const RuntimeImageEntry* entry) const
+{
+    return std::string_view(names + entry->nameOffset, entry->nameLen);
+}
+
+const RuntimeImageEntry* RuntimeImage::findChild(const RuntimeImageEntry* dir,
+                                                 std::string_view name) const
+{
+    const RuntimeImageEntry* begin = entries + dir->firstChild;
+    const RuntimeImageEntry* end = begin + dir->nChildren;
+
+    const RuntimeImageEntry* it = std::lower_bound(
+      begin, end, name, [this](const RuntimeImageEntry& e, std::string_view n) {
+          return getName(&e) < n;
+      });
+
+    if (it == end || getName(it) != name) {
+        return nullptr;
+    }
+
+    return it;
+}
+
+const RuntimeImageEntry* RuntimeImage::lookup(const std::string& path) const
+{
+    const RuntimeImageEntry* current = entries;
+
+    std::string_view remaining(path);
+    while (!remaining.empty()) {
+        size_t slashIdx = remaining.find('/');
+        std::string_view part = remaining.substr(0, slashIdx);
+        remaining = slashIdx == std::string_view::npos
+                      ? std::string_view()
+                      : remaining.substr(slashIdx + 1);
+
+        if (part.empty() || part == ".") {
+            continue;
+        }
+
+        if (part == "..") {
+            current = entries + current->parentIdx;
+            continue;
+        }
+
+        if (!S_ISDIR(current->mode)) {
+            return nullptr;
+        }
+
+        current = findChild(current, part);
+        if (current == nullptr) {
+            return nullptr;
+        }
+    }
+
+    return current;
+}
+
+bool RuntimeImage::isDirectory(const RuntimeImageEntry* entry) const
+{
+    return S_ISDIR(entry->mode);
+}
+
+std::span<const uint8_t> RuntimeImage::getFileData(
+  const RuntimeImageEntry* entry) const
+{
+    if (isDirectory(entry)) {
+        return {};
+    }
+
+    return std::span<const uint8_t>(mappedPtr + entry->dataOffset,
+                                    entry->size);
+}
+
+Stat RuntimeImage::stat(const RuntimeImageEntry* entry) const
+{
+    Stat statResult;
+    statResult.failed = false;
+    statResult.wasiErrno = 0;
+
+    statResult.wasiFiletype = isDirectory(entry)
+                                ? __WASI_FILETYPE_DIRECTORY
+                                : __WASI_FILETYPE_REGULAR_FILE;
+
+    statResult.st_dev = 0;
+    statResult.st_ino = getIndex(entry) + 1;
+    statResult.st_nlink = 1;
+    statResult.st_size = entry->size;
+    statResult.st_mode = entry->mode;
+    statResult.st_atim = header->buildTimeNanos;
+    statResult.st_mtim = header->buildTimeNanos;
+    statResult.st_ctim = header->buildTimeNanos;
+
+    return statResult;
+}
+
+DirListing RuntimeImage::getListing(const RuntimeImageEntry* entry)
+{
+    uint32_t idx = getIndex(entry);
+
+    std::unique_lock<std::mutex> lock(listingsMx);
+    auto it = listings.find(idx);
+    if (it != listings.end()) {
+        return it->second;
+    }
+
+    // Match the native listing, which includes the current and parent dirs
+    std::vector<DirEnt> dirEnts;
+    dirEnts.reserve(entry->nChildren + 2);
+
+    auto addEnt = [&dirEnts](uint32_t ino, uint8_t type, std::string path) {
+        DirEnt d;
+        d.next = dirEnts.size() + 1;
+        d.type = type;
+        d.ino = ino;
+        d.path = std::move(path);
+        dirEnts.emplace_back(std::move(d));
+    };
+
+    addEnt(idx + 1, DT_DIR, ".");
+    addEnt(entry->parentIdx + 1, DT_DIR, "..");
+    for (uint32_t i = 0; i < entry->nChildren; i++) {
+        const RuntimeImageEntry* child = entries + entry->firstChild + i;
+        addEnt(getIndex(child) + 1,
+               isDirectory(child) ? DT_DIR : DT_REG,
+               std::string(getName(child)));
+    }
+
+    auto listing =
+      std::make_shared<const std::vector<DirEnt>>(std::move(dirEnts));
+    listings.emplace(idx, listing);
+
+    return listing;
+}
+
+size_t RuntimeImage::getEntryCount() const
+{
+    return header->nEntries;
+}
+
+std::string RuntimeImage::getImagePath() const
+{
+    return imagePath;
+}
+
+// ------------------------------------------
+// Process-wide image
+// ------------------------------------------
+
+static std::shared_mutex runtimeImageMx;
+static std::shared_ptr<RuntimeImage> runtimeImage;
+
+std::shared_ptr<RuntimeImage> getRuntimeImage()
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.runtimeImagePath.empty()) {
+        return nullptr;
+    }
+
+    {
+        faabric::util::SharedLock lock(runtimeImageMx);
+        if (runtimeImage != nullptr) {
+            return runtimeImage;
+        }
+    }
+
+    faabric::util::FullLock lock(runtimeImageMx);
+    if (runtimeImage == nullptr) {
+        runtimeImage = std::make_shared<RuntimeImage>(conf.runtimeImagePath);
+    }
+
+    return runtimeImage;
+}
+
+void resetRuntimeImage()
+{
+    faabric::util::FullLock lock(runtimeImageMx);
+    runtimeImage = nullptr;
+}
+}
@@ -2,13 +2,22 @@
 #include <storage/S3Wrapper.h>
 
 #include <faabric/util/bytes.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+
+#include <aws/core/client/DefaultRetryStrategy.h>
+#include <aws/core/utils/threading/Executor.h>
 #include <aws/s3/S3Errors.h>
 #include <aws/s3/model/CreateBucketRequest.h>
 #include <aws/s3/model/DeleteBucketRequest.h>
 #include <aws/s3/model/DeleteObjectRequest.h>
 #include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsRequest.h>
 #include <aws/s3/model/PutObjectRequest.h>
 
@@ -20,6 +29,9 @@ namespace storage {
 
 static Aws::SDKOptions options;
 
+static std::mutex sharedClientMx;
+static std::shared_ptr<Aws::S3::S3Client> sharedClient;
+
 template<typename R>
 R reqFactory(const std::string& bucket)
 {
@@ -60,6 +72,34 @@ std::shared_ptr<AWSCredentialsProvider> getCredentialsProvider()
     return Aws::MakeShared<ProfileConfigFileAWSCredentialsProvider>("local");
 }
 
+/**
+ * Retries with "full jitter" exponential backoff, i.e. a delay picked at random
+ * between zero and the exponential bound. This stops clients that fail
+ * together from retrying together.
+ */
+class JitteredRetryStrategy : public DefaultRetryStrategy
+{
+  public:
+    JitteredRetryStrategy(long maxRetriesIn, long scaleFactorIn)
+      : DefaultRetryStrategy(maxRetriesIn, scaleFactorIn)
+      , scaleFactor(scaleFactorIn)
+    {}
+
+    long CalculateDelayBeforeNextRetry(
+      const Aws::Client::AWSError<Aws::Client::CoreErrors>& error,
+      long attemptedRetries) const override
+    {
+        static thread_local std::mt19937 gen(std::random_device{}());
+
+        long bound = scaleFactor * (1L << std::min(attemptedRetries, 10L));
+        std::uniform_int_distribution<long> dist(0, bound);
+        return dist(gen);
+    }
+
+  private:
+    long scaleFactor;
+};
+
 ClientConfiguration getClientConf(long timeout)
 {
     // There are a couple of conflicting pieces of info on how to configure
@@ -79,9 +119,61 @@ ClientConfiguration getClientConf(long timeout)
     // Use HTTP, not HTTPS
     config.scheme = Aws::Http::Scheme::HTTP;
 
+    // Size the connection pool and the executor for async requests together,
+    // so each in-flight request can hold a connection
+    config.maxConnections = faasmConf.s3MaxConnections;
+    config.executor =
+      Aws::MakeShared<Aws::Utils::Threading::PooledThreadExecutor>(
+        "faasm-s3", faasmConf.s3MaxConnections);
+    config.retryStrategy = Aws::MakeShared<JitteredRetryStrategy>(
+      "faasm-s3", faasmConf.s3MaxRetries, S3_RETRY_SCALE_FACTOR_MS);
+
     return config;
 }
 
+std::shared_ptr<Aws::S3::S3Client> getSharedS3Client()
+{
+    faabric::util::UniqueLock lock(sharedClientMx);
+    if (sharedClient == nullptr) {
+        const auto& faasmConf = conf::getFaasmConfig();
+        SPDLOG_DEBUG("Creating shared S3 client for {}:{} ({} connections)",
+                     faasmConf.s3Host,
+                     faasmConf.s3Port,
+                     faasmConf.s3MaxConnections);
+
+        sharedClient = std::make_shared<Aws::S3::S3Client>(
+          AWSCredentials(faasmConf.s3User, faasmConf.s3Password),
+          getClientConf(S3_REQUEST_TIMEOUT_MS),
+          AWSAuthV4Signer::PayloadSigningPolicy::Never,
+          false);
+    }
+
+    return sharedClient;
+}
+
+void resetSharedS3Client()
+{
+    faabric::util::UniqueLock lock(sharedClientMx);
+    sharedClient = nullptr;
+}
+
+/**
+ * State for a get that may be in flight more than once when hedged. Whichever
+ * request finishes first sets the result.
+ */
+struct PendingS3Get
+{
+    std::string bucketName;
+    std::string keyName;
+    bool tolerateMissing = false;
+
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<bool> done = false;
+
+    std::promise<std::vector<uint8_t>> promise;
+    std::shared_future<std::vector<uint8_t>> future;
+};
+
 void initFaasmS3()
 {
     const auto& conf = conf::getFaasmConfig();
@@ -107,23 +199,21 @@ void initFaasmS3()
 
 void shutdownFaasmS3()
 {
+    // The client must be destroyed before the SDK is shut down
+    resetSharedS3Client();
     Aws::ShutdownAPI(options);
 }
 
 S3Wrapper::S3Wrapper()
   : faasmConf(conf::getFaasmConfig())
-  , clientConf(getClientConf(S3_REQUEST_TIMEOUT_MS))
-  , client(AWSCredentials(faasmConf.s3User, faasmConf.s3Password),
-           clientConf,
-           AWSAuthV4Signer::PayloadSigningPolicy::Never,
-           false)
+  , client(getSharedS3Client())
 {}
 
 void S3Wrapper::createBucket(const std::string& bucketName)
 {
     SPDLOG_DEBUG("Creating bucket {}", bucketName);
     auto request = reqFactory<CreateBucketRequest>(bucketName);
-    auto response = client.CreateBucket(request);
+    auto response = client->CreateBucket(request);
 
     if (!response.IsSuccess()) {
         const auto& err = response.GetError();
@@ -142,7 +232,7 @@ void S3Wrapper::deleteBucket(const std::string& bucketName)
 {
     SPDLOG_DEBUG("Deleting bucket {}", bucketName);
     auto request = reqFactory<DeleteBucketRequest>(bucketName);
-    auto response = client.DeleteBucket(request);
+    auto response = client->DeleteBucket(request);
 
     if (!response.IsSuccess()) {
         const auto& err = response.GetError();
@@ -167,7 +257,7 @@ void S3Wrapper::deleteBucket(const std::string& bucketName)
 std::vector<std::string> S3Wrapper::listBuckets()
 {
     SPDLOG_TRACE("Listing buckets");
-    auto response = client.ListBuckets();
+    auto response = client->ListBuckets();
     CHECK_ERRORS(response, "", "");
 
     Aws::Vector<Bucket> bucketObjects = response.GetResult().GetBuckets();
@@ -185,7 +275,7 @@ std::vector<std::string> S3Wrapper::listKeys(const std::string& bucketName)
 {
     SPDLOG_TRACE("Listing keys in bucket {}", bucketName);
     auto request = reqFactory<ListObjectsRequest>(bucketName);
-    auto response = client.ListObjects(request);
+    auto response = client->ListObjects(request);
 
     std::vector<std::string> keys;
     if (!response.IsSuccess()) {
@@ -218,7 +308,7 @@ void S3Wrapper::deleteKey(const std::string& bucketName,
 {
     SPDLOG_TRACE("Deleting S3 key {}/{}", bucketName, keyName);
     auto request = reqFactory<DeleteObjectRequest>(bucketName, keyName);
-    auto response = client.DeleteObject(request);
+    auto response = client->DeleteObject(request);
 
     if (!response.IsSuccess()) {
         const auto& err = response.GetError();
@@ -250,7 +340,7 @@ void S3Wrapper::addKeyBytes(const std::string& bucketName,
 
     request.SetBody(dataStream);
 
-    auto response = client.PutObject(request);
+    auto response = client->PutObject(request);
     CHECK_ERRORS(response, bucketName, keyName);
 }
 
@@ -270,7 +360,7 @@ void S3Wrapper::addKeyStr(const std::string& bucketName,
     dataStream->flush();
 
     request.SetBody(dataStream);
-    auto response = client.PutObject(request);
+    auto response = client->PutObject(request);
     CHECK_ERRORS(response, bucketName, keyName);
 }
 
@@ -279,26 +369,126 @@ std::vector<uint8_t> S3Wrapper::getKeyBytes(const std::string& bucketName,
                                             bool tolerateMissing)
 {
     SPDLOG_TRACE("Getting S3 key {}/{} as bytes", bucketName, keyName);
-    auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
-    GetObjectOutcome response = client.GetObject(request);
+    return awaitGet(startGet(bucketName, keyName, tolerateMissing));
+}
 
-    if (!response.IsSuccess()) {
-        const auto& err = response.GetError();
-        auto errType = err.GetErrorType();
+std::shared_future<std::vector<uint8_t>> S3Wrapper::getKeyBytesAsync(
+  const std::string& bucketName,
+  const std::string& keyName,
+  bool tolerateMissing)
+{
+    SPDLOG_TRACE("Getting S3 key {}/{} asynchronously", bucketName, keyName);
+    return startGet(bucketName, keyName, tolerateMissing)->future;
+}
 
-        if (tolerateMissing && (errType == Aws::S3::S3Errors::NO_SUCH_KEY)) {
-            SPDLOG_TRACE(
-              "Tolerating missing S3 key {}/{}", bucketName, keyName);
-            std::vector<uint8_t> empty;
-            return empty;
-        }
+std::vector<std::vector<uint8_t>> S3Wrapper::getKeysBytes(
+  const std::string& bucketName,
+  const std::vector<std::string>& keyNames,
+  bool tolerateMissing)
+{
+    SPDLOG_TRACE("Getting {} S3 keys from {}", keyNames.size(), bucketName);
 
-        CHECK_ERRORS(response, bucketName, keyName);
+    // Put all the requests in flight before waiting on any of them
+    std::vector<std::shared_ptr<PendingS3Get>> pending;
+    pending.reserve(keyNames.size());
+    for (const auto& keyName : keyNames) {
+        pending.emplace_back(startGet(bucketName, keyName, tolerateMissing));
+    }
+
+    std::vector<std::vector<uint8_t>> results;
+    results.reserve(keyNames.size());
+    for (auto& p : pending) {
+        results.emplace_back(awaitGet(p));
     }
 
-    std::vector<uint8_t> rawData(response.GetResult().GetContentLength());
-    response.GetResult().GetBody().read((char*)rawData.data(), rawData.size());
-    return rawData;
+    return results;
+}
+
+std::shared_ptr<PendingS3Get> S3Wrapper::startGet(
+  const std::string& bucketName,
+  const std::string& keyName,
+  bool tolerateMissing)
+{
+    auto pending = std::make_shared<PendingS3Get>();
+    pending->bucketName = bucketName;
+    pending->keyName = keyName;
+    pending->tolerateMissing = tolerateMissing;
+    pending->startTime = std::chrono::steady_clock::now();
+    pending->future = pending->promise.get_future().share();
+
+    issueGet(pending);
+
+    return pending;
+}
+
+void S3Wrapper::issueGet(std::shared_ptr<PendingS3Get> pending)
+{
+    auto request =
+      reqFactory<GetObjectRequest>(pending->bucketName, pending->keyName);
+
+    client->GetObjectAsync(
+      request,
+      [pending](const Aws::S3::S3Client* c,
+                const GetObjectRequest& req,
+                GetObjectOutcome response,
+                const std::shared_ptr<const AsyncCallerContext>& ctx) {
+          // Drop the result if another request for the same key has won
+          if (pending->done.load()) {
+              return;
+          }
+
+          std::vector<uint8_t> rawData;
+          std::exception_ptr error = nullptr;
+          if (response.IsSuccess()) {
+              rawData.resize(response.GetResult().GetContentLength());
+              response.GetResult().GetBody().read((char*)rawData.data(),
+                                                  rawData.size());
+          } else if (pending->tolerateMissing &&
+                     response.GetError().GetErrorType() ==
+                       Aws::S3::S3Errors::NO_SUCH_KEY) {
+              SPDLOG_TRACE("Tolerating missing S3 key {}/{}",
+                           pending->bucketName,
+                           pending->keyName);
+          } else {
+              try {
+                  CHECK_ERRORS(response, pending->bucketName, pending->keyName);
+              } catch (...) {
+                  error = std::current_exception();
+              }
+          }
+
+          if (pending->done.exchange(true)) {
+              return;
+          }
+
+          if (error != nullptr) {
+              pending->promise.set_exception(error);
+          } else {
+              pending->promise.set_value(std::move(rawData));
+          }
+      });
+}
+
+std::vector<uint8_t> S3Wrapper::awaitGet(std::shared_ptr<PendingS3Get> pending)
+{
+    // If the request is still outstanding after the hedge delay, send a
+    // duplicate and take whichever comes back first. This cuts the tail
+    // latency caused by the odd slow connection or server. It is off by
+    // default, as large objects can take longer than any fixed delay and
+    // would then be downloaded twice.
+    if (faasmConf.s3HedgeDelayMs > 0) {
+        auto deadline = pending->startTime +
+                        std::chrono::milliseconds(faasmConf.s3HedgeDelayMs);
+        if (pending->future.wait_until(deadline) ==
+            std::future_status::timeout) {
+            SPDLOG_DEBUG("Hedging slow S3 get for {}/{}",
+                         pending->bucketName,
+                         pending->keyName);
+            issueGet(pending);
+        }
+    }
+
+    return pending->future.get();
 }
 
 std::string S3Wrapper::getKeyStr(const std::string& bucketName,
@@ -306,7 +496,7 @@ std::string S3Wrapper::getKeyStr(const std::string& bucketName,
 {
     SPDLOG_TRACE("Getting S3 key {}/{} as string", bucketName, keyName);
     auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
-    GetObjectOutcome response = client.GetObject(request);
+    GetObjectOutcome response = client->GetObject(request);
     CHECK_ERRORS(response, bucketName, keyName);
 
     std::ostringstream ss;
@@ -315,4 +505,26 @@ std::string S3Wrapper::getKeyStr(const std::string& bucketName,
 
     return ss.str();
 }
+
+std::string S3Wrapper::getKeyETag(const std::string& bucketName,
+                                  const std::string& keyName)
+{
+    SPDLOG_TRACE("Getting ETag of S3 key {}/{}", bucketName, keyName);
+    auto request = reqFactory<HeadObjectRequest>(bucketName, keyName);
+    auto response = client->HeadObject(request);
+
+    if (!response.IsSuccess()) {
+        // HEAD responses have no body, so missing keys aren't always reported
+        // as NO_SUCH_KEY
+        auto errType = response.GetError().GetErrorType();
+        if (errType == Aws::S3::S3Errors::NO_SUCH_KEY ||
+            errType == Aws::S3::S3Errors::RESOURCE_NOT_FOUND) {
+            return "";
+        }
+
+        CHECK_ERRORS(response, bucketName, keyName);
+    }
+
+    return response.GetResult().GetETag();
+}
 }
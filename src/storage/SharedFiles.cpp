@@ -9,8 +9,12 @@
 #include <faabric/util/string_tools.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/DirectoryCache.h>
 #include <storage/FileLoader.h>
 
+#include <sstream>
+#include <stdexcept>
+
 namespace storage {
 enum FileState
 {
@@ -159,6 +163,10 @@ int SharedFiles::syncSharedFile(const std::string& sharedPath,
             isDir = true;
         } catch (storage::SharedFileNotExistsException& e) {
             // Tolerate not existing
+        } catch (...) {
+            // Leave the file to be checked again on the next sync
+            sharedFileMap.erase(sharedPath);
+            throw;
         }
 
         // Handle directories and files accordingly
@@ -183,6 +191,87 @@ int SharedFiles::syncSharedFile(const std::string& sharedPath,
     return getReturnValueForSharedFileState(sharedPath);
 }
 
+std::vector<int> SharedFiles::syncSharedFiles(
+  const std::vector<std::string>& sharedPaths,
+  const std::vector<std::string>& localPaths)
+{
+    if (!localPaths.empty() && localPaths.size() != sharedPaths.size()) {
+        SPDLOG_ERROR("Syncing {} shared files to {} local paths",
+                     sharedPaths.size(),
+                     localPaths.size());
+        throw std::runtime_error("Mismatched shared and local paths");
+    }
+
+    faabric::util::FullLock fullLock(sharedFileMapMutex);
+
+    // Work out which files need fetching
+    std::vector<std::string> toFetch;
+    std::vector<std::string> toFetchShared;
+    std::vector<std::string> toFetchReal;
+    for (size_t i = 0; i < sharedPaths.size(); i++) {
+        const std::string& sharedPath = sharedPaths.at(i);
+        if (sharedFileMap.count(sharedPath) > 0) {
+            continue;
+        }
+
+        std::string strippedPath = stripSharedPrefix(sharedPath);
+        std::string realPath = localPaths.empty()
+                                 ? prependSharedRoot(strippedPath)
+                                 : localPaths.at(i);
+        if (boost::filesystem::exists(realPath)) {
+            sharedFileMap[sharedPath] =
+              boost::filesystem::is_directory(realPath) ? EXISTS_DIR : EXISTS;
+            continue;
+        }
+
+        // Avoid fetching the same file twice
+        sharedFileMap[sharedPath] = NOT_CHECKED;
+        toFetch.emplace_back(strippedPath);
+        toFetchShared.emplace_back(sharedPath);
+        toFetchReal.emplace_back(realPath);
+    }
+
+    if (!toFetch.empty()) {
+        SPDLOG_TRACE("Syncing {} shared files in parallel", toFetch.size());
+
+        FileLoader& loader = getFileLoader();
+        std::vector<std::vector<uint8_t>> allBytes;
+        try {
+            allBytes = loader.loadSharedFiles(toFetch);
+        } catch (...) {
+            // Leave the files to be checked again on the next sync
+            for (const auto& sharedPath : toFetchShared) {
+                sharedFileMap.erase(sharedPath);
+            }
+            throw;
+        }
+
+        for (size_t i = 0; i < toFetch.size(); i++) {
+            const std::vector<uint8_t>& bytes = allBytes.at(i);
+            if (bytes.empty()) {
+                sharedFileMap[toFetchShared.at(i)] = NOT_EXISTS;
+                continue;
+            }
+
+            boost::filesystem::path p(toFetchReal.at(i));
+            if (p.has_parent_path()) {
+                boost::filesystem::create_directories(p.parent_path());
+            }
+
+            faabric::util::writeBytesToFile(p.string(), bytes);
+            sharedFileMap[toFetchShared.at(i)] = EXISTS;
+        }
+    }
+
+    std::vector<int> results;
+    results.reserve(sharedPaths.size());
+    for (const auto& sharedPath : sharedPaths) {
+        results.emplace_back(getReturnValueForSharedFileState(sharedPath));
+    }
+
+    return results;
+}
+
 void SharedFiles::syncPythonFunctionFile(const faabric::Message& msg)
 {
     if (!msg.ispython()) {
@@ -209,6 +298,59 @@ void SharedFiles::syncPythonFunctionFile(const faabric::Message& msg)
     runtimePath.append(relativePath);
 
     syncSharedFile(sharedUrl.string(), runtimePath.string());
+
+    // Bytecode compiled at upload time goes next to the source in the runtime
+    // root, so that the guest can import the function without parsing it
+    if (conf.pythonPrecompile == "on") {
+        boost::filesystem::path indexUrl(SHARED_FILE_PREFIX);
+        indexUrl.append(loader.getPythonBytecodeIndexRelativePath(msg));
+
+        if (syncSharedFile(indexUrl.string(), "") == 0) {
+            std::istringstream index(faabric::util::readFileToString(
+              realPathForSharedFile(indexUrl.string())));
+
+            std::vector<std::string> pycUrls;
+            std::vector<std::string> pycRuntimePaths;
+            std::string pycPath;
+            while (std::getline(index, pycPath)) {
+                if (pycPath.empty()) {
+                    continue;
+                }
+
+                if (!loader.isPythonBytecodeRelativePath(msg, pycPath)) {
+                    SPDLOG_ERROR("Ignoring invalid bytecode path {} for {}/{}",
+                                 pycPath,
+                                 msg.pythonuser(),
+                                 msg.pythonfunction());
+                    continue;
+                }
+
+                boost::filesystem::path pycUrl(SHARED_FILE_PREFIX);
+                pycUrl.append(pycPath);
+                boost::filesystem::path pycRuntimePath(conf.runtimeFilesDir);
+                pycRuntimePath.append(pycPath);
+                pycUrls.emplace_back(pycUrl.string());
+                pycRuntimePaths.emplace_back(pycRuntimePath.string());
+            }
+
+            // A package can have many modules, so fetch them all at once
+            syncSharedFiles(pycUrls, pycRuntimePaths);
+            for (const auto& p : pycRuntimePaths) {
+                DirectoryCache::invalidate(
+                  boost::filesystem::path(p).parent_path().string());
+            }
+        }
+    }
+
+    // Syncing may have created the file and its parent directories in the
+    // runtime root, so any cached listings on the way down are stale
+    boost::filesystem::path runtimeRoot(conf.runtimeFilesDir);
+    for (boost::filesystem::path p = runtimePath.parent_path();
+         !p.empty() && p != runtimeRoot;
+         p = p.parent_path()) {
+        DirectoryCache::invalidate(p.string());
+    }
+    DirectoryCache::invalidate(runtimeRoot.string());
 }
 
 void SharedFiles::clear()
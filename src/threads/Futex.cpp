@@ -0,0 +1,134 @@
+#include <threads/Futex.h>
+
+#include <faabric/util/logging.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace threads {
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+bool futexWait(int32_t* word, int32_t expected, int timeoutMs)
+{
+    struct timespec timeout;
+    struct timespec* timeoutPtr = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        timeoutPtr = &timeout;
+    }
+
+    long res = syscall(
+      SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeoutPtr, nullptr, 0);
+    if (res == -1 && errno == ETIMEDOUT) {
+        return false;
+    }
+
+    // Anything else means we were woken, interrupted, or the value had already
+    // changed, all of which the caller handles by checking the word again
+    return true;
+}
+
+int futexWake(int32_t* word, int nWaiters)
+{
+    long res = syscall(
+      SYS_futex, word, FUTEX_WAKE_PRIVATE, nWaiters, nullptr, nullptr, 0);
+    if (res == -1) {
+        SPDLOG_ERROR("Failed to wake futex at {}: {}", (void*)word, errno);
+        return 0;
+    }
+
+    return (int)res;
+}
+
+void lockFutexMutex(int32_t* word)
+{
+    std::atomic_ref<int32_t> mx(*word);
+
+    int32_t state = FUTEX_MUTEX_UNLOCKED;
+    if (mx.compare_exchange_strong(
+          state, FUTEX_MUTEX_LOCKED, std::memory_order_acquire)) {
+        return;
+    }
+
+    // Critical sections are usually short, so the holder may well be done
+    // before it's worth going to sleep
+    for (int i = 0; i < FUTEX_MUTEX_SPINS; i++) {
+        cpuRelax();
+
+        state = FUTEX_MUTEX_UNLOCKED;
+        if (mx.load(std::memory_order_relaxed) == FUTEX_MUTEX_UNLOCKED &&
+            mx.compare_exchange_weak(
+              state, FUTEX_MUTEX_LOCKED, std::memory_order_acquire)) {
+            return;
+        }
+    }
+
+    // Mark the mutex as contended so whoever unlocks it wakes us. As we can't
+    // tell if others are still waiting, we keep it marked when we get it.
+    while (mx.exchange(FUTEX_MUTEX_CONTENDED, std::memory_order_acquire) !=
+           FUTEX_MUTEX_UNLOCKED) {
+        futexWait(word, FUTEX_MUTEX_CONTENDED);
+    }
+}
+
+bool tryLockFutexMutex(int32_t* word)
+{
+    std::atomic_ref<int32_t> mx(*word);
+
+    int32_t state = FUTEX_MUTEX_UNLOCKED;
+    return mx.compare_exchange_strong(
+      state, FUTEX_MUTEX_LOCKED, std::memory_order_acquire);
+}
+
+void unlockFutexMutex(int32_t* word)
+{
+    std::atomic_ref<int32_t> mx(*word);
+
+    if (mx.exchange(FUTEX_MUTEX_UNLOCKED, std::memory_order_release) ==
+        FUTEX_MUTEX_CONTENDED) {
+        futexWake(word, 1);
+    }
+}
+
+int32_t FutexCondition::prepareWait()
+{
+    nWaiters.fetch_add(1);
+    return std::atomic_ref<int32_t>(seq).load();
+}
+
+bool FutexCondition::wait(int32_t waitSeq, int timeoutMs)
+{
+    bool woken = futexWait(&seq, waitSeq, timeoutMs);
+    nWaiters.fetch_sub(1);
+
+    return woken;
+}
+
+void FutexCondition::notifyOne()
+{
+    std::atomic_ref<int32_t>(seq).fetch_add(1);
+    if (nWaiters.load() > 0) {
+        futexWake(&seq, 1);
+    }
+}
+
+void FutexCondition::notifyAll()
+{
+    std::atomic_ref<int32_t>(seq).fetch_add(1);
+    if (nWaiters.load() > 0) {
+        futexWake(&seq, INT_MAX);
+    }
+}
+}
@@ -1,19 +1,59 @@
 #include "UploadServer.h"
 
+#include <faabric/planner/PlannerClient.h>
 #include <faabric/state/State.h>
+#include <faabric/util/batch.h>
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
+#include <faabric/util/gids.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
+#include <faabric/util/string_tools.h>
 
 #include <codegen/MachineCodeGenerator.h>
 #include <conf/FaasmConfig.h>
+#include <storage/ArtifactServer.h>
 #include <storage/FileLoader.h>
+#include <wasm/workflows.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <sstream>
+
+#include <cpprest/containerstream.h>
+#include <cpprest/rawptrstream.h>
+#include <openssl/evp.h>
 
 namespace edge {
 
+// Compiles the Python file at the faasm:// path given as input, and returns
+// the path the bytecode belongs at (relative to the runtime root) followed by
+// a newline and the bytecode. The bytecode is hash-based and unchecked, as the
+// source's mtime differs on every host, and stale bytecode is removed when the
+// source is re-uploaded.
+static const std::string PYTHON_COMPILER_SOURCE = R"(import importlib.util
+from importlib._bootstrap_external import _code_to_hash_pyc
+
+from pyfaasm.core import get_input, set_output
+
+
+def faasm_main():
+    rel_path = get_input().decode("utf-8")
+    runtime_path = "/" + rel_path
+
+    with open("faasm://" + rel_path, "rb") as fh:
+        source = fh.read()
+
+    code = compile(source, runtime_path, "exec", dont_inherit=True)
+    pyc = _code_to_hash_pyc(code, importlib.util.source_hash(source), False)
+
+    cache_path = importlib.util.cache_from_source(runtime_path).lstrip("/")
+    set_output(cache_path.encode("utf-8") + b"\n" + bytes(pyc))
+)";
+
 // --------------------------------------
 // REQUEST UTILS
 // --------------------------------------
@@ -71,13 +111,276 @@ class PathParts
         }                                                                      \
     }
 
+// Returns the current contents of a shared file, or empty if it doesn't exist
+static std::vector<uint8_t> loadExistingSharedFile(const std::string& path)
+{
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    try {
+        return l.loadSharedFile(path);
+    } catch (storage::SharedFileNotExistsException& e) {
+        return {};
+    }
+}
+
+static std::vector<uint8_t> loadFunctionHash(const faabric::Message& msg)
+{
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    const std::string& wasmVm = conf::getFaasmConfig().wasmVm;
+    if (wasmVm == "wamr" || wasmVm == "sgx") {
+        return l.loadFunctionWamrAotHash(msg);
+    }
+
+    return l.loadFunctionObjectHash(msg);
+}
+
+static void uploadPythonCompiler()
+{
+    static std::once_flag compilerUploaded;
+    std::call_once(compilerUploaded, [] {
+        faabric::Message msg;
+        msg.set_ispython(true);
+        msg.set_pythonuser(PYTHON_COMPILER_USER);
+        msg.set_pythonfunction(PYTHON_COMPILER_FUNC);
+        msg.set_inputdata(PYTHON_COMPILER_SOURCE);
+
+        storage::getFileLoaderWithoutLocalCache().uploadPythonFunction(msg);
+    });
+}
+
+// Compiles an uploaded Python function by running the compiler function in
+// the CPython runtime on a worker, then uploads the bytecode as a shared file.
+// Returns the relative path of the bytecode, or empty if compilation failed.
+static std::string compilePythonFunction(const faabric::Message& funcMsg)
+{
+    uploadPythonCompiler();
+
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    std::string relativePath = l.getPythonFunctionRelativePath(funcMsg);
+
+    auto req = faabric::util::batchExecFactory(PYTHON_USER, PYTHON_FUNC, 1);
+    faabric::Message& msg = *req->mutable_messages(0);
+    msg.set_ispython(true);
+    msg.set_pythonuser(PYTHON_COMPILER_USER);
+    msg.set_pythonfunction(PYTHON_COMPILER_FUNC);
+    msg.set_inputdata(relativePath);
+
+    SPDLOG_DEBUG("Compiling Python file {}", relativePath);
+
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    plannerCli.callFunctions(req);
+    faabric::Message result = plannerCli.getMessageResult(
+      msg, faabric::util::getSystemConfig().globalMessageTimeout);
+
+    const std::string& output = result.outputdata();
+    size_t sep = output.find('\n');
+    if (result.returnvalue() != 0 || sep == std::string::npos) {
+        SPDLOG_ERROR("Failed compiling Python file {}: {}",
+                     relativePath,
+                     output);
+        return "";
+    }
+
+    std::string pycPath = output.substr(0, sep);
+    if (!l.isPythonBytecodeRelativePath(funcMsg, pycPath)) {
+        SPDLOG_ERROR("Compiler gave invalid bytecode path {} for {}",
+                     pycPath,
+                     relativePath);
+        return "";
+    }
+
+    std::vector<uint8_t> pycBytes(output.begin() + sep + 1, output.end());
+
+    SPDLOG_INFO("Uploading bytecode for {} to {} ({} bytes)",
+                relativePath,
+                pycPath,
+                pycBytes.size());
+    l.uploadSharedFile(pycPath, pycBytes);
+
+    return pycPath;
+}
+
 void setPermissiveHeaders(http_response& response)
 {
     response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
     response.headers().add(U("Access-Control-Allow-Methods"),
                            U("GET, POST, PUT, OPTIONS"));
     response.headers().add(U("Access-Control-Allow-Headers"),
-                           U("Accept,Content-Type"));
+                           U("Accept,Content-Type,Range,If-None-Match"));
+    response.headers().add(U("Access-Control-Expose-Headers"),
+                           U("ETag,Content-Range,Accept-Ranges"));
+}
+
+// --------------------------------------
+// CONDITIONAL AND RANGE REQUESTS
+// --------------------------------------
+
+enum RangeResult
+{
+    FULL_RANGE,
+    PARTIAL_RANGE,
+    UNSATISFIABLE_RANGE
+};
+
+static std::string md5ETag(const uint8_t* data, size_t size)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    EVP_Digest(data, size, digest, &digestLen, EVP_md5(), nullptr);
+
+    std::string etag = "\"";
+    for (unsigned int i = 0; i < digestLen; i++) {
+        etag += fmt::format("{:02x}", digest[i]);
+    }
+    etag += "\"";
+
+    return etag;
+}
+
+static bool isNotModified(const http_request& request, const std::string& etag)
+{
+    http_headers headers = request.headers();
+    if (etag.empty() || !headers.has(header_names::if_none_match)) {
+        return false;
+    }
+
+    std::string ifNoneMatch = headers[header_names::if_none_match];
+    std::istringstream tags(ifNoneMatch);
+    std::string tag;
+    while (std::getline(tags, tag, ',')) {
+        tag.erase(0, tag.find_first_not_of(' '));
+        tag.erase(tag.find_last_not_of(' ') + 1);
+        if (faabric::util::startsWith(tag, "W/")) {
+            tag = tag.substr(2);
+        }
+
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static pplx::task<void> replyNotModified(const http_request& request,
+                                         const std::string& etag)
+{
+    http_response response(status_codes::NotModified);
+    setPermissiveHeaders(response);
+    response.headers().add(header_names::etag, etag);
+    return request.reply(response);
+}
+
+// Parses a Range header of the form bytes=start-end, bytes=start- or
+// bytes=-suffixLength into an inclusive range. Only single ranges are
+// supported, anything else gets the whole buffer, as allowed by RFC 9110.
+static RangeResult parseRange(const std::string& header,
+                              size_t size,
+                              size_t& start,
+                              size_t& end)
+{
+    const std::string prefix = "bytes=";
+    if (!faabric::util::startsWith(header, prefix) ||
+        header.find(',') != std::string::npos) {
+        return FULL_RANGE;
+    }
+
+    std::string spec = header.substr(prefix.size());
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return FULL_RANGE;
+    }
+
+    std::string first = spec.substr(0, dash);
+    std::string last = spec.substr(dash + 1);
+
+    try {
+        if (first.empty()) {
+            if (last.empty()) {
+                return FULL_RANGE;
+            }
+
+            size_t suffixLength = std::stoull(last);
+            if (suffixLength == 0) {
+                return UNSATISFIABLE_RANGE;
+            }
+
+            start = size - std::min(suffixLength, size);
+            end = size - 1;
+        } else {
+            start = std::stoull(first);
+            end = last.empty() ? size - 1
+                               : std::min<size_t>(std::stoull(last), size - 1);
+
+            if (start >= size) {
+                return UNSATISFIABLE_RANGE;
+            }
+
+            if (end < start) {
+                return FULL_RANGE;
+            }
+        }
+    } catch (std::exception& e) {
+        return FULL_RANGE;
+    }
+
+    return PARTIAL_RANGE;
+}
+
+// Replies with a buffer of the given size, honouring any If-None-Match and
+// Range headers. The body is opened on just the part of the buffer being sent,
+// so callers can serve it without copying the whole buffer. The returned task
+// completes once the reply has been sent.
+static pplx::task<void> replyWithBytes(
+  const http_request& request,
+  size_t size,
+  const std::string& etag,
+  const std::function<concurrency::streams::istream(size_t, size_t)>& openBody)
+{
+    http_response response;
+    setPermissiveHeaders(response);
+
+    if (size == 0) {
+        response.set_status_code(status_codes::InternalError);
+        response.set_body(EMPTY_FILE_RESPONSE);
+        return request.reply(response);
+    }
+
+    if (isNotModified(request, etag)) {
+        return replyNotModified(request, etag);
+    }
+
+    if (!etag.empty()) {
+        response.headers().add(header_names::etag, etag);
+    }
+
+    size_t start = 0;
+    size_t end = size - 1;
+    RangeResult range = FULL_RANGE;
+    http_headers headers = request.headers();
+    if (headers.has(header_names::range)) {
+        range = parseRange(headers[header_names::range], size, start, end);
+    }
+
+    response.headers().add(header_names::accept_ranges, U("bytes"));
+    if (range == UNSATISFIABLE_RANGE) {
+        response.set_status_code(status_codes::RangeNotSatisfiable);
+        response.headers().add(header_names::content_range,
+                               fmt::format("bytes */{}", size));
+        return request.reply(response);
+    }
+
+    if (range == PARTIAL_RANGE) {
+        response.set_status_code(status_codes::PartialContent);
+        response.headers().add(header_names::content_range,
+                               fmt::format("bytes {}-{}/{}", start, end, size));
+    } else {
+        response.set_status_code(status_codes::OK);
+    }
+
+    size_t length = end - start + 1;
+    response.set_body(
+      openBody(start, length), length, U("application/octet-stream"));
+    return request.reply(response);
 }
 
 // --------------------------------------
@@ -130,21 +433,62 @@ void UploadServer::handleGet(const http_request& request)
 
     storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
     PATH_PART(pathType, pathParts, 0);
-    std::vector<uint8_t> returnBytes;
 
     if (pathType == STATE_URL_PART) {
         SPDLOG_DEBUG("GET request for state at {}", pathParts.relativeUri);
 
         PATH_PART(user, pathParts, 1);
         PATH_PART(key, pathParts, 2);
-        returnBytes = getState(user, key);
+        std::shared_ptr<faabric::state::StateKeyValue> kv = getState(user, key);
+
+        // Serve straight out of the state value, which outlives the response
+        // as the global state holds on to it. We hold the read lock until the
+        // reply has been sent, so uploads can't change it under us.
+        const uint8_t* stateValue = kv->get();
+        size_t stateSize = kv->size();
+        kv->lockRead();
+        try {
+            replyWithBytes(request,
+                           stateSize,
+                           md5ETag(stateValue, stateSize),
+                           [stateValue](size_t start, size_t length) {
+                               return concurrency::streams::rawptr_stream<
+                                 uint8_t>::open_istream(stateValue + start,
+                                                        length);
+                           })
+              .wait();
+        } catch (...) {
+            kv->unlockRead();
+            throw;
+        }
+        kv->unlockRead();
 
     } else if (pathType == SHARED_FILE_URL_PART) {
         SPDLOG_DEBUG("GET request for shared file at {}",
                      pathParts.relativeUri);
 
         PATH_HEADER(filePath, request);
-        returnBytes = l.loadSharedFile(filePath);
+
+        // S3 holds the MD5 of the file as its ETag, so we can tell the client
+        // it's up to date without fetching the file
+        std::string etag = l.getSharedFileETag(filePath);
+        if (isNotModified(request, etag)) {
+            replyNotModified(request, etag);
+            return;
+        }
+
+        std::vector<uint8_t> bytes = l.loadSharedFile(filePath);
+        replyWithBytes(
+          request,
+          bytes.size(),
+          etag,
+          [&bytes](size_t start, size_t length) {
+              // Trim in place, and hand the buffer over to the stream
+              bytes.resize(start + length);
+              bytes.erase(bytes.begin(), bytes.begin() + start);
+              return concurrency::streams::bytestream::open_istream(
+                std::move(bytes));
+          });
 
     } else {
         std::string errMessage =
@@ -153,33 +497,17 @@ void UploadServer::handleGet(const http_request& request)
 
         return;
     }
-
-    http_response response;
-    if (returnBytes.empty()) {
-        response = http_response(status_codes::InternalError);
-        response.set_body(EMPTY_FILE_RESPONSE);
-    } else {
-        response = http_response(status_codes::OK);
-        response.set_body(returnBytes);
-    }
-
-    setPermissiveHeaders(response);
-    request.reply(response);
 }
 
-std::vector<uint8_t> UploadServer::getState(const std::string& user,
-                                            const std::string& key)
+std::shared_ptr<faabric::state::StateKeyValue> UploadServer::getState(
+  const std::string& user,
+  const std::string& key)
 {
     SPDLOG_INFO("Downloading state from ({}/{})", user, key);
 
     faabric::state::State& state = faabric::state::getGlobalState();
     size_t stateSize = state.getStateSize(user, key);
-    const std::shared_ptr<faabric::state::StateKeyValue>& kv =
-      state.getKV(user, key, stateSize);
-    uint8_t* stateValue = kv->get();
-
-    const std::vector<uint8_t> value(stateValue, stateValue + stateSize);
-    return value;
+    return state.getKV(user, key, stateSize);
 }
 
 // --------------------------------------
@@ -233,6 +561,12 @@ void UploadServer::handlePut(const http_request& request)
         PATH_PART(function, pathParts, 2);
         handleFunctionUpload(request, user, function);
 
+    } else if (pathType == WORKFLOW_URL_PART) {
+        SPDLOG_DEBUG("PUT request for workflow at {}", pathParts.relativeUri);
+
+        PATH_PART(user, pathParts, 1);
+        handleWorkflowSubmission(request, user);
+
     } else {
         std::string errMessage =
           fmt::format("Unrecognised PUT request to {}", pathParts.relativeUri);
@@ -246,24 +580,63 @@ void UploadServer::handleStateUpload(const http_request& request,
 {
     SPDLOG_INFO("Upload state to ({}/{})", user, key);
 
-    // Read request body into KV store
-    const concurrency::streams::istream bodyStream = request.body();
-    concurrency::streams::stringstreambuf inputStream;
-    bodyStream.read_to_end(inputStream)
-      .then([&inputStream, &user, &key](size_t size) {
-          if (size > 0) {
-              std::string s = inputStream.collection();
-              const std::vector<uint8_t> bytesData =
-                faabric::util::stringToBytes(s);
-
-              faabric::state::State& state = faabric::state::getGlobalState();
-              const std::shared_ptr<faabric::state::StateKeyValue>& kv =
-                state.getKV(user, key, bytesData.size());
-              kv->set(bytesData.data());
-              kv->pushFull();
-          }
-      })
-      .wait();
+    // When we know the size up front, read the body straight into the state
+    // value rather than buffering it
+    faabric::state::State& state = faabric::state::getGlobalState();
+    size_t contentLength = request.headers().content_length();
+    std::vector<uint8_t> bytesData;
+    if (contentLength == 0) {
+        bytesData = request.extract_vector().get();
+        contentLength = bytesData.size();
+    }
+
+    if (contentLength > 0) {
+        // Existing values keep their size, so a value of a different size
+        // replaces the old one
+        std::shared_ptr<faabric::state::StateKeyValue> kv =
+          state.getKV(user, key, contentLength);
+        if (kv->size() != contentLength) {
+            SPDLOG_DEBUG("Replacing {}/{} ({} -> {} bytes)",
+                         user,
+                         key,
+                         kv->size(),
+                         contentLength);
+            state.deleteKV(user, key);
+            kv = state.getKV(user, key, contentLength);
+        }
+
+        if (kv->size() != contentLength) {
+            SPDLOG_ERROR("State {}/{} is {} bytes, not {}",
+                         user,
+                         key,
+                         kv->size(),
+                         contentLength);
+            http_response response(status_codes::Conflict);
+            setPermissiveHeaders(response);
+            response.set_body("State size mismatch\n");
+            request.reply(response);
+            return;
+        }
+
+        uint8_t* stateValue = kv->get();
+        kv->lockWrite();
+        try {
+            if (bytesData.empty()) {
+                concurrency::streams::rawptr_buffer<uint8_t> stateBuffer(
+                  stateValue, contentLength);
+                request.body().read_to_end(stateBuffer).wait();
+            } else {
+                std::copy(bytesData.begin(), bytesData.end(), stateValue);
+            }
+        } catch (...) {
+            kv->unlockWrite();
+            throw;
+        }
+        kv->unlockWrite();
+
+        kv->flagDirty();
+        kv->pushFull();
+    }
 
     http_response response(status_codes::OK);
     setPermissiveHeaders(response);
@@ -287,8 +660,35 @@ void UploadServer::handlePythonFunctionUpload(const http_request& request,
 
     // Do the upload
     storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    std::string relativePath = l.getPythonFunctionRelativePath(msg);
+    std::vector<uint8_t> oldBytes = loadExistingSharedFile(relativePath);
     l.uploadPythonFunction(msg);
 
+    // Only hosts that may have cached the old version need to know. This has
+    // to happen before compiling, so the compiler doesn't see the old source
+    const std::string& newBytes = msg.inputdata();
+    bool changed =
+      !oldBytes.empty() &&
+      !std::equal(
+        oldBytes.begin(), oldBytes.end(), newBytes.begin(), newBytes.end());
+    if (changed) {
+        storage::broadcastSharedFileInvalidation(relativePath);
+    }
+
+    if (conf::getFaasmConfig().pythonPrecompile == "on") {
+        std::string pycPath = compilePythonFunction(msg);
+        if (!pycPath.empty()) {
+            std::string indexPath = l.getPythonBytecodeIndexRelativePath(msg);
+            l.uploadSharedFile(indexPath,
+                               faabric::util::stringToBytes(pycPath + "\n"));
+
+            if (changed) {
+                storage::broadcastSharedFileInvalidation(indexPath);
+                storage::broadcastSharedFileInvalidation(pycPath);
+            }
+        }
+    }
+
     request.reply(status_codes::OK, "Python function upload complete\n");
 }
 
@@ -297,20 +697,17 @@ void UploadServer::handleSharedFileUpload(const http_request& request,
 {
     SPDLOG_INFO("Uploading shared file {}", path);
 
-    const concurrency::streams::istream bodyStream = request.body();
-    concurrency::streams::stringstreambuf inputStream;
-    bodyStream.read_to_end(inputStream)
-      .then([&inputStream, &path](size_t size) {
-          if (size > 0) {
-              std::string s = inputStream.collection();
-              const std::vector<uint8_t> bytesData =
-                faabric::util::stringToBytes(s);
-              storage::FileLoader& l =
-                storage::getFileLoaderWithoutLocalCache();
-              l.uploadSharedFile(path, bytesData);
-          }
-      })
-      .wait();
+    const std::vector<uint8_t> bytesData = request.extract_vector().get();
+    if (!bytesData.empty()) {
+        storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+        std::vector<uint8_t> oldBytes = loadExistingSharedFile(path);
+        l.uploadSharedFile(path, bytesData);
+
+        bool changed = !oldBytes.empty() && oldBytes != bytesData;
+        if (changed) {
+            storage::broadcastSharedFileInvalidation(path);
+        }
+    }
 
     request.reply(status_codes::OK, "Shared file uploaded\n");
 }
@@ -328,6 +725,7 @@ void UploadServer::handleFunctionUpload(const http_request& request,
     // always use the latest-uploaded WASM. We also want to make sure we use
     // the same file loader to generate the machine code
     storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    std::vector<uint8_t> oldHash = loadFunctionHash(msg);
     l.uploadFunction(msg);
 
     codegen::MachineCodeGenerator& gen = codegen::getMachineCodeGenerator(l);
@@ -335,22 +733,59 @@ void UploadServer::handleFunctionUpload(const http_request& request,
     // so we set the clean flag to true
     gen.codegenForFunction(msg, true);
 
+    // If the function has changed, evict the old version from all hosts
+    if (!oldHash.empty() && oldHash != loadFunctionHash(msg)) {
+        storage::broadcastFunctionInvalidation(msg.user(), msg.function());
+    }
+
     request.reply(status_codes::OK, "Function upload complete\n");
 }
 
+void UploadServer::handleWorkflowSubmission(const http_request& request,
+                                            const std::string& user)
+{
+    std::string spec = request.extract_string().get();
+
+    wasm::Workflow workflow;
+    try {
+        workflow = wasm::parseWorkflow(spec, user);
+    } catch (std::runtime_error& ex) {
+        request.reply(status_codes::BadRequest, ex.what());
+        return;
+    }
+
+    if (workflow.user != user) {
+        request.reply(status_codes::BadRequest,
+                      fmt::format("Workflow for {} submitted to {}",
+                                  workflow.user,
+                                  user));
+        return;
+    }
+
+    // Each workflow is a new app, and clients await its nodes' results there
+    int appId = faabric::util::generateGid();
+    std::vector<int> nodeIds = wasm::submitWorkflow(workflow, appId);
+
+    std::stringstream ids;
+    for (size_t i = 0; i < nodeIds.size(); i++) {
+        ids << (i > 0 ? ", " : "") << nodeIds.at(i);
+    }
+
+    http_response response(status_codes::OK);
+    setPermissiveHeaders(response);
+    response.set_body(
+      fmt::format("{{\"appId\": {}, \"ids\": [{}]}}\n", appId, ids.str()));
+    request.reply(response);
+}
+
 void UploadServer::extractRequestBody(const http_request& req,
                                       faabric::Message& msg)
 {
-    // Read request into msg input data
-    const concurrency::streams::istream bodyStream = req.body();
+    // Read request into a string we can hand straight over to the message
     concurrency::streams::stringstreambuf inputStream;
-    bodyStream.read_to_end(inputStream)
-      .then([&inputStream, &msg](size_t size) {
-          if (size > 0) {
-              std::string s = inputStream.collection();
-              msg.set_inputdata(s);
-          }
-      })
-      .wait();
+    size_t size = req.body().read_to_end(inputStream).get();
+    if (size > 0) {
+        msg.set_inputdata(std::move(inputStream.collection()));
+    }
 }
 }
@@ -1,5 +1,6 @@
 #include <storage/S3Wrapper.h>
 #include <upload/UploadServer.h>
+#include <wasm/workflows.h>
 
 #include <faabric/state/StateServer.h>
 #include <faabric/util/config.h>
@@ -25,7 +26,9 @@ int main()
         edge::UploadServer server;
         server.listen(UPLOAD_PORT);
 
-        // Stop the state server
+        // Stop any workflows submitted through the server, then the state
+        // server
+        wasm::shutdownWorkflows();
         stateServer.stop();
     }
     storage::shutdownFaasmS3();
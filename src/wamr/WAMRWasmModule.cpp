@@ -105,6 +105,9 @@ void WAMRWasmModule::reset(faabric::Message& msg,
     std::string funcStr = faabric::util::funcToString(msg, true);
     SPDLOG_DEBUG("WAMR resetting after {} (snap key {})", funcStr, snapshotKey);
 
+    clearStateHandles();
+    distributedPthreads = false;
+
     wasm_runtime_deinstantiate(moduleInstance);
     bindInternal(msg);
 }
@@ -10,6 +10,7 @@
 #include <wasm/chaining.h>
 #include <wasm/host_interface_test.h>
 #include <wasm/migration.h>
+#include <wasm/workflows.h>
 
 #include <wasm_export.h>
 
@@ -17,51 +18,129 @@ using namespace faabric::scheduler;
 
 namespace wasm {
 
-static std::shared_ptr<faabric::state::StateKeyValue> getStateKV(
-  int32_t* keyPtr,
-  size_t size = 0)
+/**
+ * Await a chained function's completion
+ */
+static int32_t __faasm_await_call_wrapper(wasm_exec_env_t exec_env,
+                                          int32_t callId)
 {
-    WAMRWasmModule* module = getExecutingWAMRModule();
-    module->validateNativePointer(keyPtr, sizeof(int32_t));
+    SPDLOG_DEBUG("S - faasm_await_call {}", callId);
 
-    const faabric::Message* call = &ExecutorContext::get()->getMsg();
-    char* key = reinterpret_cast<char*>(keyPtr); // second
+    int32_t result = wasm::awaitChainedCall((uint32_t)callId);
+    return result;
+}
 
-    faabric::state::State& s = faabric::state::getGlobalState();
-    std::shared_ptr<faabric::state::StateKeyValue> kv;
-    if (size > 0) {
-        kv = s.getKV(call->user(), key, size);
-    } else {
-        kv = s.getKV(call->user(), key);
+// Waits on an array of call ids, writing the ids and return values of those
+// that finish in the order they did so. Either output array may be null.
+static int32_t awaitCallsFromWasm(int32_t idsPtr,
+                                  int32_t nIds,
+                                  int32_t timeoutMs,
+                                  int32_t orderPtr,
+                                  int32_t retsPtr,
+                                  bool waitForAll)
+{
+    if (nIds <= 0) {
+        return 0;
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    auto getArray = [module, nIds](int32_t arrayPtr) -> int32_t* {
+        if (arrayPtr == 0) {
+            return nullptr;
+        }
+        module->validateWasmOffset(arrayPtr, nIds * sizeof(int32_t));
+        return reinterpret_cast<int32_t*>(
+          module->wasmPointerToNative(arrayPtr));
+    };
+
+    int32_t* ids = getArray(idsPtr);
+    int32_t* order = getArray(orderPtr);
+    int32_t* rets = getArray(retsPtr);
+    if (ids == nullptr) {
+        SPDLOG_ERROR("Awaiting {} calls with no ids", nIds);
+        throw std::runtime_error("Awaiting calls with no ids");
     }
 
-    return kv;
+    std::vector<uint32_t> messageIds(ids, ids + nIds);
+    std::vector<ChainedCallResult> results =
+      awaitChainedCalls(messageIds, waitForAll, timeoutMs);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (order != nullptr) {
+            order[i] = (int32_t)results.at(i).messageId;
+        }
+        if (rets != nullptr) {
+            rets[i] = results.at(i).returnValue;
+        }
+    }
+
+    return (int32_t)results.size();
 }
 
-static void __faasm_append_state_wrapper(wasm_exec_env_t execEnv,
-                                         int32_t* keyPtr,
-                                         uint8_t* dataPtr,
-                                         int32_t dataLen)
+/**
+ * Await all of a set of chained calls
+ */
+static int32_t __faasm_await_all_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t idsPtr,
+                                         int32_t nIds,
+                                         int32_t timeoutMs,
+                                         int32_t orderPtr,
+                                         int32_t retsPtr)
 {
-    auto* module = getExecutingWAMRModule();
-    module->validateNativePointer(dataPtr, dataLen);
+    SPDLOG_DEBUG("S - faasm_await_all {} {} {}", idsPtr, nIds, timeoutMs);
 
-    SPDLOG_DEBUG("S - faasm_append_state {}", (char*)keyPtr);
+    return awaitCallsFromWasm(idsPtr, nIds, timeoutMs, orderPtr, retsPtr, true);
+}
+
+/**
+ * Await the first of a set of chained calls to finish
+ */
+static int32_t __faasm_await_any_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t idsPtr,
+                                         int32_t nIds,
+                                         int32_t timeoutMs,
+                                         int32_t orderPtr,
+                                         int32_t retsPtr)
+{
+    SPDLOG_DEBUG("S - faasm_await_any {} {} {}", idsPtr, nIds, timeoutMs);
 
-    auto kv = getStateKV(keyPtr);
-    kv->append(dataPtr, dataLen);
+    return awaitCallsFromWasm(
+      idsPtr, nIds, timeoutMs, orderPtr, retsPtr, false);
 }
 
 /**
- * Await a chained function's completion
+ * Emit a chunk of partial output to whoever is waiting on this call
  */
-static int32_t __faasm_await_call_wrapper(wasm_exec_env_t exec_env,
-                                          int32_t callId)
+static void __faasm_emit_chunk_wrapper(wasm_exec_env_t execEnv,
+                                       uint8_t* data,
+                                       int32_t dataLen)
 {
-    SPDLOG_DEBUG("S - faasm_await_call {}", callId);
+    SPDLOG_TRACE("S - faasm_emit_chunk {}", dataLen);
+    emitCallStreamChunk(data, dataLen);
+}
 
-    int32_t result = wasm::awaitChainedCall((uint32_t)callId);
-    return result;
+/**
+ * Set whether calls chained from now on stream their partial output to us
+ */
+static void __faasm_stream_calls_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t enabled)
+{
+    SPDLOG_TRACE("S - faasm_stream_calls {}", enabled);
+    streamChainedCalls(enabled != 0);
+}
+
+/**
+ * Read the next chunk of partial output from a chained call
+ */
+static int32_t __faasm_read_chunk_wrapper(wasm_exec_env_t execEnv,
+                                          int32_t callId,
+                                          uint8_t* buffer,
+                                          int32_t bufferLen,
+                                          int32_t timeoutMs)
+{
+    SPDLOG_TRACE("S - faasm_read_chunk {} {} {}", callId, bufferLen, timeoutMs);
+    return readChainedCallStreamChunk(
+      (uint32_t)callId, buffer, bufferLen, timeoutMs);
 }
 
 /**
@@ -92,6 +171,107 @@ static int32_t __faasm_chain_ptr_wrapper(wasm_exec_env_t exec_env,
     return makeChainedCall(call.function(), wasmFuncPtr, nullptr, inputData);
 }
 
+/**
+ * Chain a batch of calls in one go, writing their ids to the ids array
+ */
+static int32_t __faasm_chain_batch_wrapper(wasm_exec_env_t execEnv,
+                                           int32_t namePtrsPtr,
+                                           int32_t funcPtrsPtr,
+                                           int32_t inputPtrsPtr,
+                                           int32_t inputLensPtr,
+                                           int32_t nCalls,
+                                           int32_t idsPtr)
+{
+    SPDLOG_DEBUG("S - faasm_chain_batch {} {} {} {} {} {}",
+                 namePtrsPtr,
+                 funcPtrsPtr,
+                 inputPtrsPtr,
+                 inputLensPtr,
+                 nCalls,
+                 idsPtr);
+
+    if (nCalls <= 0) {
+        return 0;
+    }
+
+    // Any of the arrays apart from the names and ids may be null
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    auto getArray = [module, nCalls](int32_t arrayPtr) -> int32_t* {
+        if (arrayPtr == 0) {
+            return nullptr;
+        }
+        module->validateWasmOffset(arrayPtr, nCalls * sizeof(int32_t));
+        return reinterpret_cast<int32_t*>(
+          module->wasmPointerToNative(arrayPtr));
+    };
+
+    int32_t* namePtrs = getArray(namePtrsPtr);
+    int32_t* funcPtrs = getArray(funcPtrsPtr);
+    int32_t* inputPtrs = getArray(inputPtrsPtr);
+    int32_t* inputLens = getArray(inputLensPtr);
+    int32_t* ids = getArray(idsPtr);
+
+    // A null name chains the calling function
+    const std::string thisFunc = ExecutorContext::get()->getMsg().function();
+
+    std::vector<ChainedCall> calls(nCalls);
+    for (int i = 0; i < nCalls; i++) {
+        ChainedCall& call = calls.at(i);
+        if (namePtrs == nullptr || namePtrs[i] == 0) {
+            call.functionName = thisFunc;
+        } else {
+            if (!wasm_runtime_validate_app_str_addr(
+                  module->getModuleInstance(), namePtrs[i])) {
+                SPDLOG_ERROR("Invalid chained function name {}", namePtrs[i]);
+                throw std::runtime_error("Invalid chained function name");
+            }
+            uint8_t* name = module->wasmPointerToNative(namePtrs[i]);
+            call.functionName = std::string(reinterpret_cast<char*>(name));
+        }
+
+        call.wasmFuncPtr = funcPtrs == nullptr ? 0 : funcPtrs[i];
+        if (inputPtrs != nullptr && inputLens != nullptr) {
+            module->validateWasmOffset(inputPtrs[i], inputLens[i]);
+            uint8_t* input = BYTES(module->wasmPointerToNative(inputPtrs[i]));
+            call.inputData.assign(input, input + inputLens[i]);
+        }
+    }
+
+    std::vector<int> callIds = makeChainedCallBatch(calls);
+    if (ids != nullptr) {
+        std::copy(callIds.begin(), callIds.end(), ids);
+    }
+
+    return nCalls;
+}
+
+/**
+ * Submit a workflow of calls, writing the id of each node to the ids array
+ */
+static int32_t __faasm_submit_workflow_wrapper(wasm_exec_env_t execEnv,
+                                               char* spec,
+                                               int32_t specLen,
+                                               int32_t idsPtr,
+                                               int32_t maxIds)
+{
+    SPDLOG_DEBUG("S - faasm_submit_workflow {} {} {}", specLen, idsPtr, maxIds);
+
+    std::vector<int> nodeIds =
+      submitChainedWorkflow(std::string(spec, spec + specLen));
+
+    // Write as many ids as fit, the caller can tell if any are missing
+    int nIds = std::min<int>(nodeIds.size(), std::max(maxIds, 0));
+    if (nIds > 0) {
+        WAMRWasmModule* module = getExecutingWAMRModule();
+        module->validateWasmOffset(idsPtr, nIds * sizeof(int32_t));
+        int32_t* ids =
+          reinterpret_cast<int32_t*>(module->wasmPointerToNative(idsPtr));
+        std::copy(nodeIds.begin(), nodeIds.begin() + nIds, ids);
+    }
+
+    return nodeIds.size();
+}
+
 /*
  * Single entry-point for testing the host interface behaviour
  */
@@ -110,38 +290,6 @@ static void __faasm_migrate_point_wrapper(wasm_exec_env_t execEnv,
     wasm::doMigrationPoint(wasmFuncPtr, std::to_string(funcArg));
 }
 
-static void __faasm_pull_state_wrapper(wasm_exec_env_t execEnv,
-                                       int32_t* keyPtr,
-                                       int32_t stateLen)
-{
-    auto kv = getStateKV(keyPtr, stateLen);
-    SPDLOG_DEBUG("S - pull_state - {} {}", kv->key, stateLen);
-
-    kv->pull();
-}
-
-static void __faasm_push_state_wrapper(wasm_exec_env_t execEnv, int32_t* keyPtr)
-{
-    auto kv = getStateKV(keyPtr, 0);
-    SPDLOG_DEBUG("S - push_state - {}", kv->key);
-    kv->pushFull();
-}
-
-static void __faasm_read_appended_state_wrapper(wasm_exec_env_t execEnv,
-                                                int32_t* keyPtr,
-                                                uint8_t* bufferPtr,
-                                                int32_t bufferLen,
-                                                int32_t numElems)
-{
-    auto* module = getExecutingWAMRModule();
-    module->validateNativePointer(bufferPtr, bufferLen);
-
-    SPDLOG_DEBUG("S - faasm_read_appended_state {}", (char*)keyPtr);
-
-    auto kv = getStateKV(keyPtr, bufferLen);
-    kv->getAppended(bufferPtr, bufferLen, numElems);
-}
-
 /**
  * Read the function input
  */
@@ -152,18 +300,24 @@ static int32_t __faasm_read_input_wrapper(wasm_exec_env_t exec_env,
     SPDLOG_DEBUG("S - faasm_read_input {} {}", inBuff, inLen);
 
     faabric::Message& call = ExecutorContext::get()->getMsg();
-    std::vector<uint8_t> inputBytes =
-      faabric::util::stringToBytes(call.inputdata());
+    size_t inputSize = getChainPayloadSize(call, CHAIN_PAYLOAD_INPUT);
 
     // If nothing, return nothing
-    if (inputBytes.empty()) {
+    if (inputSize == 0) {
         return 0;
     }
 
-    // Write to the wasm buffer
-    int inputSize = faabric::util::safeCopyToBuffer(
-      inputBytes, reinterpret_cast<uint8_t*>(inBuff), inLen);
-    return inputSize;
+    // An empty buffer asks for the size of the input
+    if (inLen <= 0) {
+        return (int32_t)inputSize;
+    }
+
+    // Write to the wasm buffer, straight from the state value if the input
+    // was passed by reference
+    return (int32_t)readChainPayload(call,
+                                     CHAIN_PAYLOAD_INPUT,
+                                     reinterpret_cast<uint8_t*>(inBuff),
+                                     inLen);
 }
 
 /**
@@ -176,20 +330,23 @@ static void __faasm_write_output_wrapper(wasm_exec_env_t exec_env,
     SPDLOG_DEBUG("S - faasm_write_output {} {}", outBuff, outLen);
 
     faabric::Message& call = ExecutorContext::get()->getMsg();
-    call.set_outputdata(outBuff, outLen);
+    setCallOutput(call, BYTES(outBuff), outLen);
 }
 
 static NativeSymbol ns[] = {
-    REG_NATIVE_FUNC(__faasm_append_state, "(**i)"),
+    REG_NATIVE_FUNC(__faasm_await_all, "(iiiii)i"),
+    REG_NATIVE_FUNC(__faasm_await_any, "(iiiii)i"),
     REG_NATIVE_FUNC(__faasm_await_call, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_chain_batch, "(iiiiii)i"),
     REG_NATIVE_FUNC(__faasm_chain_name, "($$i)i"),
     REG_NATIVE_FUNC(__faasm_chain_ptr, "(i$i)i"),
+    REG_NATIVE_FUNC(__faasm_emit_chunk, "(*~)"),
     REG_NATIVE_FUNC(__faasm_host_interface_test, "(i)"),
     REG_NATIVE_FUNC(__faasm_migrate_point, "(ii)"),
-    REG_NATIVE_FUNC(__faasm_pull_state, "(*i)"),
-    REG_NATIVE_FUNC(__faasm_push_state, "(*)"),
-    REG_NATIVE_FUNC(__faasm_read_appended_state, "(**ii)"),
+    REG_NATIVE_FUNC(__faasm_read_chunk, "(i*~i)i"),
     REG_NATIVE_FUNC(__faasm_read_input, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_stream_calls, "(i)"),
+    REG_NATIVE_FUNC(__faasm_submit_workflow, "(*~ii)i"),
     REG_NATIVE_FUNC(__faasm_write_output, "($i)"),
 };
 
@@ -260,7 +260,7 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
 
     SPDLOG_TRACE("S - fd_read {} ({})", fd, path);
 
-    storage::FileDescriptor fileDesc = fileSystem.getFileDescriptor(fd);
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
 
     // Translate app iovecs to native ones
     std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
@@ -277,8 +277,7 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
 
     // Read from fd
     module->validateNativePointer(bytesRead, sizeof(int32_t));
-    *bytesRead =
-      ::readv(fileDesc.getLinuxFd(), ioVecBuffNative.data(), ioVecCountWasm);
+    *bytesRead = fileDesc.read(ioVecBuffNative, ioVecCountWasm);
 
     return __WASI_ESUCCESS;
 }
@@ -375,7 +374,7 @@ static int32_t wasi_fd_write(wasm_exec_env_t exec_env,
     // Capture stdout if needed
     conf::FaasmConfig& conf = conf::getFaasmConfig();
     bool isStd = fd <= 2;
-    if (isStd && conf.captureStdout == "on") {
+    if (isStd && conf.captureStdout != "off") {
         module->captureStdout(ioVecBuffNative.data(), ioVecCountWasm);
     }
 
@@ -53,6 +53,19 @@ static int32_t mmap_wrapper(wasm_exec_env_t exec_env,
         // If fd is provided, we're mapping a file into memory
         storage::FileDescriptor& fileDesc =
           module->getFileSystem().getFileDescriptor(fd);
+
+        // Files in the runtime image have no Linux fd, so copy them in
+        if (fileDesc.isImageBacked()) {
+            std::span<const uint8_t> data = fileDesc.getImageData();
+            uint32_t wasmPtr = module->mmapMemory(length);
+            auto* hostPtr =
+              static_cast<uint8_t*>(module->wasmPointerToNative(wasmPtr));
+            std::copy(data.begin(),
+                      data.begin() + std::min<size_t>(length, data.size()),
+                      hostPtr);
+            return wasmPtr;
+        }
+
         return module->mmapFile(fileDesc.getLinuxFd(), length);
     }
 
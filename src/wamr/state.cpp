@@ -1,101 +1,742 @@
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/files.h>
 #include <faabric/util/logging.h>
 
+#include <storage/FileDescriptor.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/state.h>
 #include <wasm_export.h>
 
 using namespace faabric::scheduler;
 
 namespace wasm {
+
+// ------------------------------------
+// STATE
+// ------------------------------------
+
+static std::shared_ptr<faabric::state::StateKeyValue> getStateKV(
+  const char* key,
+  size_t size = 0)
+{
+    std::string user = ExecutorContext::get()->getMsg().user();
+
+    faabric::state::State& s = faabric::state::getGlobalState();
+    if (size > 0) {
+        return s.getKV(user, key, size);
+    }
+
+    return s.getKV(user, key);
+}
+
+// Applies any combined offset writes and dirty flags to the key, which must
+// happen before it's read, pushed, pulled or unlocked
+static const std::shared_ptr<faabric::state::StateKeyValue>& flushedKV(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    getExecutingModule()->flushStateWrites(kv);
+    return kv;
+}
+
+// Returns a pointer to an array of ints in wasm memory, checking it's in
+// bounds. Arrays are passed as plain offsets so that zero can mean none.
+static int32_t* getWasmIntArray(int32_t wasmPtr, int32_t nElems)
+{
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateWasmOffset(wasmPtr, nElems * sizeof(int32_t));
+    return reinterpret_cast<int32_t*>(module->wasmPointerToNative(wasmPtr));
+}
+
+// Reads arrays of key pointers, and optionally sizes, out of wasm memory
+static StateKVs getStateKVs(int32_t keyPtrsPtr, int32_t sizesPtr, int32_t nKeys)
+{
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    int32_t* keyPtrs = getWasmIntArray(keyPtrsPtr, nKeys);
+    int32_t* sizes = sizesPtr == 0 ? nullptr : getWasmIntArray(sizesPtr, nKeys);
+
+    StateKVs kvs;
+    kvs.reserve(nKeys);
+    for (int i = 0; i < nKeys; i++) {
+        if (!wasm_runtime_validate_app_str_addr(module->getModuleInstance(),
+                                                keyPtrs[i])) {
+            SPDLOG_ERROR("Invalid state key pointer {}", keyPtrs[i]);
+            throw std::runtime_error("Invalid state key pointer");
+        }
+
+        const char* key =
+          reinterpret_cast<char*>(module->wasmPointerToNative(keyPtrs[i]));
+        kvs.emplace_back(
+          flushedKV(getStateKV(key, sizes == nullptr ? 0 : sizes[i])));
+    }
+
+    return kvs;
+}
+
+static int32_t _readStatePtrImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  int32_t totalLen)
+{
+    // Map shared memory
+    WasmModule* module = getExecutingModule();
+    uint32_t wasmPtr = module->mapSharedStateMemory(kv, 0, totalLen);
+
+    // Call get to make sure the value is pulled
+    kv->get();
+
+    return wasmPtr;
+}
+
+static int32_t _readStateOffsetPtrImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  int32_t offset,
+  int32_t len)
+{
+    // Map whole key in shared memory
+    WasmModule* module = getExecutingModule();
+    uint32_t wasmPtr = module->mapSharedStateMemory(kv, offset, len);
+
+    // Call get to make sure the value is there
+    kv->getChunk(offset, len);
+
+    return wasmPtr;
+}
+
+static void __faasm_push_state_wrapper(wasm_exec_env_t execEnv, char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - push_state - {}", kv->key);
+    kv->pushFull();
+}
+
+static void __faasm_push_state_partial_wrapper(wasm_exec_env_t execEnv,
+                                               char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - push_state_partial - {}", kv->key);
+    kv->pushPartial();
+}
+
+static void __faasm_push_state_partial_mask_wrapper(wasm_exec_env_t execEnv,
+                                                    char* key,
+                                                    char* maskKey)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - push_state_partial_mask - {} {}", kv->key, maskKey);
+    kv->pushPartialMask(flushedKV(getStateKV(maskKey)));
+}
+
+static void __faasm_pull_state_wrapper(wasm_exec_env_t execEnv,
+                                       char* key,
+                                       int32_t stateLen)
+{
+    auto kv = flushedKV(getStateKV(key, stateLen));
+    SPDLOG_DEBUG("S - pull_state - {} {}", kv->key, stateLen);
+    kv->pull();
+}
+
+static void __faasm_pull_state_multi_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t keyPtrsPtr,
+                                             int32_t stateLensPtr,
+                                             int32_t nKeys)
+{
+    SPDLOG_DEBUG(
+      "S - pull_state_multi - {} {} {}", keyPtrsPtr, stateLensPtr, nKeys);
+
+    pullStateMulti(getStateKVs(keyPtrsPtr, stateLensPtr, nKeys));
+}
+
+static void __faasm_pull_state_offset_multi_wrapper(wasm_exec_env_t execEnv,
+                                                    int32_t keyPtrsPtr,
+                                                    int32_t totalLensPtr,
+                                                    int32_t offsetsPtr,
+                                                    int32_t lensPtr,
+                                                    int32_t nKeys)
+{
+    SPDLOG_DEBUG("S - pull_state_offset_multi - {} {} {} {} {}",
+                 keyPtrsPtr,
+                 totalLensPtr,
+                 offsetsPtr,
+                 lensPtr,
+                 nKeys);
+
+    int32_t* offsets = getWasmIntArray(offsetsPtr, nKeys);
+    int32_t* lens = getWasmIntArray(lensPtr, nKeys);
+
+    pullStateChunksMulti(getStateKVs(keyPtrsPtr, totalLensPtr, nKeys),
+                         std::vector<long>(offsets, offsets + nKeys),
+                         std::vector<long>(lens, lens + nKeys));
+}
+
+static void __faasm_push_state_multi_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t keyPtrsPtr,
+                                             int32_t nKeys)
+{
+    SPDLOG_DEBUG("S - push_state_multi - {} {}", keyPtrsPtr, nKeys);
+
+    pushStateMulti(getStateKVs(keyPtrsPtr, 0, nKeys), false);
+}
+
+static void __faasm_push_state_partial_multi_wrapper(wasm_exec_env_t execEnv,
+                                                     int32_t keyPtrsPtr,
+                                                     int32_t nKeys)
+{
+    SPDLOG_DEBUG("S - push_state_partial_multi - {} {}", keyPtrsPtr, nKeys);
+
+    pushStateMulti(getStateKVs(keyPtrsPtr, 0, nKeys), true);
+}
+
+static void __faasm_lock_state_read_wrapper(wasm_exec_env_t execEnv, char* key)
+{
+    auto kv = getStateKV(key);
+    SPDLOG_DEBUG("S - lock_state_read - {}", kv->key);
+    kv->lockRead();
+}
+
+static void __faasm_unlock_state_read_wrapper(wasm_exec_env_t execEnv,
+                                              char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - unlock_state_read - {}", kv->key);
+    kv->unlockRead();
+}
+
+static void __faasm_lock_state_write_wrapper(wasm_exec_env_t execEnv,
+                                             char* key)
+{
+    auto kv = getStateKV(key);
+    SPDLOG_DEBUG("S - lock_state_write - {}", kv->key);
+    kv->lockWrite();
+}
+
+static void __faasm_unlock_state_write_wrapper(wasm_exec_env_t execEnv,
+                                               char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - unlock_state_write - {}", kv->key);
+    kv->unlockWrite();
+}
+
+/**
+ * Writes the given data buffer to the state referenced by the given key.
+ */
+static void __faasm_write_state_wrapper(wasm_exec_env_t execEnv,
+                                        char* key,
+                                        uint8_t* buffer,
+                                        int32_t bufferLen)
+{
+    auto kv = flushedKV(getStateKV(key, bufferLen));
+    SPDLOG_DEBUG("S - write_state - {} <data> {}", kv->key, bufferLen);
+
+    checkStateBufferSize(kv, bufferLen);
+    kv->set(buffer);
+}
+
+static void __faasm_append_state_wrapper(wasm_exec_env_t execEnv,
+                                         char* key,
+                                         uint8_t* data,
+                                         int32_t dataLen)
+{
+    SPDLOG_DEBUG("S - append_state - {} {}", key, dataLen);
+
+    auto kv = getStateKV(key);
+    kv->append(data, dataLen);
+}
+
+static void __faasm_read_appended_state_wrapper(wasm_exec_env_t execEnv,
+                                                char* key,
+                                                uint8_t* buffer,
+                                                int32_t bufferLen,
+                                                int32_t nElems)
+{
+    SPDLOG_DEBUG("S - read_appended_state - {} {} {}", key, bufferLen, nElems);
+
+    auto kv = getStateKV(key, bufferLen);
+    kv->getAppended(buffer, bufferLen, nElems);
+}
+
+static void __faasm_clear_appended_state_wrapper(wasm_exec_env_t execEnv,
+                                                 char* key)
+{
+    SPDLOG_DEBUG("S - clear_appended_state - {}", key);
+
+    auto kv = getStateKV(key);
+    kv->clearAppended();
+}
+
+static void __faasm_write_state_offset_wrapper(wasm_exec_env_t execEnv,
+                                               char* key,
+                                               int32_t totalLen,
+                                               int32_t offset,
+                                               uint8_t* data,
+                                               int32_t dataLen)
+{
+    auto kv = getStateKV(key, totalLen);
+    SPDLOG_DEBUG("S - write_state_offset - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 dataLen);
+
+    getExecutingModule()->writeStateOffset(kv, offset, data, dataLen);
+}
+
+static int32_t __faasm_write_state_from_file_wrapper(wasm_exec_env_t execEnv,
+                                                     char* key,
+                                                     char* path)
+{
+    SPDLOG_DEBUG("S - write_state_from_file - {} {}", key, path);
+
+    // Read file into bytes
+    const std::string maskedPath = storage::prependRuntimeRoot(path);
+    const std::vector<uint8_t> bytes =
+      faabric::util::readFileToBytes(maskedPath);
+    unsigned long fileLength = bytes.size();
+
+    // Write to state, after any earlier combined writes so that they don't
+    // later overwrite it
+    auto kv = flushedKV(getStateKV(key, fileLength));
+    checkStateBufferSize(kv, fileLength);
+    kv->set(bytes.data());
+
+    return fileLength;
+}
+
 /**
  * Read state for the given key into the buffer provided.
  *
  * Returns size of the state if buffer length is zero.
  */
-static int32_t __faasm_read_state_wrapper(wasm_exec_env_t exec_env,
+static int32_t __faasm_read_state_wrapper(wasm_exec_env_t execEnv,
                                           char* key,
-                                          char* buffer,
+                                          uint8_t* buffer,
                                           int32_t bufferLen)
 {
-    SPDLOG_DEBUG("S - faasm_read_state {} <buffer> {}", key, bufferLen);
-
-    std::string user = ExecutorContext::get()->getMsg().user();
+    SPDLOG_DEBUG("S - read_state - {} {}", key, bufferLen);
 
     if (bufferLen == 0) {
         // If buffer len is zero, just need the state size
+        std::string user = ExecutorContext::get()->getMsg().user();
         faabric::state::State& state = faabric::state::getGlobalState();
         return (int32_t)state.getStateSize(user, key);
-    } else {
-        // Write state to buffer
-        auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
-        kv->get(reinterpret_cast<uint8_t*>(buffer));
-
-        return kv->size();
     }
 
-    return 0;
+    // Write state to buffer
+    auto kv = flushedKV(getStateKV(key, bufferLen));
+    checkStateBufferSize(kv, bufferLen);
+    kv->get(buffer);
+
+    return kv->size();
 }
 
 /**
- * Create a new memory region, read the state for the given key into it,
- * then return a pointer to the new memory.
+ * Map the state for the given key into memory, then return a pointer to it.
  */
-static int32_t __faasm_read_state_ptr_wrapper(wasm_exec_env_t exec_env,
+static int32_t __faasm_read_state_ptr_wrapper(wasm_exec_env_t execEnv,
                                               char* key,
+                                              int32_t totalLen)
+{
+    auto kv = flushedKV(getStateKV(key, totalLen));
+    SPDLOG_DEBUG("S - read_state_ptr - {} {}", kv->key, totalLen);
+
+    return _readStatePtrImpl(kv, totalLen);
+}
+
+static void __faasm_read_state_offset_wrapper(wasm_exec_env_t execEnv,
+                                              char* key,
+                                              int32_t totalLen,
+                                              int32_t offset,
+                                              uint8_t* buffer,
                                               int32_t bufferLen)
 {
-    std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
+    auto kv = flushedKV(getStateKV(key, totalLen));
+    SPDLOG_DEBUG("S - read_state_offset - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 bufferLen);
 
-    SPDLOG_DEBUG("S - faasm_read_state_ptr - {} {}", kv->key, bufferLen);
+    kv->getChunk(offset, buffer, bufferLen);
+}
 
-    // Map shared memory
-    WasmModule* module = getExecutingModule();
-    uint32_t wasmPtr = module->mapSharedStateMemory(kv, 0, bufferLen);
+static int32_t __faasm_read_state_offset_ptr_wrapper(wasm_exec_env_t execEnv,
+                                                     char* key,
+                                                     int32_t totalLen,
+                                                     int32_t offset,
+                                                     int32_t len)
+{
+    auto kv = flushedKV(getStateKV(key, totalLen));
+    SPDLOG_DEBUG("S - read_state_offset_ptr - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 len);
 
-    // Call get to make sure the value is pulled
-    kv->get();
+    return _readStateOffsetPtrImpl(kv, offset, len);
+}
 
-    return wasmPtr;
+static void __faasm_state_unmap_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t wasmPtr)
+{
+    SPDLOG_DEBUG("S - state_unmap - {}", wasmPtr);
+    getExecutingModule()->unmapSharedStateMemory(wasmPtr);
 }
 
-/**
- * Writes the given data buffer to the state referenced by the given key.
- */
-static void __faasm_write_state_wrapper(wasm_exec_env_t exec_env,
-                                        char* key,
-                                        char* buffer,
-                                        int32_t bufferLen)
+static void __faasm_flag_state_dirty_wrapper(wasm_exec_env_t execEnv,
+                                             char* key,
+                                             int32_t totalLen)
 {
-    std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
+    auto kv = getStateKV(key, totalLen);
+    SPDLOG_DEBUG("S - flag_state_dirty - {} {}", kv->key, totalLen);
 
-    SPDLOG_DEBUG("S - faasm_write_state - {} <data> {}", kv->key, bufferLen);
+    kv->flagDirty();
+}
 
-    kv->set(reinterpret_cast<uint8_t*>(buffer));
+static void __faasm_flag_state_offset_dirty_wrapper(wasm_exec_env_t execEnv,
+                                                    char* key,
+                                                    int32_t totalLen,
+                                                    int32_t offset,
+                                                    int32_t len)
+{
+    // Avoid heavy logging
+    auto kv = getStateKV(key, totalLen);
+    getExecutingModule()->flagStateOffsetDirty(kv, offset, len);
 }
 
-/**
- * Pushes the state for the given key
- */
-static void __faasm_push_state_wrapper(wasm_exec_env_t exec_env, char* key)
+// ------------------------------------
+// STATE HANDLES
+// ------------------------------------
+
+static const std::shared_ptr<faabric::state::StateKeyValue>& getStateHandleKV(
+  int32_t handle)
+{
+    return getExecutingModule()->getStateHandle(handle);
+}
+
+static int32_t __faasm_state_open_wrapper(wasm_exec_env_t execEnv,
+                                          char* key,
+                                          int32_t size)
 {
-    SPDLOG_DEBUG("S - faasm_push_state - {}", key);
+    SPDLOG_DEBUG("S - state_open - {} {}", key, size);
 
     std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, 0);
-    kv->pushFull();
+    return getExecutingModule()->openStateHandle(user, key, size);
+}
+
+static void __faasm_push_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                              int32_t handle)
+{
+    flushedKV(getStateHandleKV(handle))->pushFull();
+}
+
+static void __faasm_push_state_partial_handle_wrapper(wasm_exec_env_t execEnv,
+                                                      int32_t handle)
+{
+    flushedKV(getStateHandleKV(handle))->pushPartial();
+}
+
+static void __faasm_push_state_partial_mask_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle,
+  int32_t maskHandle)
+{
+    flushedKV(getStateHandleKV(handle))
+      ->pushPartialMask(flushedKV(getStateHandleKV(maskHandle)));
+}
+
+static void __faasm_pull_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                              int32_t handle)
+{
+    flushedKV(getStateHandleKV(handle))->pull();
+}
+
+static void __faasm_lock_state_read_handle_wrapper(wasm_exec_env_t execEnv,
+                                                   int32_t handle)
+{
+    getStateHandleKV(handle)->lockRead();
+}
+
+static void __faasm_unlock_state_read_handle_wrapper(wasm_exec_env_t execEnv,
+                                                     int32_t handle)
+{
+    flushedKV(getStateHandleKV(handle))->unlockRead();
+}
+
+static void __faasm_lock_state_write_handle_wrapper(wasm_exec_env_t execEnv,
+                                                    int32_t handle)
+{
+    getStateHandleKV(handle)->lockWrite();
+}
+
+static void __faasm_unlock_state_write_handle_wrapper(wasm_exec_env_t execEnv,
+                                                      int32_t handle)
+{
+    flushedKV(getStateHandleKV(handle))->unlockWrite();
+}
+
+static void __faasm_write_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                               int32_t handle,
+                                               uint8_t* data,
+                                               int32_t dataLen)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    checkStateBufferSize(kv, dataLen);
+    kv->set(data);
+}
+
+static void __faasm_append_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t handle,
+                                                uint8_t* data,
+                                                int32_t dataLen)
+{
+    getStateHandleKV(handle)->append(data, dataLen);
+}
+
+static void __faasm_read_appended_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                                       int32_t handle,
+                                                       uint8_t* buffer,
+                                                       int32_t bufferLen,
+                                                       int32_t nElems)
+{
+    getStateHandleKV(handle)->getAppended(buffer, bufferLen, nElems);
+}
+
+static void __faasm_clear_appended_state_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle)
+{
+    getStateHandleKV(handle)->clearAppended();
+}
+
+static void __faasm_write_state_offset_handle_wrapper(wasm_exec_env_t execEnv,
+                                                      int32_t handle,
+                                                      int32_t offset,
+                                                      uint8_t* data,
+                                                      int32_t dataLen)
+{
+    getExecutingModule()->writeStateOffset(
+      getStateHandleKV(handle), offset, data, dataLen);
+}
+
+static int32_t __faasm_read_state_handle_wrapper(wasm_exec_env_t execEnv,
+                                                 int32_t handle,
+                                                 uint8_t* buffer,
+                                                 int32_t bufferLen)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+
+    // If buffer len is zero, just need the state size
+    if (bufferLen > 0) {
+        checkStateBufferSize(kv, bufferLen);
+        kv->get(buffer);
+    }
+
+    return kv->size();
+}
+
+static int32_t __faasm_read_state_ptr_handle_wrapper(wasm_exec_env_t execEnv,
+                                                     int32_t handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return _readStatePtrImpl(kv, kv->size());
+}
+
+static void __faasm_read_state_offset_handle_wrapper(wasm_exec_env_t execEnv,
+                                                     int32_t handle,
+                                                     int32_t offset,
+                                                     uint8_t* buffer,
+                                                     int32_t bufferLen)
+{
+    flushedKV(getStateHandleKV(handle))->getChunk(offset, buffer, bufferLen);
+}
+
+static int32_t __faasm_read_state_offset_ptr_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle,
+  int32_t offset,
+  int32_t len)
+{
+    return _readStateOffsetPtrImpl(
+      flushedKV(getStateHandleKV(handle)), offset, len);
+}
+
+static void __faasm_flag_state_dirty_handle_wrapper(wasm_exec_env_t execEnv,
+                                                    int32_t handle)
+{
+    getStateHandleKV(handle)->flagDirty();
+}
+
+static void __faasm_flag_state_offset_dirty_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle,
+  int32_t offset,
+  int32_t len)
+{
+    getExecutingModule()->flagStateOffsetDirty(
+      getStateHandleKV(handle), offset, len);
+}
+
+// ------------------------------------
+// ASYNC STATE
+// ------------------------------------
+
+static int32_t startStateTransfer(std::function<void()> op)
+{
+    return getExecutingModule()->startStateTransfer(std::move(op));
+}
+
+static int32_t __faasm_pull_state_async_wrapper(wasm_exec_env_t execEnv,
+                                                char* key,
+                                                int32_t stateLen)
+{
+    auto kv = flushedKV(getStateKV(key, stateLen));
+    SPDLOG_DEBUG("S - pull_state_async - {} {}", kv->key, stateLen);
+
+    return startStateTransfer([kv] { kv->pull(); });
+}
+
+static int32_t __faasm_pull_state_offset_async_wrapper(wasm_exec_env_t execEnv,
+                                                       char* key,
+                                                       int32_t totalLen,
+                                                       int32_t offset,
+                                                       int32_t len)
+{
+    auto kv = flushedKV(getStateKV(key, totalLen));
+    SPDLOG_DEBUG("S - pull_state_offset_async - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 len);
+
+    // Getting a chunk pulls it if it's not already present
+    return startStateTransfer([kv, offset, len] { kv->getChunk(offset, len); });
+}
+
+static int32_t __faasm_push_state_async_wrapper(wasm_exec_env_t execEnv,
+                                                char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - push_state_async - {}", kv->key);
+
+    return startStateTransfer([kv] { kv->pushFull(); });
+}
+
+static int32_t __faasm_push_state_partial_async_wrapper(wasm_exec_env_t execEnv,
+                                                        char* key)
+{
+    auto kv = flushedKV(getStateKV(key));
+    SPDLOG_DEBUG("S - push_state_partial_async - {}", kv->key);
+
+    return startStateTransfer([kv] { kv->pushPartial(); });
+}
+
+static int32_t __faasm_pull_state_async_handle_wrapper(wasm_exec_env_t execEnv,
+                                                       int32_t handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pull(); });
+}
+
+static int32_t __faasm_pull_state_offset_async_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle,
+  int32_t offset,
+  int32_t len)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv, offset, len] { kv->getChunk(offset, len); });
+}
+
+static int32_t __faasm_push_state_async_handle_wrapper(wasm_exec_env_t execEnv,
+                                                       int32_t handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pushFull(); });
+}
+
+static int32_t __faasm_push_state_partial_async_handle_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pushPartial(); });
+}
+
+static void __faasm_state_wait_wrapper(wasm_exec_env_t execEnv,
+                                       int32_t requestId)
+{
+    SPDLOG_DEBUG("S - state_wait - {}", requestId);
+    getExecutingModule()->awaitStateTransfer(requestId);
+}
+
+static int32_t __faasm_state_test_wrapper(wasm_exec_env_t execEnv,
+                                          int32_t requestId)
+{
+    SPDLOG_TRACE("S - state_test - {}", requestId);
+    return getExecutingModule()->testStateTransfer(requestId);
 }
 
 static NativeSymbol ns[] = {
-    REG_NATIVE_FUNC(__faasm_read_state, "($$i)i"),
-    REG_NATIVE_FUNC(__faasm_read_state_ptr, "($i)i"),
-    REG_NATIVE_FUNC(__faasm_write_state, "($$i)"),
+    REG_NATIVE_FUNC(__faasm_append_state, "($*~)"),
+    REG_NATIVE_FUNC(__faasm_clear_appended_state, "($)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_dirty, "($i)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_offset_dirty, "($iii)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_read, "($)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_write, "($)"),
+    REG_NATIVE_FUNC(__faasm_pull_state, "($i)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_multi, "(iii)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_offset_multi, "(iiiii)"),
     REG_NATIVE_FUNC(__faasm_push_state, "($)"),
+    REG_NATIVE_FUNC(__faasm_push_state_multi, "(ii)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial, "($)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_mask, "($$)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_multi, "(ii)"),
+    REG_NATIVE_FUNC(__faasm_read_appended_state, "($*~i)"),
+    REG_NATIVE_FUNC(__faasm_read_state, "($*~)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset, "($ii*~)"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset_ptr, "($iii)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_ptr, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_state_unmap, "(i)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_read, "($)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_write, "($)"),
+    REG_NATIVE_FUNC(__faasm_write_state, "($*~)"),
+    REG_NATIVE_FUNC(__faasm_write_state_from_file, "($$)i"),
+    REG_NATIVE_FUNC(__faasm_write_state_offset, "($ii*~)"),
+    // Handles
+    REG_NATIVE_FUNC(__faasm_append_state_handle, "(i*~)"),
+    REG_NATIVE_FUNC(__faasm_clear_appended_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_dirty_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_offset_dirty_handle, "(iii)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_read_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_write_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_push_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_mask_handle, "(ii)"),
+    REG_NATIVE_FUNC(__faasm_read_appended_state_handle, "(i*~i)"),
+    REG_NATIVE_FUNC(__faasm_read_state_handle, "(i*~)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset_handle, "(ii*~)"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset_ptr_handle, "(iii)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_ptr_handle, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_state_open, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_read_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_write_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_write_state_handle, "(i*~)"),
+    REG_NATIVE_FUNC(__faasm_write_state_offset_handle, "(ii*~)"),
+    // Async
+    REG_NATIVE_FUNC(__faasm_pull_state_async, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_pull_state_async_handle, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_pull_state_offset_async, "($iii)i"),
+    REG_NATIVE_FUNC(__faasm_pull_state_offset_async_handle, "(iii)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_async, "($)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_async_handle, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_async, "($)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_async_handle, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_state_test, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_state_wait, "(i)"),
 };
 
 uint32_t getFaasmStateApi(NativeSymbol** nativeSymbols)
@@ -0,0 +1,87 @@
+#include <wasm/RegionAllocator.h>
+
+#include <faabric/util/logging.h>
+
+#include <iterator>
+#include <stdexcept>
+
+namespace wasm {
+
+std::optional<uint32_t> RegionAllocator::allocate(uint32_t size)
+{
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        auto [start, rangeSize] = *it;
+        if (rangeSize < size) {
+            continue;
+        }
+
+        // Hand out the bottom of the range, keeping the rest free
+        freeRanges.erase(it);
+        if (rangeSize > size) {
+            freeRanges.emplace(start + size, rangeSize - size);
+        }
+
+        SPDLOG_TRACE("MEM - reusing free region {}-{}", start, start + size);
+        return start;
+    }
+
+    return std::nullopt;
+}
+
+void RegionAllocator::free(uint32_t start, uint32_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    uint64_t end = (uint64_t)start + size;
+
+    // Check the range doesn't overlap one that's already free
+    auto next = freeRanges.lower_bound(start);
+    bool overlapsNext = next != freeRanges.end() && next->first < end;
+    bool overlapsPrev =
+      next != freeRanges.begin() &&
+      (uint64_t)std::prev(next)->first + std::prev(next)->second > start;
+    if (overlapsNext || overlapsPrev) {
+        SPDLOG_ERROR("Freeing region {}-{} which is already free", start, end);
+        throw std::runtime_error("Freeing region which is already free");
+    }
+
+    // Merge with the following range
+    if (next != freeRanges.end() && next->first == end) {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+
+    // Merge with the preceding range
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if ((uint64_t)prev->first + prev->second == start) {
+            prev->second += size;
+            return;
+        }
+    }
+
+    freeRanges.emplace_hint(next, start, size);
+}
+
+void RegionAllocator::clear()
+{
+    freeRanges.clear();
+}
+
+size_t RegionAllocator::getFreeBytes() const
+{
+    size_t total = 0;
+    for (const auto& [start, size] : freeRanges) {
+        total += size;
+    }
+
+    return total;
+}
+
+size_t RegionAllocator::getNumFreeRanges() const
+{
+    return freeRanges.size();
+}
+}
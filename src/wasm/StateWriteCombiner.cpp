@@ -0,0 +1,182 @@
+#include <wasm/StateWriteCombiner.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace wasm {
+
+void StateWriteCombiner::write(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  long offset,
+  const uint8_t* data,
+  size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+
+    faabric::util::UniqueLock lock(mx);
+    metrics.fragmentsIn++;
+    metrics.bytesIn += length;
+
+    PendingKey& p = pending[kv.get()];
+    p.kv = kv;
+
+    // Find the first pending write that overlaps or touches this one
+    long start = offset;
+    long end = offset + (long)length;
+    auto first = p.writes.upper_bound(start);
+    if (first != p.writes.begin()) {
+        auto prev = std::prev(first);
+        if (prev->first + (long)prev->second.size() >= start) {
+            first = prev;
+        }
+    }
+
+    if (first == p.writes.end() || first->first > end) {
+        p.writes.emplace(start, std::vector<uint8_t>(data, data + length));
+        p.writeBytes += length;
+    } else {
+        // Grow the first run in place rather than building a new buffer, so
+        // runs of ascending writes only copy each byte once (amortised). A
+        // write that extends the run downwards still has to shift it.
+        if (start < first->first) {
+            std::vector<uint8_t> bytes = std::move(first->second);
+            bytes.insert(bytes.begin(), first->first - start, 0);
+            p.writeBytes += first->first - start;
+            p.writes.erase(first);
+            first = p.writes.emplace(start, std::move(bytes)).first;
+        }
+
+        std::vector<uint8_t>& run = first->second;
+        long runStart = first->first;
+
+        // Absorb any later runs that this write now reaches
+        auto next = std::next(first);
+        while (next != p.writes.end() && next->first <= end) {
+            long nextEnd = next->first + (long)next->second.size();
+            if (nextEnd > runStart + (long)run.size()) {
+                size_t oldSize = run.size();
+                run.resize(nextEnd - runStart);
+                p.writeBytes += run.size() - oldSize;
+            }
+            std::copy(next->second.begin(),
+                      next->second.end(),
+                      run.begin() + (next->first - runStart));
+            p.writeBytes -= next->second.size();
+            next = p.writes.erase(next);
+        }
+
+        if (end > runStart + (long)run.size()) {
+            size_t oldSize = run.size();
+            run.resize(end - runStart);
+            p.writeBytes += run.size() - oldSize;
+        }
+
+        // The new write goes on top
+        std::copy(data, data + length, run.begin() + (offset - runStart));
+    }
+
+    if (p.writeBytes > STATE_WRITE_COMBINE_MAX_BYTES) {
+        doFlush(p);
+        pending.erase(kv.get());
+    }
+}
+
+void StateWriteCombiner::flagDirty(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  long offset,
+  size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+
+    faabric::util::UniqueLock lock(mx);
+    metrics.fragmentsIn++;
+
+    PendingKey& p = pending[kv.get()];
+    p.kv = kv;
+
+    long start = offset;
+    long end = offset + (long)length;
+    auto first = p.dirty.upper_bound(start);
+    if (first != p.dirty.begin() && std::prev(first)->second >= start) {
+        first = std::prev(first);
+    }
+
+    auto last = first;
+    while (last != p.dirty.end() && last->first <= end) {
+        start = std::min(start, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+
+    p.dirty.erase(first, last);
+    p.dirty.emplace(start, end);
+}
+
+void StateWriteCombiner::flush(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    faabric::util::UniqueLock lock(mx);
+    auto it = pending.find(kv.get());
+    if (it == pending.end()) {
+        return;
+    }
+
+    doFlush(it->second);
+    pending.erase(it);
+}
+
+void StateWriteCombiner::flushAll()
+{
+    faabric::util::UniqueLock lock(mx);
+    for (auto& [ptr, p] : pending) {
+        doFlush(p);
+    }
+    pending.clear();
+
+    SPDLOG_DEBUG("State write combining merged {} fragments into {} ({} "
+                 "bytes, {} flushes)",
+                 metrics.fragmentsIn,
+                 metrics.fragmentsOut,
+                 metrics.bytesIn,
+                 metrics.flushes);
+}
+
+void StateWriteCombiner::clear()
+{
+    faabric::util::UniqueLock lock(mx);
+    pending.clear();
+}
+
+StateWriteCombinerMetrics StateWriteCombiner::getMetrics()
+{
+    faabric::util::UniqueLock lock(mx);
+    return metrics;
+}
+
+void StateWriteCombiner::doFlush(PendingKey& p)
+{
+    // Setting a chunk also flags it dirty
+    for (const auto& [start, bytes] : p.writes) {
+        p.kv->setChunk(start, bytes.data(), bytes.size());
+    }
+
+    for (const auto& [start, end] : p.dirty) {
+        p.kv->flagChunkDirty(start, end - start);
+    }
+
+    SPDLOG_TRACE("Flushed {} writes and {} dirty ranges to {}",
+                 p.writes.size(),
+                 p.dirty.size(),
+                 p.kv->key);
+
+    metrics.fragmentsOut += p.writes.size() + p.dirty.size();
+    metrics.flushes++;
+}
+}
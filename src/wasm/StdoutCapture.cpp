@@ -0,0 +1,144 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/StdoutCapture.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+
+namespace wasm {
+
+StdoutCapture::StdoutCapture()
+{
+    clear();
+}
+
+size_t StdoutCapture::append(const struct ::iovec* iovecs, int iovecCount)
+{
+    faabric::util::UniqueLock lock(mx);
+
+    size_t total = 0;
+    for (int i = 0; i < iovecCount; i++) {
+        doAppend(static_cast<const char*>(iovecs[i].iov_base),
+                 iovecs[i].iov_len);
+        total += iovecs[i].iov_len;
+    }
+
+    return total;
+}
+
+size_t StdoutCapture::append(std::string_view data)
+{
+    faabric::util::UniqueLock lock(mx);
+    doAppend(data.data(), data.size());
+    return data.size();
+}
+
+void StdoutCapture::doAppend(const char* data, size_t len)
+{
+    if (len == 0 || capacity == 0) {
+        truncated += len;
+        return;
+    }
+
+    // If the new data alone fills the buffer, only keep its tail
+    if (len >= capacity) {
+        truncated += used + (len - capacity);
+        buffer.resize(capacity);
+        std::copy(data + (len - capacity), data + len, buffer.begin());
+        head = 0;
+        used = capacity;
+        return;
+    }
+
+    // While there's space, just grow the buffer linearly
+    if (buffer.size() < capacity) {
+        if (used + len <= capacity) {
+            buffer.insert(buffer.end(), data, data + len);
+            used += len;
+            return;
+        }
+
+        // Switch to using the full ring
+        buffer.resize(capacity);
+    }
+
+    // Drop the oldest bytes to make room
+    size_t overflow = used + len > capacity ? used + len - capacity : 0;
+    head = (head + overflow) % capacity;
+    used -= overflow;
+    truncated += overflow;
+
+    // Copy in, wrapping around the end if need be
+    size_t tail = (head + used) % capacity;
+    size_t firstLen = std::min(len, capacity - tail);
+    std::copy(data, data + firstLen, buffer.begin() + tail);
+    std::copy(data + firstLen, data + len, buffer.begin());
+    used += len;
+}
+
+std::string StdoutCapture::read()
+{
+    faabric::util::UniqueLock lock(mx);
+    return doRead();
+}
+
+std::string StdoutCapture::doRead()
+{
+    std::string result;
+    if (truncated > 0) {
+        result = fmt::format(STDOUT_TRUNCATED_MARKER, truncated);
+    }
+
+    size_t firstLen = std::min(used, buffer.size() - head);
+    result.append(buffer.data() + head, firstLen);
+    result.append(buffer.data(), used - firstLen);
+
+    return result;
+}
+
+std::string StdoutCapture::take()
+{
+    faabric::util::UniqueLock lock(mx);
+
+    std::string result = doRead();
+    buffer.clear();
+    head = 0;
+    used = 0;
+    truncated = 0;
+
+    return result;
+}
+
+size_t StdoutCapture::size()
+{
+    faabric::util::UniqueLock lock(mx);
+    return used;
+}
+
+size_t StdoutCapture::getTruncatedBytes()
+{
+    faabric::util::UniqueLock lock(mx);
+    return truncated;
+}
+
+size_t StdoutCapture::getCapacity()
+{
+    faabric::util::UniqueLock lock(mx);
+    return capacity;
+}
+
+void StdoutCapture::clear()
+{
+    faabric::util::UniqueLock lock(mx);
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    capacity = std::max(conf.captureStdoutMaxBytes, 0);
+
+    buffer.clear();
+    buffer.shrink_to_fit();
+    head = 0;
+    used = 0;
+    truncated = 0;
+}
+}
@@ -13,13 +13,22 @@
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/snapshot.h>
+#include <faabric/util/state.h>
 #include <faabric/util/testing.h>
 #include <faabric/util/timing.h>
+#include <threads/Futex.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/chaining.h>
+#include <wasm/state.h>
+#include <wasm/streams.h>
 
+#include <algorithm>
+#include <array>
 #include <boost/filesystem.hpp>
+#include <cerrno>
+#include <optional>
 #include <sstream>
 #include <sys/mman.h>
 #include <sys/uio.h>
@@ -195,72 +204,85 @@ std::string WasmModule::getBoundFunction()
     return boundFunction;
 }
 
-int WasmModule::getStdoutFd()
+ssize_t WasmModule::captureStdout(const struct ::iovec* iovecs, int iovecCount)
 {
-    if (stdoutMemFd == 0) {
-        stdoutMemFd = memfd_create("stdoutfd", 0);
-        SPDLOG_DEBUG("Capturing stdout: fd={}", stdoutMemFd);
+    ssize_t writtenSize = stdoutCapture.append(iovecs, iovecCount);
+
+    SPDLOG_TRACE("Captured {} bytes of formatted stdout", writtenSize);
+
+    if (conf::getFaasmConfig().captureStdout == "stream") {
+        {
+            faabric::util::UniqueLock lock(stdoutStreamMx);
+            stdoutSinceStreamFlush += writtenSize;
+        }
+
+        flushStdoutStream(false);
     }
 
-    return stdoutMemFd;
+    return writtenSize;
 }
 
-ssize_t WasmModule::captureStdout(const struct ::iovec* iovecs, int iovecCount)
+void WasmModule::flushStdoutStream(bool force)
 {
-    int memFd = getStdoutFd();
-    ssize_t writtenSize = ::writev(memFd, iovecs, iovecCount);
-
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error(std::string("Failed capturing stdout: ") +
-                                 strerror(errno));
+    faabric::util::UniqueLock lock(stdoutStreamMx);
+    if (stdoutSinceStreamFlush == 0 ||
+        (!force && stdoutSinceStreamFlush < STDOUT_STREAM_CHUNK_BYTES)) {
+        return;
     }
+    stdoutSinceStreamFlush = 0;
+
+    // Until the caller reads the stream nothing holds the call back, so the
+    // output stays in the bounded capture rather than piling up in state.
+    // Whatever's never streamed ends up in the call's output.
+    const faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    std::string output;
+    try {
+        if (!isStreamReaderAttached(msg)) {
+            return;
+        }
 
-    SPDLOG_DEBUG("Captured {} bytes of formatted stdout", writtenSize);
-    stdoutSize += writtenSize;
-    return writtenSize;
+        output = stdoutCapture.take();
+        emitStreamChunk(msg,
+                        BYTES_CONST(output.data()),
+                        output.size(),
+                        conf::getFaasmConfig().chainedCallTimeout);
+
+        SPDLOG_TRACE("Streamed {} bytes of stdout", output.size());
+    } catch (std::exception& e) {
+        // Writing to stdout must not fail, so the output is kept instead
+        SPDLOG_ERROR("Failed streaming stdout for {}: {}", msg.id(), e.what());
+        stdoutCapture.append(output);
+    }
 }
 
 ssize_t WasmModule::captureStdout(const void* buffer)
 {
-    int memFd = getStdoutFd();
+    std::string_view str(reinterpret_cast<const char*>(buffer));
+    std::string_view newline("\n");
 
-    ssize_t writtenSize =
-      dprintf(memFd, "%s\n", reinterpret_cast<const char*>(buffer));
+    std::array<::iovec, 2> iovecs = {
+        ::iovec{ const_cast<char*>(str.data()), str.size() },
+        ::iovec{ const_cast<char*>(newline.data()), newline.size() }
+    };
 
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error("Failed capturing stdout");
-    }
-
-    SPDLOG_DEBUG("Captured {} bytes of unformatted stdout", writtenSize);
-    stdoutSize += writtenSize;
-    return writtenSize;
+    return captureStdout(iovecs.data(), iovecs.size());
 }
 
 std::string WasmModule::getCapturedStdout()
 {
-    if (stdoutSize == 0) {
-        return "";
-    }
-
-    // Go back to start
-    int memFd = getStdoutFd();
-    lseek(memFd, 0, SEEK_SET);
-
-    // Read in and return
-    std::string stdoutString(stdoutSize, '\0');
-    read(memFd, stdoutString.data(), stdoutSize);
-    SPDLOG_DEBUG("Read stdout length {}:\n{}", stdoutSize, stdoutString);
+    std::string stdoutString = stdoutCapture.read();
+    SPDLOG_DEBUG("Read stdout length {}", stdoutString.size());
 
     return stdoutString;
 }
 
 void WasmModule::clearCapturedStdout()
 {
-    close(stdoutMemFd);
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    stdoutCapture.clear();
+
+    faabric::util::UniqueLock lock(stdoutStreamMx);
+    stdoutSinceStreamFlush = 0;
 }
 
 uint32_t WasmModule::getArgc()
@@ -325,40 +347,247 @@ uint32_t WasmModule::mapSharedStateMemory(
     std::string segmentKey = kv->user + "_" + kv->key + "__" +
                              std::to_string(offset) + "__" +
                              std::to_string(length);
-    if (sharedMemWasmPtrs.count(segmentKey) == 0) {
-        // Lock and double check
-        faabric::util::FullLock lock(sharedMemWasmPtrsMutex);
-
-        if (sharedMemWasmPtrs.count(segmentKey) == 0) {
-            // Page-align the chunk
-            faabric::util::AlignedChunk chunk =
-              faabric::util::getPageAlignedChunk(offset, length);
-
-            // Create the wasm memory region and work out the offset to the
-            // start of the desired chunk in this region (this will be zero
-            // if the offset is already zero, or if the offset is
-            // page-aligned already). We need to round the allocation up to
-            // a wasm page boundary
-            uint32_t allocSize = roundUpToWasmPageAligned(chunk.nBytesLength);
-            uint32_t wasmBasePtr = this->growMemory(allocSize);
-            uint32_t wasmOffsetPtr = wasmBasePtr + chunk.offsetRemainder;
-
-            // Map the shared memory
-            uint8_t* wasmMemoryRegionPtr = wasmPointerToNative(wasmBasePtr);
-            kv->mapSharedMemory(static_cast<void*>(wasmMemoryRegionPtr),
-                                chunk.nPagesOffset,
-                                chunk.nPagesLength);
-
-            // Cache the wasm pointer
-            sharedMemWasmPtrs[segmentKey] = wasmOffsetPtr;
+    {
+        faabric::util::SharedLock lock(sharedMemWasmPtrsMutex);
+        auto it = sharedMemWasmPtrs.find(segmentKey);
+        if (it != sharedMemWasmPtrs.end()) {
+            return it->second;
         }
     }
 
-    // Return the wasm pointer
+    // Lock and double check
+    faabric::util::FullLock lock(sharedMemWasmPtrsMutex);
+    auto it = sharedMemWasmPtrs.find(segmentKey);
+    if (it != sharedMemWasmPtrs.end()) {
+        return it->second;
+    }
+
+    // Page-align the chunk
+    faabric::util::AlignedChunk chunk =
+      faabric::util::getPageAlignedChunk(offset, length);
+
+    // Create the wasm memory region and work out the offset to the start of
+    // the desired chunk in this region (this will be zero if the offset is
+    // already zero, or if the offset is page-aligned already). We need to
+    // round the allocation up to a wasm page boundary. Regions freed by
+    // unmapping earlier segments are reused before growing memory.
+    uint32_t allocSize = roundUpToWasmPageAligned(chunk.nBytesLength);
+    std::optional<uint32_t> freeRegion = sharedMemAllocator.allocate(allocSize);
+    uint32_t wasmBasePtr =
+      freeRegion.has_value() ? *freeRegion : this->growMemory(allocSize);
+    uint32_t wasmOffsetPtr = wasmBasePtr + chunk.offsetRemainder;
+
+    // Map the shared memory
+    uint8_t* wasmMemoryRegionPtr = wasmPointerToNative(wasmBasePtr);
+    kv->mapSharedMemory(static_cast<void*>(wasmMemoryRegionPtr),
+                        chunk.nPagesOffset,
+                        chunk.nPagesLength);
+
+    // Cache the wasm pointer
+    sharedMemWasmPtrs[segmentKey] = wasmOffsetPtr;
+    sharedMemSegments[wasmOffsetPtr] = { segmentKey, wasmBasePtr, allocSize };
+
+    return wasmOffsetPtr;
+}
+
+void WasmModule::unmapSharedStateMemory(uint32_t wasmPtr)
+{
+    faabric::util::FullLock lock(sharedMemWasmPtrsMutex);
+    auto it = sharedMemSegments.find(wasmPtr);
+    if (it == sharedMemSegments.end()) {
+        SPDLOG_ERROR("Unmapping unknown state segment at {}", wasmPtr);
+        throw std::runtime_error("Unmapping unknown state segment");
+    }
+
+    SharedMemSegment segment = it->second;
+    SPDLOG_TRACE("MEM - unmapping state segment {} at {}-{}",
+                 segment.segmentKey,
+                 segment.wasmBasePtr,
+                 segment.wasmBasePtr + segment.allocSize);
+
+    // Swap the shared mapping for fresh private memory in place, so that the
+    // range never becomes a hole in linear memory
+    void* res = mmap(wasmPointerToNative(segment.wasmBasePtr),
+                     segment.allocSize,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                     -1,
+                     0);
+    if (res == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to unmap state segment {}: {}",
+                     segment.segmentKey,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to unmap state segment");
+    }
+
+    sharedMemWasmPtrs.erase(segment.segmentKey);
+    sharedMemSegments.erase(it);
+    sharedMemAllocator.free(segment.wasmBasePtr, segment.allocSize);
+}
+
+int32_t WasmModule::openStateHandle(const std::string& user,
+                                    const std::string& key,
+                                    size_t size)
+{
+    std::string userKey = faabric::util::keyForUser(user, key);
+
+    faabric::util::UniqueLock lock(stateHandlesMx);
+    auto it = stateHandleIdxs.find(userKey);
+    if (it != stateHandleIdxs.end()) {
+        return it->second;
+    }
+
+    int32_t handle = nStateHandles.load(std::memory_order_relaxed);
+    if (handle >= MAX_STATE_HANDLES) {
+        SPDLOG_ERROR("Too many state handles open ({}), can't open {}",
+                     handle,
+                     userKey);
+        throw std::runtime_error("Too many state handles");
+    }
+
+    faabric::state::State& state = faabric::state::getGlobalState();
+    stateHandles[handle] = state.getKV(user, key, size);
+    stateHandleIdxs[userKey] = handle;
+
+    // Publish the handle only once its slot is filled
+    nStateHandles.store(handle + 1, std::memory_order_release);
+
+    SPDLOG_DEBUG("Opened state handle {} for {}", handle, userKey);
+    return handle;
+}
+
+const std::shared_ptr<faabric::state::StateKeyValue>&
+WasmModule::getStateHandle(int32_t handle)
+{
+    if (handle < 0 || handle >= nStateHandles.load(std::memory_order_acquire)) {
+        SPDLOG_ERROR("Invalid state handle {}", handle);
+        throw std::runtime_error("Invalid state handle");
+    }
+
+    return stateHandles[handle];
+}
+
+void WasmModule::clearStateHandles()
+{
+    faabric::util::UniqueLock lock(stateHandlesMx);
+
+    int32_t nHandles = nStateHandles.load(std::memory_order_relaxed);
+    nStateHandles.store(0, std::memory_order_release);
+    for (int32_t i = 0; i < nHandles; i++) {
+        stateHandles[i] = nullptr;
+    }
+
+    stateHandleIdxs.clear();
+}
+
+int32_t WasmModule::startStateTransfer(std::function<void()> op)
+{
+    std::future<void> transfer = submitStateTransfer(std::move(op));
+
+    faabric::util::UniqueLock lock(stateTransfersMx);
+    int32_t requestId = nextStateTransferId++;
+    stateTransfers.emplace(requestId, std::move(transfer));
+
+    return requestId;
+}
+
+int WasmModule::testStateTransfer(int32_t requestId)
+{
+    faabric::util::UniqueLock lock(stateTransfersMx);
+    auto it = stateTransfers.find(requestId);
+    if (it == stateTransfers.end()) {
+        return -1;
+    }
+
+    return it->second.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready
+             ? 1
+             : 0;
+}
+
+void WasmModule::awaitStateTransfer(int32_t requestId)
+{
+    std::future<void> transfer;
     {
-        faabric::util::SharedLock lock(sharedMemWasmPtrsMutex);
-        return sharedMemWasmPtrs[segmentKey];
+        faabric::util::UniqueLock lock(stateTransfersMx);
+        auto it = stateTransfers.find(requestId);
+        if (it == stateTransfers.end()) {
+            SPDLOG_ERROR("Awaiting unknown state transfer {}", requestId);
+            throw std::runtime_error("Unknown state transfer");
+        }
+
+        transfer = std::move(it->second);
+        stateTransfers.erase(it);
+    }
+
+    // Rethrows any error from the transfer
+    transfer.get();
+}
+
+void WasmModule::awaitAllStateTransfers()
+{
+    std::unordered_map<int32_t, std::future<void>> outstanding;
+    {
+        faabric::util::UniqueLock lock(stateTransfersMx);
+        outstanding.swap(stateTransfers);
+    }
+
+    if (!outstanding.empty()) {
+        SPDLOG_DEBUG("Waiting for {} outstanding state transfers",
+                     outstanding.size());
+    }
+
+    // Errors here have nobody to go to, so we only log them
+    for (auto& [requestId, transfer] : outstanding) {
+        try {
+            transfer.get();
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("State transfer {} failed: {}", requestId, e.what());
+        }
+    }
+}
+
+void WasmModule::writeStateOffset(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  long offset,
+  const uint8_t* data,
+  size_t length)
+{
+    if (conf::getFaasmConfig().stateWriteCombine != "on") {
+        kv->setChunk(offset, data, length);
+        return;
     }
+
+    stateWrites.write(kv, offset, data, length);
+}
+
+void WasmModule::flagStateOffsetDirty(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  long offset,
+  size_t length)
+{
+    if (conf::getFaasmConfig().stateWriteCombine != "on") {
+        kv->flagChunkDirty(offset, length);
+        return;
+    }
+
+    stateWrites.flagDirty(kv, offset, length);
+}
+
+void WasmModule::flushStateWrites(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    stateWrites.flush(kv);
+}
+
+void WasmModule::flushAllStateWrites()
+{
+    stateWrites.flushAll();
+}
+
+StateWriteCombinerMetrics WasmModule::getStateWriteMetrics()
+{
+    return stateWrites.getMetrics();
 }
 
 uint32_t WasmModule::getCurrentBrk()
@@ -397,6 +626,9 @@ int32_t WasmModule::executeTask(
     // Perform the appropriate type of execution
     int returnValue;
     if (req->type() == faabric::BatchExecuteRequest::THREADS) {
+        // Threads on other hosts only learn they're distributed from the batch
+        setDistributedPthreads(*req);
+
         switch (req->subtype()) {
             case ThreadRequestType::PTHREAD: {
                 SPDLOG_TRACE("Executing {} as pthread", funcStr);
@@ -424,17 +656,56 @@ int32_t WasmModule::executeTask(
     } else {
         // Vanilla function
         SPDLOG_TRACE("Executing {} as standard function", funcStr);
-        returnValue = executeFunction(msg);
+
+        // Eager pthreads may still be running, even if they were never joined,
+        // and pushes the guest didn't wait for must still land before we
+        // return. Both use the module's memory, so this holds even when the
+        // function fails.
+        auto finishBackgroundWork = [this] {
+            awaitEagerPthreadCalls();
+            flushAllStateWrites();
+            awaitAllStateTransfers();
+        };
+
+        try {
+            returnValue = executeFunction(msg);
+        } catch (...) {
+            // Threads that never started are dropped rather than run
+            queuedPthreadCalls.clear();
+
+            try {
+                finishBackgroundWork();
+            } catch (std::exception& e) {
+                SPDLOG_ERROR("Failed finishing background work for {}: {}",
+                             funcStr,
+                             e.what());
+            }
+
+            throw;
+        }
+
+        finishBackgroundWork();
     }
 
+    // Inputs passed by reference are only read by this call, and outputs of
+    // the calls it chained can't be read once it's done
+    deleteChainPayload(msg, CHAIN_PAYLOAD_INPUT);
+    deleteChainedCallOutputs(msg);
+
     if (returnValue != 0) {
+        deleteChainPayload(msg, CHAIN_PAYLOAD_OUTPUT);
         msg.set_outputdata(
           fmt::format("Call failed (return value={})", returnValue));
     }
 
-    // Add captured stdout if necessary
+    // Add captured stdout if necessary, unless the output is by reference
     conf::FaasmConfig& conf = conf::getFaasmConfig();
-    if (conf.captureStdout == "on") {
+    if (conf.captureStdout == "stream") {
+        flushStdoutStream(true);
+    }
+
+    if (conf.captureStdout != "off" &&
+        !isChainPayloadRef(msg, CHAIN_PAYLOAD_OUTPUT)) {
         std::string moduleStdout = getCapturedStdout();
         if (!moduleStdout.empty()) {
             std::string newOutput = moduleStdout + "\n" + msg.outputdata();
@@ -493,72 +764,213 @@ void WasmModule::queuePthreadCall(threads::PthreadCall call)
     // await is called from the same thread, so this doesn't need to be
     // thread-safe.
     queuedPthreadCalls.emplace_back(call);
+
+    // In eager mode we start threads as soon as we have a full group
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    int groupSize = std::max(1, conf.pthreadEagerGroupSize);
+    if (conf.pthreadDispatch == "eager" &&
+        (int)queuedPthreadCalls.size() >= groupSize) {
+        startEagerPthreadCalls(
+          faabric::scheduler::ExecutorContext::get()->getMsg());
+    }
 }
 
-int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
+std::shared_ptr<faabric::BatchExecuteRequest> WasmModule::buildPthreadRequest(
+  const faabric::Message& msg,
+  const std::vector<int>& threadIdxs)
 {
-    // We assume that await is called in a loop from the main thread, after
-    // all pthread calls have been queued, so this function doesn't need to be
-    // thread safe.
-    assert(msg != nullptr);
+    int nPthreadCalls = queuedPthreadCalls.size();
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        msg.user(), msg.function(), nPthreadCalls);
+    faabric::util::updateBatchExecAppId(req, msg.appid());
+
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    req->set_subtype(wasm::ThreadRequestType::PTHREAD);
+
+    for (int i = 0; i < nPthreadCalls; i++) {
+        threads::PthreadCall p = queuedPthreadCalls.at(i);
+        faabric::Message& m = req->mutable_messages()->at(i);
+
+        // Function pointer and args
+        // NOTE - with a pthread interface we only ever pass the
+        // function a single pointer argument, hence we use the
+        // input data here to hold this argument as a string
+        m.set_funcptr(p.entryFunc);
+        m.set_inputdata(std::to_string(p.argsPtr));
+
+        // Assign a thread ID. Our pthread IDs start at 1, and the thread
+        // ID picks the pool thread it runs on. Set this as part of the
+        // group with the other threads.
+        m.set_appidx(threadIdxs.empty() ? i + 1 : threadIdxs.at(i));
+        m.set_groupidx(i + 1);
+
+        // Record this thread -> call ID
+        SPDLOG_TRACE("pthread {} mapped to call {}", p.pthreadPtr, m.id());
+        pthreadPtrsToChainedCalls.insert({ p.pthreadPtr, m.id() });
+    }
+
+    return req;
+}
+
+bool WasmModule::startEagerPthreadCalls(const faabric::Message& msg)
+{
+    int nPthreadCalls = queuedPthreadCalls.size();
+    if (nPthreadCalls == 0) {
+        return true;
+    }
+
+    // Each eager thread needs a pool thread of its own, apart from the one
+    // the main thread is using. Without enough, we leave the calls queued to
+    // be sent as a batch on the next await, which may place them elsewhere.
+    std::vector<int> threadIdxs;
+    {
+        faabric::util::UniqueLock lock(eagerPthreadsMx);
+        if (freeEagerPthreadIdxs.empty() && eagerPthreadResults.empty()) {
+            for (int i = threadPoolSize - 1; i > 0; i--) {
+                freeEagerPthreadIdxs.push_back(i);
+            }
+        }
+
+        if ((int)freeEagerPthreadIdxs.size() < nPthreadCalls) {
+            SPDLOG_TRACE("No pool threads free for {} eager pthreads",
+                         nPthreadCalls);
+            return false;
+        }
+
+        for (int i = 0; i < nPthreadCalls; i++) {
+            threadIdxs.push_back(freeEagerPthreadIdxs.back());
+            freeEagerPthreadIdxs.pop_back();
+        }
+    }
+
+    SPDLOG_DEBUG("Starting {} pthread calls eagerly for {}",
+                 nPthreadCalls,
+                 faabric::util::funcToString(msg, true));
+
+    // Eager threads always run on this host, so they share memory with the
+    // main thread and need no snapshot
+    auto req = buildPthreadRequest(msg, threadIdxs);
+    req->set_singlehost(true);
 
-    // Execute the queued pthread calls
     faabric::scheduler::Executor* executor =
       faabric::scheduler::ExecutorContext::get()->getExecutor();
-    if (!queuedPthreadCalls.empty()) {
-        int nPthreadCalls = queuedPthreadCalls.size();
+    std::shared_future<std::vector<std::pair<uint32_t, int32_t>>> results =
+      std::async(std::launch::async, [this, executor, req, threadIdxs] {
+          auto groupResults = executor->executeThreads(req, {});
 
-        std::string funcStr = faabric::util::funcToString(*msg, true);
-        SPDLOG_DEBUG(
-          "Executing {} pthread calls for {}", nPthreadCalls, funcStr);
+          faabric::util::UniqueLock lock(eagerPthreadsMx);
+          freeEagerPthreadIdxs.insert(
+            freeEagerPthreadIdxs.end(), threadIdxs.begin(), threadIdxs.end());
 
-        std::shared_ptr<faabric::BatchExecuteRequest> req =
-          faabric::util::batchExecFactory(
-            msg->user(), msg->function(), nPthreadCalls);
-        faabric::util::updateBatchExecAppId(req, msg->appid());
+          return groupResults;
+      }).share();
 
-        req->set_type(faabric::BatchExecuteRequest::THREADS);
-        req->set_subtype(wasm::ThreadRequestType::PTHREAD);
+    for (const auto& p : queuedPthreadCalls) {
+        eagerPthreadResults.insert({ p.pthreadPtr, results });
+    }
 
-        // In the local tests, we always set the single-host flag to avoid
-        // having to synchronise snapshots
-        if (faabric::util::isTestMode()) {
-            req->set_singlehost(true);
-        }
+    queuedPthreadCalls.clear();
 
-        for (int i = 0; i < nPthreadCalls; i++) {
-            threads::PthreadCall p = queuedPthreadCalls.at(i);
-            faabric::Message& m = req->mutable_messages()->at(i);
-
-            // Function pointer and args
-            // NOTE - with a pthread interface we only ever pass the
-            // function a single pointer argument, hence we use the
-            // input data here to hold this argument as a string
-            m.set_funcptr(p.entryFunc);
-            m.set_inputdata(std::to_string(p.argsPtr));
-
-            // Assign a thread ID and increment. Our pthread IDs start
-            // at 1. Set this as part of the group with the other threads.
-            m.set_appidx(i + 1);
-            m.set_groupidx(i + 1);
-
-            // Record this thread -> call ID
-            SPDLOG_TRACE("pthread {} mapped to call {}", p.pthreadPtr, m.id());
-            pthreadPtrsToChainedCalls.insert({ p.pthreadPtr, m.id() });
+    return true;
+}
+
+std::vector<std::pair<uint32_t, int32_t>> WasmModule::executeQueuedPthreadCalls(
+  const faabric::Message& msg)
+{
+    // A batch picks its pool threads and stacks from 1 upwards, and may switch
+    // the module's mutexes out of wasm memory, so no eager thread may still be
+    // running. Their results stay around for later joins.
+    for (auto& [ptr, results] : eagerPthreadResults) {
+        results.wait();
+    }
+
+    faabric::scheduler::Executor* executor =
+      faabric::scheduler::ExecutorContext::get()->getExecutor();
+
+    std::string funcStr = faabric::util::funcToString(msg, true);
+    SPDLOG_DEBUG("Executing {} pthread calls for {}",
+                 queuedPthreadCalls.size(),
+                 funcStr);
+
+    auto req = buildPthreadRequest(msg, {});
+
+    // In the local tests, we always set the single-host flag to avoid
+    // having to synchronise snapshots
+    if (faabric::util::isTestMode()) {
+        req->set_singlehost(true);
+    }
+
+    setDistributedPthreads(*req);
+
+    // Execute the threads and await results
+    auto results = executor->executeThreads(req, mergeRegions);
+
+    // Empty the queue
+    queuedPthreadCalls.clear();
+
+    return results;
+}
+
+void WasmModule::awaitEagerPthreadCalls()
+{
+    if (conf::getFaasmConfig().pthreadDispatch != "eager") {
+        return;
+    }
+
+    // Threads that were never joined must still finish before the function
+    // returns, as they use its memory
+    if (!queuedPthreadCalls.empty()) {
+        faabric::Message& msg =
+          faabric::scheduler::ExecutorContext::get()->getMsg();
+        if (!startEagerPthreadCalls(msg)) {
+            executeQueuedPthreadCalls(msg);
         }
+    }
+
+    for (auto& [ptr, results] : eagerPthreadResults) {
+        results.wait();
+    }
+
+    eagerPthreadResults.clear();
+    pthreadPtrsToChainedCalls.clear();
+    lastPthreadResults.clear();
+}
 
-        // Execute the threads and await results
-        lastPthreadResults = executor->executeThreads(req, mergeRegions);
+int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
+{
+    // We assume that await is called in a loop from the main thread, after
+    // all pthread calls have been queued, so this function doesn't need to be
+    // thread safe.
+    assert(msg != nullptr);
 
-        // Empty the queue
-        queuedPthreadCalls.clear();
+    // In eager mode, start any partial group rather than waiting for it to
+    // fill up
+    auto eagerIt = eagerPthreadResults.find(pthreadPtr);
+    if (eagerIt == eagerPthreadResults.end() &&
+        conf::getFaasmConfig().pthreadDispatch == "eager" &&
+        startEagerPthreadCalls(*msg)) {
+        eagerIt = eagerPthreadResults.find(pthreadPtr);
+    }
+
+    std::vector<std::pair<uint32_t, int32_t>> results;
+    if (eagerIt != eagerPthreadResults.end()) {
+        // Threads started eagerly only need their own group to finish
+        results = eagerIt->second.get();
+        eagerPthreadResults.erase(eagerIt);
+    } else if (!queuedPthreadCalls.empty()) {
+        lastPthreadResults = executeQueuedPthreadCalls(*msg);
+        results = lastPthreadResults;
+    } else {
+        results = lastPthreadResults;
     }
 
     // Get the result of this call
     unsigned int pthreadMsgId = pthreadPtrsToChainedCalls[pthreadPtr];
     bool found = false;
     int thisResult = 0;
-    for (auto [mid, res] : lastPthreadResults) {
+    for (auto [mid, res] : results) {
         if (pthreadMsgId == mid) {
             thisResult = res;
             found = true;
@@ -647,6 +1059,132 @@ std::shared_ptr<std::mutex> WasmModule::getOrCreatePthreadMutex(uint32_t id)
     return mx;
 }
 
+// Threads spread across hosts each work on their own copy of memory, which is
+// merged back into the main host's copy once they're done. Their mutexes can't
+// live in memory, as each host would lock its own copy, and merging would
+// overwrite the main host's mutexes with whatever state they were left in.
+// Every thread of the module on a host must agree on where a mutex lives, so
+// the switch is made for the whole module, not per batch.
+void WasmModule::setDistributedPthreads(
+  const faabric::BatchExecuteRequest& req)
+{
+    if (req.type() == faabric::BatchExecuteRequest::THREADS &&
+        !req.singlehost()) {
+        distributedPthreads.store(true, std::memory_order_release);
+    }
+}
+
+bool WasmModule::usePthreadMutexMap(uint32_t mx)
+{
+    return distributedPthreads.load(std::memory_order_acquire) ||
+           mx % sizeof(int32_t) != 0;
+}
+
+void WasmModule::initPthreadMutex(uint32_t mx)
+{
+    if (!usePthreadMutexMap(mx)) {
+        std::atomic_ref<int32_t>(
+          *reinterpret_cast<int32_t*>(wasmPointerToNative(mx)))
+          .store(FUTEX_MUTEX_UNLOCKED);
+    }
+}
+
+void WasmModule::lockPthreadMutex(uint32_t mx)
+{
+    if (usePthreadMutexMap(mx)) {
+        getOrCreatePthreadMutex(mx)->lock();
+        return;
+    }
+
+    threads::lockFutexMutex(
+      reinterpret_cast<int32_t*>(wasmPointerToNative(mx)));
+}
+
+bool WasmModule::tryLockPthreadMutex(uint32_t mx)
+{
+    if (usePthreadMutexMap(mx)) {
+        return getOrCreatePthreadMutex(mx)->try_lock();
+    }
+
+    return threads::tryLockFutexMutex(
+      reinterpret_cast<int32_t*>(wasmPointerToNative(mx)));
+}
+
+void WasmModule::unlockPthreadMutex(uint32_t mx)
+{
+    if (usePthreadMutexMap(mx)) {
+        std::shared_ptr<std::mutex> m = nullptr;
+        {
+            faabric::util::SharedLock lock(pthreadLocksMx);
+            auto it = pthreadLocks.find(mx);
+            if (it != pthreadLocks.end()) {
+                m = it->second;
+            }
+        }
+
+        // A mutex locked in memory before the switch is unlocked there
+        if (m != nullptr) {
+            m->unlock();
+            return;
+        }
+
+        if (mx % sizeof(int32_t) != 0) {
+            SPDLOG_ERROR("Trying to unlock non-existent pthread lock {}", mx);
+            throw std::runtime_error("Non-existent pthread lock");
+        }
+    }
+
+    threads::unlockFutexMutex(
+      reinterpret_cast<int32_t*>(wasmPointerToNative(mx)));
+}
+
+std::shared_ptr<threads::FutexCondition> WasmModule::getOrCreatePthreadCond(
+  uint32_t cond)
+{
+    {
+        faabric::util::SharedLock lock(pthreadCondsMx);
+        auto it = pthreadConds.find(cond);
+        if (it != pthreadConds.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(pthreadCondsMx);
+    auto [it, inserted] = pthreadConds.try_emplace(cond);
+    if (inserted) {
+        it->second = std::make_shared<threads::FutexCondition>();
+    }
+
+    return it->second;
+}
+
+void WasmModule::destroyPthreadCond(uint32_t cond)
+{
+    // Anyone still waiting holds on to the condition until they wake
+    faabric::util::FullLock lock(pthreadCondsMx);
+    pthreadConds.erase(cond);
+}
+
+int WasmModule::waitPthreadCond(uint32_t cond, uint32_t mx, int timeoutMs)
+{
+    std::shared_ptr<threads::FutexCondition> c = getOrCreatePthreadCond(cond);
+
+    // Threads on other hosts signal their own copy of the condition, so a
+    // distributed wait could sleep forever. Instead it wakes spuriously, which
+    // guests must already handle by checking their condition in a loop.
+    bool bounded =
+      distributedPthreads.load(std::memory_order_acquire) &&
+      (timeoutMs < 0 || timeoutMs > DISTRIBUTED_PTHREAD_COND_WAIT_MS);
+    int waitMs = bounded ? DISTRIBUTED_PTHREAD_COND_WAIT_MS : timeoutMs;
+
+    int32_t seq = c->prepareWait();
+    unlockPthreadMutex(mx);
+    bool woken = c->wait(seq, waitMs);
+    lockPthreadMutex(mx);
+
+    return (woken || bounded) ? 0 : ETIMEDOUT;
+}
+
 bool WasmModule::isBound()
 {
     return _isBound;
@@ -1,15 +1,30 @@
 #include <conf/FaasmConfig.h>
 #include <faabric/planner/PlannerClient.h>
 #include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/state/State.h>
 #include <faabric/util/ExecGraph.h>
 #include <faabric/util/batch.h>
 #include <faabric/util/bytes.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
 #include <wasm/chaining.h>
+#include <wasm/streams.h>
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 namespace wasm {
+
+// Calls that may pass their output back by reference, by the id of the call
+// that chained them, so that outputs the caller never reads can be dropped
+static std::mutex outputRefCallsMx;
+static std::unordered_map<int, std::vector<int>> outputRefCalls;
+
 int awaitChainedCall(unsigned int messageId)
 {
     int callTimeoutMs = conf::getFaasmConfig().chainedCallTimeout;
@@ -35,6 +50,191 @@ int awaitChainedCall(unsigned int messageId)
     return returnCode;
 }
 
+ChainedCallWaiter::ChainedCallWaiter(int appIdIn)
+  : appId(appIdIn)
+  , lastSweep(faabric::util::startTimer())
+{}
+
+void ChainedCallWaiter::add(uint32_t messageId)
+{
+    added.emplace_back(messageId);
+}
+
+size_t ChainedCallWaiter::getPendingCount() const
+{
+    return added.size() + pending.size();
+}
+
+// Records the call's result if it's finished, waiting up to the given time.
+// Calls we fail to get results for count as failed.
+bool ChainedCallWaiter::checkCall(uint32_t messageId,
+                                  int waitMs,
+                                  std::vector<ChainedCallResult>& results)
+{
+    int returnValue = 1;
+    try {
+        const faabric::Message result =
+          faabric::planner::getPlannerClient().getMessageResult(
+            appId, messageId, waitMs);
+        if (result.type() == faabric::Message_MessageType_EMPTY) {
+            return false;
+        }
+        returnValue = result.returnvalue();
+    } catch (std::exception& ex) {
+        SPDLOG_ERROR(
+          "Error awaiting chained call {}: {}", messageId, ex.what());
+    }
+
+    results.push_back({ messageId, returnValue });
+    return true;
+}
+
+std::vector<ChainedCallResult> ChainedCallWaiter::wait(bool waitForAll,
+                                                       int timeoutMs)
+{
+    std::vector<ChainedCallResult> results;
+
+    for (uint32_t messageId : added) {
+        if (!checkCall(messageId, 0, results)) {
+            pending.emplace_back(messageId);
+        }
+    }
+    added.clear();
+
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    while (!pending.empty()) {
+        if (!waitForAll && !results.empty()) {
+            break;
+        }
+
+        long elapsedMs = faabric::util::getTimeDiffMillis(start);
+        if (elapsedMs >= timeoutMs) {
+            break;
+        }
+
+        // Rather than sleep until the next sweep, block on the oldest call so
+        // we return as soon as it finishes
+        long untilSweepMs =
+          sweepMs - faabric::util::getTimeDiffMillis(lastSweep);
+        if (untilSweepMs > 0) {
+            int waitMs = (int)std::min(untilSweepMs, timeoutMs - elapsedMs);
+            if (checkCall(pending.front(), waitMs, results)) {
+                pending.pop_front();
+            }
+            continue;
+        }
+
+        // Check everything else still pending without blocking, backing off
+        // while nothing's finishing
+        size_t nDone = results.size();
+        pending.remove_if([this, &results](uint32_t messageId) {
+            return checkCall(messageId, 0, results);
+        });
+        lastSweep = faabric::util::startTimer();
+
+        if (results.size() > nDone) {
+            sweepMs = AWAIT_CALLS_MIN_POLL_MS;
+        } else {
+            sweepMs = std::min(sweepMs * 2, AWAIT_CALLS_MAX_POLL_MS);
+        }
+    }
+
+    return results;
+}
+
+std::vector<ChainedCallResult> awaitChainedCalls(
+  int appId,
+  const std::vector<uint32_t>& messageIds,
+  bool waitForAll,
+  int timeoutMs)
+{
+    ChainedCallWaiter waiter(appId);
+    for (uint32_t messageId : messageIds) {
+        waiter.add(messageId);
+    }
+
+    std::vector<ChainedCallResult> results =
+      waiter.wait(waitForAll, timeoutMs);
+    if (results.size() < messageIds.size() && (waitForAll || results.empty())) {
+        SPDLOG_WARN("Timed out waiting for {}/{} chained calls",
+                    waiter.getPendingCount(),
+                    messageIds.size());
+    }
+
+    return results;
+}
+
+std::vector<ChainedCallResult> awaitChainedCalls(
+  const std::vector<uint32_t>& messageIds,
+  bool waitForAll,
+  int timeoutMs)
+{
+    if (timeoutMs <= 0) {
+        timeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+    }
+
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+    int appId = exec->getBoundMessage().appid();
+
+    return awaitChainedCalls(appId, messageIds, waitForAll, timeoutMs);
+}
+
+// Copies the fields a chained call inherits from the call that made it
+static void setChainedCallFields(const faabric::Message& originalCall,
+                                 faabric::Message& msg,
+                                 int wasmFuncPtr,
+                                 const char* pyFuncName,
+                                 const std::vector<uint8_t>& inputData)
+{
+    msg.set_funcptr(wasmFuncPtr);
+    setChainedCallInput(msg, inputData);
+    if (isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT)) {
+        faabric::util::UniqueLock lock(outputRefCallsMx);
+        outputRefCalls[originalCall.id()].emplace_back(msg.id());
+    }
+
+    // Propagate the command line if needed
+    msg.set_cmdline(originalCall.cmdline());
+
+    // Python properties
+    msg.set_pythonuser(originalCall.pythonuser());
+    msg.set_pythonfunction(originalCall.pythonfunction());
+    if (pyFuncName != nullptr) {
+        msg.set_pythonentry(pyFuncName);
+    }
+    msg.set_ispython(originalCall.ispython());
+
+    if (originalCall.recordexecgraph()) {
+        msg.set_recordexecgraph(true);
+    }
+}
+
+static void submitChainedCalls(
+  const faabric::Message& originalCall,
+  std::shared_ptr<faabric::BatchExecuteRequest> req)
+{
+    // Record the chained calls in the executor before invoking the new
+    // functions to avoid data races. Only the caller can read their streams,
+    // and only if it's asked to.
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+    bool streamed = streamsChainedCalls(originalCall);
+    for (auto& msg : *req->mutable_messages()) {
+        if (streamed) {
+            addStreamReader(originalCall, msg);
+        }
+        exec->addChainedMessage(msg);
+    }
+
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    plannerCli.callFunctions(req);
+
+    if (originalCall.recordexecgraph()) {
+        for (const auto& msg : req->messages()) {
+            faabric::util::logChainedFunction(originalCall, msg);
+        }
+    }
+}
+
 int makeChainedCall(const std::string& functionName,
                     int wasmFuncPtr,
                     const char* pyFuncName,
@@ -56,23 +256,8 @@ int makeChainedCall(const std::string& functionName,
 
     // Propagate chaining-specific fields
     faabric::Message& msg = req->mutable_messages()->at(0);
-    msg.set_inputdata(inputData.data(), inputData.size());
-    msg.set_funcptr(wasmFuncPtr);
-
-    // Propagate the command line if needed
-    msg.set_cmdline(originalCall->cmdline());
-
-    // Python properties
-    msg.set_pythonuser(originalCall->pythonuser());
-    msg.set_pythonfunction(originalCall->pythonfunction());
-    if (pyFuncName != nullptr) {
-        msg.set_pythonentry(pyFuncName);
-    }
-    msg.set_ispython(originalCall->ispython());
-
-    if (originalCall->recordexecgraph()) {
-        msg.set_recordexecgraph(true);
-    }
+    setChainedCallFields(
+      *originalCall, msg, wasmFuncPtr, pyFuncName, inputData);
 
     if (msg.funcptr() == 0) {
         SPDLOG_INFO("Chaining call {}/{} -> {}/{} (ids: {} -> {})",
@@ -90,19 +275,89 @@ int makeChainedCall(const std::string& functionName,
                     msg.id());
     }
 
-    // Record the chained call in the executor before invoking the new
-    // functions to avoid data races
-    faabric::scheduler::ExecutorContext::get()
-      ->getExecutor()
-      ->addChainedMessage(req->messages(0));
+    submitChainedCalls(*originalCall, req);
 
-    auto& plannerCli = faabric::planner::getPlannerClient();
-    plannerCli.callFunctions(req);
-    if (originalCall->recordexecgraph()) {
-        faabric::util::logChainedFunction(*originalCall, msg);
+    return msg.id();
+}
+
+std::vector<std::shared_ptr<faabric::BatchExecuteRequest>>
+buildChainedCallBatches(const faabric::Message& originalCall,
+                        const std::vector<ChainedCall>& calls)
+{
+    // Calls in a batch must all be to the same function, so we make one batch
+    // per function, keeping the calls in order within each
+    std::vector<std::string> funcOrder;
+    std::unordered_map<std::string, std::vector<const ChainedCall*>> byFunc;
+    for (const auto& call : calls) {
+        if (call.functionName.empty()) {
+            throw std::runtime_error("Chained call with no function name");
+        }
+
+        auto [it, inserted] = byFunc.try_emplace(call.functionName);
+        if (inserted) {
+            funcOrder.emplace_back(call.functionName);
+        }
+        it->second.emplace_back(&call);
     }
 
-    return msg.id();
+    std::vector<std::shared_ptr<faabric::BatchExecuteRequest>> reqs;
+    for (const auto& funcName : funcOrder) {
+        const auto& funcCalls = byFunc.at(funcName);
+        auto req = faabric::util::batchExecFactory(
+          originalCall.user(), funcName, funcCalls.size());
+        faabric::util::updateBatchExecAppId(req, originalCall.appid());
+
+        for (size_t i = 0; i < funcCalls.size(); i++) {
+            setChainedCallFields(originalCall,
+                                 req->mutable_messages()->at(i),
+                                 funcCalls.at(i)->wasmFuncPtr,
+                                 nullptr,
+                                 funcCalls.at(i)->inputData);
+        }
+
+        reqs.emplace_back(req);
+    }
+
+    return reqs;
+}
+
+std::vector<int> makeChainedCallBatch(const std::vector<ChainedCall>& calls)
+{
+    faabric::Message* originalCall =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    std::vector<std::shared_ptr<faabric::BatchExecuteRequest>> reqs =
+      buildChainedCallBatches(*originalCall, calls);
+
+    // Batches hold the calls grouped by function, so we map the ids back to
+    // the order they were requested in
+    std::unordered_map<std::string, std::vector<int>> idsByFunc;
+    for (const auto& req : reqs) {
+        SPDLOG_INFO("Chaining batch of {} calls {}/{} -> {}/{} (app: {})",
+                    req->messages_size(),
+                    originalCall->user(),
+                    originalCall->function(),
+                    req->messages(0).user(),
+                    req->messages(0).function(),
+                    originalCall->appid());
+
+        auto& funcIds = idsByFunc[req->messages(0).function()];
+        for (const auto& msg : req->messages()) {
+            funcIds.emplace_back(msg.id());
+        }
+
+        submitChainedCalls(*originalCall, req);
+    }
+
+    std::vector<int> ids;
+    ids.reserve(calls.size());
+    std::unordered_map<std::string, int> nextIdx;
+    for (const auto& call : calls) {
+        ids.emplace_back(
+          idsByFunc.at(call.functionName).at(nextIdx[call.functionName]++));
+    }
+
+    return ids;
 }
 
 int awaitChainedCallOutput(unsigned int messageId, char* buffer, int bufferLen)
@@ -125,15 +380,285 @@ int awaitChainedCallOutput(unsigned int messageId, char* buffer, int bufferLen)
         SPDLOG_ERROR("Cannot find output for {}", messageId);
     }
 
-    std::string outputData = result.outputdata();
-    strncpy(buffer, outputData.c_str(), outputData.size());
+    const std::string& outputData = result.outputdata();
+    size_t outputSize = getChainPayloadSize(result, CHAIN_PAYLOAD_OUTPUT);
+    if (isChainPayloadRef(result, CHAIN_PAYLOAD_OUTPUT)) {
+        // The output is only read once, so we can drop it afterwards
+        readChainPayload(result,
+                         CHAIN_PAYLOAD_OUTPUT,
+                         reinterpret_cast<uint8_t*>(buffer),
+                         std::max(bufferLen, 0));
+        deleteChainPayload(result, CHAIN_PAYLOAD_OUTPUT);
+    } else {
+        strncpy(buffer, outputData.c_str(), outputData.size());
+    }
 
-    if (bufferLen < outputData.size()) {
+    if (bufferLen < outputSize) {
         SPDLOG_WARN("Undersized output buffer: {} for {} output",
                     bufferLen,
-                    outputData.size());
+                    outputSize);
     }
 
     return result.returnvalue();
 }
+
+static const std::string& getInlinePayload(const faabric::Message& msg,
+                                           const std::string& field)
+{
+    if (field == CHAIN_PAYLOAD_INPUT) {
+        return msg.inputdata();
+    }
+
+    if (field == CHAIN_PAYLOAD_OUTPUT) {
+        return msg.outputdata();
+    }
+
+    SPDLOG_ERROR("Unrecognised chained call payload field {}", field);
+    throw std::runtime_error("Unrecognised chained call payload field");
+}
+
+// Parses a payload reference, returning false if the data is inline
+static bool parseChainPayloadRef(const faabric::Message& msg,
+                                 const std::string& field,
+                                 ChainPayloadRef& ref,
+                                 std::string& key)
+{
+    auto it = msg.execgraphdetails().find(field);
+    if (it == msg.execgraphdetails().end()) {
+        return false;
+    }
+
+    // References can only name chained call payloads
+    const std::string& data = it->second;
+    key = data.size() > sizeof(ChainPayloadRef)
+            ? data.substr(sizeof(ChainPayloadRef))
+            : "";
+    if (key.rfind(CHAIN_PAYLOAD_KEY_PREFIX, 0) != 0) {
+        SPDLOG_ERROR("Malformed chained call payload reference for {}",
+                     msg.id());
+        throw std::runtime_error("Malformed chained call payload reference");
+    }
+
+    std::memcpy(&ref, data.data(), sizeof(ChainPayloadRef));
+
+    return true;
+}
+
+static void setChainPayloadRef(faabric::Message& msg,
+                               const std::string& field,
+                               const ChainPayloadRef& ref,
+                               const std::string& key)
+{
+    std::string data(reinterpret_cast<const char*>(&ref),
+                     sizeof(ChainPayloadRef));
+    data += key;
+
+    (*msg.mutable_execgraphdetails())[field] = data;
+    if (field == CHAIN_PAYLOAD_INPUT) {
+        msg.clear_inputdata();
+    } else {
+        msg.clear_outputdata();
+    }
+}
+
+static std::string getChainPayloadKey(int messageId, const std::string& suffix)
+{
+    return fmt::format("{}{}_{}", CHAIN_PAYLOAD_KEY_PREFIX, messageId, suffix);
+}
+
+// Writes the data to a state value and makes the field a reference to it
+static void writeChainPayload(faabric::Message& msg,
+                              const std::string& field,
+                              const std::string& suffix,
+                              const uint8_t* data,
+                              size_t len,
+                              uint32_t flags)
+{
+    const std::string& user = msg.user();
+    std::string key = getChainPayloadKey(msg.id(), suffix);
+
+    auto kv = faabric::state::getGlobalState().getKV(user, key, len);
+    kv->set(data);
+    kv->pushFull();
+
+    SPDLOG_DEBUG("Passing {} bytes of {} {} by reference ({}/{})",
+                 len,
+                 msg.id(),
+                 suffix,
+                 user,
+                 key);
+
+    ChainPayloadRef ref;
+    ref.flags = flags;
+    ref.reserved = 0;
+    ref.size = len;
+    setChainPayloadRef(msg, field, ref, key);
+}
+
+bool isChainPayloadRef(const faabric::Message& msg, const std::string& field)
+{
+    return msg.execgraphdetails().count(field) > 0;
+}
+
+size_t getChainPayloadSize(const faabric::Message& msg,
+                           const std::string& field)
+{
+    ChainPayloadRef ref;
+    std::string key;
+    if (!parseChainPayloadRef(msg, field, ref, key)) {
+        return getInlinePayload(msg, field).size();
+    }
+
+    return ref.size;
+}
+
+size_t readChainPayload(const faabric::Message& msg,
+                        const std::string& field,
+                        uint8_t* buffer,
+                        size_t bufferLen)
+{
+    ChainPayloadRef ref;
+    std::string key;
+    if (!parseChainPayloadRef(msg, field, ref, key)) {
+        const std::string& data = getInlinePayload(msg, field);
+        size_t nBytes = std::min(bufferLen, data.size());
+        std::memcpy(buffer, data.data(), nBytes);
+        return nBytes;
+    }
+
+    // Only pulls the chunk we need if the value lives on another host
+    size_t nBytes = std::min<size_t>(bufferLen, ref.size);
+    if (nBytes > 0) {
+        auto kv =
+          faabric::state::getGlobalState().getKV(msg.user(), key, ref.size);
+        kv->getChunk(0, buffer, nBytes);
+    }
+
+    return nBytes;
+}
+
+void deleteChainPayload(faabric::Message& msg, const std::string& field)
+{
+    ChainPayloadRef ref;
+    std::string key;
+    if (parseChainPayloadRef(msg, field, ref, key)) {
+        faabric::state::getGlobalState().deleteKV(msg.user(), key);
+        msg.mutable_execgraphdetails()->erase(field);
+    }
+}
+
+void deleteChainedCallOutputs(const faabric::Message& msg)
+{
+    std::vector<int> callIds;
+    {
+        faabric::util::UniqueLock lock(outputRefCallsMx);
+        auto it = outputRefCalls.find(msg.id());
+        if (it == outputRefCalls.end()) {
+            return;
+        }
+
+        callIds = std::move(it->second);
+        outputRefCalls.erase(it);
+    }
+
+    // Outputs already read have gone, and deleting them again is harmless
+    auto& state = faabric::state::getGlobalState();
+    for (int callId : callIds) {
+        state.deleteKV(msg.user(), getChainPayloadKey(callId, "output"));
+    }
+}
+
+void forwardChainPayload(const faabric::Message& from,
+                         faabric::Message& to,
+                         bool outputByRef)
+{
+    if (from.user() != to.user()) {
+        SPDLOG_ERROR("Cannot forward payload from {} to {} across users",
+                     from.id(),
+                     to.id());
+        throw std::runtime_error("Cannot forward payload across users");
+    }
+
+    ChainPayloadRef ref;
+    std::string key;
+    if (!parseChainPayloadRef(from, CHAIN_PAYLOAD_OUTPUT, ref, key)) {
+        SPDLOG_ERROR("Output of {} is not a reference", from.id());
+        throw std::runtime_error("Forwarded output is not a reference");
+    }
+
+    ref.flags = outputByRef ? CHAIN_PAYLOAD_FLAG_OUTPUT_REF : 0;
+    setChainPayloadRef(to, CHAIN_PAYLOAD_INPUT, ref, key);
+}
+
+void setChainedCallInput(faabric::Message& msg,
+                         const std::vector<uint8_t>& inputData,
+                         bool outputByRef)
+{
+    msg.mutable_execgraphdetails()->erase(CHAIN_PAYLOAD_INPUT);
+
+    int threshold = conf::getFaasmConfig().chainPayloadThreshold;
+    if (threshold <= 0 || inputData.size() <= threshold) {
+        msg.set_inputdata(inputData.data(), inputData.size());
+        return;
+    }
+
+    writeChainPayload(msg,
+                      CHAIN_PAYLOAD_INPUT,
+                      "input",
+                      inputData.data(),
+                      inputData.size(),
+                      outputByRef ? CHAIN_PAYLOAD_FLAG_OUTPUT_REF : 0);
+}
+
+void setCallOutput(faabric::Message& msg, const uint8_t* data, size_t len)
+{
+    deleteChainPayload(msg, CHAIN_PAYLOAD_OUTPUT);
+
+    // Only callers that passed the input by reference can take the output
+    // that way too, anything else may be reading the output from outside
+    int threshold = conf::getFaasmConfig().chainPayloadThreshold;
+    bool callerTakesRef = false;
+    ChainPayloadRef ref;
+    std::string key;
+    if (parseChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT, ref, key)) {
+        callerTakesRef = (ref.flags & CHAIN_PAYLOAD_FLAG_OUTPUT_REF) != 0;
+    }
+
+    if (threshold <= 0 || len <= threshold || !callerTakesRef) {
+        msg.set_outputdata(data, len);
+        return;
+    }
+
+    writeChainPayload(msg, CHAIN_PAYLOAD_OUTPUT, "output", data, len, 0);
+}
+
+void streamChainedCalls(bool enabled)
+{
+    faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    setStreamChainedCalls(msg, enabled);
+}
+
+void emitCallStreamChunk(const uint8_t* data, size_t len)
+{
+    const faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    emitStreamChunk(msg, data, len, conf::getFaasmConfig().chainedCallTimeout);
+}
+
+int readChainedCallStreamChunk(unsigned int messageId,
+                               uint8_t* buffer,
+                               size_t bufferLen,
+                               int timeoutMs)
+{
+    if (timeoutMs <= 0) {
+        timeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+    }
+
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+    const faabric::Message& msg = exec->getBoundMessage();
+
+    return readStreamChunk(
+      msg.appid(), msg.user(), messageId, buffer, bufferLen, timeoutMs);
+}
 }
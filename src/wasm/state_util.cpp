@@ -0,0 +1,226 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/state.h>
+
+#include <faabric/state/InMemoryStateRegistry.h>
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace wasm {
+
+// Returns the host that masters the key, or empty if all keys live in the same
+// external store (i.e. Redis)
+static std::string getStateMaster(const faabric::state::StateKeyValue& kv)
+{
+    const faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    if (conf.stateMode != "inmemory") {
+        return "";
+    }
+
+    return faabric::state::getInMemoryStateRegistry().getMasterIP(
+      kv.user, kv.key, conf.endpointHost, false);
+}
+
+// Applies the operation to every key. Keys mastered by other hosts are
+// transferred by a few threads per host, each taking the next key in the group
+// until there are none left.
+static void forEachByMaster(const StateKVs& kvs,
+                            const std::function<void(size_t)>& op)
+{
+    std::map<std::string, std::vector<size_t>> byMaster;
+    for (size_t i = 0; i < kvs.size(); i++) {
+        byMaster[getStateMaster(*kvs.at(i))].emplace_back(i);
+    }
+
+    SPDLOG_TRACE("Multi-key state operation on {} keys across {} hosts",
+                 kvs.size(),
+                 byMaster.size());
+
+    // Keys mastered here need no transfer, so we do them on this thread while
+    // the remote groups are in flight. The same goes for a single key, which
+    // gains nothing from another thread.
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    const std::vector<size_t>* localGroup = nullptr;
+    struct RemoteGroup
+    {
+        const std::vector<size_t>* idxs = nullptr;
+        std::atomic<size_t> next = 0;
+    };
+    std::vector<RemoteGroup> remoteGroups(byMaster.size());
+    std::vector<std::future<void>> remoteWorkers;
+    size_t nRemote = 0;
+    for (const auto& [master, idxs] : byMaster) {
+        if (master == thisHost || kvs.size() == 1) {
+            localGroup = &idxs;
+            continue;
+        }
+
+        RemoteGroup& group = remoteGroups.at(nRemote++);
+        group.idxs = &idxs;
+
+        size_t nWorkers =
+          std::min<size_t>(idxs.size(), STATE_MULTI_KEYS_IN_FLIGHT);
+        for (size_t w = 0; w < nWorkers; w++) {
+            remoteWorkers.emplace_back(
+              std::async(std::launch::async, [&op, &group] {
+                  size_t i;
+                  while ((i = group.next++) < group.idxs->size()) {
+                      op(group.idxs->at(i));
+                  }
+              }));
+        }
+    }
+
+    if (localGroup != nullptr) {
+        for (size_t idx : *localGroup) {
+            op(idx);
+        }
+    }
+
+    // Rethrows any errors from the remote groups
+    for (auto& f : remoteWorkers) {
+        f.get();
+    }
+}
+
+void pullStateMulti(const StateKVs& kvs)
+{
+    forEachByMaster(kvs, [&kvs](size_t idx) { kvs.at(idx)->pull(); });
+}
+
+void pullStateChunksMulti(const StateKVs& kvs,
+                          const std::vector<long>& offsets,
+                          const std::vector<long>& lengths)
+{
+    if (offsets.size() != kvs.size() || lengths.size() != kvs.size()) {
+        SPDLOG_ERROR("Mismatched multi-key chunk pull ({} keys, {} offsets, "
+                     "{} lengths)",
+                     kvs.size(),
+                     offsets.size(),
+                     lengths.size());
+        throw std::runtime_error("Mismatched multi-key chunk pull");
+    }
+
+    // Getting a chunk pulls it if it's not already present
+    forEachByMaster(kvs, [&](size_t idx) {
+        kvs.at(idx)->getChunk(offsets.at(idx), lengths.at(idx));
+    });
+}
+
+void pushStateMulti(const StateKVs& kvs, bool partial)
+{
+    forEachByMaster(kvs, [&kvs, partial](size_t idx) {
+        if (partial) {
+            kvs.at(idx)->pushPartial();
+        } else {
+            kvs.at(idx)->pushFull();
+        }
+    });
+}
+
+void checkStateBufferSize(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  int32_t bufferLen)
+{
+    if (bufferLen < 0 || (size_t)bufferLen < kv->size()) {
+        SPDLOG_ERROR("Buffer of {} bytes too small for state {} ({} bytes)",
+                     bufferLen,
+                     kv->key,
+                     kv->size());
+        throw std::runtime_error("State buffer too small for value");
+    }
+}
+
+// Fixed set of threads working through a queue of transfers. Transfers spend
+// nearly all their time waiting on the network, so a handful of threads can
+// keep many guests' transfers in flight.
+class StateIOPool
+{
+  public:
+    explicit StateIOPool(int nThreads)
+    {
+        SPDLOG_DEBUG("Starting {} state I/O threads", nThreads);
+
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~StateIOPool()
+    {
+        {
+            faabric::util::UniqueLock lock(mx);
+            shuttingDown = true;
+        }
+        cv.notify_all();
+
+        for (auto& t : threads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
+
+    std::future<void> submit(std::function<void()> op)
+    {
+        std::packaged_task<void()> task(std::move(op));
+        std::future<void> result = task.get_future();
+
+        {
+            faabric::util::UniqueLock lock(mx);
+            queue.emplace_back(std::move(task));
+        }
+        cv.notify_one();
+
+        return result;
+    }
+
+  private:
+    std::mutex mx;
+    std::condition_variable cv;
+    std::deque<std::packaged_task<void()>> queue;
+    std::vector<std::thread> threads;
+    bool shuttingDown = false;
+
+    void work()
+    {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                faabric::util::UniqueLock lock(mx);
+                cv.wait(lock, [this] { return shuttingDown || !queue.empty(); });
+
+                // Finish what's queued before shutting down, as guests may
+                // still be waiting on it
+                if (queue.empty()) {
+                    return;
+                }
+
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            // Exceptions are caught by the task and passed to its future
+            task();
+        }
+    }
+};
+
+std::future<void> submitStateTransfer(std::function<void()> op)
+{
+    static StateIOPool pool(
+      std::max(1, conf::getFaasmConfig().stateIoThreads));
+
+    return pool.submit(std::move(op));
+}
+}
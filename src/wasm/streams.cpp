@@ -0,0 +1,401 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/streams.h>
+
+#include <faabric/planner/PlannerClient.h>
+#include <faabric/state/State.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wasm {
+
+struct StreamHeader
+{
+    int64_t nChunks = 0;
+    int64_t closed = 0;
+};
+
+// What the reader of a stream is up to, as seen by the producer
+enum StreamReaderState : int64_t
+{
+    STREAM_READER_NONE = 0,
+    STREAM_READER_ATTACHED = 1,
+    STREAM_READER_DETACHED = 2,
+};
+
+// A stream that a call on this host may read
+struct StreamReader
+{
+    int readerId = 0;
+    std::string user;
+    bool attached = false;
+};
+
+static std::mutex streamsMx;
+static std::condition_variable streamsCv;
+
+// Headers of the streams being produced by calls on this host
+static std::unordered_map<int, StreamHeader> openStreams;
+
+// Streams that calls on this host may read, by producing call id
+static std::unordered_map<int, StreamReader> readStreams;
+
+static std::string getStreamKey(int callId, const std::string& suffix)
+{
+    return fmt::format("{}{}_{}", STREAM_KEY_PREFIX, callId, suffix);
+}
+
+static std::shared_ptr<faabric::state::StateKeyValue> getHeaderKV(
+  const std::string& user,
+  int callId)
+{
+    return faabric::state::getGlobalState().getKV(
+      user, getStreamKey(callId, "header"), sizeof(StreamHeader));
+}
+
+static std::shared_ptr<faabric::state::StateKeyValue> getConsumedKV(
+  const std::string& user,
+  int callId)
+{
+    return faabric::state::getGlobalState().getKV(
+      user, getStreamKey(callId, "consumed"), sizeof(int64_t));
+}
+
+static std::shared_ptr<faabric::state::StateKeyValue> getReaderKV(
+  const std::string& user,
+  int callId)
+{
+    return faabric::state::getGlobalState().getKV(
+      user, getStreamKey(callId, "reader"), sizeof(int64_t));
+}
+
+bool hasStreamReader(const faabric::Message& msg)
+{
+    return msg.execgraphdetails().count(STREAM_READER) > 0;
+}
+
+void setStreamChainedCalls(faabric::Message& msg, bool enabled)
+{
+    if (enabled) {
+        (*msg.mutable_execgraphdetails())[STREAM_CHAINED_CALLS] = "1";
+    } else {
+        msg.mutable_execgraphdetails()->erase(STREAM_CHAINED_CALLS);
+    }
+}
+
+bool streamsChainedCalls(const faabric::Message& msg)
+{
+    return msg.execgraphdetails().count(STREAM_CHAINED_CALLS) > 0;
+}
+
+template<typename T>
+static T readStreamValue(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    T value;
+    kv->pull();
+    kv->get(reinterpret_cast<uint8_t*>(&value));
+    return value;
+}
+
+template<typename T>
+static void writeStreamValue(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  const T& value)
+{
+    kv->set(reinterpret_cast<const uint8_t*>(&value));
+    kv->pushFull();
+}
+
+bool isStreamReaderAttached(const faabric::Message& msg)
+{
+    if (!hasStreamReader(msg)) {
+        return false;
+    }
+
+    return readStreamValue<int64_t>(getReaderKV(msg.user(), msg.id())) ==
+           STREAM_READER_ATTACHED;
+}
+
+// Waits for the other end of a stream on this host to do something, or for the
+// poll interval to pass in case the other end is elsewhere
+static void waitForStreams(int pollMs)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    streamsCv.wait_for(lock, std::chrono::milliseconds(pollMs));
+}
+
+// Removes everything left of a stream once both ends are done with it. Both
+// ends may do this, so it must leave nothing behind when run twice.
+static void removeStream(const std::string& user, int callId, int64_t nChunks)
+{
+    faabric::state::State& state = faabric::state::getGlobalState();
+    int64_t consumed = readStreamValue<int64_t>(getConsumedKV(user, callId));
+    for (int64_t i = consumed; i < nChunks; i++) {
+        state.deleteKV(user, getStreamKey(callId, std::to_string(i)));
+    }
+
+    state.deleteKV(user, getStreamKey(callId, "header"));
+    state.deleteKV(user, getStreamKey(callId, "consumed"));
+    state.deleteKV(user, getStreamKey(callId, "reader"));
+
+    SPDLOG_TRACE("Removed stream from {} ({} unread chunks)",
+                 callId,
+                 std::max<int64_t>(nChunks - consumed, 0));
+}
+
+void emitStreamChunk(const faabric::Message& msg,
+                     const uint8_t* data,
+                     size_t len,
+                     int timeoutMs)
+{
+    if (len == 0) {
+        return;
+    }
+
+    int callId = msg.id();
+    if (!hasStreamReader(msg)) {
+        SPDLOG_TRACE("Dropping chunk from {} as nothing can read it", callId);
+        return;
+    }
+
+    const std::string& user = msg.user();
+    auto headerKV = getHeaderKV(user, callId);
+    auto consumedKV = getConsumedKV(user, callId);
+    auto readerKV = getReaderKV(user, callId);
+
+    StreamHeader header;
+    {
+        faabric::util::UniqueLock lock(streamsMx);
+        header = openStreams[callId];
+    }
+
+    // Only wait for room once the reader is reading, otherwise we'd stall a
+    // call whose caller never reads its stream
+    int maxChunks = std::max(1, conf::getFaasmConfig().streamMaxChunks);
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    int pollMs = STREAM_MIN_POLL_MS;
+    int64_t readerState = readStreamValue<int64_t>(readerKV);
+    while (readerState == STREAM_READER_ATTACHED &&
+           header.nChunks - readStreamValue<int64_t>(consumedKV) >=
+             maxChunks) {
+        if (faabric::util::getTimeDiffMillis(start) >= timeoutMs) {
+            SPDLOG_ERROR("Timed out emitting chunk {} of stream for {}",
+                         header.nChunks,
+                         callId);
+            throw std::runtime_error("Timed out emitting stream chunk");
+        }
+
+        waitForStreams(pollMs);
+        pollMs = std::min(pollMs * 2, STREAM_MAX_POLL_MS);
+        readerState = readStreamValue<int64_t>(readerKV);
+    }
+
+    if (readerState == STREAM_READER_DETACHED) {
+        SPDLOG_TRACE("Dropping chunk from {} as its reader has gone", callId);
+        return;
+    }
+
+    // The chunk must be in place before the header says it's there
+    auto chunkKV = faabric::state::getGlobalState().getKV(
+      user, getStreamKey(callId, std::to_string(header.nChunks)), len);
+    chunkKV->set(data);
+    chunkKV->pushFull();
+
+    header.nChunks++;
+    writeStreamValue(headerKV, header);
+
+    SPDLOG_TRACE("Emitted chunk {} ({} bytes) from {}",
+                 header.nChunks - 1,
+                 len,
+                 callId);
+
+    faabric::util::UniqueLock lock(streamsMx);
+    openStreams[callId] = header;
+    streamsCv.notify_all();
+}
+
+// Checks without blocking whether the call has finished
+static bool isCallFinished(int appId, int callId)
+{
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    try {
+        const faabric::Message result =
+          plannerCli.getMessageResult(appId, callId, 0);
+        return result.type() != faabric::Message_MessageType_EMPTY;
+    } catch (std::exception& ex) {
+        SPDLOG_ERROR("Error checking call {}: {}", callId, ex.what());
+        return true;
+    }
+}
+
+int readStreamChunk(int appId,
+                    const std::string& user,
+                    int callId,
+                    uint8_t* buffer,
+                    size_t bufferLen,
+                    int timeoutMs)
+{
+    faabric::state::State& state = faabric::state::getGlobalState();
+    auto headerKV = getHeaderKV(user, callId);
+    auto consumedKV = getConsumedKV(user, callId);
+
+    // The producer only waits for us once we've started reading
+    bool attach = false;
+    {
+        faabric::util::UniqueLock lock(streamsMx);
+        auto it = readStreams.find(callId);
+        if (it != readStreams.end() && !it->second.attached) {
+            it->second.attached = true;
+            attach = true;
+        }
+    }
+    if (attach) {
+        writeStreamValue<int64_t>(getReaderKV(user, callId),
+                                  STREAM_READER_ATTACHED);
+    }
+
+    int64_t consumed = readStreamValue<int64_t>(consumedKV);
+
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    int pollMs = STREAM_MIN_POLL_MS;
+    bool finished = false;
+    while (true) {
+        auto header = readStreamValue<StreamHeader>(headerKV);
+        if (header.nChunks > consumed) {
+            std::string chunkKey =
+              getStreamKey(callId, std::to_string(consumed));
+            auto chunkKV = state.getKV(user, chunkKey);
+            size_t chunkSize = chunkKV->size();
+            if (chunkSize > bufferLen) {
+                return (int)chunkSize;
+            }
+
+            chunkKV->getChunk(0, buffer, chunkSize);
+            state.deleteKV(user, chunkKey);
+            writeStreamValue<int64_t>(consumedKV, consumed + 1);
+
+            faabric::util::UniqueLock lock(streamsMx);
+            streamsCv.notify_all();
+
+            return (int)chunkSize;
+        }
+
+        // Once the call has finished we check for chunks once more, as it may
+        // have emitted some just before finishing
+        if (finished || header.closed != 0) {
+            SPDLOG_TRACE("Stream from {} finished after {} chunks",
+                         callId,
+                         header.nChunks);
+            {
+                faabric::util::UniqueLock lock(streamsMx);
+                readStreams.erase(callId);
+            }
+
+            // The producer may still be checking on us as it closes
+            writeStreamValue<int64_t>(getReaderKV(user, callId),
+                                      STREAM_READER_DETACHED);
+            removeStream(user, callId, header.nChunks);
+            return 0;
+        }
+        finished = isCallFinished(appId, callId);
+        if (finished) {
+            continue;
+        }
+
+        if (faabric::util::getTimeDiffMillis(start) >= timeoutMs) {
+            SPDLOG_WARN("Timed out reading chunk {} of stream from {}",
+                        consumed,
+                        callId);
+            return -1;
+        }
+
+        waitForStreams(pollMs);
+        pollMs = std::min(pollMs * 2, STREAM_MAX_POLL_MS);
+    }
+}
+
+void closeStream(const faabric::Message& msg)
+{
+    StreamHeader header;
+    {
+        faabric::util::UniqueLock lock(streamsMx);
+        auto it = openStreams.find(msg.id());
+        if (it != openStreams.end()) {
+            header = it->second;
+            openStreams.erase(it);
+        }
+    }
+
+    if (!hasStreamReader(msg)) {
+        return;
+    }
+
+    // We mark the stream closed before checking on the reader, and the reader
+    // detaches before checking if we're closed, so at least one of us sees the
+    // other has finished and removes the stream. We hold on to the reader's
+    // value first so that checking it can't bring it back once it's removed.
+    auto readerKV = getReaderKV(msg.user(), msg.id());
+    header.closed = 1;
+    writeStreamValue(getHeaderKV(msg.user(), msg.id()), header);
+
+    int64_t readerState = readStreamValue<int64_t>(readerKV);
+    if (readerState == STREAM_READER_DETACHED) {
+        removeStream(msg.user(), msg.id(), header.nChunks);
+    }
+
+    faabric::util::UniqueLock lock(streamsMx);
+    streamsCv.notify_all();
+}
+
+void addStreamReader(const faabric::Message& reader, faabric::Message& msg)
+{
+    (*msg.mutable_execgraphdetails())[STREAM_READER] =
+      std::to_string(reader.id());
+
+    faabric::util::UniqueLock lock(streamsMx);
+    StreamReader& stream = readStreams[msg.id()];
+    stream.readerId = reader.id();
+    stream.user = msg.user();
+}
+
+void detachStreams(const faabric::Message& reader)
+{
+    std::vector<std::pair<int, std::string>> detached;
+    {
+        faabric::util::UniqueLock lock(streamsMx);
+        for (auto it = readStreams.begin(); it != readStreams.end();) {
+            if (it->second.readerId == reader.id()) {
+                detached.emplace_back(it->first, it->second.user);
+                it = readStreams.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (const auto& [callId, user] : detached) {
+        auto headerKV = getHeaderKV(user, callId);
+        writeStreamValue<int64_t>(getReaderKV(user, callId),
+                                  STREAM_READER_DETACHED);
+
+        auto header = readStreamValue<StreamHeader>(headerKV);
+        if (header.closed != 0) {
+            removeStream(user, callId, header.nChunks);
+        }
+    }
+
+    if (!detached.empty()) {
+        SPDLOG_DEBUG("{} detached from {} streams", reader.id(), detached.size());
+        faabric::util::UniqueLock lock(streamsMx);
+        streamsCv.notify_all();
+    }
+}
+}
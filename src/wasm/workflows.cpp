@@ -0,0 +1,564 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/chaining.h>
+#include <wasm/workflows.h>
+
+#include <faabric/planner/PlannerClient.h>
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/batch.h>
+#include <faabric/util/func.h>
+#include <faabric/util/gids.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <rapidjson/document.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace wasm {
+
+static std::mutex workflowsMx;
+static std::condition_variable workflowsCv;
+static size_t activeWorkflows = 0;
+static bool workflowsCancelled = false;
+
+// Threads running workflows, and those that have finished but not been joined
+static std::unordered_map<int, std::thread> workflowThreads;
+static std::vector<int> finishedWorkflows;
+static int nextWorkflowId = 0;
+
+// The state of a workflow as its nodes are run
+struct WorkflowRun
+{
+    Workflow workflow;
+    int appId = 0;
+    std::vector<int> messageIds;
+
+    std::vector<std::vector<int>> successors;
+
+    // Dependencies each node is still waiting on
+    std::vector<int> nWaiting;
+
+    // Successors that still need each node's output
+    std::vector<int> nConsumers;
+
+    std::vector<std::string> outputs;
+
+    // Results of nodes whose outputs are passed on by reference
+    std::vector<faabric::Message> refResults;
+
+    std::vector<bool> skipped;
+};
+
+static void throwWorkflowError(const std::string& errorMsg)
+{
+    SPDLOG_ERROR("Invalid workflow: {}", errorMsg);
+    throw std::runtime_error("Invalid workflow: " + errorMsg);
+}
+
+Workflow parseWorkflow(const std::string& json, const std::string& defaultUser)
+{
+    rapidjson::Document d;
+    d.Parse(json.data(), json.size());
+    if (d.HasParseError() || !d.IsObject()) {
+        throwWorkflowError("spec is not a JSON object");
+    }
+
+    Workflow workflow;
+    workflow.user = defaultUser;
+    if (d.HasMember("user")) {
+        if (!d["user"].IsString()) {
+            throwWorkflowError("user must be a string");
+        }
+        workflow.user = d["user"].GetString();
+    }
+
+    if (!d.HasMember("nodes") || !d["nodes"].IsArray()) {
+        throwWorkflowError("spec has no array of nodes");
+    }
+
+    for (const auto& n : d["nodes"].GetArray()) {
+        if (!n.IsObject() || !n.HasMember("function") ||
+            !n["function"].IsString()) {
+            throwWorkflowError(
+              fmt::format("node {} has no function", workflow.nodes.size()));
+        }
+
+        WorkflowNode& node = workflow.nodes.emplace_back();
+        node.function = n["function"].GetString();
+
+        if (n.HasMember("input")) {
+            if (!n["input"].IsString()) {
+                throwWorkflowError(fmt::format(
+                  "input of node {} must be a string", workflow.nodes.size()));
+            }
+            const char* input = n["input"].GetString();
+            node.inputData.assign(input, input + n["input"].GetStringLength());
+        }
+
+        if (n.HasMember("deps")) {
+            if (!n["deps"].IsArray()) {
+                throwWorkflowError(fmt::format(
+                  "deps of node {} must be an array", workflow.nodes.size()));
+            }
+            for (const auto& dep : n["deps"].GetArray()) {
+                if (!dep.IsInt()) {
+                    throwWorkflowError(fmt::format("non-integer dep of node {}",
+                                                   workflow.nodes.size()));
+                }
+                node.dependsOn.emplace_back(dep.GetInt());
+            }
+        }
+    }
+
+    validateWorkflow(workflow);
+
+    return workflow;
+}
+
+void validateWorkflow(const Workflow& workflow)
+{
+    if (workflow.user.empty()) {
+        throwWorkflowError("no user");
+    }
+
+    if (workflow.nodes.empty()) {
+        throwWorkflowError("no nodes");
+    }
+
+    for (size_t i = 0; i < workflow.nodes.size(); i++) {
+        const WorkflowNode& node = workflow.nodes.at(i);
+        if (node.function.empty()) {
+            throwWorkflowError(fmt::format("node {} has no function", i));
+        }
+
+        for (int dep : node.dependsOn) {
+            if (dep < 0 || (size_t)dep >= i) {
+                throwWorkflowError(fmt::format(
+                  "node {} depends on {}, which is not an earlier node",
+                  i,
+                  dep));
+            }
+        }
+    }
+}
+
+static WorkflowRun prepareWorkflow(const Workflow& workflow, int appId)
+{
+    validateWorkflow(workflow);
+
+    size_t nNodes = workflow.nodes.size();
+
+    WorkflowRun run;
+    run.workflow = workflow;
+    run.appId = appId;
+    run.successors.resize(nNodes);
+    run.nWaiting.resize(nNodes, 0);
+    run.nConsumers.resize(nNodes, 0);
+    run.outputs.resize(nNodes);
+    run.refResults.resize(nNodes);
+    run.skipped.resize(nNodes, false);
+
+    // Ids are fixed up front so callers can await nodes before they're run
+    for (int i = 0; i < nNodes; i++) {
+        run.messageIds.emplace_back(faabric::util::generateGid());
+
+        for (int dep : workflow.nodes.at(i).dependsOn) {
+            run.successors.at(dep).emplace_back(i);
+            run.nWaiting.at(i)++;
+            run.nConsumers.at(dep)++;
+        }
+    }
+
+    return run;
+}
+
+// Only a node's sole consumer can take its output by reference, as whoever
+// runs with the reference deletes it
+static bool canForwardOutput(const WorkflowRun& run, int idx)
+{
+    if (run.successors.at(idx).size() != 1) {
+        return false;
+    }
+
+    const WorkflowNode& succ =
+      run.workflow.nodes.at(run.successors.at(idx).front());
+    return succ.dependsOn.size() == 1 && succ.inputData.empty();
+}
+
+static void setNodeInput(WorkflowRun& run, int idx, faabric::Message& msg)
+{
+    const WorkflowNode& node = run.workflow.nodes.at(idx);
+
+    // Sinks' outputs may be read from outside, so they can't be references
+    bool outputByRef = !run.successors.at(idx).empty();
+
+    if (node.dependsOn.size() == 1 && node.inputData.empty() &&
+        isChainPayloadRef(run.refResults.at(node.dependsOn.front()),
+                          CHAIN_PAYLOAD_OUTPUT)) {
+        // Pass the output straight on without copying it out of state
+        forwardChainPayload(
+          run.refResults.at(node.dependsOn.front()), msg, outputByRef);
+    } else {
+        std::vector<uint8_t> inputData = node.inputData;
+        for (int dep : node.dependsOn) {
+            const std::string& output = run.outputs.at(dep);
+            inputData.insert(inputData.end(), output.begin(), output.end());
+        }
+
+        setChainedCallInput(msg, inputData, outputByRef);
+    }
+
+    // Drop outputs once all their consumers have them
+    for (int dep : node.dependsOn) {
+        if (--run.nConsumers.at(dep) == 0) {
+            std::string().swap(run.outputs.at(dep));
+            run.refResults.at(dep).Clear();
+        }
+    }
+}
+
+static void startNodes(WorkflowRun& run, const std::vector<int>& nodes)
+{
+    // As with batches of chained calls, we send one request per function
+    std::vector<std::string> funcOrder;
+    std::unordered_map<std::string, std::vector<int>> byFunc;
+    for (int idx : nodes) {
+        const std::string& func = run.workflow.nodes.at(idx).function;
+        auto [it, inserted] = byFunc.try_emplace(func);
+        if (inserted) {
+            funcOrder.emplace_back(func);
+        }
+        it->second.emplace_back(idx);
+    }
+
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    for (const auto& func : funcOrder) {
+        const auto& funcNodes = byFunc.at(func);
+        auto req = faabric::util::batchExecFactory(
+          run.workflow.user, func, funcNodes.size());
+        faabric::util::updateBatchExecAppId(req, run.appId);
+
+        for (size_t i = 0; i < funcNodes.size(); i++) {
+            faabric::Message& msg = req->mutable_messages()->at(i);
+            msg.set_id(run.messageIds.at(funcNodes.at(i)));
+            setNodeInput(run, funcNodes.at(i), msg);
+        }
+
+        SPDLOG_DEBUG("Starting {} workflow nodes {}/{} (app: {})",
+                     funcNodes.size(),
+                     run.workflow.user,
+                     func,
+                     run.appId);
+
+        plannerCli.callFunctions(req);
+    }
+}
+
+// Gives the nodes, and all the nodes downstream of them, a failed result
+// without running them
+static void skipNodes(WorkflowRun& run,
+                      std::vector<int> toSkip,
+                      const std::string& reason)
+{
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    while (!toSkip.empty()) {
+        int idx = toSkip.back();
+        toSkip.pop_back();
+        if (run.skipped.at(idx)) {
+            continue;
+        }
+
+        run.skipped.at(idx) = true;
+        toSkip.insert(toSkip.end(),
+                      run.successors.at(idx).begin(),
+                      run.successors.at(idx).end());
+
+        auto msg =
+          std::make_shared<faabric::Message>(faabric::util::messageFactory(
+            run.workflow.user, run.workflow.nodes.at(idx).function));
+        msg->set_id(run.messageIds.at(idx));
+        msg->set_appid(run.appId);
+        msg->set_returnvalue(1);
+        msg->set_outputdata(reason);
+        plannerCli.setMessageResult(msg);
+    }
+}
+
+// Gives all the nodes downstream of a failed node a failed result
+static void skipSuccessors(WorkflowRun& run, int failedIdx)
+{
+    skipNodes(run,
+              run.successors.at(failedIdx),
+              fmt::format("Skipped as workflow node {} failed",
+                          run.messageIds.at(failedIdx)));
+}
+
+static bool isWorkflowCancelled()
+{
+    faabric::util::UniqueLock lock(workflowsMx);
+    return workflowsCancelled;
+}
+
+// Records a finished node's output, keeping it as a reference only if it can
+// be passed straight on
+static void takeNodeOutput(WorkflowRun& run, int idx)
+{
+    auto& plannerCli = faabric::planner::getPlannerClient();
+    faabric::Message result =
+      plannerCli.getMessageResult(run.appId, run.messageIds.at(idx), 0);
+
+    if (!isChainPayloadRef(result, CHAIN_PAYLOAD_OUTPUT)) {
+        run.outputs.at(idx) = result.outputdata();
+    } else if (canForwardOutput(run, idx)) {
+        run.refResults.at(idx) = std::move(result);
+    } else {
+        std::string bytes(getChainPayloadSize(result, CHAIN_PAYLOAD_OUTPUT),
+                          '\0');
+        readChainPayload(result,
+                         CHAIN_PAYLOAD_OUTPUT,
+                         reinterpret_cast<uint8_t*>(bytes.data()),
+                         bytes.size());
+        deleteChainPayload(result, CHAIN_PAYLOAD_OUTPUT);
+        run.outputs.at(idx) = std::move(bytes);
+    }
+}
+
+static void runWorkflow(WorkflowRun& run)
+{
+    int timeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+
+    std::vector<int> ready;
+    for (size_t i = 0; i < run.nWaiting.size(); i++) {
+        if (run.nWaiting.at(i) == 0) {
+            ready.emplace_back(i);
+        }
+    }
+
+    std::unordered_map<uint32_t, int> running;
+
+    // Kept across rounds, so running nodes aren't all checked again each time
+    // one finishes
+    ChainedCallWaiter waiter(run.appId);
+    while (true) {
+        if (isWorkflowCancelled()) {
+            SPDLOG_WARN("Cancelling workflow in app {} with {} nodes running",
+                        run.appId,
+                        running.size());
+            skipNodes(run, ready, "Skipped as workflow was cancelled");
+            for (const auto& [id, idx] : running) {
+                skipNodes(run,
+                          run.successors.at(idx),
+                          "Skipped as workflow was cancelled");
+            }
+            break;
+        }
+
+        startNodes(run, ready);
+        for (int idx : ready) {
+            running.emplace(run.messageIds.at(idx), idx);
+            waiter.add(run.messageIds.at(idx));
+        }
+        ready.clear();
+
+        if (running.empty()) {
+            break;
+        }
+
+        // Wait in slices so that we notice if we're cancelled
+        std::vector<ChainedCallResult> results;
+        faabric::util::TimePoint start = faabric::util::startTimer();
+        int remainingMs = timeoutMs;
+        while (results.empty() && remainingMs > 0 && !isWorkflowCancelled()) {
+            results = waiter.wait(
+              false, std::min(remainingMs, WORKFLOW_CANCEL_POLL_MS));
+            remainingMs =
+              timeoutMs - (int)faabric::util::getTimeDiffMillis(start);
+        }
+
+        if (results.empty() && isWorkflowCancelled()) {
+            continue;
+        }
+
+        if (results.empty()) {
+            // The running nodes may still finish, but nothing will run after
+            SPDLOG_ERROR("Timed out waiting for {} nodes of workflow in app {}",
+                         running.size(),
+                         run.appId);
+            for (const auto& [id, idx] : running) {
+                skipSuccessors(run, idx);
+            }
+            break;
+        }
+
+        for (const auto& r : results) {
+            int idx = running.at(r.messageId);
+            running.erase(r.messageId);
+
+            if (r.returnValue != 0) {
+                SPDLOG_WARN("Workflow node {} failed in app {} ({})",
+                            r.messageId,
+                            run.appId,
+                            r.returnValue);
+                skipSuccessors(run, idx);
+                continue;
+            }
+
+            takeNodeOutput(run, idx);
+            for (int succ : run.successors.at(idx)) {
+                if (--run.nWaiting.at(succ) == 0 && !run.skipped.at(succ)) {
+                    ready.emplace_back(succ);
+                }
+            }
+        }
+    }
+
+    SPDLOG_DEBUG("Finished workflow of {} nodes in app {}",
+                 run.workflow.nodes.size(),
+                 run.appId);
+}
+
+// Joins the threads of workflows that have finished. Must be called with the
+// workflows lock held.
+static void joinFinishedWorkflows()
+{
+    for (int id : finishedWorkflows) {
+        auto it = workflowThreads.find(id);
+        if (it != workflowThreads.end()) {
+            // The thread has nothing left to do but return
+            it->second.join();
+            workflowThreads.erase(it);
+        }
+    }
+    finishedWorkflows.clear();
+}
+
+static void launchWorkflow(WorkflowRun run)
+{
+    faabric::util::UniqueLock lock(workflowsMx);
+    if (workflowsCancelled) {
+        SPDLOG_ERROR("Rejecting workflow in app {} while shutting down",
+                     run.appId);
+        throw std::runtime_error("Workflows are shutting down");
+    }
+
+    joinFinishedWorkflows();
+
+    int id = nextWorkflowId++;
+    activeWorkflows++;
+
+    // Workflows run on their own thread rather than an executor, so there's no
+    // function blocked waiting between stages
+    std::thread thread([id, run = std::move(run)]() mutable {
+        try {
+            runWorkflow(run);
+        } catch (std::exception& ex) {
+            SPDLOG_ERROR("Error running workflow in app {}: {}",
+                         run.appId,
+                         ex.what());
+        }
+
+        faabric::util::UniqueLock lock(workflowsMx);
+        activeWorkflows--;
+        finishedWorkflows.emplace_back(id);
+        workflowsCv.notify_all();
+    });
+    workflowThreads.emplace(id, std::move(thread));
+}
+
+std::vector<int> submitWorkflow(const Workflow& workflow, int appId)
+{
+    WorkflowRun run = prepareWorkflow(workflow, appId);
+    std::vector<int> messageIds = run.messageIds;
+
+    SPDLOG_INFO("Submitting workflow of {} nodes for {} (app: {})",
+                workflow.nodes.size(),
+                workflow.user,
+                appId);
+
+    launchWorkflow(std::move(run));
+
+    return messageIds;
+}
+
+std::vector<int> submitChainedWorkflow(const std::string& json)
+{
+    faabric::Message* originalCall =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    Workflow workflow = parseWorkflow(json, originalCall->user());
+    if (workflow.user != originalCall->user()) {
+        throwWorkflowError(
+          fmt::format("{} can't run workflows for {}",
+                      faabric::util::funcToString(*originalCall, false),
+                      workflow.user));
+    }
+
+    WorkflowRun run = prepareWorkflow(workflow, originalCall->appid());
+    std::vector<int> messageIds = run.messageIds;
+
+    SPDLOG_INFO("Chaining workflow of {} nodes from {} (app: {})",
+                workflow.nodes.size(),
+                faabric::util::funcToString(*originalCall, false),
+                originalCall->appid());
+
+    // Record the nodes as chained calls before any are run, so the caller can
+    // await them
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+    for (size_t i = 0; i < workflow.nodes.size(); i++) {
+        faabric::Message msg = faabric::util::messageFactory(
+          workflow.user, workflow.nodes.at(i).function);
+        msg.set_id(messageIds.at(i));
+        msg.set_appid(originalCall->appid());
+        exec->addChainedMessage(msg);
+    }
+
+    launchWorkflow(std::move(run));
+
+    return messageIds;
+}
+
+size_t getActiveWorkflowCount()
+{
+    faabric::util::UniqueLock lock(workflowsMx);
+    return activeWorkflows;
+}
+
+bool waitForWorkflows(int timeoutMs)
+{
+    faabric::util::UniqueLock lock(workflowsMx);
+    bool finished = workflowsCv.wait_for(lock,
+                                         std::chrono::milliseconds(timeoutMs),
+                                         [] { return activeWorkflows == 0; });
+    joinFinishedWorkflows();
+
+    return finished;
+}
+
+void shutdownWorkflows()
+{
+    std::unordered_map<int, std::thread> threads;
+    {
+        faabric::util::UniqueLock lock(workflowsMx);
+        workflowsCancelled = true;
+        threads.swap(workflowThreads);
+        finishedWorkflows.clear();
+    }
+
+    if (!threads.empty()) {
+        SPDLOG_INFO("Waiting for {} workflows to stop", threads.size());
+    }
+
+    // Each workflow notices within one poll interval, unless it's in the
+    // middle of talking to the planner
+    for (auto& [id, thread] : threads) {
+        thread.join();
+    }
+
+    faabric::util::UniqueLock lock(workflowsMx);
+    workflowsCancelled = false;
+}
+}
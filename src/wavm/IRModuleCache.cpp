@@ -313,6 +313,42 @@ bool IRModuleCache::isCompiledModuleCached(const std::string& user,
     return getCompiledModuleCount(key) > 0;
 }
 
+template<typename M, typename F>
+static int eraseMatching(M& map, F pred)
+{
+    int count = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        if (pred(it->first)) {
+            it = map.erase(it);
+            count++;
+        } else {
+            ++it;
+        }
+    }
+
+    return count;
+}
+
+void IRModuleCache::invalidateFunction(const std::string& user,
+                                       const std::string& func)
+{
+    // Shared module keys are the main key followed by an absolute path
+    const std::string mainKey = getModuleKey(user, func, "");
+    auto isForFunction = [&mainKey](const std::string& key) {
+        return key == mainKey ||
+               (key.size() > mainKey.size() &&
+                key.compare(0, mainKey.size(), mainKey) == 0 &&
+                key.at(mainKey.size()) == '/');
+    };
+
+    faabric::util::FullLock lock(mx);
+    int count = eraseMatching(moduleMap, isForFunction);
+    eraseMatching(compiledModuleMap, isForFunction);
+    eraseMatching(originalTableSizes, isForFunction);
+
+    SPDLOG_DEBUG("Invalidated {} IR modules for {}/{}", count, user, func);
+}
+
 void IRModuleCache::clear()
 {
     faabric::util::FullLock lock(mx);
@@ -33,10 +33,19 @@ WAVMModuleCache::getCachedModule(faabric::Message& msg)
 {
     std::string key = faabric::util::funcToString(msg, false);
 
-    // If there's no cached module, we need to create it
-    faabric::util::SharedLock readLock(mx);
-    if (cachedModuleMap.find(key) == cachedModuleMap.end()) {
-        readLock.unlock();
+    // The module may be invalidated between creating it and taking the shared
+    // lock again, in which case we create it again
+    while (true) {
+        {
+            faabric::util::SharedLock lock(mx);
+            auto it = cachedModuleMap.find(key);
+            if (it != cachedModuleMap.end()) {
+                return std::pair<wasm::WAVMWasmModule&,
+                                 faabric::util::SharedLock>(it->second,
+                                                            std::move(lock));
+            }
+        }
+
         faabric::util::FullLock lock(mx);
 
         // Re-check condition
@@ -49,34 +58,31 @@ WAVMModuleCache::getCachedModule(faabric::Message& msg)
             module.bindToFunction(msg, false);
         }
     }
-
-    {
-        // Note that we need a shared lock here to avoid a race condition on
-        // initialising the module
-        faabric::util::SharedLock lock(mx);
-        return std::pair<wasm::WAVMWasmModule&, faabric::util::SharedLock>(
-          cachedModuleMap[key], std::move(lock));
-    }
 }
 
-std::string WAVMModuleCache::registerResetSnapshot(wasm::WasmModule& module,
-                                                   faabric::Message& msg)
+std::string WAVMModuleCache::registerResetSnapshot(faabric::Message& msg)
 {
     std::string snapKey = faabric::util::funcToString(msg, false) + "_reset";
 
+    auto [cachedModule, cacheLock] = getCachedModule(msg);
+    ensureResetSnapshot(cachedModule, snapKey);
+
+    return snapKey;
+}
+
+void WAVMModuleCache::ensureResetSnapshot(wasm::WAVMWasmModule& cachedModule,
+                                          const std::string& snapKey)
+{
     faabric::snapshot::SnapshotRegistry& reg =
       faabric::snapshot::getSnapshotRegistry();
 
+    // Callers hold the cache's shared lock, so the snapshot can't be deleted
+    // by an invalidation until it's registered, and it's always taken from
+    // the zygote that's currently cached
+    faabric::util::UniqueLock lock(snapshotMx);
     if (!reg.snapshotExists(snapKey)) {
-        faabric::util::FullLock lock(mx);
-        if (!reg.snapshotExists(snapKey)) {
-            reg.registerSnapshot(snapKey, module.getSnapshotData());
-        }
-    }
-
-    {
-        faabric::util::SharedLock lock(mx);
-        return snapKey;
+        SPDLOG_DEBUG("Registering reset snapshot {}", snapKey);
+        reg.registerSnapshot(snapKey, cachedModule.getSnapshotData());
     }
 }
 
@@ -85,4 +91,24 @@ void WAVMModuleCache::clear()
     faabric::util::FullLock lock(mx);
     cachedModuleMap.clear();
 }
+
+void WAVMModuleCache::invalidate(const faabric::Message& msg)
+{
+    std::string key = faabric::util::funcToString(msg, false);
+    std::string snapKey = key + "_reset";
+
+    faabric::util::FullLock lock(mx);
+    cachedModuleMap.erase(key);
+
+    // Faaslets still holding the old snapshot key will recreate the snapshot
+    // from the new zygote on their next reset
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    faabric::util::UniqueLock snapshotLock(snapshotMx);
+    if (reg.snapshotExists(snapKey)) {
+        reg.deleteSnapshot(snapKey);
+    }
+
+    SPDLOG_DEBUG("WAVM module cache invalidated {}", key);
+}
 }
@@ -2,8 +2,11 @@
 
 #include <boost/filesystem.hpp>
 #include <stdexcept>
+#include <dirent.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/util/bytes.h>
@@ -16,6 +19,7 @@
 #include <faabric/util/timing.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/DirectoryCache.h>
 #include <storage/SharedFiles.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
@@ -73,6 +77,12 @@ void WAVMWasmModule::clearCaches()
     getWAVMModuleCache().clear();
 }
 
+void WAVMWasmModule::clearCachesForFunction(const faabric::Message& msg)
+{
+    getIRModuleCache().invalidateFunction(msg.user(), msg.function());
+    getWAVMModuleCache().invalidate(msg);
+}
+
 void WAVMWasmModule::reset(faabric::Message& msg,
                            const std::string& snapshotKey)
 {
@@ -86,8 +96,14 @@ void WAVMWasmModule::reset(faabric::Message& msg,
 
     std::string funcStr = faabric::util::funcToString(msg, true);
     SPDLOG_DEBUG("Resetting after {} (snap key {})", funcStr, snapshotKey);
-    auto [cachedModule, cacheLock] =
-      wasm::getWAVMModuleCache().getCachedModule(msg);
+    wasm::WAVMModuleCache& cache = wasm::getWAVMModuleCache();
+    auto [cachedModule, cacheLock] = cache.getCachedModule(msg);
+
+    // The reset snapshot is removed if the function has been invalidated, in
+    // which case we recreate it from the new zygote
+    if (!snapshotKey.empty()) {
+        cache.ensureResetSnapshot(cachedModule, snapshotKey);
+    }
 
     clone(cachedModule, snapshotKey);
 }
@@ -183,8 +199,13 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
     openMPContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
 
     // Do not copy over any captured stdout
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    stdoutCapture.clear();
+
+    // Nor any state handles
+    clearStateHandles();
+
+    // Nor whether its threads were spread across hosts
+    distributedPthreads = false;
 
     if (other._isBound) {
         assert(other.compartment != nullptr);
@@ -228,6 +249,8 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
 
         // Reset shared memory variables
         sharedMemWasmPtrs = other.sharedMemWasmPtrs;
+        sharedMemSegments = other.sharedMemSegments;
+        sharedMemAllocator = other.sharedMemAllocator;
 
         // Remap dynamic modules
         lastLoadedDynamicModuleHandle = other.lastLoadedDynamicModuleHandle;
@@ -1025,6 +1048,99 @@ U32 WAVMWasmModule::mmapFile(U32 fd, size_t length)
     return wasmPtr;
 }
 
+/**
+ * getdents64 is tricky to implement as it's iterating through an unknown
+ * number of files in the directory. We will be running two loops, one to fill
+ * up the given buffer, and a nested loop to iterate through the native
+ * directory listing.
+ *
+ * We try to be conservative but will throw an exception if things aren't right.
+ * A bug here can be hard to find.
+ *
+ * The musl implementation of readdir seems to require returning (-1 * errno) on
+ * error, not -1 as the man pages suggest.
+ */
+I32 WAVMWasmModule::readDirents64(I32 fd,
+                                  I32 wasmDirentBuf,
+                                  I32 wasmDirentBufLen)
+{
+    U8* hostWasmDirentBuf =
+      &Runtime::memoryRef<U8>(defaultMemory, (Uptr)wasmDirentBuf);
+
+    size_t wasmDirentSize = sizeof(wasm_dirent64);
+    if (wasmDirentBufLen < 0 || (size_t)wasmDirentBufLen < wasmDirentSize) {
+        return -EINVAL;
+    }
+
+    // Read the native dirents in large batches to avoid a syscall per entry.
+    // The kernel moves the directory offset past every entry it returns, so
+    // if the wasm buffer fills up part way through a batch, we have to seek
+    // back to just after the last entry we copied. The first entry of each
+    // batch is always copied, so this offset is always set when we need it.
+    std::vector<std::byte> nativeBuf(DIRENT_BATCH_BUFFER_SIZE, std::byte(0));
+    off_t resumeOffset = -1;
+
+    U32 wasmBytesRead = 0;
+    while (wasmBytesRead + wasmDirentSize <= (U32)wasmDirentBufLen) {
+        long nativeBytesRead =
+          syscall(SYS_getdents64, fd, nativeBuf.data(), nativeBuf.size());
+
+        if (nativeBytesRead < 0) {
+            // Error reading native dirents
+            int newErrno = errno;
+            return -newErrno;
+        }
+
+        if (nativeBytesRead == 0) {
+            // End of directory
+            break;
+        }
+
+        // Now we iterate through the dirents we just got back from the host
+        long nativeOffset = 0;
+        while (nativeOffset < nativeBytesRead) {
+            if (wasmBytesRead + wasmDirentSize > (U32)wasmDirentBufLen) {
+                // Wasm buffer full, rewind so the remaining entries are
+                // returned on the next call
+                if (::lseek(fd, resumeOffset, SEEK_SET) < 0) {
+                    int newErrno = errno;
+                    return -newErrno;
+                }
+
+                return wasmBytesRead;
+            }
+
+            // Get a pointer to the native dirent
+            auto d = reinterpret_cast<::dirent64*>(&nativeBuf.at(nativeOffset));
+
+            // Copy the relevant info into the wasm dirent.
+            struct wasm_dirent64 dWasm
+            {};
+            dWasm.d_ino = (U32)d->d_ino;
+            dWasm.d_type = d->d_type;
+
+            // Copy as much of the name as fits into place
+            size_t nameLen = std::min<size_t>(
+              strlen(d->d_name),
+              wasmDirentSize - offsetof(wasm_dirent64, d_name));
+            std::copy(d->d_name, d->d_name + nameLen, dWasm.d_name);
+
+            // Copy the wasm dirent into place in wasm memory
+            auto dWasmBytes = BYTES(&dWasm);
+            std::copy(dWasmBytes,
+                      dWasmBytes + wasmDirentSize,
+                      hostWasmDirentBuf + wasmBytesRead);
+
+            // Move offsets along
+            resumeOffset = d->d_off;
+            nativeOffset += d->d_reclen;
+            wasmBytesRead += wasmDirentSize;
+        }
+    }
+
+    return wasmBytesRead;
+}
+
 bool WAVMWasmModule::doGrowMemory(uint32_t pageChange)
 {
     size_t oldPages = Runtime::getMemoryNumPages(defaultMemory);
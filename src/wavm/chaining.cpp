@@ -7,6 +7,7 @@
 #include <faabric/util/logging.h>
 
 #include <wasm/chaining.h>
+#include <wasm/workflows.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Runtime.h>
@@ -46,6 +47,82 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     return awaitChainedCallOutput(messageId, buffer, bufferLen);
 }
 
+// Waits on an array of call ids, writing the ids and return values of those
+// that finish in the order they did so. Either output array may be null.
+static I32 awaitCallsFromWasm(I32 idsPtr,
+                              I32 nIds,
+                              I32 timeoutMs,
+                              I32 orderPtr,
+                              I32 retsPtr,
+                              bool waitForAll)
+{
+    if (nIds <= 0) {
+        return 0;
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U32* ids =
+      Runtime::memoryArrayPtr<U32>(memoryPtr, (Uptr)idsPtr, (Uptr)nIds);
+    std::vector<uint32_t> messageIds(ids, ids + nIds);
+
+    std::vector<ChainedCallResult> results =
+      awaitChainedCalls(messageIds, waitForAll, timeoutMs);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (orderPtr != 0) {
+            Runtime::memoryRef<U32>(memoryPtr, orderPtr + i * sizeof(U32)) =
+              results.at(i).messageId;
+        }
+        if (retsPtr != 0) {
+            Runtime::memoryRef<I32>(memoryPtr, retsPtr + i * sizeof(I32)) =
+              results.at(i).returnValue;
+        }
+    }
+
+    return (I32)results.size();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_await_all",
+                               I32,
+                               __faasm_await_all,
+                               I32 idsPtr,
+                               I32 nIds,
+                               I32 timeoutMs,
+                               I32 orderPtr,
+                               I32 retsPtr)
+{
+    SPDLOG_DEBUG("S - await_all - {} {} {} {} {}",
+                 idsPtr,
+                 nIds,
+                 timeoutMs,
+                 orderPtr,
+                 retsPtr);
+
+    return awaitCallsFromWasm(idsPtr, nIds, timeoutMs, orderPtr, retsPtr, true);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_await_any",
+                               I32,
+                               __faasm_await_any,
+                               I32 idsPtr,
+                               I32 nIds,
+                               I32 timeoutMs,
+                               I32 orderPtr,
+                               I32 retsPtr)
+{
+    SPDLOG_DEBUG("S - await_any - {} {} {} {} {}",
+                 idsPtr,
+                 nIds,
+                 timeoutMs,
+                 orderPtr,
+                 retsPtr);
+
+    return awaitCallsFromWasm(
+      idsPtr, nIds, timeoutMs, orderPtr, retsPtr, false);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_chain_name",
                                U32,
@@ -104,4 +181,139 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
     return makeChainedCall(call->function(), 0, pyFuncName.c_str(), inputData);
 }
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_batch",
+                               I32,
+                               __faasm_chain_batch,
+                               I32 namePtrsPtr,
+                               I32 funcPtrsPtr,
+                               I32 inputPtrsPtr,
+                               I32 inputLensPtr,
+                               I32 nCalls,
+                               I32 idsPtr)
+{
+    SPDLOG_DEBUG("S - chain_batch - {} {} {} {} {} {}",
+                 namePtrsPtr,
+                 funcPtrsPtr,
+                 inputPtrsPtr,
+                 inputLensPtr,
+                 nCalls,
+                 idsPtr);
+
+    if (nCalls <= 0) {
+        return 0;
+    }
+
+    // Any of the arrays apart from the names and ids may be null
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    auto getArray = [memoryPtr, nCalls](I32 arrayPtr) -> I32* {
+        if (arrayPtr == 0) {
+            return nullptr;
+        }
+        return Runtime::memoryArrayPtr<I32>(
+          memoryPtr, (Uptr)arrayPtr, (Uptr)nCalls);
+    };
+
+    I32* namePtrs = getArray(namePtrsPtr);
+    I32* funcPtrs = getArray(funcPtrsPtr);
+    I32* inputPtrs = getArray(inputPtrsPtr);
+    I32* inputLens = getArray(inputLensPtr);
+    I32* ids = getArray(idsPtr);
+
+    // A null name chains the calling function
+    const std::string thisFunc = ExecutorContext::get()->getMsg().function();
+
+    std::vector<ChainedCall> calls(nCalls);
+    for (int i = 0; i < nCalls; i++) {
+        ChainedCall& call = calls.at(i);
+        call.functionName = namePtrs == nullptr || namePtrs[i] == 0
+                              ? thisFunc
+                              : getStringFromWasm(namePtrs[i]);
+        call.wasmFuncPtr = funcPtrs == nullptr ? 0 : funcPtrs[i];
+        if (inputPtrs != nullptr && inputLens != nullptr) {
+            call.inputData = getBytesFromWasm(inputPtrs[i], inputLens[i]);
+        }
+    }
+
+    std::vector<int> callIds = makeChainedCallBatch(calls);
+    if (ids != nullptr) {
+        std::copy(callIds.begin(), callIds.end(), ids);
+    }
+
+    return nCalls;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_stream_calls",
+                               void,
+                               __faasm_stream_calls,
+                               I32 enabled)
+{
+    SPDLOG_TRACE("S - stream_calls - {}", enabled);
+    streamChainedCalls(enabled != 0);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_emit_chunk",
+                               void,
+                               __faasm_emit_chunk,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    SPDLOG_TRACE("S - emit_chunk - {} {}", dataPtr, dataLen);
+
+    U8* data = Runtime::memoryArrayPtr<U8>(
+      getExecutingWAVMModule()->defaultMemory, (Uptr)dataPtr, (Uptr)dataLen);
+    emitCallStreamChunk(data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_chunk",
+                               I32,
+                               __faasm_read_chunk,
+                               U32 messageId,
+                               I32 bufferPtr,
+                               I32 bufferLen,
+                               I32 timeoutMs)
+{
+    SPDLOG_TRACE("S - read_chunk - {} {} {} {}",
+                 messageId,
+                 bufferPtr,
+                 bufferLen,
+                 timeoutMs);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
+    return readChainedCallStreamChunk(
+      messageId, buffer, std::max(bufferLen, 0), timeoutMs);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_submit_workflow",
+                               I32,
+                               __faasm_submit_workflow,
+                               I32 specPtr,
+                               I32 specLen,
+                               I32 idsPtr,
+                               I32 maxIds)
+{
+    SPDLOG_DEBUG(
+      "S - submit_workflow - {} {} {} {}", specPtr, specLen, idsPtr, maxIds);
+
+    const std::vector<uint8_t> spec = getBytesFromWasm(specPtr, specLen);
+    std::vector<int> nodeIds =
+      submitChainedWorkflow(std::string(spec.begin(), spec.end()));
+
+    // Write as many ids as fit, the caller can tell if any are missing
+    int nIds = std::min<int>(nodeIds.size(), std::max(maxIds, 0));
+    if (nIds > 0) {
+        I32* ids = Runtime::memoryArrayPtr<I32>(
+          getExecutingWAVMModule()->defaultMemory, (Uptr)idsPtr, (Uptr)nIds);
+        std::copy(nodeIds.begin(), nodeIds.begin() + nIds, ids);
+    }
+
+    return nodeIds.size();
+}
 }
@@ -17,6 +17,7 @@
 #include <wasm/chaining.h>
 #include <wasm/host_interface_test.h>
 #include <wasm/migration.h>
+#include <wasm/state.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <WAVM/Platform/Diagnostics.h>
@@ -35,13 +36,22 @@ void faasmLink() {}
 // STATE
 // ------------------------------------
 
+// Applies any combined offset writes and dirty flags to the key, which must
+// happen before it's read, pushed, pulled or unlocked
+static const std::shared_ptr<faabric::state::StateKeyValue>& flushedKV(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    getExecutingWAVMModule()->flushStateWrites(kv);
+    return kv;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_push_state",
                                void,
                                __faasm_push_state,
                                I32 keyPtr)
 {
-    auto kv = getStateKV(keyPtr, 0);
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
     SPDLOG_DEBUG("S - push_state - {}", kv->key);
     kv->pushFull();
 }
@@ -52,7 +62,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_push_state_partial,
                                I32 keyPtr)
 {
-    auto kv = getStateKV(keyPtr, 0);
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
     SPDLOG_DEBUG("S - push_state_partial - {}", kv->key);
     kv->pushPartial();
 }
@@ -64,10 +74,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 maskKeyPtr)
 {
-    auto kv = getStateKV(keyPtr, 0);
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
     SPDLOG_DEBUG("S - push_state_partial_mask - {} {}", kv->key, maskKeyPtr);
 
-    auto maskKv = getStateKV(maskKeyPtr, 0);
+    auto maskKv = flushedKV(getStateKV(maskKeyPtr, 0));
     kv->pushPartialMask(maskKv);
 }
 
@@ -78,12 +88,102 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 stateLen)
 {
-    auto kv = getStateKV(keyPtr, stateLen);
+    auto kv = flushedKV(getStateKV(keyPtr, stateLen));
     SPDLOG_DEBUG("S - pull_state - {} {}", kv->key, stateLen);
 
     kv->pull();
 }
 
+// Reads arrays of key pointers, and optionally sizes, out of wasm memory
+static StateKVs getStateKVs(I32 keyPtrsPtr, I32 sizesPtr, I32 nKeys)
+{
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* keyPtrs =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)keyPtrsPtr, (Uptr)nKeys);
+    I32* sizes = nullptr;
+    if (sizesPtr != 0) {
+        sizes =
+          Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)sizesPtr, (Uptr)nKeys);
+    }
+
+    StateKVs kvs;
+    kvs.reserve(nKeys);
+    for (int i = 0; i < nKeys; i++) {
+        kvs.emplace_back(
+          flushedKV(getStateKV(keyPtrs[i], sizes == nullptr ? 0 : sizes[i])));
+    }
+
+    return kvs;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_multi",
+                               void,
+                               __faasm_pull_state_multi,
+                               I32 keyPtrsPtr,
+                               I32 stateLensPtr,
+                               I32 nKeys)
+{
+    SPDLOG_DEBUG("S - pull_state_multi - {} {} {}",
+                 keyPtrsPtr,
+                 stateLensPtr,
+                 nKeys);
+
+    pullStateMulti(getStateKVs(keyPtrsPtr, stateLensPtr, nKeys));
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_offset_multi",
+                               void,
+                               __faasm_pull_state_offset_multi,
+                               I32 keyPtrsPtr,
+                               I32 totalLensPtr,
+                               I32 offsetsPtr,
+                               I32 lensPtr,
+                               I32 nKeys)
+{
+    SPDLOG_DEBUG("S - pull_state_offset_multi - {} {} {} {} {}",
+                 keyPtrsPtr,
+                 totalLensPtr,
+                 offsetsPtr,
+                 lensPtr,
+                 nKeys);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* offsets =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)offsetsPtr, (Uptr)nKeys);
+    I32* lens =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)lensPtr, (Uptr)nKeys);
+
+    pullStateChunksMulti(getStateKVs(keyPtrsPtr, totalLensPtr, nKeys),
+                         std::vector<long>(offsets, offsets + nKeys),
+                         std::vector<long>(lens, lens + nKeys));
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_multi",
+                               void,
+                               __faasm_push_state_multi,
+                               I32 keyPtrsPtr,
+                               I32 nKeys)
+{
+    SPDLOG_DEBUG("S - push_state_multi - {} {}", keyPtrsPtr, nKeys);
+
+    pushStateMulti(getStateKVs(keyPtrsPtr, 0, nKeys), false);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_multi",
+                               void,
+                               __faasm_push_state_partial_multi,
+                               I32 keyPtrsPtr,
+                               I32 nKeys)
+{
+    SPDLOG_DEBUG("S - push_state_partial_multi - {} {}", keyPtrsPtr, nKeys);
+
+    pushStateMulti(getStateKVs(keyPtrsPtr, 0, nKeys), true);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_lock_state_read",
                                void,
@@ -102,7 +202,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_unlock_state_read,
                                I32 keyPtr)
 {
-    auto kv = getStateKV(keyPtr, 0);
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
     SPDLOG_DEBUG("S - unlock_state_read - {}", kv->key);
 
     kv->unlockRead();
@@ -126,12 +226,68 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_unlock_state_write,
                                I32 keyPtr)
 {
-    auto kv = getStateKV(keyPtr, 0);
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
     SPDLOG_DEBUG("S - unlock_state_write - {}", keyPtr, kv->key);
 
     kv->unlockWrite();
 }
 
+static U8* getWasmBuffer(I32 ptr, I32 len)
+{
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    return Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)ptr, (Uptr)len);
+}
+
+static void _writeStateImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  I32 dataPtr,
+  I32 dataLen)
+{
+    SPDLOG_DEBUG("Writing state length {} to key {}", dataLen, kv->key);
+    checkStateBufferSize(kv, dataLen);
+    kv->set(getWasmBuffer(dataPtr, dataLen));
+}
+
+static I32 _readStateImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  I32 bufferPtr,
+  I32 bufferLen)
+{
+    // Copy to straight to buffer
+    checkStateBufferSize(kv, bufferLen);
+    kv->get(getWasmBuffer(bufferPtr, bufferLen));
+    return kv->size();
+}
+
+static I32 _readStatePtrImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  I32 totalLen)
+{
+    // Map shared memory
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    U32 wasmPtr = module->mapSharedStateMemory(kv, 0, totalLen);
+
+    // Call get to make sure the value is pulled
+    kv->get();
+
+    return wasmPtr;
+}
+
+static I32 _readStateOffsetPtrImpl(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  I32 offset,
+  I32 len)
+{
+    // Map whole key in shared memory
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    U32 wasmPtr = module->mapSharedStateMemory(kv, offset, len);
+
+    // Call get to make sure the value is there
+    kv->getChunk(offset, len);
+
+    return wasmPtr;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_write_state",
                                void,
@@ -141,15 +297,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 dataLen)
 {
 
-    auto kv = getStateKV(keyPtr, dataLen);
+    auto kv = flushedKV(getStateKV(keyPtr, dataLen));
     SPDLOG_DEBUG("S - write_state - {} {} {}", kv->key, dataPtr, dataLen);
 
-    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
-    U8* data =
-      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
-
-    SPDLOG_DEBUG("Writing state length {} to key {}", dataLen, kv->key);
-    kv->set(data);
+    _writeStateImpl(kv, dataPtr, dataLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -238,7 +389,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     U8* data =
       Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
 
-    kv->setChunk(offset, data, dataLen);
+    getExecutingWAVMModule()->writeStateOffset(kv, offset, data, dataLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -259,8 +410,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
       faabric::util::readFileToBytes(maskedPath);
     unsigned long fileLength = bytes.size();
 
-    // Write to state
-    auto kv = getStateKV(keyPtr, fileLength);
+    // Write to state, after any earlier combined writes so that they don't
+    // later overwrite it
+    auto kv = flushedKV(getStateKV(keyPtr, fileLength));
+    checkStateBufferSize(kv, fileLength);
     kv->set(bytes.data());
 
     return fileLength;
@@ -284,16 +437,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
         faabric::state::State& state = faabric::state::getGlobalState();
         return (I32)state.getStateSize(user, key);
     } else {
-        auto kv = getStateKV(keyPtr, bufferLen);
+        auto kv = flushedKV(getStateKV(keyPtr, bufferLen));
         SPDLOG_DEBUG(
           "S - read_state - {} {} {}", kv->key, bufferPtr, bufferLen);
 
-        // Copy to straight to buffer
-        Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
-        U8* buffer = Runtime::memoryArrayPtr<U8>(
-          memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
-        kv->get(buffer);
-        return kv->size();
+        return _readStateImpl(kv, bufferPtr, bufferLen);
     }
 }
 
@@ -304,17 +452,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 totalLen)
 {
-    auto kv = getStateKV(keyPtr, totalLen);
+    auto kv = flushedKV(getStateKV(keyPtr, totalLen));
     SPDLOG_DEBUG("S - read_state_ptr - {} {}", kv->key, totalLen);
 
-    // Map shared memory
-    WAVMWasmModule* module = getExecutingWAVMModule();
-    U32 wasmPtr = module->mapSharedStateMemory(kv, 0, totalLen);
-
-    // Call get to make sure the value is pulled
-    kv->get();
-
-    return wasmPtr;
+    return _readStatePtrImpl(kv, totalLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -327,7 +468,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
-    auto kv = getStateKV(keyPtr, totalLen);
+    auto kv = flushedKV(getStateKV(keyPtr, totalLen));
     SPDLOG_DEBUG("S - read_state_offset - {} {} {} {} {}",
                  kv->key,
                  totalLen,
@@ -351,21 +492,24 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 offset,
                                I32 len)
 {
-    auto kv = getStateKV(keyPtr, totalLen);
+    auto kv = flushedKV(getStateKV(keyPtr, totalLen));
     SPDLOG_DEBUG("S - read_state_offset_ptr - {} {} {} {}",
                  kv->key,
                  totalLen,
                  offset,
                  len);
 
-    // Map whole key in shared memory
-    WAVMWasmModule* module = getExecutingWAVMModule();
-    U32 wasmPtr = module->mapSharedStateMemory(kv, offset, len);
-
-    // Call get to make sure the value is there
-    kv->getChunk(offset, len);
+    return _readStateOffsetPtrImpl(kv, offset, len);
+}
 
-    return wasmPtr;
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_state_unmap",
+                               void,
+                               __faasm_state_unmap,
+                               I32 wasmPtr)
+{
+    SPDLOG_DEBUG("S - state_unmap - {}", wasmPtr);
+    getExecutingWAVMModule()->unmapSharedStateMemory(wasmPtr);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -396,29 +540,393 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     // SPDLOG_DEBUG("S - __faasm_flag_state_offset_dirty -
     // {} {} {} {}", keyPtr, totalLen, offset, len);
 
-    kv->flagChunkDirty(offset, len);
+    getExecutingWAVMModule()->flagStateOffsetDirty(kv, offset, len);
+}
+
+// ------------------------------------
+// STATE HANDLES
+// ------------------------------------
+
+static const std::shared_ptr<faabric::state::StateKeyValue>& getStateHandleKV(
+  I32 handle)
+{
+    return getExecutingWAVMModule()->getStateHandle(handle);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_state_open",
+                               I32,
+                               __faasm_state_open,
+                               I32 keyPtr,
+                               I32 size)
+{
+    const std::pair<std::string, std::string> userKey =
+      getUserKeyPairFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - state_open - {} {}", userKey.second, size);
+
+    return getExecutingWAVMModule()->openStateHandle(
+      userKey.first, userKey.second, size);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_handle",
+                               void,
+                               __faasm_push_state_handle,
+                               I32 handle)
+{
+    flushedKV(getStateHandleKV(handle))->pushFull();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_handle",
+                               void,
+                               __faasm_push_state_partial_handle,
+                               I32 handle)
+{
+    flushedKV(getStateHandleKV(handle))->pushPartial();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_mask_handle",
+                               void,
+                               __faasm_push_state_partial_mask_handle,
+                               I32 handle,
+                               I32 maskHandle)
+{
+    flushedKV(getStateHandleKV(handle))
+      ->pushPartialMask(flushedKV(getStateHandleKV(maskHandle)));
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_handle",
+                               void,
+                               __faasm_pull_state_handle,
+                               I32 handle)
+{
+    flushedKV(getStateHandleKV(handle))->pull();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_lock_state_read_handle",
+                               void,
+                               __faasm_lock_state_read_handle,
+                               I32 handle)
+{
+    getStateHandleKV(handle)->lockRead();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_unlock_state_read_handle",
+                               void,
+                               __faasm_unlock_state_read_handle,
+                               I32 handle)
+{
+    flushedKV(getStateHandleKV(handle))->unlockRead();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_lock_state_write_handle",
+                               void,
+                               __faasm_lock_state_write_handle,
+                               I32 handle)
+{
+    getStateHandleKV(handle)->lockWrite();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_unlock_state_write_handle",
+                               void,
+                               __faasm_unlock_state_write_handle,
+                               I32 handle)
+{
+    flushedKV(getStateHandleKV(handle))->unlockWrite();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_handle",
+                               void,
+                               __faasm_write_state_handle,
+                               I32 handle,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    _writeStateImpl(flushedKV(getStateHandleKV(handle)), dataPtr, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_append_state_handle",
+                               void,
+                               __faasm_append_state_handle,
+                               I32 handle,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    getStateHandleKV(handle)->append(getWasmBuffer(dataPtr, dataLen), dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_appended_state_handle",
+                               void,
+                               __faasm_read_appended_state_handle,
+                               I32 handle,
+                               I32 bufferPtr,
+                               I32 bufferLen,
+                               I32 nElems)
+{
+    getStateHandleKV(handle)->getAppended(
+      getWasmBuffer(bufferPtr, bufferLen), bufferLen, nElems);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_clear_appended_state_handle",
+                               void,
+                               __faasm_clear_appended_state_handle,
+                               I32 handle)
+{
+    getStateHandleKV(handle)->clearAppended();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_offset_handle",
+                               void,
+                               __faasm_write_state_offset_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    getExecutingWAVMModule()->writeStateOffset(getStateHandleKV(handle),
+                                               offset,
+                                               getWasmBuffer(dataPtr, dataLen),
+                                               dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_handle",
+                               I32,
+                               __faasm_read_state_handle,
+                               I32 handle,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+
+    // If buffer len is zero, just need the state size
+    if (bufferLen == 0) {
+        return kv->size();
+    }
+
+    return _readStateImpl(kv, bufferPtr, bufferLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_ptr_handle",
+                               I32,
+                               __faasm_read_state_ptr_handle,
+                               I32 handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return _readStatePtrImpl(kv, kv->size());
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_offset_handle",
+                               void,
+                               __faasm_read_state_offset_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    flushedKV(getStateHandleKV(handle))->getChunk(
+      offset, getWasmBuffer(bufferPtr, bufferLen), bufferLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_offset_ptr_handle",
+                               I32,
+                               __faasm_read_state_offset_ptr_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 len)
+{
+    return _readStateOffsetPtrImpl(
+      flushedKV(getStateHandleKV(handle)), offset, len);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_flag_state_dirty_handle",
+                               void,
+                               __faasm_flag_state_dirty_handle,
+                               I32 handle)
+{
+    getStateHandleKV(handle)->flagDirty();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_flag_state_offset_dirty_handle",
+                               void,
+                               __faasm_flag_state_offset_dirty_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 len)
+{
+    getExecutingWAVMModule()->flagStateOffsetDirty(
+      getStateHandleKV(handle), offset, len);
+}
+
+// ------------------------------------
+// ASYNC STATE
+// ------------------------------------
+
+static I32 startStateTransfer(std::function<void()> op)
+{
+    return getExecutingWAVMModule()->startStateTransfer(std::move(op));
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_async",
+                               I32,
+                               __faasm_pull_state_async,
+                               I32 keyPtr,
+                               I32 stateLen)
+{
+    auto kv = flushedKV(getStateKV(keyPtr, stateLen));
+    SPDLOG_DEBUG("S - pull_state_async - {} {}", kv->key, stateLen);
+
+    return startStateTransfer([kv] { kv->pull(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_offset_async",
+                               I32,
+                               __faasm_pull_state_offset_async,
+                               I32 keyPtr,
+                               I32 totalLen,
+                               I32 offset,
+                               I32 len)
+{
+    auto kv = flushedKV(getStateKV(keyPtr, totalLen));
+    SPDLOG_DEBUG("S - pull_state_offset_async - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 len);
+
+    // Getting a chunk pulls it if it's not already present
+    return startStateTransfer([kv, offset, len] { kv->getChunk(offset, len); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_async",
+                               I32,
+                               __faasm_push_state_async,
+                               I32 keyPtr)
+{
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
+    SPDLOG_DEBUG("S - push_state_async - {}", kv->key);
+
+    return startStateTransfer([kv] { kv->pushFull(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_async",
+                               I32,
+                               __faasm_push_state_partial_async,
+                               I32 keyPtr)
+{
+    auto kv = flushedKV(getStateKV(keyPtr, 0));
+    SPDLOG_DEBUG("S - push_state_partial_async - {}", kv->key);
+
+    return startStateTransfer([kv] { kv->pushPartial(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_async_handle",
+                               I32,
+                               __faasm_pull_state_async_handle,
+                               I32 handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pull(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_offset_async_handle",
+                               I32,
+                               __faasm_pull_state_offset_async_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 len)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv, offset, len] { kv->getChunk(offset, len); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_async_handle",
+                               I32,
+                               __faasm_push_state_async_handle,
+                               I32 handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pushFull(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_async_handle",
+                               I32,
+                               __faasm_push_state_partial_async_handle,
+                               I32 handle)
+{
+    const auto& kv = flushedKV(getStateHandleKV(handle));
+    return startStateTransfer([kv] { kv->pushPartial(); });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_state_wait",
+                               void,
+                               __faasm_state_wait,
+                               I32 requestId)
+{
+    SPDLOG_DEBUG("S - state_wait - {}", requestId);
+    getExecutingWAVMModule()->awaitStateTransfer(requestId);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_state_test",
+                               I32,
+                               __faasm_state_test,
+                               I32 requestId)
+{
+    SPDLOG_TRACE("S - state_test - {}", requestId);
+    return getExecutingWAVMModule()->testStateTransfer(requestId);
 }
 
 I32 _readInputImpl(I32 bufferPtr, I32 bufferLen)
 {
     // Get the input
     faabric::Message* call = &ExecutorContext::get()->getMsg();
-    std::vector<uint8_t> inputBytes =
-      faabric::util::stringToBytes(call->inputdata());
+    size_t inputSize = getChainPayloadSize(*call, CHAIN_PAYLOAD_INPUT);
 
     // If nothing, return nothing
-    if (inputBytes.empty()) {
+    if (inputSize == 0) {
         return 0;
     }
 
-    // Write to the wasm buffer
+    // An empty buffer asks for the size of the input
+    if (bufferLen <= 0) {
+        return (I32)inputSize;
+    }
+
+    // Write to the wasm buffer, straight from the state value if the input
+    // was passed by reference
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     U8* buffer =
       Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
 
-    int inputSize =
-      faabric::util::safeCopyToBuffer(inputBytes, buffer, bufferLen);
-    return inputSize;
+    return (I32)readChainPayload(
+      *call, CHAIN_PAYLOAD_INPUT, buffer, bufferLen);
 }
 
 // ------------------------------------
@@ -439,9 +947,12 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 void _writeOutputImpl(I32 outputPtr, I32 outputLen)
 {
-    std::string outputData = getStringFromWasm(outputPtr);
+    U8* outputData =
+      Runtime::memoryArrayPtr<U8>(getExecutingWAVMModule()->defaultMemory,
+                                  (Uptr)outputPtr,
+                                  (Uptr)outputLen);
     faabric::Message* call = &ExecutorContext::get()->getMsg();
-    call->set_outputdata(outputData);
+    setCallOutput(*call, outputData, outputLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
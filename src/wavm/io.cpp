@@ -222,95 +222,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     return __WASI_ESUCCESS;
 }
 
-/**
- * This function is tricky to implement as it's iterating through an unknown
- * number of files in the directory. We will be running two loops, one to fill
- * up the given buffer, and a nested loop to iterate through the native
- * directory listing.
- *
- * We try to be conservative but will throw an exception if things aren't right.
- * A bug here can be hard to find.
- *
- * The musl implementation of readdir seems to require returning (-1 * errno) on
- * error, not -1 as the man pages suggest.
- */
 I32 s__getdents64(I32 fd, I32 wasmDirentBuf, I32 wasmDirentBufLen)
 {
     SPDLOG_DEBUG(
       "S - getdents64 - {} {} {}", fd, wasmDirentBuf, wasmDirentBufLen);
 
-    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
-    U8* hostWasmDirentBuf =
-      &Runtime::memoryRef<U8>(memoryPtr, (Uptr)wasmDirentBuf);
-
-    // Work out how many dirents we can fit (rounding down)
-    size_t wasmDirentSize = sizeof(wasm_dirent64);
-
-    // Create a small native buffer (can't overshoot the wasm offset)
-    // Note that this can cause an EINVAL error if too small for the result
-    int nativeBufLen = 80;
-
-    U32 wasmBytesRead = 0;
-    int wasmDirentCount = 0;
-
-    std::vector<std::byte> nativeBuf(nativeBufLen, std::byte(0));
-    // Here we will iterate getting native dirents until we've filled up the
-    // wasm buffer supplied
-    for (wasmBytesRead = 0;
-         wasmBytesRead < wasmDirentBufLen - (2 * wasmDirentSize);) {
-        // Make the native syscall. This will read in a list of dirent structs
-        // to the buffer We need to read at most two native dirents.
-        long nativeBytesRead =
-          syscall(SYS_getdents64, fd, nativeBuf.data(), nativeBuf.size());
-
-        if (nativeBytesRead < 0) {
-            // Error reading native dirents
-            int newErrno = errno;
-            return -newErrno;
-        } else if (nativeBytesRead == 0) {
-            // End of directory
-            return wasmBytesRead;
-        } else {
-            // Now we iterate through the dirents we just got back from the host
-            unsigned int nativeOffset;
-            for (nativeOffset = 0; nativeOffset < nativeBytesRead;) {
-                // If we're going to overshoot on the wasm buffer, we have a
-                // problem (worth throwing an exception)
-                if (wasmBytesRead > (U32)wasmDirentBufLen) {
-                    throw std::runtime_error(
-                      "Overshot the end of the dirent buffer");
-                }
-
-                // Get a pointer to the native dirent
-                auto d =
-                  reinterpret_cast<::dirent64*>(&nativeBuf.at(nativeOffset));
-
-                // Copy the relevant info into the wasm dirent.
-                struct wasm_dirent64 dWasm
-                {};
-                dWasm.d_ino = (U32)d->d_ino;
-                dWasm.d_type = d->d_type;
-
-                // Copy the name into place
-                size_t nameLen = strlen(d->d_name);
-                std::copy(d->d_name, d->d_name + nameLen, dWasm.d_name);
-
-                // Copy the wasm dirent into place in wasm memory
-                auto dWasmBytes = BYTES(&dWasm);
-                std::copy(dWasmBytes,
-                          dWasmBytes + wasmDirentSize,
-                          hostWasmDirentBuf + wasmBytesRead);
-
-                // Move offsets along
-                nativeOffset += d->d_reclen;
-
-                wasmBytesRead += wasmDirentSize;
-                wasmDirentCount++;
-            }
-        }
-    }
-
-    return wasmBytesRead;
+    return getExecutingWAVMModule()->readDirents64(
+      fd, wasmDirentBuf, wasmDirentBufLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_close", I32, wasi_fd_close, I32 fd)
@@ -353,7 +271,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     // Catpure stdout if necessary, otherwise write as normal
     conf::FaasmConfig& conf = conf::getFaasmConfig();
     bool isStd = fd <= 2;
-    if (isStd && conf.captureStdout == "on") {
+    if (isStd && conf.captureStdout != "off") {
         getExecutingWAVMModule()->captureStdout(nativeIovecs.data(),
                                                 iovecCount);
     }
@@ -383,8 +301,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
     auto nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
 
-    int bytesRead =
-      readv(fileDesc.getLinuxFd(), nativeIovecs.data(), iovecCount);
+    int bytesRead = fileDesc.read(nativeIovecs, iovecCount);
     Runtime::memoryRef<int>(getExecutingWAVMModule()->defaultMemory,
                             resBytesRead) = (int)bytesRead;
 
@@ -760,7 +677,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "puts", I32, puts, I32 strPtr)
 
     // Capture stdout if necessary
     conf::FaasmConfig& conf = conf::getFaasmConfig();
-    if (conf.captureStdout == "on") {
+    if (conf.captureStdout != "off") {
         module->captureStdout(hostStr);
     }
 
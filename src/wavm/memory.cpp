@@ -85,6 +85,19 @@ I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
         // If fd is provided, we're mapping a file into memory
         storage::FileDescriptor& fileDesc =
           module->getFileSystem().getFileDescriptor(fd);
+
+        // Files in the runtime image have no Linux fd, so copy them in
+        if (fileDesc.isImageBacked()) {
+            std::span<const uint8_t> data = fileDesc.getImageData();
+            U32 wasmPtr = module->mmapMemory(length);
+            U8* hostPtr = Runtime::memoryArrayPtr<U8>(
+              module->defaultMemory, wasmPtr, length);
+            std::copy(data.begin(),
+                      data.begin() + std::min<size_t>(length, data.size()),
+                      hostPtr);
+            return wasmPtr;
+        }
+
         return module->mmapFile(fileDesc.getLinuxFd(), length);
     } else {
         // Map memory
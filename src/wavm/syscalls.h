@@ -119,25 +119,6 @@ struct wasm_passwd
     uint32_t pw_shell; // char*
 };
 
-/**
- * To double check this, work out which header from the sysroot is resolved
- * Currently this is:
- *  - include/__struct_dirent.h
- *  - include/__typedef_ino_t.h
- *
- * struct dirent {
- *     ino_t d_ino;  # unsigned long long
- *     unsigned char d_type;
- *     char d_name[];
- * };
- */
-struct wasm_dirent64
-{
-    uint64_t d_ino;
-    uint8_t d_type;
-    uint8_t d_name[];
-};
-
 /**
  * Found in bits/signal.h
  * stack_t is used in calls to sigaltstack, either to specify a new stack
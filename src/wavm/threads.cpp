@@ -15,6 +15,8 @@
 #include <wasm/chaining.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <climits>
+#include <ctime>
 #include <linux/futex.h>
 
 #include <WAVM/Platform/Thread.h>
@@ -173,7 +175,8 @@ I32 s__futex(I32 uaddrPtr,
 
 // --------------------------
 // PTHREAD MUTEXES - We support pthread mutexes locally as they're important to
-// support thread-safe libc operations.
+// support thread-safe libc operations. The lock is the first word of the
+// pthread_mutex_t, which threads on the same host wait on directly.
 // Note we use trace logging here as these are invoked a lot
 // --------------------------
 
@@ -185,6 +188,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 attr)
 {
     SPDLOG_TRACE("S - pthread_mutex_init {} {}", mx, attr);
+    getExecutingModule()->initPthreadMutex(mx);
 
     return 0;
 }
@@ -196,7 +200,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 mx)
 {
     SPDLOG_TRACE("S - pthread_mutex_lock {}", mx);
-    getExecutingModule()->getOrCreatePthreadMutex(mx)->lock();
+    getExecutingModule()->lockPthreadMutex(mx);
 
     return 0;
 }
@@ -209,8 +213,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     SPDLOG_TRACE("S - pthread_mutex_trylock {}", mx);
 
-    bool success =
-      getExecutingModule()->getOrCreatePthreadMutex(mx)->try_lock();
+    bool success = getExecutingModule()->tryLockPthreadMutex(mx);
 
     if (!success) {
         return EBUSY;
@@ -226,7 +229,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 mx)
 {
     SPDLOG_TRACE("S - pthread_mutex_unlock {}", mx);
-    getExecutingModule()->getPthreadMutex(mx)->unlock();
+    getExecutingModule()->unlockPthreadMutex(mx);
 
     return 0;
 }
@@ -242,162 +245,194 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 }
 
 // --------------------------
-// STUBBED PTHREADS - We can safely ignore the following functions
+// PTHREAD CONDITION VARIABLES - Waiters are held on the host, keyed by the
+// address of the pthread_cond_t, and release the guest mutex while they wait.
 // --------------------------
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_init",
+                               "pthread_cond_init",
                                I32,
-                               pthread_mutexattr_init,
-                               I32 a)
+                               pthread_cond_init,
+                               I32 cond,
+                               I32 attr)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
+    SPDLOG_TRACE("S - pthread_cond_init {} {}", cond, attr);
+
+    // Memory may be reused for a new condition variable
+    getExecutingModule()->destroyPthreadCond(cond);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_destroy",
+                               "pthread_cond_wait",
                                I32,
-                               pthread_mutexattr_destroy,
-                               I32 a)
+                               pthread_cond_wait,
+                               I32 cond,
+                               I32 mx)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_cond_wait {} {}", cond, mx);
 
-    return 0;
+    return getExecutingModule()->waitPthreadCond(cond, mx);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_init",
+                               "pthread_cond_timedwait",
                                I32,
-                               pthread_cond_init,
-                               I32 a,
-                               I32 b)
+                               pthread_cond_timedwait,
+                               I32 cond,
+                               I32 mx,
+                               I32 abstimePtr)
 {
-    SPDLOG_TRACE("S - pthread_cond_init {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_cond_timedwait {} {} {}", cond, mx, abstimePtr);
+
+    // The timeout is an absolute time on the realtime clock
+    auto abstime = &Runtime::memoryRef<wasm_timespec>(
+      getExecutingWAVMModule()->defaultMemory, (Uptr)abstimePtr);
+
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t remainingNs =
+      (abstime->tv_sec - (int64_t)now.tv_sec) * 1000000000L +
+      (abstime->tv_nsec - (int64_t)now.tv_nsec);
+    if (remainingNs <= 0) {
+        return ETIMEDOUT;
+    }
 
-    return 0;
+    // Round up so we don't wake just before the deadline
+    int timeoutMs =
+      (int)std::min<int64_t>((remainingNs + 999999) / 1000000, INT_MAX);
+
+    return getExecutingModule()->waitPthreadCond(cond, mx, timeoutMs);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_cond_signal",
                                I32,
                                pthread_cond_signal,
-                               I32 a)
+                               I32 cond)
 {
-    SPDLOG_TRACE("S - pthread_cond_signal {}", a);
+    SPDLOG_TRACE("S - pthread_cond_signal {}", cond);
+    getExecutingModule()->getOrCreatePthreadCond(cond)->notifyOne();
 
     return 0;
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_cond_broadcast",
+                               I32,
+                               pthread_cond_broadcast,
+                               I32 cond)
 {
-    SPDLOG_TRACE("S - pthread_self");
+    SPDLOG_TRACE("S - pthread_cond_broadcast {}", cond);
+    getExecutingModule()->getOrCreatePthreadCond(cond)->notifyAll();
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_key_create",
+                               "pthread_cond_destroy",
                                I32,
-                               s__pthread_key_create,
-                               I32 a,
-                               I32 b)
+                               pthread_cond_destroy,
+                               I32 cond)
 {
-    SPDLOG_TRACE("S - pthread_key_create {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_cond_destroy {}", cond);
+    getExecutingModule()->destroyPthreadCond(cond);
 
     return 0;
 }
 
+// --------------------------
+// STUBBED PTHREADS - We can safely ignore the following functions
+// --------------------------
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_key_delete",
+                               "pthread_mutexattr_init",
                                I32,
-                               s__pthread_key_delete,
+                               pthread_mutexattr_init,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_key_delete {}", a);
+    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_getspecific",
+                               "pthread_mutexattr_destroy",
                                I32,
-                               s__pthread_getspecific,
+                               pthread_mutexattr_destroy,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_getspecific {}", a);
+    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
+
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
+{
+    SPDLOG_TRACE("S - pthread_self");
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_setspecific",
+                               "pthread_key_create",
                                I32,
-                               s__pthread_setspecific,
+                               s__pthread_key_create,
                                I32 a,
                                I32 b)
 {
-    SPDLOG_TRACE("S - pthread_setspecific {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_key_create {} {}", a, b);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_destroy",
+                               "pthread_key_delete",
                                I32,
-                               pthread_cond_destroy,
+                               s__pthread_key_delete,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_key_delete {}", a);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_broadcast",
+                               "pthread_getspecific",
                                I32,
-                               pthread_cond_broadcast,
+                               s__pthread_getspecific,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_broadcast {}", a);
+    SPDLOG_TRACE("S - pthread_getspecific {}", a);
 
     return 0;
 }
 
-// --------------------------
-// Unsupported
-// --------------------------
-
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_equal",
+                               "pthread_setspecific",
                                I32,
-                               pthread_equal,
+                               s__pthread_setspecific,
                                I32 a,
                                I32 b)
 {
-    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
+    SPDLOG_TRACE("S - pthread_setspecific {} {}", a, b);
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_timedwait",
-                               I32,
-                               pthread_cond_timedwait,
-                               I32 a,
-                               I32 b,
-                               I32 c)
-{
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    return 0;
 }
 
+// --------------------------
+// Unsupported
+// --------------------------
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_wait",
+                               "pthread_equal",
                                I32,
-                               pthread_cond_wait,
+                               pthread_equal,
                                I32 a,
                                I32 b)
 {
+    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -23,17 +23,35 @@ TEST_CASE("Test default faasm config initialisation", "[conf]")
     REQUIRE(conf.maxNetNs == 100);
 
     REQUIRE(conf.pythonPreload == "off");
+    REQUIRE(conf.pythonPrecompile == "off");
     REQUIRE(conf.captureStdout == "off");
+    REQUIRE(conf.captureStdoutMaxBytes == 1048576);
 
     REQUIRE(conf.chainedCallTimeout == 300000);
+    REQUIRE(conf.chainPayloadThreshold == 1048576);
+    REQUIRE(conf.stateIoThreads == 4);
+    REQUIRE(conf.stateWriteCombine == "off");
+    REQUIRE(conf.streamMaxChunks == 16);
+    REQUIRE(conf.pthreadDispatch == "batch");
+    REQUIRE(conf.pthreadEagerGroupSize == 1);
 
     REQUIRE(conf.wasmVm == "wavm");
 
+    REQUIRE(conf.runtimeImagePath.empty());
+    REQUIRE(conf.artifactCompression == "off");
+    REQUIRE(conf.artifactCompressionLevel == 3);
+    REQUIRE(conf.artifactPeerFetch == "off");
+    REQUIRE(conf.artifactServerPort == 8006);
+    REQUIRE(conf.artifactTrustedHosts.empty());
+
     REQUIRE(conf.s3Bucket == "faasm");
     REQUIRE(conf.s3Host == "minio");
     REQUIRE(conf.s3Port == "9000");
     REQUIRE(conf.s3User == "minio");
     REQUIRE(conf.s3Password == "minio123");
+    REQUIRE(conf.s3MaxConnections == 32);
+    REQUIRE(conf.s3MaxRetries == 3);
+    REQUIRE(conf.s3HedgeDelayMs == 0);
 
     REQUIRE(conf.attestationProviderUrl == "");
 }
@@ -48,18 +66,40 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
     std::string maxNetNs = setEnvVar("MAX_NET_NAMESPACES", "300");
 
     std::string pythonPre = setEnvVar("PYTHON_PRELOAD", "on");
+    std::string pythonPrecompile = setEnvVar("PYTHON_PRECOMPILE", "on");
     std::string captureStdout = setEnvVar("CAPTURE_STDOUT", "on");
+    std::string captureStdoutMax = setEnvVar("CAPTURE_STDOUT_MAX_BYTES", "512");
     std::string wasmVm = setEnvVar("WASM_VM", "blah");
 
     std::string chainedTimeout = setEnvVar("CHAINED_CALL_TIMEOUT", "9999");
+    std::string chainPayloadThreshold =
+      setEnvVar("CHAIN_PAYLOAD_THRESHOLD", "2048");
+    std::string stateIoThreads = setEnvVar("STATE_IO_THREADS", "12");
+    std::string stateWriteCombine = setEnvVar("STATE_WRITE_COMBINE", "on");
+    std::string streamMaxChunks = setEnvVar("STREAM_MAX_CHUNKS", "64");
+    std::string pthreadDispatch = setEnvVar("PTHREAD_DISPATCH", "eager");
+    std::string pthreadEagerGroupSize =
+      setEnvVar("PTHREAD_EAGER_GROUP_SIZE", "4");
 
     std::string faasmLocalDir = setEnvVar("FAASM_LOCAL_DIR", "/tmp/blah");
+    std::string runtimeImage =
+      setEnvVar("RUNTIME_IMAGE", "/tmp/blah/runtime.img");
+    std::string artifactCompression = setEnvVar("ARTIFACT_COMPRESSION", "on");
+    std::string artifactCompressionLevel =
+      setEnvVar("ARTIFACT_COMPRESSION_LEVEL", "19");
+    std::string artifactPeerFetch = setEnvVar("ARTIFACT_PEER_FETCH", "on");
+    std::string artifactServerPort = setEnvVar("ARTIFACT_SERVER_PORT", "9123");
+    std::string artifactTrustedHosts =
+      setEnvVar("ARTIFACT_TRUSTED_HOSTS", "upload,10.0.0.1");
 
     std::string s3Bucket = setEnvVar("S3_BUCKET", "dummy-bucket");
     std::string s3Host = setEnvVar("S3_HOST", "dummy-host");
     std::string s3Port = setEnvVar("S3_PORT", "123456");
     std::string s3User = setEnvVar("S3_USER", "dummy-user");
     std::string s3Password = setEnvVar("S3_PASSWORD", "dummy-password");
+    std::string s3MaxConns = setEnvVar("S3_MAX_CONNECTIONS", "7");
+    std::string s3MaxRetries = setEnvVar("S3_MAX_RETRIES", "11");
+    std::string s3HedgeDelay = setEnvVar("S3_HEDGE_DELAY_MS", "55");
 
     std::string attestationProviderUrl =
       setEnvVar("AZ_ATTESTATION_PROVIDER_URL", "dummy-url");
@@ -73,21 +113,38 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
     REQUIRE(conf.maxNetNs == 300);
 
     REQUIRE(conf.pythonPreload == "on");
+    REQUIRE(conf.pythonPrecompile == "on");
     REQUIRE(conf.captureStdout == "on");
+    REQUIRE(conf.captureStdoutMaxBytes == 512);
     REQUIRE(conf.wasmVm == "blah");
 
     REQUIRE(conf.chainedCallTimeout == 9999);
+    REQUIRE(conf.chainPayloadThreshold == 2048);
+    REQUIRE(conf.stateIoThreads == 12);
+    REQUIRE(conf.stateWriteCombine == "on");
+    REQUIRE(conf.streamMaxChunks == 64);
+    REQUIRE(conf.pthreadDispatch == "eager");
+    REQUIRE(conf.pthreadEagerGroupSize == 4);
 
     REQUIRE(conf.functionDir == "/tmp/blah/wasm");
     REQUIRE(conf.objectFileDir == "/tmp/blah/object");
     REQUIRE(conf.runtimeFilesDir == "/tmp/blah/runtime_root");
     REQUIRE(conf.sharedFilesDir == "/tmp/blah/shared");
+    REQUIRE(conf.runtimeImagePath == "/tmp/blah/runtime.img");
+    REQUIRE(conf.artifactCompression == "on");
+    REQUIRE(conf.artifactCompressionLevel == 19);
+    REQUIRE(conf.artifactPeerFetch == "on");
+    REQUIRE(conf.artifactServerPort == 9123);
+    REQUIRE(conf.artifactTrustedHosts == "upload,10.0.0.1");
 
     REQUIRE(conf.s3Bucket == "dummy-bucket");
     REQUIRE(conf.s3Host == "dummy-host");
     REQUIRE(conf.s3Port == "123456");
     REQUIRE(conf.s3User == "dummy-user");
     REQUIRE(conf.s3Password == "dummy-password");
+    REQUIRE(conf.s3MaxConnections == 7);
+    REQUIRE(conf.s3MaxRetries == 11);
+    REQUIRE(conf.s3HedgeDelayMs == 55);
 
     REQUIRE(conf.attestationProviderUrl == "dummy-url");
 
@@ -99,18 +156,35 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
     setEnvVar("MAX_NET_NAMESPACES", maxNetNs);
 
     setEnvVar("PYTHON_PRELOAD", pythonPre);
+    setEnvVar("PYTHON_PRECOMPILE", pythonPrecompile);
     setEnvVar("CAPTURE_STDOUT", captureStdout);
+    setEnvVar("CAPTURE_STDOUT_MAX_BYTES", captureStdoutMax);
     setEnvVar("WASM_VM", wasmVm);
 
     setEnvVar("CHAINED_CALL_TIMEOUT", chainedTimeout);
+    setEnvVar("CHAIN_PAYLOAD_THRESHOLD", chainPayloadThreshold);
+    setEnvVar("STATE_IO_THREADS", stateIoThreads);
+    setEnvVar("STATE_WRITE_COMBINE", stateWriteCombine);
+    setEnvVar("STREAM_MAX_CHUNKS", streamMaxChunks);
+    setEnvVar("PTHREAD_DISPATCH", pthreadDispatch);
+    setEnvVar("PTHREAD_EAGER_GROUP_SIZE", pthreadEagerGroupSize);
 
     setEnvVar("FAASM_LOCAL_DIR", faasmLocalDir);
+    setEnvVar("RUNTIME_IMAGE", runtimeImage);
+    setEnvVar("ARTIFACT_COMPRESSION", artifactCompression);
+    setEnvVar("ARTIFACT_COMPRESSION_LEVEL", artifactCompressionLevel);
+    setEnvVar("ARTIFACT_PEER_FETCH", artifactPeerFetch);
+    setEnvVar("ARTIFACT_SERVER_PORT", artifactServerPort);
+    setEnvVar("ARTIFACT_TRUSTED_HOSTS", artifactTrustedHosts);
 
     setEnvVar("S3_BUCKET", s3Bucket);
     setEnvVar("S3_HOST", s3Host);
     setEnvVar("S3_PORT", s3Port);
     setEnvVar("S3_USER", s3User);
     setEnvVar("S3_PASSWORD", s3Password);
+    setEnvVar("S3_MAX_CONNECTIONS", s3MaxConns);
+    setEnvVar("S3_MAX_RETRIES", s3MaxRetries);
+    setEnvVar("S3_HEDGE_DELAY_MS", s3HedgeDelay);
 
     setEnvVar("AZ_ATTESTATION_PROVIDER_URL", attestationProviderUrl);
 }
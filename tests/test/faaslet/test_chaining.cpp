@@ -3,7 +3,14 @@
 #include "faasm_fixtures.h"
 #include "utils.h"
 
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/util/batch.h>
 #include <faabric/util/environment.h>
+#include <faabric/util/gids.h>
+#include <wasm/chaining.h>
+#include <wasm/workflows.h>
+
+#include <set>
 
 namespace tests {
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
@@ -29,4 +36,120 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     auto req = faabric::util::batchExecFactory("demo", "chain_named_a", 1);
     executeWithPool(req, 5000);
 }
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test awaiting sets of chained calls",
+                 "[faaslet]")
+{
+    int nCalls = 4;
+    auto req = faabric::util::batchExecFactory("demo", "echo", nCalls);
+    int appId = req->appid();
+
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < nCalls; i++) {
+        req->mutable_messages(i)->set_inputdata(fmt::format("call {}", i));
+        ids.emplace_back(req->messages(i).id());
+    }
+
+    plannerCli.callFunctions(req);
+
+    SECTION("Await all")
+    {
+        auto results = wasm::awaitChainedCalls(appId, ids, true, 5000);
+        REQUIRE(results.size() == nCalls);
+
+        // Each call is reported exactly once
+        std::set<uint32_t> seen;
+        for (const auto& r : results) {
+            REQUIRE(r.returnValue == 0);
+            seen.insert(r.messageId);
+        }
+        REQUIRE(seen == std::set<uint32_t>(ids.begin(), ids.end()));
+    }
+
+    SECTION("Await any")
+    {
+        auto results = wasm::awaitChainedCalls(appId, ids, false, 5000);
+        REQUIRE(!results.empty());
+        REQUIRE(results.size() <= nCalls);
+        REQUIRE(std::find(ids.begin(), ids.end(), results.at(0).messageId) !=
+                ids.end());
+
+        // Waiting again for the rest picks up the others
+        wasm::awaitChainedCalls(appId, ids, true, 5000);
+    }
+
+    SECTION("Timeout")
+    {
+        // Nothing will ever finish a call with this id
+        std::vector<uint32_t> withMissing = ids;
+        withMissing.emplace_back(ids.back() + 1000);
+
+        auto results = wasm::awaitChainedCalls(appId, withMissing, true, 500);
+        REQUIRE(results.size() == nCalls);
+    }
+
+    SECTION("Adding calls between waits")
+    {
+        wasm::ChainedCallWaiter waiter(appId);
+        waiter.add(ids.at(0));
+        waiter.add(ids.at(1));
+
+        auto results = waiter.wait(true, 5000);
+        REQUIRE(results.size() == 2);
+        REQUIRE(waiter.getPendingCount() == 0);
+
+        // Only the new calls are waited on
+        waiter.add(ids.at(2));
+        waiter.add(ids.at(3));
+        REQUIRE(waiter.getPendingCount() == 2);
+
+        results = waiter.wait(true, 5000);
+        REQUIRE(results.size() == 2);
+
+        std::set<uint32_t> seen;
+        for (const auto& r : results) {
+            seen.insert(r.messageId);
+        }
+        REQUIRE(seen == std::set<uint32_t>({ ids.at(2), ids.at(3) }));
+    }
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test running workflows",
+                 "[faaslet]")
+{
+    faasmConf.chainedCallTimeout = 10000;
+
+    // Each node echoes its input, which is its own input followed by the
+    // outputs of the nodes it depends on
+    wasm::Workflow workflow = wasm::parseWorkflow(R"({"user": "demo", "nodes": [
+        {"function": "echo", "input": "ab"},
+        {"function": "echo", "deps": [0]},
+        {"function": "echo", "input": "c", "deps": [0]},
+        {"function": "echo", "deps": [1, 2]}
+    ]})");
+
+    int appId = faabric::util::generateGid();
+    std::vector<int> ids = wasm::submitWorkflow(workflow, appId);
+    REQUIRE(ids.size() == 4);
+
+    std::vector<std::string> expectedOutputs = { "ab", "ab", "cab", "abcab" };
+    for (int i = 0; i < ids.size(); i++) {
+        faabric::Message result =
+          plannerCli.getMessageResult(appId, ids.at(i), 10000);
+        REQUIRE(result.returnvalue() == 0);
+        REQUIRE(result.outputdata() == expectedOutputs.at(i));
+    }
+
+    REQUIRE(wasm::waitForWorkflows(5000));
+    REQUIRE(wasm::getActiveWorkflowCount() == 0);
+
+    // Shutting down with nothing running returns straight away, and
+    // workflows can be submitted again afterwards
+    wasm::shutdownWorkflows();
+    ids = wasm::submitWorkflow(workflow, faabric::util::generateGid());
+    wasm::shutdownWorkflows();
+    REQUIRE(wasm::getActiveWorkflowCount() == 0);
+}
 }
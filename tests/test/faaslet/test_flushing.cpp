@@ -118,6 +118,76 @@ TEST_CASE_METHOD(FlushingTestFixture,
     REQUIRE(cache.getTotalCachedModuleCount() == 0);
 }
 
+TEST_CASE_METHOD(FlushingTestFixture,
+                 "Test invalidating a single function",
+                 "[faaslet]")
+{
+    std::thread tA(
+      [this] { wasm::getWAVMModuleCache().getCachedModule(msgA); });
+
+    std::thread tB(
+      [this] { wasm::getWAVMModuleCache().getCachedModule(msgB); });
+
+    if (tA.joinable()) {
+        tA.join();
+    }
+    if (tB.joinable()) {
+        tB.join();
+    }
+
+    wasm::WAVMModuleCache& cache = wasm::getWAVMModuleCache();
+    wasm::IRModuleCache& irCache = wasm::getIRModuleCache();
+    REQUIRE(cache.getTotalCachedModuleCount() == 2);
+    REQUIRE(irCache.isModuleCached("demo", "hello", ""));
+    REQUIRE(irCache.isModuleCached("demo", "echo", ""));
+
+    std::string wasmFileA = loader.getFunctionFile(msgA);
+    std::string wasmFileB = loader.getFunctionFile(msgB);
+    REQUIRE(std::filesystem::exists(wasmFileA));
+    REQUIRE(std::filesystem::exists(wasmFileB));
+
+    // Invalidate one function and check the other is untouched
+    faaslet::invalidateFunction(msgA.user(), msgA.function());
+
+    REQUIRE(cache.getTotalCachedModuleCount() == 1);
+    REQUIRE(!irCache.isModuleCached("demo", "hello", ""));
+    REQUIRE(irCache.isModuleCached("demo", "echo", ""));
+
+    REQUIRE(!std::filesystem::exists(wasmFileA));
+    REQUIRE(!std::filesystem::exists(loader.getFunctionObjectFile(msgA)));
+    REQUIRE(std::filesystem::exists(wasmFileB));
+
+    // Check the function can still be loaded afresh
+    REQUIRE(loader.loadFunctionWasm(msgA) == wasmBytesA);
+}
+
+TEST_CASE_METHOD(FlushingTestFixture,
+                 "Test invalidating a shared file",
+                 "[faaslet]")
+{
+    std::string fileName = "invalidate-test.txt";
+    std::string otherFileName = "invalidate-other.txt";
+    std::vector<uint8_t> fileBytes = { 0, 1, 2, 3 };
+
+    loader.uploadSharedFile(fileName, fileBytes);
+    loader.uploadSharedFile(otherFileName, fileBytes);
+    std::string syncSharedPath = "faasm://" + fileName;
+    REQUIRE(storage::SharedFiles::syncSharedFile(syncSharedPath, "") == 0);
+
+    std::string sharedPath = loader.getSharedFileFile(fileName);
+    std::string otherSharedPath = loader.getSharedFileFile(otherFileName);
+    REQUIRE(std::filesystem::exists(sharedPath));
+
+    faaslet::invalidateSharedFile(fileName);
+
+    REQUIRE(!std::filesystem::exists(sharedPath));
+    REQUIRE(std::filesystem::exists(otherSharedPath));
+
+    // Syncing again should pull it back down
+    REQUIRE(storage::SharedFiles::syncSharedFile(syncSharedPath, "") == 0);
+    REQUIRE(faabric::util::readFileToBytes(sharedPath) == fileBytes);
+}
+
 TEST_CASE_METHOD(FlushingTestFixture,
                  "Test flushing clears IR module cache",
                  "[faaslet]")
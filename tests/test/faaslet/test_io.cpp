@@ -3,6 +3,10 @@
 #include "faasm_fixtures.h"
 #include "utils.h"
 
+#include <faabric/util/func.h>
+#include <wasm/StdoutCapture.h>
+#include <wasm/streams.h>
+
 namespace tests {
 
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
@@ -76,6 +80,99 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     REQUIRE(actual == expected);
 }
 
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test truncating and streaming stdout",
+                 "[faaslet][wamr]")
+{
+    auto req = setUpContext("demo", "stdout");
+    faabric::Message& call = req->mutable_messages()->at(0);
+    call.set_inputdata("23");
+
+    std::string fullStdout = "Input value = 23\n"
+                             "i=7 s=8 f=7.89\n"
+                             "FloatA=28.393 FloatB=181.493\n"
+                             "Out: I am output\n"
+                             "Unformatted output\n";
+
+    std::string streamed;
+    std::string expected;
+
+    SECTION("Truncated")
+    {
+        SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+        SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
+        faasmConf.captureStdout = "on";
+        faasmConf.captureStdoutMaxBytes = 19;
+        expected = fmt::format(STDOUT_TRUNCATED_MARKER,
+                               fullStdout.size() - 19) +
+                   "Unformatted output\n\nNormal Faasm output";
+    }
+
+    // Stdout goes down the call's stream once its caller is reading it
+    faabric::Message reader = faabric::util::messageFactory("demo", "chain");
+    bool hasReader = false;
+    std::string expectedStreamed;
+
+    SECTION("Streamed")
+    {
+        SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+        SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
+        faasmConf.captureStdout = "stream";
+        wasm::addStreamReader(reader, call);
+        hasReader = true;
+
+        // Reading attaches the caller, even though nothing's there yet
+        std::vector<uint8_t> buffer(10);
+        REQUIRE(wasm::readStreamChunk(call.appid(),
+                                      "demo",
+                                      call.id(),
+                                      buffer.data(),
+                                      buffer.size(),
+                                      0) == -1);
+
+        expected = "Normal Faasm output";
+        expectedStreamed = fullStdout;
+    }
+
+    SECTION("Streamed before the reader reads")
+    {
+        // Nothing holds the call back, so its stdout stays in its output
+        faasmConf.captureStdout = "stream";
+        wasm::addStreamReader(reader, call);
+        hasReader = true;
+        expected = fullStdout + "\nNormal Faasm output";
+    }
+
+    SECTION("Streamed without a reader")
+    {
+        faasmConf.captureStdout = "stream";
+        expected = fullStdout + "\nNormal Faasm output";
+    }
+
+    int appId = call.appid();
+    int msgId = call.id();
+    const std::string actual = executeWithPool(req).at(0).outputdata();
+    REQUIRE(actual == expected);
+
+    if (hasReader) {
+        std::vector<uint8_t> buffer(100);
+        int chunkSize = 0;
+        while ((chunkSize = wasm::readStreamChunk(
+                  appId, "demo", msgId, buffer.data(), buffer.size(), 1000)) >
+               0) {
+            streamed.append(reinterpret_cast<char*>(buffer.data()), chunkSize);
+        }
+
+        REQUIRE(chunkSize == 0);
+        REQUIRE(streamed == expectedStreamed);
+        wasm::detachStreams(reader);
+    }
+}
+
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
                  "Test capturing stderr",
                  "[faaslet]")
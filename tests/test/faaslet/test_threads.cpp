@@ -16,6 +16,7 @@ namespace tests {
 class PthreadTestFixture
   : public FunctionExecTestFixture
   , public ConfFixture
+  , public FaasmConfTestFixture
 {
   public:
     PthreadTestFixture() { conf.overrideCpuCount = nThreads + 2; }
@@ -43,4 +44,23 @@ TEST_CASE_METHOD(PthreadTestFixture, "Run thread checks locally", "[threads]")
 {
     runTestLocally("threads_check");
 }
+
+TEST_CASE_METHOD(PthreadTestFixture,
+                 "Run thread checks with eager dispatch",
+                 "[threads]")
+{
+    faasmConf.pthreadDispatch = "eager";
+
+    SECTION("Single threads") { faasmConf.pthreadEagerGroupSize = 1; }
+
+    SECTION("Groups of threads") { faasmConf.pthreadEagerGroupSize = 2; }
+
+    SECTION("Groups larger than the pool")
+    {
+        faasmConf.pthreadEagerGroupSize = nThreads + 4;
+    }
+
+    runTestLocally("threads_check");
+    runTestLocally("threads_local");
+}
 }
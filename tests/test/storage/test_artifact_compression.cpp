@@ -0,0 +1,157 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/func.h>
+
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactCompression.h>
+#include <storage/FileLoader.h>
+
+using namespace storage;
+
+namespace tests {
+
+class ArtifactCompressionTestFixture : public S3TestFixture
+{
+  public:
+    ArtifactCompressionTestFixture() { clearArtifactDictionaries(); }
+
+    ~ArtifactCompressionTestFixture() { clearArtifactDictionaries(); }
+
+    // Artifacts of the same type share a lot of structure, so give the samples
+    // a common prefix and suffix with a varying middle
+    std::vector<uint8_t> makeSample(int i)
+    {
+        std::string s = "(module (func $main (export \"main\") ";
+        for (int j = 0; j < 50; j++) {
+            s += fmt::format("(call $f{} (i32.const {})) ", (i * j) % 37, j);
+        }
+        s += ") (memory 1))";
+        return std::vector<uint8_t>(s.begin(), s.end());
+    }
+};
+
+TEST_CASE_METHOD(ArtifactCompressionTestFixture,
+                 "Test compressing and decompressing artifacts",
+                 "[storage]")
+{
+    std::vector<uint8_t> raw = makeSample(7);
+
+    SECTION("Compression off")
+    {
+        faasmConf.artifactCompression = "off";
+        std::vector<uint8_t> actual = compressArtifact(raw, WASM_ARTIFACT);
+        REQUIRE(actual == raw);
+        REQUIRE(!isCompressedArtifact(actual));
+        REQUIRE(decompressArtifact(actual) == raw);
+    }
+
+    SECTION("Compression on")
+    {
+        faasmConf.artifactCompression = "on";
+
+        SECTION("No dictionary") {}
+
+        SECTION("With dictionary")
+        {
+            std::vector<std::vector<uint8_t>> samples;
+            for (int i = 0; i < 200; i++) {
+                samples.emplace_back(makeSample(i));
+            }
+
+            std::vector<uint8_t> dict = trainArtifactDictionary(samples, 4096);
+            REQUIRE(!dict.empty());
+            uploadArtifactDictionary(WASM_ARTIFACT, dict);
+        }
+
+        std::vector<uint8_t> compressed = compressArtifact(raw, WASM_ARTIFACT);
+        REQUIRE(isCompressedArtifact(compressed));
+        REQUIRE(compressed.size() < raw.size());
+
+        // Make sure decompression doesn't rely on cached dictionaries
+        clearArtifactDictionaries();
+        REQUIRE(decompressArtifact(compressed) == raw);
+    }
+}
+
+TEST_CASE_METHOD(ArtifactCompressionTestFixture,
+                 "Test decompressing oversized artifacts",
+                 "[storage]")
+{
+    faasmConf.artifactCompression = "on";
+    std::vector<uint8_t> compressed =
+      compressArtifact(makeSample(7), WASM_ARTIFACT);
+    compressed.resize(sizeof(CompressedArtifactHeader));
+
+    // Frame header claiming more content than we're willing to allocate: the
+    // magic, a single segment descriptor with an 8-byte content size, then
+    // the size itself, all little endian
+    std::vector<uint8_t> frame = { 0x28, 0xB5, 0x2F, 0xFD, 0xE0 };
+    uint64_t rawSize = ARTIFACT_MAX_RAW_SIZE + 1;
+    for (int i = 0; i < 8; i++) {
+        frame.emplace_back(static_cast<uint8_t>(rawSize >> (8 * i)));
+    }
+    compressed.insert(compressed.end(), frame.begin(), frame.end());
+
+    REQUIRE(isCompressedArtifact(compressed));
+    REQUIRE_THROWS_WITH(decompressArtifact(compressed),
+                        "Compressed artifact too large");
+}
+
+TEST_CASE_METHOD(ArtifactCompressionTestFixture,
+                 "Test file loader stores compressed artifacts",
+                 "[storage]")
+{
+    faasmConf.artifactCompression = "on";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "compressed");
+    std::vector<uint8_t> objBytes = makeSample(3);
+
+    FileLoader loader(false);
+    loader.uploadFunctionObjectFile(msg, objBytes);
+
+    // Check what's in S3 is compressed
+    std::vector<uint8_t> stored =
+      s3.getKeyBytes(faasmConf.s3Bucket, "demo/compressed/function.wasm.o");
+    REQUIRE(isCompressedArtifact(stored));
+    REQUIRE(stored.size() < objBytes.size());
+
+    // Check loading decompresses transparently, even with compression off
+    SECTION("Compression still on") {}
+
+    SECTION("Compression switched off")
+    {
+        faasmConf.artifactCompression = "off";
+    }
+
+    REQUIRE(loader.loadFunctionObjectFile(msg) == objBytes);
+
+    // Hashes are not compressed
+    std::vector<uint8_t> hash = { 1, 2, 3, 4 };
+    loader.uploadFunctionObjectHash(msg, hash);
+    REQUIRE(loader.loadFunctionObjectHash(msg) == hash);
+}
+
+TEST_CASE_METHOD(ArtifactCompressionTestFixture,
+                 "Test shared files that look compressed are left alone",
+                 "[storage]")
+{
+    faasmConf.artifactCompression = "on";
+
+    // A compressed artifact uploaded as a plain shared file must come back
+    // byte for byte, rather than being decompressed
+    std::vector<uint8_t> fileBytes =
+      compressArtifact(makeSample(5), WASM_ARTIFACT);
+    REQUIRE(isCompressedArtifact(fileBytes));
+
+    FileLoader loader(false);
+    std::string path = "compressed/looking.bin";
+    loader.uploadSharedFile(path, fileBytes);
+
+    REQUIRE(loader.loadSharedFile(path) == fileBytes);
+    REQUIRE(loader.loadSharedFiles({ path }).at(0) == fileBytes);
+
+    loader.deleteSharedFile(path);
+}
+}
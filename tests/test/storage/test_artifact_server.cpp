@@ -0,0 +1,187 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/files.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+
+#include <conf/FaasmConfig.h>
+#include <storage/ArtifactServer.h>
+#include <storage/FileLoader.h>
+
+#include <cpprest/http_client.h>
+
+#include <filesystem>
+
+using namespace storage;
+
+namespace tests {
+
+class ArtifactServerTestFixture : public S3TestFixture
+{
+  public:
+    ArtifactServerTestFixture()
+      : serverA(18006)
+      , serverB(18007)
+    {
+        faasmConf.artifactPeerFetch = "on";
+
+        serverA.start();
+        serverB.start();
+
+        // Include a peer that isn't running to check we skip it
+        setArtifactPeers(
+          { "localhost:18099", "localhost:18006", "localhost:18007" });
+    }
+
+    ~ArtifactServerTestFixture()
+    {
+        setArtifactPeers({});
+
+        serverA.stop();
+        serverB.stop();
+    }
+
+  protected:
+    ArtifactServer serverA;
+    ArtifactServer serverB;
+};
+
+TEST_CASE_METHOD(ArtifactServerTestFixture,
+                 "Test fetching artifacts from peers",
+                 "[storage]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "peer");
+    std::vector<uint8_t> objBytes = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<uint8_t> hash = { 9, 8, 7 };
+
+    // Upload through a loader with a local cache, as a peer that has already
+    // pulled the artifact would have it
+    FileLoader peerLoader(true);
+    peerLoader.uploadFunctionObjectFile(msg, objBytes);
+    peerLoader.uploadFunctionObjectHash(msg, hash);
+
+    std::string cachedObjFile = peerLoader.getFunctionObjectFile(msg);
+    REQUIRE(std::filesystem::exists(cachedObjFile));
+    REQUIRE(std::filesystem::exists(peerLoader.getHashFilePath(cachedObjFile)));
+
+    // Remove the artifact from S3, so that it can only come from a peer
+    s3.deleteKey(faasmConf.s3Bucket, "demo/peer/function.wasm.o");
+
+    FileLoader loader(false);
+
+    SECTION("Peer has up-to-date copy")
+    {
+        REQUIRE(loader.loadFunctionObjectFile(msg) == objBytes);
+    }
+
+    SECTION("Peer has stale copy")
+    {
+        std::vector<uint8_t> newHash = { 1, 1, 1 };
+        s3.addKeyBytes(
+          faasmConf.s3Bucket, "demo/peer/function.wasm.o.md5", newHash);
+
+        // Falls back to S3, which doesn't have it
+        REQUIRE_THROWS(loader.loadFunctionObjectFile(msg));
+    }
+
+    SECTION("Peer fetch disabled")
+    {
+        faasmConf.artifactPeerFetch = "off";
+        REQUIRE_THROWS(loader.loadFunctionObjectFile(msg));
+    }
+
+    SECTION("Peer has corrupt copy")
+    {
+        faabric::util::writeBytesToFile(cachedObjFile, { 0, 1, 2 });
+
+        // Falls back to S3, which doesn't have it
+        REQUIRE_THROWS(loader.loadFunctionObjectFile(msg));
+    }
+
+    SECTION("Peers don't serve files outside the cache")
+    {
+        REQUIRE(fetchArtifactFromPeers("/etc/hostname", {}, {}).empty());
+        REQUIRE(
+          fetchArtifactFromPeers(faasmConf.objectFileDir + "/../../etc/hosts",
+                                 {},
+                                 {})
+            .empty());
+
+        // Symlinks out of the cache are followed
+        std::string linkPath = faasmConf.objectFileDir + "/link";
+        std::filesystem::remove(linkPath);
+        std::filesystem::create_directory_symlink("/etc", linkPath);
+        REQUIRE(fetchArtifactFromPeers(linkPath + "/hostname", {}, {}).empty());
+        std::filesystem::remove(linkPath);
+    }
+
+    std::filesystem::remove(cachedObjFile);
+    std::filesystem::remove(peerLoader.getHashFilePath(cachedObjFile));
+    std::filesystem::remove(cachedObjFile + DIGEST_EXT);
+}
+
+TEST_CASE_METHOD(ArtifactServerTestFixture,
+                 "Test broadcasting invalidations",
+                 "[storage]")
+{
+    std::mutex mx;
+    std::vector<std::string> invalidated;
+    setInvalidationHandlers(
+      [&mx, &invalidated](const std::string& user, const std::string& func) {
+          faabric::util::UniqueLock lock(mx);
+          invalidated.emplace_back(user + "/" + func);
+      },
+      [&mx, &invalidated](const std::string& path) {
+          faabric::util::UniqueLock lock(mx);
+          invalidated.emplace_back(path);
+      });
+
+    std::vector<std::string> expected;
+    SECTION("Function")
+    {
+        broadcastFunctionInvalidation("demo", "echo");
+        expected = { "demo/echo", "demo/echo" };
+    }
+
+    SECTION("Shared file")
+    {
+        broadcastSharedFileInvalidation("some/dir/file.txt");
+        expected = { "some/dir/file.txt", "some/dir/file.txt" };
+    }
+
+    SECTION("Peer fetch disabled")
+    {
+        // Caches are still invalidated without peer fetching
+        faasmConf.artifactPeerFetch = "off";
+        broadcastFunctionInvalidation("demo", "echo");
+        expected = { "demo/echo", "demo/echo" };
+    }
+
+    SECTION("Invalid invalidations")
+    {
+        using namespace web::http;
+
+        client::http_client client("http://localhost:18006");
+
+        http_request request(methods::PUT);
+        request.set_request_uri("/invalidate/function/demo/bad%20func");
+        REQUIRE(client.request(request).get().status_code() ==
+                status_codes::BadRequest);
+
+        for (const auto& path : { "../../etc/hosts", "a/../../../etc" }) {
+            http_request fileRequest(methods::PUT);
+            fileRequest.set_request_uri("/invalidate/file");
+            fileRequest.headers().add(FILE_PATH_HEADER, path);
+            REQUIRE(client.request(fileRequest).get().status_code() ==
+                    status_codes::BadRequest);
+        }
+    }
+
+    // Each running server gets the invalidation once, the dead one is skipped
+    REQUIRE(invalidated == expected);
+
+    setInvalidationHandlers(nullptr, nullptr);
+}
+}
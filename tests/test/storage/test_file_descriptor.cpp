@@ -6,12 +6,14 @@
 #include <conf/FaasmConfig.h>
 #include <faabric/util/bytes.h>
 #include <faabric/util/files.h>
+#include <storage/DirectoryCache.h>
 #include <storage/FileDescriptor.h>
 #include <storage/FileLoader.h>
 #include <storage/SharedFiles.h>
 
 #include <WAVM/WASI/WASIABI.h>
 #include <boost/filesystem.hpp>
+#include <set>
 #include <string_view>
 
 using namespace storage;
@@ -409,4 +411,120 @@ TEST_CASE_METHOD(FileDescriptorTestFixture,
         checkWasiDirentInBuffer(buffer2.data(), entC);
     }
 }
+
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test directory listings are cached and invalidated",
+                 "[storage]")
+{
+    DirectoryCache::clear();
+
+    std::string dummyDir = "fs_cache_test_dir";
+    std::string realDir = faasmConf.runtimeFilesDir + "/" + dummyDir;
+    boost::filesystem::remove_all(realDir);
+    boost::filesystem::create_directories(realDir);
+
+    std::vector<uint8_t> contents = { 0, 1, 2 };
+    faabric::util::writeBytesToFile(realDir + "/a.txt", contents);
+    faabric::util::writeBytesToFile(realDir + "/b.txt", contents);
+
+    auto listPaths = [this, &dummyDir]() {
+        int dirFd = fs.openFileDescriptor(
+          DEFAULT_ROOT_FD, dummyDir, 0, 0, 0, __WASI_O_DIRECTORY, 0);
+        REQUIRE(dirFd > 0);
+
+        std::set<std::string> paths;
+        FileDescriptor& dirDesc = fs.getFileDescriptor(dirFd);
+        while (!dirDesc.iterFinished()) {
+            paths.insert(dirDesc.iterNext().path);
+        }
+
+        return paths;
+    };
+
+    std::set<std::string> expected = { ".", "..", "a.txt", "b.txt" };
+    REQUIRE(listPaths() == expected);
+    REQUIRE(DirectoryCache::getCachedListingCount() == 1);
+
+    // Listing again should be served from the same cached listing
+    DirListing listingA = DirectoryCache::getListing(realDir);
+    DirListing listingB = DirectoryCache::getListing(realDir + "/");
+    REQUIRE(listingA == listingB);
+    REQUIRE(DirectoryCache::getCachedListingCount() == 1);
+
+    // Changes made outside of Faasm aren't visible until invalidated
+    faabric::util::writeBytesToFile(realDir + "/c.txt", contents);
+    REQUIRE(listPaths() == expected);
+
+    DirectoryCache::invalidate(realDir);
+    expected.insert("c.txt");
+    REQUIRE(listPaths() == expected);
+
+    // Changes made through a file descriptor invalidate the listing
+    int newFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, dummyDir + "/d.txt", 0, 0, 0, __WASI_O_CREAT, 0);
+    REQUIRE(newFd > 0);
+    expected.insert("d.txt");
+    REQUIRE(listPaths() == expected);
+
+    FileDescriptor& rootFileDesc = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    rootFileDesc.unlink(dummyDir + "/a.txt");
+    expected.erase("a.txt");
+    REQUIRE(listPaths() == expected);
+
+    rootFileDesc.mkdir(dummyDir + "/subdir");
+    expected.insert("subdir");
+    REQUIRE(listPaths() == expected);
+
+    // Listings are dropped when the cache is cleared
+    DirectoryCache::clear();
+    REQUIRE(DirectoryCache::getCachedListingCount() == 0);
+
+    boost::filesystem::remove_all(realDir);
+}
+
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test copy-on-write file descriptor tables",
+                 "[storage]")
+{
+    // Preopened roots are shared between filesystems
+    FileSystem fsB;
+    fsB.prepareFilesystem();
+
+    FileDescriptor& rootA = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    FileDescriptor& rootB = fsB.getFileDescriptor(DEFAULT_ROOT_FD);
+    REQUIRE(rootA.getLinuxFd() == rootB.getLinuxFd());
+    REQUIRE(rootA.getPath() == ".");
+
+    // Open a file in one table, then copy it
+    std::string dummyPath = "cow_dummy_file.txt";
+    std::string realPath = faasmConf.runtimeFilesDir + "/" + dummyPath;
+    std::vector<uint8_t> contents = { 0, 1, 2, 3, 4, 5 };
+    faabric::util::writeBytesToFile(realPath, contents);
+
+    int fileFd =
+      fs.openFileDescriptor(DEFAULT_ROOT_FD, dummyPath, 0, 0, 0, 0, 0);
+    REQUIRE(fileFd > 0);
+
+    FileSystem fsCopy = fs;
+    REQUIRE(fsCopy.fileDescriptorExists(fileFd));
+    REQUIRE(fsCopy.getPathForFd(fileFd) == dummyPath);
+
+    // Modifying the copy must not affect the original
+    FileDescriptor& copyDesc = fsCopy.getFileDescriptor(fileFd);
+    copyDesc.setPath("changed");
+    REQUIRE(fsCopy.getPathForFd(fileFd) == "changed");
+    REQUIRE(fs.getPathForFd(fileFd) == dummyPath);
+
+    // New descriptors are independent
+    int newFd = fsCopy.dup(fileFd);
+    REQUIRE(fsCopy.fileDescriptorExists(newFd));
+    REQUIRE(!fs.fileDescriptorExists(newFd));
+
+    // Out-of-range fds don't exist
+    REQUIRE(!fs.fileDescriptorExists(-1));
+    REQUIRE(!fs.fileDescriptorExists(1000));
+    REQUIRE(fs.getPathForFd(1000).empty());
+
+    boost::filesystem::remove(realPath);
+}
 }
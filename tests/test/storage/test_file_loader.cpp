@@ -18,6 +18,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
 
+#include <filesystem>
 #include <stdlib.h>
 
 using namespace storage;
@@ -227,4 +228,38 @@ TEST_CASE_METHOD(FileLoaderTestFixture,
     storage::FileLoader loader;
     REQUIRE_THROWS(loader.uploadPythonFunction(msg));
 }
+
+TEST_CASE("Test resolving paths under a root", "[storage]")
+{
+    std::filesystem::path root = "/tmp/faasm-resolve-test/root";
+    std::filesystem::remove_all(root.parent_path());
+    std::filesystem::create_directories(root / "dir");
+
+    std::string rootStr = root.string();
+    REQUIRE(resolvePathUnder(rootStr, "dir/file.txt") ==
+            rootStr + "/dir/file.txt");
+    REQUIRE(resolvePathUnder(rootStr, "/dir/file.txt") ==
+            rootStr + "/dir/file.txt");
+    REQUIRE(resolvePathUnder(rootStr, "dir/../file.txt") ==
+            rootStr + "/file.txt");
+
+    REQUIRE(resolvePathUnder(rootStr, "").empty());
+    REQUIRE(resolvePathUnder(rootStr, ".").empty());
+    REQUIRE(resolvePathUnder(rootStr, "../other").empty());
+    REQUIRE(resolvePathUnder(rootStr, "dir/../../other").empty());
+
+    // Symlinks out of the root are followed
+    std::filesystem::create_directory_symlink("/etc", root / "link");
+    REQUIRE(resolvePathUnder(rootStr, "link/hosts").empty());
+    REQUIRE(!isPathInside(rootStr, rootStr + "/link/hosts"));
+    REQUIRE(isPathInside(rootStr, rootStr + "/dir/file.txt"));
+
+    REQUIRE(isValidPathComponent("demo"));
+    REQUIRE(isValidPathComponent("my_func-2.1"));
+    REQUIRE(!isValidPathComponent(""));
+    REQUIRE(!isValidPathComponent(".."));
+    REQUIRE(!isValidPathComponent("a/b"));
+
+    std::filesystem::remove_all(root.parent_path());
+}
 }
@@ -0,0 +1,217 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/bytes.h>
+#include <faabric/util/files.h>
+
+#include <storage/FileSystem.h>
+#include <storage/RuntimeImage.h>
+
+#include <WAVM/WASI/WASIABI.h>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using namespace storage;
+
+namespace tests {
+
+class RuntimeImageTestFixture : public FaasmConfTestFixture
+{
+  public:
+    RuntimeImageTestFixture()
+    {
+        boost::filesystem::remove_all(sourceDir);
+        boost::filesystem::create_directories(sourceDir + "/lib/pkg");
+        boost::filesystem::create_directories(sourceDir + "/empty");
+
+        faabric::util::writeBytesToFile(sourceDir + "/top.txt", contentsA);
+        faabric::util::writeBytesToFile(sourceDir + "/lib/pkg/mod.py",
+                                        contentsB);
+        faabric::util::writeBytesToFile(sourceDir + "/lib/pkg/zz.py",
+                                        contentsA);
+
+        RuntimeImage::build(sourceDir, imagePath);
+        resetRuntimeImage();
+    }
+
+    ~RuntimeImageTestFixture()
+    {
+        resetRuntimeImage();
+        boost::filesystem::remove_all(sourceDir);
+        boost::filesystem::remove(imagePath);
+    }
+
+  protected:
+    std::string sourceDir = "/tmp/faasm_runtime_image_src";
+    std::string imagePath = "/tmp/faasm_runtime_image.img";
+
+    std::vector<uint8_t> contentsA = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    std::vector<uint8_t> contentsB = { 9, 8, 7 };
+};
+
+TEST_CASE_METHOD(RuntimeImageTestFixture,
+                 "Test building and reading a runtime image",
+                 "[storage]")
+{
+    RuntimeImage image(imagePath);
+
+    // Root, top.txt, lib, empty, pkg, mod.py, zz.py
+    REQUIRE(image.getEntryCount() == 7);
+
+    const RuntimeImageEntry* root = image.lookup("/");
+    REQUIRE(root != nullptr);
+    REQUIRE(image.isDirectory(root));
+    REQUIRE(image.lookup(".") == root);
+    REQUIRE(image.lookup("") == root);
+
+    const RuntimeImageEntry* mod = image.lookup("lib/pkg/mod.py");
+    REQUIRE(mod != nullptr);
+    REQUIRE(!image.isDirectory(mod));
+    REQUIRE(image.lookup("/lib/pkg/mod.py") == mod);
+    REQUIRE(image.lookup("./lib/../lib/pkg//mod.py") == mod);
+
+    std::span<const uint8_t> data = image.getFileData(mod);
+    REQUIRE(std::vector<uint8_t>(data.begin(), data.end()) == contentsB);
+
+    REQUIRE(image.lookup("lib/pkg/missing.py") == nullptr);
+    REQUIRE(image.lookup("top.txt/foo") == nullptr);
+
+    Stat modStat = image.stat(mod);
+    REQUIRE(!modStat.failed);
+    REQUIRE(modStat.wasiFiletype == __WASI_FILETYPE_REGULAR_FILE);
+    REQUIRE(modStat.st_size == contentsB.size());
+
+    Stat dirStat = image.stat(image.lookup("lib/pkg"));
+    REQUIRE(dirStat.wasiFiletype == __WASI_FILETYPE_DIRECTORY);
+
+    DirListing listing = image.getListing(image.lookup("lib/pkg"));
+    std::vector<std::string> actualPaths;
+    for (const auto& d : *listing) {
+        actualPaths.push_back(d.path);
+    }
+    std::vector<std::string> expectedPaths = { ".", "..", "mod.py", "zz.py" };
+    REQUIRE(actualPaths == expectedPaths);
+
+    // Listings are shared
+    REQUIRE(image.getListing(image.lookup("lib/pkg")) == listing);
+}
+
+TEST_CASE_METHOD(RuntimeImageTestFixture,
+                 "Test serving file descriptors from a runtime image",
+                 "[storage]")
+{
+    // Point the runtime root somewhere empty to make sure we're only
+    // reading from the image
+    faasmConf.runtimeFilesDir = "/tmp/faasm_runtime_image_missing";
+    faasmConf.runtimeImagePath = imagePath;
+
+    FileSystem fs;
+    fs.prepareFilesystem();
+
+    FileDescriptor& rootFd = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    REQUIRE(rootFd.isImageBacked());
+
+    // Stat through the root
+    Stat fileStat = rootFd.stat("top.txt");
+    REQUIRE(!fileStat.failed);
+    REQUIRE(fileStat.st_size == contentsA.size());
+
+    // Open and read in two chunks
+    int fileFd =
+      fs.openFileDescriptor(DEFAULT_ROOT_FD, "top.txt", 0, 0, 0, 0, 0);
+    REQUIRE(fileFd > 0);
+    FileDescriptor& fileDesc = fs.getFileDescriptor(fileFd);
+    REQUIRE(fileDesc.isImageBacked());
+
+    std::vector<uint8_t> bufA(4);
+    std::vector<uint8_t> bufB(10);
+    std::vector<::iovec> iovecs = { { bufA.data(), bufA.size() },
+                                    { bufB.data(), bufB.size() } };
+    ssize_t bytesRead = fileDesc.read(iovecs, 2);
+    REQUIRE(bytesRead == contentsA.size());
+    REQUIRE(fileDesc.tell() == contentsA.size());
+
+    std::vector<uint8_t> expectedA(contentsA.begin(), contentsA.begin() + 4);
+    std::vector<uint8_t> expectedB(contentsA.begin() + 4, contentsA.end());
+    REQUIRE(bufA == expectedA);
+    REQUIRE(std::vector<uint8_t>(bufB.begin(), bufB.begin() + 5) == expectedB);
+
+    // Seek back and read again
+    uint64_t newOffset = 0;
+    REQUIRE(fileDesc.seek(-2, __WASI_WHENCE_END, &newOffset) ==
+            __WASI_ESUCCESS);
+    REQUIRE(newOffset == contentsA.size() - 2);
+
+    std::vector<::iovec> iovecsB = { { bufA.data(), bufA.size() } };
+    REQUIRE(fileDesc.read(iovecsB, 1) == 2);
+    REQUIRE(bufA.at(0) == contentsA.at(contentsA.size() - 2));
+
+    // Iterate through a directory
+    int dirFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, "lib/pkg", 0, 0, 0, __WASI_O_DIRECTORY, 0);
+    REQUIRE(dirFd > 0);
+    FileDescriptor& dirDesc = fs.getFileDescriptor(dirFd);
+
+    std::vector<std::string> actualPaths;
+    while (!dirDesc.iterFinished()) {
+        actualPaths.push_back(dirDesc.iterNext().path);
+    }
+    std::vector<std::string> expectedPaths = { ".", "..", "mod.py", "zz.py" };
+    REQUIRE(actualPaths == expectedPaths);
+
+    // Opening a file as a directory fails
+    int badFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, "top.txt", 0, 0, 0, __WASI_O_DIRECTORY, 0);
+    REQUIRE(badFd == -1 * __WASI_ENOTDIR);
+
+    // Missing files fall through to the (empty) runtime root
+    int missingFd =
+      fs.openFileDescriptor(DEFAULT_ROOT_FD, "missing.txt", 0, 0, 0, 0, 0);
+    REQUIRE(missingFd == -1 * __WASI_ENOENT);
+
+    // Open files keep working after the image is dropped
+    resetRuntimeImage();
+    REQUIRE(fileDesc.seek(0, __WASI_WHENCE_SET, &newOffset) ==
+            __WASI_ESUCCESS);
+    REQUIRE(fileDesc.read(iovecsB, 1) == bufA.size());
+    REQUIRE(bufA == expectedA);
+}
+
+TEST_CASE_METHOD(RuntimeImageTestFixture,
+                 "Test rejecting corrupt runtime images",
+                 "[storage]")
+{
+    std::vector<uint8_t> bytes = faabric::util::readFileToBytes(imagePath);
+    RuntimeImageHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    auto* entries =
+      reinterpret_cast<RuntimeImageEntry*>(bytes.data() + header.indexOffset);
+
+    SECTION("File data past the end")
+    {
+        uint32_t i = 0;
+        while (S_ISDIR(entries[i].mode)) {
+            i++;
+        }
+        entries[i].size = bytes.size();
+    }
+
+    SECTION("Children past the index")
+    {
+        entries[0].nChildren = header.nEntries;
+    }
+
+    SECTION("Name past the names table") { entries[1].nameLen = bytes.size(); }
+
+    SECTION("Parent past the index")
+    {
+        entries[1].parentIdx = header.nEntries;
+    }
+
+    faabric::util::writeBytesToFile(imagePath, bytes);
+    REQUIRE_THROWS(std::make_unique<RuntimeImage>(imagePath));
+}
+}
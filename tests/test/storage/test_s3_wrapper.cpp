@@ -75,6 +75,29 @@ TEST_CASE_METHOD(S3TestFixture, "Test read/write keys in bucket", "[s3]")
         REQUIRE(actualB == byteDataB);
     }
 
+    SECTION("Test async and parallel byte reads")
+    {
+        s3.addKeyBytes(faasmConf.s3Bucket, "alpha", byteDataA);
+        s3.addKeyBytes(faasmConf.s3Bucket, "beta", byteDataB);
+
+        auto futureA = s3.getKeyBytesAsync(faasmConf.s3Bucket, "alpha");
+        REQUIRE(futureA.get() == byteDataA);
+
+        SECTION("No hedging") { faasmConf.s3HedgeDelayMs = 0; }
+
+        SECTION("Immediate hedging") { faasmConf.s3HedgeDelayMs = 1; }
+
+        std::vector<std::vector<uint8_t>> actual = s3.getKeysBytes(
+          faasmConf.s3Bucket, { "beta", "blahblah", "alpha" }, true);
+        std::vector<std::vector<uint8_t>> expected = { byteDataB,
+                                                       {},
+                                                       byteDataA };
+        REQUIRE(actual == expected);
+
+        REQUIRE_THROWS(
+          s3.getKeysBytes(faasmConf.s3Bucket, { "alpha", "blahblah" }));
+    }
+
     SECTION("Test tolerate missing key")
     {
         const std::vector<uint8_t> actual =
@@ -6,6 +6,7 @@
 #include <boost/filesystem.hpp>
 
 #include <conf/FaasmConfig.h>
+#include <faabric/util/bytes.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
 #include <storage/FileLoader.h>
@@ -54,6 +55,40 @@ TEST_CASE_METHOD(SharedFilesTestFixture, "Check sync shared file", "[storage]")
     REQUIRE(actualBytes == bytes);
 }
 
+TEST_CASE_METHOD(SharedFilesTestFixture,
+                 "Check sync shared files in parallel",
+                 "[storage]")
+{
+    std::vector<std::string> relPaths = { "shared_test_dir/batch_a.txt",
+                                          "shared_test_dir/batch_b.txt",
+                                          "shared_test_dir/batch_c.txt" };
+    std::vector<std::vector<uint8_t>> contents = { { 0, 1, 2 }, { 3, 4 }, {} };
+
+    std::vector<std::string> sharedPaths;
+    for (size_t i = 0; i < relPaths.size(); i++) {
+        sharedPaths.emplace_back("faasm://" + relPaths.at(i));
+        boost::filesystem::remove(loader.getSharedFileFile(relPaths.at(i)));
+
+        // Leave the last file missing
+        if (!contents.at(i).empty()) {
+            loader.uploadSharedFile(relPaths.at(i), contents.at(i));
+            boost::filesystem::remove(loader.getSharedFileFile(relPaths.at(i)));
+        }
+    }
+
+    std::vector<int> expected = { 0, 0, ENOENT };
+    REQUIRE(SharedFiles::syncSharedFiles(sharedPaths) == expected);
+
+    for (int i = 0; i < 2; i++) {
+        std::string syncedPath = loader.getSharedFileFile(relPaths.at(i));
+        REQUIRE(faabric::util::readFileToBytes(syncedPath) == contents.at(i));
+    }
+
+    // Subsequent individual syncs should hit the cache
+    REQUIRE(SharedFiles::syncSharedFile(sharedPaths.at(0)) == 0);
+    REQUIRE(SharedFiles::syncSharedFile(sharedPaths.at(2)) == ENOENT);
+}
+
 TEST_CASE_METHOD(SharedFilesTestFixture, "Check sync python file", "[storage]")
 {
     // Upload a python function
@@ -100,4 +135,90 @@ TEST_CASE_METHOD(SharedFilesTestFixture, "Check sync python file", "[storage]")
     REQUIRE(actualBytes.size() == contents.size());
     REQUIRE(actualBytes == contents);
 }
+
+TEST_CASE_METHOD(SharedFilesTestFixture,
+                 "Check sync python file with precompiled bytecode",
+                 "[storage]")
+{
+    faabric::Message msg;
+    msg.set_ispython(true);
+    msg.set_pythonuser("alpha");
+    msg.set_pythonfunction("gamma");
+    msg.set_inputdata("print('hello')");
+
+    std::string pycPath = "pyfuncs/alpha/gamma/__pycache__/function.test.pyc";
+    std::vector<uint8_t> pycBytes = { 5, 4, 3, 2, 1 };
+
+    std::string indexPath = loader.getPythonBytecodeIndexRelativePath(msg);
+    REQUIRE(indexPath == "pyfuncs/alpha/gamma/bytecode.idx");
+
+    std::string runtimePycPath =
+      fmt::format("{}/{}", faasmConf.runtimeFilesDir, pycPath);
+    boost::filesystem::remove(runtimePycPath);
+
+    loader.uploadPythonFunction(msg);
+    loader.uploadSharedFile(pycPath, pycBytes);
+    loader.uploadSharedFile(indexPath,
+                            faabric::util::stringToBytes(pycPath + "\n"));
+
+    bool expectPyc = false;
+    SECTION("Precompile on")
+    {
+        faasmConf.pythonPrecompile = "on";
+        expectPyc = true;
+    }
+
+    SECTION("Precompile off")
+    {
+        faasmConf.pythonPrecompile = "off";
+    }
+
+    SharedFiles::syncPythonFunctionFile(msg);
+
+    REQUIRE(boost::filesystem::exists(runtimePycPath) == expectPyc);
+    if (expectPyc) {
+        REQUIRE(faabric::util::readFileToBytes(runtimePycPath) == pycBytes);
+    }
+}
+
+TEST_CASE_METHOD(SharedFilesTestFixture,
+                 "Check bytecode paths outside the function are not synced",
+                 "[storage]")
+{
+    faasmConf.pythonPrecompile = "on";
+
+    faabric::Message msg;
+    msg.set_ispython(true);
+    msg.set_pythonuser("alpha");
+    msg.set_pythonfunction("delta");
+    msg.set_inputdata("print('hello')");
+
+    std::string pycPath;
+    SECTION("Traversal")
+    {
+        pycPath = "pyfuncs/alpha/delta/__pycache__/../../gamma/x.pyc";
+    }
+
+    SECTION("Other function") { pycPath = "pyfuncs/beta/delta/x.pyc"; }
+
+    SECTION("Not bytecode") { pycPath = "pyfuncs/alpha/delta/__pycache__/x"; }
+
+    REQUIRE(!loader.isPythonBytecodeRelativePath(msg, pycPath));
+    REQUIRE(!loader.isPythonBytecodeRelativePath(msg, "/" + pycPath));
+    REQUIRE(loader.isPythonBytecodeRelativePath(
+      msg, "pyfuncs/alpha/delta/__pycache__/function.test.pyc"));
+
+    std::string runtimePycPath =
+      fmt::format("{}/{}", faasmConf.runtimeFilesDir, pycPath);
+    boost::filesystem::remove(runtimePycPath);
+
+    loader.uploadPythonFunction(msg);
+    loader.uploadSharedFile(pycPath, { 1, 2, 3 });
+    loader.uploadSharedFile(loader.getPythonBytecodeIndexRelativePath(msg),
+                            faabric::util::stringToBytes(pycPath + "\n"));
+
+    SharedFiles::syncPythonFunctionFile(msg);
+
+    REQUIRE(!boost::filesystem::exists(runtimePycPath));
+}
 }
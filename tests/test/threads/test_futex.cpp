@@ -0,0 +1,192 @@
+#include <catch2/catch.hpp>
+
+#include <threads/Futex.h>
+
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test futex mutex under contention", "[threads]")
+{
+    int nThreads = 8;
+    int nLoops = 10000;
+
+    int32_t word = FUTEX_MUTEX_UNLOCKED;
+    int counter = 0;
+
+    std::vector<std::thread> ts;
+    for (int i = 0; i < nThreads; i++) {
+        ts.emplace_back([&word, &counter, nLoops] {
+            for (int j = 0; j < nLoops; j++) {
+                lockFutexMutex(&word);
+                counter++;
+                unlockFutexMutex(&word);
+            }
+        });
+    }
+
+    for (auto& t : ts) {
+        t.join();
+    }
+
+    REQUIRE(counter == nThreads * nLoops);
+    REQUIRE(word == FUTEX_MUTEX_UNLOCKED);
+}
+
+TEST_CASE("Test futex mutex try lock", "[threads]")
+{
+    int32_t word = FUTEX_MUTEX_UNLOCKED;
+
+    REQUIRE(tryLockFutexMutex(&word));
+    REQUIRE(!tryLockFutexMutex(&word));
+
+    // Unlocking wakes a waiting locker
+    std::thread t([&word] {
+        lockFutexMutex(&word);
+        unlockFutexMutex(&word);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    unlockFutexMutex(&word);
+    t.join();
+
+    REQUIRE(word == FUTEX_MUTEX_UNLOCKED);
+    REQUIRE(tryLockFutexMutex(&word));
+}
+
+TEST_CASE("Test futex wait and wake", "[threads]")
+{
+    int32_t word = 0;
+
+    // Waiting on the wrong value returns straight away
+    REQUIRE(futexWait(&word, 1, 1000));
+
+    // Waiting on the right value with no-one to wake us times out
+    REQUIRE(!futexWait(&word, 0, 10));
+
+    std::thread t([&word] {
+        while (std::atomic_ref<int32_t>(word).load() == 0) {
+            futexWait(&word, 0, 1000);
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::atomic_ref<int32_t>(word).store(1);
+    futexWake(&word, 1);
+    t.join();
+
+    REQUIRE(word == 1);
+}
+
+TEST_CASE("Test futex condition producer and consumer", "[threads]")
+{
+    int nItems = 1000;
+    size_t maxQueued = 4;
+
+    int32_t mx = FUTEX_MUTEX_UNLOCKED;
+    FutexCondition notEmpty;
+    FutexCondition notFull;
+    std::queue<int> queue;
+
+    // The producer has to wait for the consumer to make room in the queue
+    std::thread producer([&] {
+        for (int i = 0; i < nItems; i++) {
+            lockFutexMutex(&mx);
+            while (queue.size() >= maxQueued) {
+                int32_t seq = notFull.prepareWait();
+                unlockFutexMutex(&mx);
+                notFull.wait(seq);
+                lockFutexMutex(&mx);
+            }
+
+            queue.push(i);
+            notEmpty.notifyOne();
+            unlockFutexMutex(&mx);
+        }
+    });
+
+    std::vector<int> consumed;
+    while (consumed.size() < nItems) {
+        lockFutexMutex(&mx);
+        while (queue.empty()) {
+            int32_t seq = notEmpty.prepareWait();
+            unlockFutexMutex(&mx);
+            notEmpty.wait(seq);
+            lockFutexMutex(&mx);
+        }
+
+        consumed.emplace_back(queue.front());
+        queue.pop();
+        notFull.notifyOne();
+        unlockFutexMutex(&mx);
+    }
+
+    producer.join();
+
+    // Everything arrives exactly once and in order
+    for (int i = 0; i < nItems; i++) {
+        REQUIRE(consumed.at(i) == i);
+    }
+}
+
+TEST_CASE("Test futex condition broadcast", "[threads]")
+{
+    int nWaiters = 5;
+
+    int32_t mx = FUTEX_MUTEX_UNLOCKED;
+    FutexCondition cond;
+    bool ready = false;
+    std::atomic<int> nWoken = 0;
+
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < nWaiters; i++) {
+        waiters.emplace_back([&] {
+            lockFutexMutex(&mx);
+            while (!ready) {
+                int32_t seq = cond.prepareWait();
+                unlockFutexMutex(&mx);
+                cond.wait(seq);
+                lockFutexMutex(&mx);
+            }
+            unlockFutexMutex(&mx);
+
+            nWoken++;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE(nWoken == 0);
+
+    // A single broadcast wakes all the waiters
+    lockFutexMutex(&mx);
+    ready = true;
+    cond.notifyAll();
+    unlockFutexMutex(&mx);
+
+    for (auto& t : waiters) {
+        t.join();
+    }
+
+    REQUIRE(nWoken == nWaiters);
+}
+
+TEST_CASE("Test futex condition timed wait", "[threads]")
+{
+    FutexCondition cond;
+
+    // Nothing notifies, so the wait times out
+    int32_t seq = cond.prepareWait();
+    REQUIRE(!cond.wait(seq, 10));
+
+    // A notify between preparing and waiting isn't missed
+    seq = cond.prepareWait();
+    cond.notifyOne();
+    REQUIRE(cond.wait(seq, 1000));
+}
+}
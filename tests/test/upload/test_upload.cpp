@@ -149,6 +149,24 @@ TEST_CASE_METHOD(UploadTestFixture, "Test upload and download", "[upload]")
         checkGet(requestB, state);
     }
 
+    SECTION("Test replacing state with a different size")
+    {
+        std::string path = fmt::format("/{}/foo/resized", STATE_URL_PART);
+        std::vector<uint8_t> stateA = { 0, 1, 2 };
+        std::vector<uint8_t> stateB = { 3, 4, 5, 6, 7, 8, 9, 10 };
+        std::vector<uint8_t> stateC = { 11 };
+
+        for (const auto& state : { stateA, stateB, stateC }) {
+            http_request putRequest = createRequest(path, state);
+            edge::UploadServer::handlePut(putRequest);
+            REQUIRE(putRequest.get_response().get().status_code() ==
+                    status_codes::OK);
+
+            http_request getRequest = createRequest(path);
+            checkGet(getRequest, state);
+        }
+    }
+
     SECTION("Test uploading function wasm file")
     {
         // Ensure environment is clean before running
@@ -333,6 +351,12 @@ TEST_CASE_METHOD(UploadTestFixture,
         SECTION("PUT") { isGet = false; }
     }
 
+    SECTION("Invalid workflow")
+    {
+        url = fmt::format("/{}/demo", WORKFLOW_URL_PART);
+        isGet = false;
+    }
+
     http_request req = createRequest(url);
 
     if (isGet) {
@@ -345,6 +369,139 @@ TEST_CASE_METHOD(UploadTestFixture,
     REQUIRE(response.status_code() == status_codes::BadRequest);
 }
 
+TEST_CASE_METHOD(UploadTestFixture,
+                 "Test upload server range and conditional requests",
+                 "[upload]")
+{
+    std::vector<uint8_t> bytes = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    std::string url;
+    std::string filePath;
+
+    SECTION("State")
+    {
+        url = fmt::format("/{}/foo/range", STATE_URL_PART);
+        checkPut(createRequest(url, bytes), 0);
+    }
+
+    SECTION("Shared file")
+    {
+        url = fmt::format("/{}/", SHARED_FILE_URL_PART);
+        filePath = "test/range.txt";
+        http_request request = createRequest(url, bytes);
+        addRequestFilePathHeader(request, filePath);
+        checkPut(request, 1);
+    }
+
+    auto doGet = [&](const std::string& headerName,
+                     const std::string& headerValue) {
+        http_request request = createRequest(url);
+        if (!filePath.empty()) {
+            addRequestFilePathHeader(request, filePath);
+        }
+        if (!headerName.empty()) {
+            request.headers().add(headerName, headerValue);
+        }
+
+        edge::UploadServer::handleGet(request);
+        return request.get_response().get();
+    };
+
+    // Plain request gets everything along with the ETag
+    http_response response = doGet("", "");
+    REQUIRE(response.status_code() == status_codes::OK);
+    REQUIRE(response.headers().has(header_names::etag));
+    std::string etag = response.headers()[header_names::etag];
+    REQUIRE(response.extract_vector().get() == bytes);
+
+    // Matching ETag means nothing is sent
+    response = doGet(header_names::if_none_match, etag);
+    REQUIRE(response.status_code() == status_codes::NotModified);
+
+    response = doGet(header_names::if_none_match, "\"blah\"");
+    REQUIRE(response.status_code() == status_codes::OK);
+    REQUIRE(response.extract_vector().get() == bytes);
+
+    // Ranges
+    std::string rangeHeader;
+    std::vector<uint8_t> expectedBytes;
+    std::string expectedContentRange;
+    SECTION("Start and end")
+    {
+        rangeHeader = "bytes=2-4";
+        expectedBytes = { 2, 3, 4 };
+        expectedContentRange = "bytes 2-4/10";
+    }
+
+    SECTION("Open ended")
+    {
+        rangeHeader = "bytes=7-";
+        expectedBytes = { 7, 8, 9 };
+        expectedContentRange = "bytes 7-9/10";
+    }
+
+    SECTION("Suffix")
+    {
+        rangeHeader = "bytes=-2";
+        expectedBytes = { 8, 9 };
+        expectedContentRange = "bytes 8-9/10";
+    }
+
+    SECTION("End past size")
+    {
+        rangeHeader = "bytes=8-100";
+        expectedBytes = { 8, 9 };
+        expectedContentRange = "bytes 8-9/10";
+    }
+
+    SECTION("Unsatisfiable")
+    {
+        rangeHeader = "bytes=20-30";
+        expectedContentRange = "bytes */10";
+    }
+
+    response = doGet(header_names::range, rangeHeader);
+    REQUIRE(response.headers()[header_names::content_range] ==
+            expectedContentRange);
+
+    if (expectedBytes.empty()) {
+        REQUIRE(response.status_code() == status_codes::RangeNotSatisfiable);
+    } else {
+        REQUIRE(response.status_code() == status_codes::PartialContent);
+        REQUIRE(response.extract_vector().get() == expectedBytes);
+    }
+}
+
+TEST_CASE_METHOD(UploadTestFixture,
+                 "Test state ETags follow writes made outside the server",
+                 "[upload]")
+{
+    std::vector<uint8_t> bytes = { 0, 1, 2, 3, 4 };
+    std::string url = fmt::format("/{}/foo/etag", STATE_URL_PART);
+    checkPut(createRequest(url, bytes), 0);
+
+    http_request request = createRequest(url);
+    edge::UploadServer::handleGet(request);
+    http_response response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::OK);
+    std::string etag = response.headers()[header_names::etag];
+
+    // A function pushing the key changes the value without going through
+    // the upload server
+    std::vector<uint8_t> newBytes = { 5, 6, 7, 8, 9 };
+    auto kv =
+      faabric::state::getGlobalState().getKV("foo", "etag", newBytes.size());
+    kv->set(newBytes.data());
+    kv->pushFull();
+
+    request = createRequest(url);
+    request.headers().add(header_names::if_none_match, etag);
+    edge::UploadServer::handleGet(request);
+    response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::OK);
+    REQUIRE(response.headers()[header_names::etag] != etag);
+    REQUIRE(response.extract_vector().get() == newBytes);
+}
+
 TEST_CASE_METHOD(UploadTestFixture, "Test upload server ping", "[upload]")
 {
     http_request req = createRequest("/ping");
@@ -0,0 +1,125 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <faabric/util/func.h>
+#include <faabric/util/memory.h>
+#include <wamr/WAMRWasmModule.h>
+
+namespace tests {
+
+class WAMRStateTestFixture
+  : public MultiRuntimeFunctionExecTestFixture
+  , public StateFixture
+{
+  public:
+    WAMRStateTestFixture() { faasmConf.wasmVm = "wamr"; }
+};
+
+TEST_CASE_METHOD(WAMRStateTestFixture, "Test WAMR state functions", "[wamr]")
+{
+    std::string function;
+    std::string expectedOutput;
+
+    SECTION("Async")
+    {
+        function = "state_async";
+        expectedOutput = "equal";
+    }
+
+    SECTION("Offset")
+    {
+        function = "state_offset";
+        expectedOutput = "success";
+    }
+
+    SECTION("Size") { function = "state_size"; }
+
+    SECTION("File") { function = "state_file"; }
+
+    SECTION("Append") { function = "state_append"; }
+
+    auto req = setUpContext("demo", function);
+    faabric::Message result = executeWithPool(req).at(0);
+    REQUIRE(result.returnvalue() == 0);
+
+    if (!expectedOutput.empty()) {
+        REQUIRE(result.outputdata() == expectedOutput);
+    }
+}
+
+TEST_CASE_METHOD(WAMRStateTestFixture,
+                 "Test WAMR shared state pointers",
+                 "[wamr]")
+{
+    std::string writeFunction;
+    std::string readFunction;
+
+    SECTION("Whole value")
+    {
+        writeFunction = "state_shared_write";
+        readFunction = "state_shared_read";
+    }
+
+    SECTION("Offset")
+    {
+        writeFunction = "state_shared_write_offset";
+        readFunction = "state_shared_read_offset";
+    }
+
+    auto reqWrite = setUpContext("demo", writeFunction);
+    REQUIRE(executeWithPoolGetBooleanResult(reqWrite));
+
+    auto reqRead = setUpContext("demo", readFunction);
+    REQUIRE(executeWithPoolGetBooleanResult(reqRead));
+}
+
+TEST_CASE_METHOD(WAMRStateTestFixture,
+                 "Test mapping state into WAMR memory",
+                 "[wamr]")
+{
+    auto req = setUpContext("demo", "echo");
+    wasm::WAMRWasmModule module;
+    module.bindToFunction(req->mutable_messages()->at(0));
+
+    long stateSize = 2 * faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> value(stateSize);
+    for (long i = 0; i < stateSize; i++) {
+        value.at(i) = (uint8_t)(i % 255);
+    }
+
+    auto kv = state.getKV("demo", "wamr_mapped", stateSize);
+    kv->set(value.data());
+
+    // Map the whole value
+    uint32_t wasmPtr = module.mapSharedStateMemory(kv, 0, stateSize);
+    uint8_t* hostPtr = module.wasmPointerToNative(wasmPtr);
+    REQUIRE(std::vector<uint8_t>(hostPtr, hostPtr + stateSize) == value);
+
+    // Writes through the mapping are seen in the state value
+    hostPtr[10] = 99;
+    value.at(10) = 99;
+    std::vector<uint8_t> actual(stateSize, 0);
+    kv->get(actual.data());
+    REQUIRE(actual == value);
+
+    // Map a segment at an offset
+    long offset = faabric::util::HOST_PAGE_SIZE + 5;
+    uint32_t offsetPtr = module.mapSharedStateMemory(kv, offset, 10);
+    uint8_t* offsetHostPtr = module.wasmPointerToNative(offsetPtr);
+    REQUIRE(std::vector<uint8_t>(offsetHostPtr, offsetHostPtr + 10) ==
+            std::vector<uint8_t>(value.begin() + offset,
+                                 value.begin() + offset + 10));
+
+    // Remapping after unmapping reuses the memory
+    size_t memSize = module.getMemorySizeBytes();
+    module.unmapSharedStateMemory(wasmPtr);
+    module.unmapSharedStateMemory(offsetPtr);
+
+    uint32_t newPtr = module.mapSharedStateMemory(kv, 0, stateSize);
+    uint8_t* newHostPtr = module.wasmPointerToNative(newPtr);
+    REQUIRE(std::vector<uint8_t>(newHostPtr, newHostPtr + stateSize) == value);
+    REQUIRE(module.getMemorySizeBytes() == memSize);
+}
+}
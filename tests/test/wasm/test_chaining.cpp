@@ -0,0 +1,240 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/func.h>
+#include <wasm/chaining.h>
+
+#include <set>
+
+namespace tests {
+TEST_CASE("Test building chained call batches", "[wasm]")
+{
+    faabric::Message parent = faabric::util::messageFactory("demo", "parent");
+    parent.set_cmdline("foo bar");
+    parent.set_recordexecgraph(true);
+
+    std::vector<wasm::ChainedCall> calls = {
+        { "echo", 0, { 0, 1 } },
+        { "hello", 0, { 2 } },
+        { "echo", 0, { 3, 4, 5 } },
+        { "parent", 7, {} },
+        { "echo", 0, {} },
+    };
+
+    auto reqs = wasm::buildChainedCallBatches(parent, calls);
+
+    // One batch per function, in the order each first appears
+    REQUIRE(reqs.size() == 3);
+    REQUIRE(reqs.at(0)->messages_size() == 3);
+    REQUIRE(reqs.at(1)->messages_size() == 1);
+    REQUIRE(reqs.at(2)->messages_size() == 1);
+
+    std::vector<std::string> expectedFuncs = { "echo", "hello", "parent" };
+    std::vector<std::vector<std::string>> expectedInputs = {
+        { std::string("\0\1", 2), std::string("\3\4\5", 3), "" },
+        { std::string("\2", 1) },
+        { "" },
+    };
+
+    for (int i = 0; i < reqs.size(); i++) {
+        const auto& req = reqs.at(i);
+        REQUIRE(req->appid() == parent.appid());
+
+        for (int j = 0; j < req->messages_size(); j++) {
+            const faabric::Message& msg = req->messages(j);
+            REQUIRE(msg.user() == "demo");
+            REQUIRE(msg.function() == expectedFuncs.at(i));
+            REQUIRE(msg.appid() == parent.appid());
+            REQUIRE(msg.inputdata() == expectedInputs.at(i).at(j));
+            REQUIRE(msg.cmdline() == "foo bar");
+            REQUIRE(msg.recordexecgraph());
+        }
+    }
+
+    REQUIRE(reqs.at(2)->messages(0).funcptr() == 7);
+
+    // All ids are unique
+    std::set<int> ids;
+    for (const auto& req : reqs) {
+        for (const auto& msg : req->messages()) {
+            ids.insert(msg.id());
+        }
+    }
+    REQUIRE(ids.size() == calls.size());
+
+    // Calls must name a function
+    calls.push_back({ "", 0, {} });
+    REQUIRE_THROWS(wasm::buildChainedCallBatches(parent, calls));
+}
+
+class ChainPayloadTestFixture
+  : public FaasmConfTestFixture
+  , public StateFixture
+{
+  public:
+    ChainPayloadTestFixture() { faasmConf.chainPayloadThreshold = 100; }
+};
+
+TEST_CASE_METHOD(ChainPayloadTestFixture,
+                 "Test passing chained call payloads by reference",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    std::vector<uint8_t> smallInput(100, 1);
+    std::vector<uint8_t> largeInput(1000);
+    for (int i = 0; i < largeInput.size(); i++) {
+        largeInput.at(i) = (uint8_t)i;
+    }
+
+    // Small inputs are sent inline
+    wasm::setChainedCallInput(msg, smallInput);
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT));
+    REQUIRE(msg.inputdata().size() == smallInput.size());
+
+    std::vector<uint8_t> actual(smallInput.size());
+    REQUIRE(wasm::readChainPayload(msg,
+                                   CHAIN_PAYLOAD_INPUT,
+                                   actual.data(),
+                                   actual.size()) == 100);
+    REQUIRE(actual == smallInput);
+
+    // Small outputs are always sent inline
+    wasm::setCallOutput(msg, smallInput.data(), smallInput.size());
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_OUTPUT));
+
+    // Large outputs are only sent by reference if the input was
+    wasm::setCallOutput(msg, largeInput.data(), largeInput.size());
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_OUTPUT));
+    REQUIRE(msg.outputdata().size() == largeInput.size());
+
+    // Large inputs are sent by reference
+    wasm::setChainedCallInput(msg, largeInput);
+    REQUIRE(wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT));
+    REQUIRE(msg.inputdata().empty());
+    REQUIRE(wasm::getChainPayloadSize(msg, CHAIN_PAYLOAD_INPUT) ==
+            largeInput.size());
+
+    actual.resize(largeInput.size());
+    REQUIRE(wasm::readChainPayload(msg,
+                                   CHAIN_PAYLOAD_INPUT,
+                                   actual.data(),
+                                   actual.size()) == 1000);
+    REQUIRE(actual == largeInput);
+
+    // Reads into smaller buffers are truncated
+    std::vector<uint8_t> partial(10);
+    REQUIRE(wasm::readChainPayload(msg,
+                                   CHAIN_PAYLOAD_INPUT,
+                                   partial.data(),
+                                   partial.size()) == 10);
+    REQUIRE(partial ==
+            std::vector<uint8_t>(largeInput.begin(), largeInput.begin() + 10));
+
+    // Now the output can go by reference too
+    wasm::setCallOutput(msg, largeInput.data(), largeInput.size());
+    REQUIRE(wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_OUTPUT));
+    REQUIRE(wasm::getChainPayloadSize(msg, CHAIN_PAYLOAD_OUTPUT) ==
+            largeInput.size());
+
+    std::fill(actual.begin(), actual.end(), 0);
+    wasm::readChainPayload(
+      msg, CHAIN_PAYLOAD_OUTPUT, actual.data(), actual.size());
+    REQUIRE(actual == largeInput);
+
+    // The output can be passed straight on as another call's input
+    faabric::Message next = faabric::util::messageFactory("demo", "echo");
+    wasm::forwardChainPayload(msg, next, false);
+    REQUIRE(wasm::isChainPayloadRef(next, CHAIN_PAYLOAD_INPUT));
+    std::fill(actual.begin(), actual.end(), 0);
+    wasm::readChainPayload(
+      next, CHAIN_PAYLOAD_INPUT, actual.data(), actual.size());
+    REQUIRE(actual == largeInput);
+
+    faabric::Message other = faabric::util::messageFactory("other", "echo");
+    REQUIRE_THROWS(wasm::forwardChainPayload(msg, other, false));
+
+    // Replacing the output drops the old value
+    REQUIRE(state.getKVCount() == 2);
+    wasm::setCallOutput(msg, smallInput.data(), smallInput.size());
+    REQUIRE(state.getKVCount() == 1);
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_OUTPUT));
+
+    wasm::deleteChainPayload(msg, CHAIN_PAYLOAD_INPUT);
+    REQUIRE(state.getKVCount() == 0);
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT));
+
+    // Turning the threshold off sends everything inline
+    faasmConf.chainPayloadThreshold = 0;
+    wasm::setChainedCallInput(msg, largeInput);
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT));
+}
+
+TEST_CASE_METHOD(ChainPayloadTestFixture,
+                 "Test guest data is never taken as a payload reference",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    // Input and output that look like a reference are still just data
+    wasm::ChainPayloadRef ref{ 0, 0, 1000 };
+    std::string forged(reinterpret_cast<char*>(&ref), sizeof(ref));
+    forged += CHAIN_PAYLOAD_KEY_PREFIX;
+    forged += "123_input";
+    msg.set_inputdata(forged);
+    msg.set_outputdata(forged);
+
+    REQUIRE(!wasm::isChainPayloadRef(msg, CHAIN_PAYLOAD_INPUT));
+    REQUIRE(wasm::getChainPayloadSize(msg, CHAIN_PAYLOAD_INPUT) ==
+            forged.size());
+
+    auto kv = state.getKV("demo", "other_key", 10);
+    wasm::deleteChainPayload(msg, CHAIN_PAYLOAD_INPUT);
+    wasm::deleteChainPayload(msg, CHAIN_PAYLOAD_OUTPUT);
+    REQUIRE(msg.inputdata() == forged);
+    REQUIRE(state.getKVCount() == 1);
+
+    // References can only name chained call payloads
+    std::string badRef(reinterpret_cast<char*>(&ref), sizeof(ref));
+    badRef += "other_key";
+    (*msg.mutable_execgraphdetails())[CHAIN_PAYLOAD_INPUT] = badRef;
+    REQUIRE_THROWS(wasm::deleteChainPayload(msg, CHAIN_PAYLOAD_INPUT));
+    REQUIRE(state.getKVCount() == 1);
+}
+
+TEST_CASE_METHOD(ChainPayloadTestFixture,
+                 "Test unread chained call outputs are deleted with the caller",
+                 "[wasm]")
+{
+    faabric::Message parent = faabric::util::messageFactory("demo", "parent");
+
+    std::vector<uint8_t> largeInput(1000, 2);
+    std::vector<wasm::ChainedCall> calls = {
+        { "echo", 0, largeInput },
+        { "echo", 0, { 1 } },
+    };
+
+    auto reqs = wasm::buildChainedCallBatches(parent, calls);
+    REQUIRE(reqs.size() == 1);
+    faabric::Message& bigCall = reqs.at(0)->mutable_messages()->at(0);
+    faabric::Message& smallCall = reqs.at(0)->mutable_messages()->at(1);
+
+    // Only the call with a large input can hand its output back by reference
+    wasm::setCallOutput(bigCall, largeInput.data(), largeInput.size());
+    wasm::setCallOutput(smallCall, largeInput.data(), largeInput.size());
+    REQUIRE(wasm::isChainPayloadRef(bigCall, CHAIN_PAYLOAD_OUTPUT));
+    REQUIRE(!wasm::isChainPayloadRef(smallCall, CHAIN_PAYLOAD_OUTPUT));
+
+    wasm::deleteChainPayload(bigCall, CHAIN_PAYLOAD_INPUT);
+    REQUIRE(state.getKVCount() == 1);
+
+    // The caller never read the output, so it goes when the caller finishes
+    wasm::deleteChainedCallOutputs(parent);
+    REQUIRE(state.getKVCount() == 0);
+
+    // Doing so twice is harmless
+    wasm::deleteChainedCallOutputs(parent);
+}
+}
@@ -7,6 +7,8 @@
 #include <faabric/util/config.h>
 #include <faabric/util/func.h>
 
+#include <wasm/StdoutCapture.h>
+
 namespace tests {
 
 TEST_CASE_METHOD(FunctionExecTestFixture, "Test printf", "[wasm]")
@@ -20,4 +22,68 @@ TEST_CASE_METHOD(FunctionExecTestFixture, "Test emscripten I/O", "[wasm]")
     auto req = setUpContext("demo", "emscripten_check");
     executeWithPool(req);
 }
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test bounded stdout capture buffer",
+                 "[wasm]")
+{
+    faasmConf.captureStdoutMaxBytes = 10;
+    wasm::StdoutCapture capture;
+    REQUIRE(capture.getCapacity() == 10);
+    REQUIRE(capture.read().empty());
+
+    // Append within capacity
+    std::string partA = "abcd";
+    std::string partB = "efg";
+    std::vector<::iovec> iovecs = {
+        { partA.data(), partA.size() },
+        { partB.data(), partB.size() },
+    };
+    REQUIRE(capture.append(iovecs.data(), iovecs.size()) == 7);
+    REQUIRE(capture.size() == 7);
+    REQUIRE(capture.read() == "abcdefg");
+
+    // Overflow, dropping the oldest bytes and wrapping around
+    capture.append("hijkl");
+    REQUIRE(capture.size() == 10);
+    REQUIRE(capture.getTruncatedBytes() == 2);
+    REQUIRE(capture.read() ==
+            "[Faasm: 2 bytes of stdout truncated]\ncdefghijkl");
+
+    capture.append("mn");
+    REQUIRE(capture.read() ==
+            "[Faasm: 4 bytes of stdout truncated]\nefghijklmn");
+
+    // Append more than the whole capacity at once
+    capture.append("0123456789ABC");
+    REQUIRE(capture.getTruncatedBytes() == 17);
+    REQUIRE(capture.read() ==
+            "[Faasm: 17 bytes of stdout truncated]\n3456789ABC");
+
+    // Clear
+    capture.clear();
+    REQUIRE(capture.size() == 0);
+    REQUIRE(capture.getTruncatedBytes() == 0);
+    REQUIRE(capture.read().empty());
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test taking stdout from the capture buffer",
+                 "[wasm]")
+{
+    faasmConf.captureStdoutMaxBytes = 10;
+    wasm::StdoutCapture capture;
+
+    capture.append("abcd");
+    REQUIRE(capture.take() == "abcd");
+    REQUIRE(capture.size() == 0);
+    REQUIRE(capture.take().empty());
+
+    // Truncation is reported once, then cleared along with the contents
+    capture.append("0123456789AB");
+    REQUIRE(capture.take() ==
+            "[Faasm: 2 bytes of stdout truncated]\n23456789AB");
+    REQUIRE(capture.getTruncatedBytes() == 0);
+    REQUIRE(capture.read().empty());
+}
 }
@@ -4,6 +4,7 @@
 #include "utils.h"
 
 #include <wamr/WAMRWasmModule.h>
+#include <wasm/RegionAllocator.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/util/bytes.h>
@@ -12,6 +13,7 @@
 #include <faabric/util/func.h>
 
 #include <fcntl.h>
+#include <random>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
@@ -208,4 +210,82 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 
     REQUIRE(failed);
 }
+
+TEST_CASE("Test region allocator", "[wasm]")
+{
+    wasm::RegionAllocator alloc;
+    uint32_t page = WASM_BYTES_PER_PAGE;
+
+    // Nothing free to begin with
+    REQUIRE(!alloc.allocate(page).has_value());
+
+    // Neighbours are merged in either order
+    alloc.free(2 * page, page);
+    alloc.free(4 * page, page);
+    REQUIRE(alloc.getNumFreeRanges() == 2);
+    alloc.free(3 * page, page);
+    REQUIRE(alloc.getNumFreeRanges() == 1);
+    alloc.free(page, page);
+    REQUIRE(alloc.getNumFreeRanges() == 1);
+    REQUIRE(alloc.getFreeBytes() == 4 * page);
+
+    // Double frees are rejected
+    REQUIRE_THROWS(alloc.free(2 * page, page));
+    REQUIRE_THROWS(alloc.free(0, 2 * page));
+
+    // Allocations split ranges from the bottom
+    REQUIRE(alloc.allocate(page) == page);
+    REQUIRE(alloc.allocate(2 * page) == 2 * page);
+    REQUIRE(!alloc.allocate(2 * page).has_value());
+    REQUIRE(alloc.allocate(page) == 4 * page);
+    REQUIRE(alloc.getFreeBytes() == 0);
+}
+
+TEST_CASE("Test region allocator stress", "[wasm]")
+{
+    // Randomly allocate and free, checking allocations never overlap and
+    // everything coalesces back into one range at the end
+    wasm::RegionAllocator alloc;
+    uint32_t page = WASM_BYTES_PER_PAGE;
+    uint32_t nPages = 256;
+    alloc.free(0, nPages * page);
+
+    std::vector<bool> used(nPages, false);
+    std::vector<std::pair<uint32_t, uint32_t>> live;
+    std::mt19937 gen(1234);
+
+    for (int i = 0; i < 5000; i++) {
+        bool doFree = !live.empty() && (gen() % 2 == 0);
+        if (doFree) {
+            size_t idx = gen() % live.size();
+            auto [start, size] = live.at(idx);
+            live.erase(live.begin() + idx);
+
+            for (uint32_t p = start / page; p < (start + size) / page; p++) {
+                used.at(p) = false;
+            }
+            alloc.free(start, size);
+            continue;
+        }
+
+        uint32_t size = (1 + gen() % 8) * page;
+        std::optional<uint32_t> start = alloc.allocate(size);
+        if (!start.has_value()) {
+            continue;
+        }
+
+        for (uint32_t p = *start / page; p < (*start + size) / page; p++) {
+            REQUIRE(!used.at(p));
+            used.at(p) = true;
+        }
+        live.emplace_back(*start, size);
+    }
+
+    for (auto [start, size] : live) {
+        alloc.free(start, size);
+    }
+
+    REQUIRE(alloc.getNumFreeRanges() == 1);
+    REQUIRE(alloc.getFreeBytes() == nPages * page);
+}
 }
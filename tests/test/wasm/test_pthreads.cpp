@@ -0,0 +1,135 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <threads/Futex.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+namespace tests {
+
+// These drive the module functions behind the pthread_mutex_* and
+// pthread_cond_* intrinsics, with the mutex, condition and guest data all in
+// wasm memory
+class PthreadModuleTestFixture : public FunctionExecTestFixture
+{
+  public:
+    PthreadModuleTestFixture()
+    {
+        faabric::Message call = faabric::util::messageFactory("demo", "echo");
+        module.bindToFunction(call);
+
+        uint32_t base = module.mmapMemory(1);
+        mx = base;
+        cond = base + 8;
+        ready = base + 16;
+
+        module.initPthreadMutex(mx);
+    }
+
+    int32_t* nativeWord(uint32_t wasmPtr)
+    {
+        return reinterpret_cast<int32_t*>(module.wasmPointerToNative(wasmPtr));
+    }
+
+    void setDistributed()
+    {
+        auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+        req->set_type(faabric::BatchExecuteRequest::THREADS);
+        req->set_singlehost(false);
+        module.setDistributedPthreads(*req);
+    }
+
+  protected:
+    wasm::WAVMWasmModule module;
+
+    uint32_t mx = 0;
+    uint32_t cond = 0;
+    uint32_t ready = 0;
+};
+
+TEST_CASE_METHOD(PthreadModuleTestFixture,
+                 "Test pthread condition wait and signal",
+                 "[wasm][threads]")
+{
+    std::atomic<int> nErrors = 0;
+    std::atomic<bool> done = false;
+    std::thread waiter([this, &nErrors, &done] {
+        module.lockPthreadMutex(mx);
+        while (*nativeWord(ready) == 0) {
+            if (module.waitPthreadCond(cond, mx) != 0) {
+                nErrors++;
+            }
+        }
+        module.unlockPthreadMutex(mx);
+        done = true;
+    });
+
+    module.lockPthreadMutex(mx);
+    *nativeWord(ready) = 1;
+    module.getOrCreatePthreadCond(cond)->notifyOne();
+    module.unlockPthreadMutex(mx);
+
+    waiter.join();
+
+    REQUIRE(nErrors == 0);
+    REQUIRE(done);
+    REQUIRE(*nativeWord(mx) == FUTEX_MUTEX_UNLOCKED);
+}
+
+TEST_CASE_METHOD(PthreadModuleTestFixture,
+                 "Test pthread condition timed wait",
+                 "[wasm][threads]")
+{
+    module.lockPthreadMutex(mx);
+    REQUIRE(module.waitPthreadCond(cond, mx, 10) == ETIMEDOUT);
+
+    // The mutex is held again on return
+    REQUIRE(!module.tryLockPthreadMutex(mx));
+    module.unlockPthreadMutex(mx);
+
+    REQUIRE(*nativeWord(mx) == FUTEX_MUTEX_UNLOCKED);
+}
+
+TEST_CASE_METHOD(PthreadModuleTestFixture,
+                 "Test pthread condition wait with distributed threads",
+                 "[wasm][threads]")
+{
+    // A mutex locked in memory before the switch is unlocked there
+    module.lockPthreadMutex(mx);
+    setDistributed();
+    module.unlockPthreadMutex(mx);
+    REQUIRE(*nativeWord(mx) == FUTEX_MUTEX_UNLOCKED);
+
+    // Mutexes are now held outside of wasm memory
+    module.lockPthreadMutex(mx);
+    REQUIRE(*nativeWord(mx) == FUTEX_MUTEX_UNLOCKED);
+
+    // Nothing signals, but the wait wakes spuriously rather than blocking
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(module.waitPthreadCond(cond, mx) == 0);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    REQUIRE(elapsed < 1000);
+
+    // Timed waits shorter than the bound still time out
+    REQUIRE(module.waitPthreadCond(cond, mx, 1) == ETIMEDOUT);
+
+    // The mutex is held again on return
+    bool lockedElsewhere = true;
+    std::thread t([this, &lockedElsewhere] {
+        lockedElsewhere = module.tryLockPthreadMutex(mx);
+    });
+    t.join();
+    REQUIRE(!lockedElsewhere);
+
+    module.unlockPthreadMutex(mx);
+}
+}
@@ -0,0 +1,157 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/func.h>
+#include <wasm/streams.h>
+
+#include <thread>
+
+namespace tests {
+
+class StreamsTestFixture
+  : public FaasmConfTestFixture
+  , public StateFixture
+{
+  public:
+    StreamsTestFixture() { faasmConf.streamMaxChunks = 2; }
+};
+
+TEST_CASE_METHOD(StreamsTestFixture, "Test streaming chunks", "[wasm]")
+{
+    faabric::Message reader = faabric::util::messageFactory("demo", "chain");
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    wasm::addStreamReader(reader, msg);
+    int nChunks = 10;
+
+    // The producer can only get two chunks ahead of the reader
+    std::thread producer([&msg, nChunks] {
+        for (int i = 0; i < nChunks; i++) {
+            std::vector<uint8_t> chunk(i + 1, (uint8_t)i);
+            wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 5000);
+        }
+
+        wasm::closeStream(msg);
+    });
+
+    std::vector<uint8_t> buffer(100);
+    for (int i = 0; i < nChunks; i++) {
+        // Buffers too small for the chunk leave it in place
+        if (i == 5) {
+            REQUIRE(wasm::readStreamChunk(
+                      msg.appid(), "demo", msg.id(), buffer.data(), 2, 5000) ==
+                    6);
+        }
+
+        int chunkSize = wasm::readStreamChunk(
+          msg.appid(), "demo", msg.id(), buffer.data(), buffer.size(), 5000);
+        REQUIRE(chunkSize == i + 1);
+
+        std::vector<uint8_t> expected(i + 1, (uint8_t)i);
+        REQUIRE(std::vector<uint8_t>(buffer.begin(),
+                                     buffer.begin() + chunkSize) == expected);
+    }
+
+    producer.join();
+
+    // Closed streams report their end, and are removed once read
+    REQUIRE(wasm::readStreamChunk(
+              msg.appid(), "demo", msg.id(), buffer.data(), buffer.size(), 0) ==
+            0);
+
+    wasm::detachStreams(reader);
+    REQUIRE(state.getKVCount() == 0);
+}
+
+TEST_CASE_METHOD(StreamsTestFixture,
+                 "Test emitting to a full stream times out",
+                 "[wasm]")
+{
+    faabric::Message reader = faabric::util::messageFactory("demo", "chain");
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    wasm::addStreamReader(reader, msg);
+    std::vector<uint8_t> chunk(10, 1);
+
+    // Once the reader starts reading, the producer waits for it
+    std::vector<uint8_t> buffer(100);
+    wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+    REQUIRE(wasm::readStreamChunk(msg.appid(),
+                                  "demo",
+                                  msg.id(),
+                                  buffer.data(),
+                                  buffer.size(),
+                                  100) == chunk.size());
+
+    wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+    wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+    REQUIRE_THROWS(
+      wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100));
+
+    wasm::closeStream(msg);
+    wasm::detachStreams(reader);
+    REQUIRE(state.getKVCount() == 0);
+}
+
+TEST_CASE_METHOD(StreamsTestFixture,
+                 "Test streams without a reader",
+                 "[wasm]")
+{
+    faabric::Message reader = faabric::util::messageFactory("demo", "chain");
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    std::vector<uint8_t> chunk(10, 1);
+
+    SECTION("No reader added")
+    {
+        // Nothing can read the stream, so nothing is kept
+        for (int i = 0; i < 5; i++) {
+            wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+        }
+        REQUIRE(state.getKVCount() == 0);
+
+        wasm::closeStream(msg);
+        wasm::detachStreams(reader);
+    }
+
+    SECTION("Reader never reads")
+    {
+        wasm::addStreamReader(reader, msg);
+
+        // Emitting doesn't block until the reader starts reading
+        for (int i = 0; i < 5; i++) {
+            wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+        }
+
+        SECTION("Producer finishes first")
+        {
+            wasm::closeStream(msg);
+            REQUIRE(state.getKVCount() > 0);
+            wasm::detachStreams(reader);
+        }
+
+        SECTION("Reader finishes first")
+        {
+            wasm::detachStreams(reader);
+
+            // Anything emitted after the reader's gone is dropped
+            wasm::emitStreamChunk(msg, chunk.data(), chunk.size(), 100);
+            wasm::closeStream(msg);
+        }
+    }
+
+    REQUIRE(state.getKVCount() == 0);
+}
+
+TEST_CASE("Test callers opting in to streams", "[wasm]")
+{
+    faabric::Message caller = faabric::util::messageFactory("demo", "chain");
+
+    // Callers only read the streams of calls chained after they ask to
+    REQUIRE(!wasm::streamsChainedCalls(caller));
+
+    wasm::setStreamChainedCalls(caller, true);
+    REQUIRE(wasm::streamsChainedCalls(caller));
+
+    wasm::setStreamChainedCalls(caller, false);
+    REQUIRE(!wasm::streamsChainedCalls(caller));
+}
+}
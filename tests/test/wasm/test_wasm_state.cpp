@@ -6,8 +6,12 @@
 #include <faabric/util/func.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/state.h>
+#include <wasm/StateWriteCombiner.h>
+#include <wasm/state.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <future>
+
 using namespace WAVM;
 
 namespace tests {
@@ -86,4 +90,277 @@ TEST_CASE_METHOD(WasmStateTestFixture,
     std::vector<uint8_t> expectedB2 = { 1, 1, 1, 1, 1, markerB2, 1 };
     checkMapping(moduleB, kv, offsetB2 - 5, 7, expectedB2);
 }
+
+TEST_CASE_METHOD(WasmStateTestFixture,
+                 "Test unmapping state memory",
+                 "[wasm]")
+{
+    wasm::WAVMWasmModule module;
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    module.bindToFunction(call);
+
+    const std::string user = "demo";
+    int nKeys = 20;
+    long stateSize = 3 * faabric::util::HOST_PAGE_SIZE;
+
+    std::vector<std::shared_ptr<faabric::state::StateKeyValue>> kvs;
+    std::vector<std::vector<uint8_t>> values;
+    for (int i = 0; i < nKeys; i++) {
+        auto kv = state.getKV(user, fmt::format("unmap_{}", i), stateSize);
+        std::vector<uint8_t> value(stateSize, (uint8_t)(i + 1));
+        kv->set(value.data());
+
+        kvs.emplace_back(kv);
+        values.emplace_back(value);
+    }
+
+    // Map and unmap every key once to provision the memory
+    std::vector<uint32_t> ptrs;
+    for (int i = 0; i < nKeys; i++) {
+        checkMapping(module, kvs.at(i), 0, stateSize, values.at(i));
+        ptrs.emplace_back(module.mapSharedStateMemory(kvs.at(i), 0, stateSize));
+    }
+    for (auto ptr : ptrs) {
+        module.unmapSharedStateMemory(ptr);
+    }
+    size_t memSize = module.getMemorySizeBytes();
+
+    // Unmapped memory no longer reflects the state value
+    U8* hostPtr = Runtime::memoryArrayPtr<U8>(
+      module.defaultMemory, (Uptr)ptrs.at(0), (Uptr)stateSize);
+    REQUIRE(std::vector<uint8_t>(hostPtr, hostPtr + stateSize) !=
+            values.at(0));
+
+    // Repeatedly mapping and unmapping different combinations of keys and
+    // segments reuses the freed memory rather than growing it
+    for (int round = 0; round < 50; round++) {
+        std::vector<uint32_t> roundPtrs;
+        for (int i = round % 3; i < nKeys; i += 2) {
+            long offset = (round % 2) * faabric::util::HOST_PAGE_SIZE;
+            long len = stateSize - offset;
+            std::vector<uint8_t> expected(len, (uint8_t)(i + 1));
+
+            checkMapping(module, kvs.at(i), offset, len, expected);
+            roundPtrs.emplace_back(
+              module.mapSharedStateMemory(kvs.at(i), offset, len));
+        }
+
+        for (auto ptr : roundPtrs) {
+            module.unmapSharedStateMemory(ptr);
+        }
+    }
+
+    REQUIRE(module.getMemorySizeBytes() == memSize);
+
+    // Unmapping twice or unmapping something never mapped fails
+    REQUIRE_THROWS(module.unmapSharedStateMemory(ptrs.at(0)));
+    REQUIRE_THROWS(module.unmapSharedStateMemory(12345));
+}
+
+TEST_CASE_METHOD(StateFixture, "Test multi-key state operations", "[wasm]")
+{
+    const std::string user = "demo";
+    int nKeys = 10;
+    long stateSize = 2 * faabric::util::HOST_PAGE_SIZE;
+
+    wasm::StateKVs kvs;
+    std::vector<std::vector<uint8_t>> values;
+    for (int i = 0; i < nKeys; i++) {
+        auto kv = state.getKV(user, fmt::format("multi_{}", i), stateSize);
+        std::vector<uint8_t> value(stateSize, (uint8_t)i);
+        kv->set(value.data());
+
+        kvs.emplace_back(kv);
+        values.emplace_back(value);
+    }
+
+    SECTION("Full push and pull")
+    {
+        wasm::pushStateMulti(kvs, false);
+        wasm::pullStateMulti(kvs);
+    }
+
+    SECTION("Partial push and chunked pull")
+    {
+        wasm::pushStateMulti(kvs, true);
+
+        std::vector<long> offsets(nKeys, faabric::util::HOST_PAGE_SIZE);
+        std::vector<long> lengths(nKeys, 10);
+        wasm::pullStateChunksMulti(kvs, offsets, lengths);
+    }
+
+    for (int i = 0; i < nKeys; i++) {
+        std::vector<uint8_t> actual(stateSize, 0);
+        kvs.at(i)->get(actual.data());
+        REQUIRE(actual == values.at(i));
+    }
+
+    // Offsets and lengths must line up with keys
+    std::vector<long> badOffsets(nKeys - 1, 0);
+    std::vector<long> lengths(nKeys, 1);
+    REQUIRE_THROWS(wasm::pullStateChunksMulti(kvs, badOffsets, lengths));
+}
+
+TEST_CASE_METHOD(StateFixture, "Test state handles", "[wasm]")
+{
+    wasm::WAVMWasmModule module;
+
+    int32_t handleA = module.openStateHandle("demo", "handle_a", 10);
+    int32_t handleB = module.openStateHandle("demo", "handle_b", 20);
+    REQUIRE(handleA != handleB);
+
+    // Opening again gives the same handle
+    REQUIRE(module.openStateHandle("demo", "handle_a", 10) == handleA);
+
+    // Handles refer to the same values as the global state
+    REQUIRE(module.getStateHandle(handleA) == state.getKV("demo", "handle_a"));
+    REQUIRE(module.getStateHandle(handleB) == state.getKV("demo", "handle_b"));
+    REQUIRE(module.getStateHandle(handleB)->size() == 20);
+
+    // Handles are per module
+    wasm::WAVMWasmModule otherModule;
+    REQUIRE_THROWS(otherModule.getStateHandle(handleB));
+
+    REQUIRE_THROWS(module.getStateHandle(-1));
+    REQUIRE_THROWS(module.getStateHandle(handleB + 1));
+
+    // Clearing drops all handles, and numbering starts again
+    module.clearStateHandles();
+    REQUIRE_THROWS(module.getStateHandle(handleA));
+    REQUIRE(module.openStateHandle("demo", "handle_b", 20) == 0);
+}
+
+TEST_CASE_METHOD(StateFixture, "Test checking state buffer sizes", "[wasm]")
+{
+    auto kv = state.getKV("demo", "buffer_size", 10);
+
+    // Buffers must hold the whole value
+    REQUIRE_NOTHROW(wasm::checkStateBufferSize(kv, 10));
+    REQUIRE_NOTHROW(wasm::checkStateBufferSize(kv, 20));
+    REQUIRE_THROWS(wasm::checkStateBufferSize(kv, 9));
+    REQUIRE_THROWS(wasm::checkStateBufferSize(kv, -1));
+}
+
+TEST_CASE_METHOD(StateFixture, "Test async state transfers", "[wasm]")
+{
+    wasm::WAVMWasmModule module;
+
+    auto kv = state.getKV("demo", "async_a", 10);
+    std::vector<uint8_t> value(10, 3);
+    kv->set(value.data());
+
+    int32_t pushId = module.startStateTransfer([kv] { kv->pushFull(); });
+    int32_t pullId = module.startStateTransfer([kv] { kv->pull(); });
+    REQUIRE(pushId != pullId);
+
+    module.awaitStateTransfer(pushId);
+    module.awaitStateTransfer(pullId);
+
+    std::vector<uint8_t> actual(10, 0);
+    kv->get(actual.data());
+    REQUIRE(actual == value);
+
+    // Ids are released once awaited
+    REQUIRE(module.testStateTransfer(pushId) == -1);
+    REQUIRE_THROWS(module.awaitStateTransfer(pushId));
+
+    // Testing reports progress without releasing the id
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    int32_t blockedId =
+      module.startStateTransfer([released] { released.wait(); });
+    REQUIRE(module.testStateTransfer(blockedId) == 0);
+
+    release.set_value();
+    module.awaitStateTransfer(blockedId);
+
+    // Errors come back through the wait
+    int32_t failedId = module.startStateTransfer(
+      [] { throw std::runtime_error("Transfer failed"); });
+    REQUIRE_THROWS(module.awaitStateTransfer(failedId));
+
+    // Anything left outstanding can be waited on in one go
+    int32_t leftId = module.startStateTransfer([kv] { kv->pushFull(); });
+    module.awaitAllStateTransfers();
+    REQUIRE(module.testStateTransfer(leftId) == -1);
+}
+
+TEST_CASE_METHOD(StateFixture, "Test state write combining", "[wasm]")
+{
+    wasm::StateWriteCombiner combiner;
+
+    auto kv = state.getKV("demo", "combine", 20);
+    std::vector<uint8_t> initial(20, 0);
+    kv->set(initial.data());
+
+    // Adjacent and overlapping writes merge into one range, with later writes
+    // taking precedence
+    std::vector<uint8_t> a(4, 1);
+    std::vector<uint8_t> b(4, 2);
+    std::vector<uint8_t> c(4, 3);
+    std::vector<uint8_t> d(2, 4);
+    combiner.write(kv, 2, a.data(), a.size());
+    combiner.write(kv, 6, b.data(), b.size());
+    combiner.write(kv, 8, c.data(), c.size());
+    combiner.write(kv, 16, d.data(), d.size());
+
+    // Nothing reaches the value until flushed
+    std::vector<uint8_t> actual(20, 0);
+    kv->get(actual.data());
+    REQUIRE(actual == initial);
+
+    combiner.flush(kv);
+
+    std::vector<uint8_t> expected = { 0, 0, 1, 1, 1, 1, 2, 2, 3, 3,
+                                      3, 3, 0, 0, 0, 0, 4, 4, 0, 0 };
+    kv->get(actual.data());
+    REQUIRE(actual == expected);
+
+    wasm::StateWriteCombinerMetrics metrics = combiner.getMetrics();
+    REQUIRE(metrics.fragmentsIn == 4);
+    REQUIRE(metrics.fragmentsOut == 2);
+    REQUIRE(metrics.bytesIn == 14);
+    REQUIRE(metrics.flushes == 1);
+
+    // Dirty flags merge in the same way
+    combiner.flagDirty(kv, 0, 4);
+    combiner.flagDirty(kv, 2, 4);
+    combiner.flagDirty(kv, 6, 2);
+    combiner.flagDirty(kv, 12, 2);
+    combiner.flushAll();
+
+    metrics = combiner.getMetrics();
+    REQUIRE(metrics.fragmentsIn == 8);
+    REQUIRE(metrics.fragmentsOut == 4);
+    REQUIRE(metrics.flushes == 2);
+
+    // Flushing with nothing pending does nothing
+    combiner.flush(kv);
+    REQUIRE(combiner.getMetrics().flushes == 2);
+
+    // Writes that extend a run downwards, or bridge two runs, also merge
+    std::vector<uint8_t> e(2, 5);
+    std::vector<uint8_t> f(4, 6);
+    combiner.write(kv, 12, d.data(), d.size());
+    combiner.write(kv, 10, e.data(), e.size());
+    combiner.write(kv, 4, e.data(), e.size());
+    combiner.write(kv, 6, f.data(), f.size());
+    combiner.flush(kv);
+
+    expected = { 0, 0, 1, 1, 5, 5, 6, 6, 6, 6, 5, 5, 4, 4, 0, 0, 4, 4, 0, 0 };
+    kv->get(actual.data());
+    REQUIRE(actual == expected);
+
+    metrics = combiner.getMetrics();
+    REQUIRE(metrics.fragmentsIn == 12);
+    REQUIRE(metrics.fragmentsOut == 5);
+    REQUIRE(metrics.flushes == 3);
+
+    // Cleared writes are dropped
+    combiner.write(kv, 0, d.data(), d.size());
+    combiner.clear();
+    combiner.flushAll();
+    kv->get(actual.data());
+    REQUIRE(actual == expected);
+}
 }
@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/workflows.h>
+
+namespace tests {
+
+TEST_CASE("Test parsing workflows", "[wasm]")
+{
+    std::string spec = R"({"user": "demo", "nodes": [
+        {"function": "split", "input": "abc"},
+        {"function": "count", "deps": [0]},
+        {"function": "count", "deps": [0]},
+        {"function": "merge", "input": "x", "deps": [1, 2]}
+    ]})";
+
+    wasm::Workflow workflow = wasm::parseWorkflow(spec);
+    REQUIRE(workflow.user == "demo");
+    REQUIRE(workflow.nodes.size() == 4);
+
+    REQUIRE(workflow.nodes.at(0).function == "split");
+    REQUIRE(workflow.nodes.at(0).inputData ==
+            std::vector<uint8_t>({ 'a', 'b', 'c' }));
+    REQUIRE(workflow.nodes.at(0).dependsOn.empty());
+
+    REQUIRE(workflow.nodes.at(1).function == "count");
+    REQUIRE(workflow.nodes.at(1).inputData.empty());
+    REQUIRE(workflow.nodes.at(1).dependsOn == std::vector<int>({ 0 }));
+
+    REQUIRE(workflow.nodes.at(3).function == "merge");
+    REQUIRE(workflow.nodes.at(3).inputData == std::vector<uint8_t>({ 'x' }));
+    REQUIRE(workflow.nodes.at(3).dependsOn == std::vector<int>({ 1, 2 }));
+
+    // The user can come from the caller
+    wasm::Workflow noUser =
+      wasm::parseWorkflow(R"({"nodes": [{"function": "echo"}]})", "foo");
+    REQUIRE(noUser.user == "foo");
+}
+
+TEST_CASE("Test invalid workflows", "[wasm]")
+{
+    std::string spec;
+
+    SECTION("Not JSON") { spec = "blah"; }
+
+    SECTION("No nodes") { spec = R"({"user": "demo", "nodes": []})"; }
+
+    SECTION("No user") { spec = R"({"nodes": [{"function": "echo"}]})"; }
+
+    SECTION("No function")
+    {
+        spec = R"({"user": "demo", "nodes": [{"input": "abc"}]})";
+    }
+
+    SECTION("Dependency on later node")
+    {
+        spec = R"({"user": "demo", "nodes": [
+            {"function": "echo", "deps": [1]},
+            {"function": "echo"}
+        ]})";
+    }
+
+    SECTION("Dependency on itself")
+    {
+        spec = R"({"user": "demo", "nodes": [
+            {"function": "echo", "deps": [0]}
+        ]})";
+    }
+
+    SECTION("Non-integer dependency")
+    {
+        spec = R"({"user": "demo", "nodes": [
+            {"function": "echo"},
+            {"function": "echo", "deps": ["a"]}
+        ]})";
+    }
+
+    REQUIRE_THROWS(wasm::parseWorkflow(spec));
+}
+}
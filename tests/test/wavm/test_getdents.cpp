@@ -0,0 +1,85 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/files.h>
+#include <faabric/util/func.h>
+
+#include <storage/DirectoryCache.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace tests {
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test getdents64 on a directory larger than the buffer",
+                 "[wasm]")
+{
+    // Enough files for the native listing to span several batches
+    int nFiles = 2000;
+    boost::filesystem::path dirPath("/tmp/faasm-test-getdents");
+    boost::filesystem::remove_all(dirPath);
+    boost::filesystem::create_directories(dirPath);
+
+    std::vector<std::string> expected = { ".", ".." };
+    for (int i = 0; i < nFiles; i++) {
+        std::string name = "f" + std::to_string(i);
+        boost::filesystem::path filePath = dirPath;
+        filePath.append(name);
+        faabric::util::writeBytesToFile(filePath.string(), { 0 });
+        expected.emplace_back(name);
+    }
+
+    // Each native dirent takes at least its header
+    REQUIRE(nFiles * offsetof(::dirent64, d_name) > DIRENT_BATCH_BUFFER_SIZE);
+
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+    wasm::WasmExecutionContext ctx(&module);
+
+    // Use a buffer that doesn't divide the batches evenly, so most calls
+    // have to rewind part way through one
+    size_t direntSize = sizeof(wasm::wasm_dirent64);
+    size_t maxNameLen = direntSize - offsetof(wasm::wasm_dirent64, d_name);
+    int32_t bufLen = 7 * direntSize;
+    uint32_t wasmBuf = module.mmapMemory(bufLen);
+    uint8_t* buf = module.wasmPointerToNative(wasmBuf);
+
+    int fd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+    REQUIRE(fd > 0);
+
+    std::vector<std::string> actual;
+    int nCalls = 0;
+    int32_t bytesRead;
+    while ((bytesRead = module.readDirents64(fd, wasmBuf, bufLen)) > 0) {
+        REQUIRE(bytesRead % direntSize == 0);
+        for (int32_t offset = 0; offset < bytesRead; offset += direntSize) {
+            auto d = reinterpret_cast<wasm::wasm_dirent64*>(buf + offset);
+            const char* name = reinterpret_cast<const char*>(d->d_name);
+            actual.emplace_back(name, strnlen(name, maxNameLen));
+        }
+        nCalls++;
+    }
+    ::close(fd);
+
+    REQUIRE(bytesRead == 0);
+    REQUIRE(nCalls > 1);
+
+    // Every entry comes back exactly once
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    REQUIRE(actual == expected);
+
+    boost::filesystem::remove_all(dirPath);
+}
+}
@@ -4,11 +4,14 @@
 #include "utils.h"
 
 #include <faabric/proto/faabric.pb.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/util/func.h>
 #include <faabric/util/macros.h>
 #include <faaslet/Faaslet.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <thread>
+
 namespace tests {
 
 TEST_CASE_METHOD(FunctionExecTestFixture,
@@ -49,4 +52,40 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 
     faaslet.shutdown();
 }
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test invalidating cached WAVM modules",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    std::string snapKey = moduleCache.registerResetSnapshot(msg);
+    REQUIRE(reg.snapshotExists(snapKey));
+
+    moduleCache.invalidate(msg);
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 0);
+    REQUIRE(!reg.snapshotExists(snapKey));
+
+    // Modules handed out while invalidations race are always bound, and the
+    // snapshot is recreated from whichever zygote is cached
+    std::thread invalidator([this, &msg] {
+        for (int i = 0; i < 5; i++) {
+            moduleCache.invalidate(msg);
+        }
+    });
+
+    for (int i = 0; i < 5; i++) {
+        auto [module, lock] = moduleCache.getCachedModule(msg);
+        REQUIRE(module.isBound());
+        moduleCache.ensureResetSnapshot(module, snapKey);
+        REQUIRE(reg.snapshotExists(snapKey));
+    }
+
+    invalidator.join();
+
+    REQUIRE(moduleCache.registerResetSnapshot(msg) == snapKey);
+    REQUIRE(reg.snapshotExists(snapKey));
+}
 }